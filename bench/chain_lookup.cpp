@@ -0,0 +1,64 @@
+/*************************************************************************
+ * File:	chain_lookup.cpp
+ * Author:	liuyongshuai<liuyongshuai@hotmail.com>
+ * Time:	2026-10-17 13:20
+ * 长链表查找压测：把hash表容量固定得很小，让每个bucket挂几十个等长的key，
+ * 分别统计命中和未命中时每次get的耗时
+ * 用法：./bench_chain_lookup [key_num]
+ ************************************************************************/
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <chrono>
+
+#define RING_BUFFER_NUM 4
+//hash表最多2^12个bucket，不再扩容
+#define HASH_POWER_MAX 12
+#include "ringcache/ringcache.h"
+
+#define BENCH_CACHE_MB 128
+#define BENCH_VALUE_SIZE 16
+
+/**
+ * 等长的key，前缀相同，逐字节比较时最费劲
+ */
+static std::string bench_key(uint64_t i){
+    char buf[64];
+    snprintf(buf, sizeof(buf), "user:profile:session:%020llu", (unsigned long long) i);
+    return std::string(buf);
+}
+
+static double lookup_ns(ringcache::ringcache *cache, uint64_t key_begin, uint64_t key_num, uint32_t rounds, uint64_t &hit){
+    std::string val;
+    hit = 0;
+    auto begin = std::chrono::steady_clock::now();
+    for (uint32_t r = 0; r < rounds; r++){
+        for (uint64_t i = 0; i < key_num; i++){
+            if (cache->get(bench_key(key_begin + i), val) == RINGCACHE_ERRNO_OK){
+                hit++;
+            }
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+    return (double) std::chrono::duration_cast< std::chrono::nanoseconds >(end - begin).count() / (key_num * rounds);
+}
+
+int main(int argc, char **argv){
+    uint64_t key_num = argc > 1 ? atoll(argv[1]) : 200000;
+    ringcache::ringcache *cache = new ringcache::ringcache(BENCH_CACHE_MB);
+    std::string value(BENCH_VALUE_SIZE, 'v');
+    for (uint64_t i = 0; i < key_num; i++){
+        cache->set(bench_key(i), value, 0);
+    }
+    //等后台线程把buffer都申请好
+    sleep(1);
+
+    uint64_t hit = 0;
+    double hit_ns = lookup_ns(cache, 0, key_num, 3, hit);
+    printf("avg_chain_len=%.1f\n", (double) key_num / HASH_SIZE(HASH_POWER_MAX));
+    printf("hit_lookup_ns=%.1f\thit=%llu\n", hit_ns, (unsigned long long) hit);
+    double miss_ns = lookup_ns(cache, key_num, key_num, 3, hit);
+    printf("miss_lookup_ns=%.1f\thit=%llu\n", miss_ns, (unsigned long long) hit);
+    delete cache;
+    return 0;
+}
@@ -0,0 +1,82 @@
+/*************************************************************************
+ * File:	codec_bench.cpp
+ * Author:	liuyongshuai<liuyongshuai@hotmail.com>
+ * Time:	2026-10-21 20:30
+ * value压缩压测：同样大小的缓存，分别不压缩、用zlib压缩，写入远超缓存容量的类JSON数据，
+ * 统计最后缓存里还留着多少个数据、set/get平均耗时及压缩比
+ * 用法：./bench_codec [cache_mb] [value_size] [key_num]
+ ************************************************************************/
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <chrono>
+#include <vector>
+
+#define RING_BUFFER_NUM 16
+#include "ringcache/ringcache.h"
+
+static std::string bench_key(uint64_t i){
+    return "bench_key_" + std::to_string(i);
+}
+
+/**
+ * 字段名固定、字段值随key变化的类JSON数据
+ */
+static std::string bench_value(uint64_t i, uint32_t size){
+    static const char *names[] = {"user_id", "nick_name", "avatar_url", "create_time", "status", "tags", "score", "city"};
+    std::string v = "{";
+    uint64_t seed = i * 2654435761u + 1;
+    for (uint32_t n = 0; v.size() < size; n++){
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        v += "\"" + std::string(names[n % 8]) + "\":\"" + std::to_string((seed >> 33) % 100000) + "\",";
+    }
+    v.resize(size);
+    return v;
+}
+
+static double ns_per_op(std::chrono::steady_clock::time_point begin, uint64_t ops){
+    return (double) std::chrono::duration_cast< std::chrono::nanoseconds >(std::chrono::steady_clock::now() - begin).count() / ops;
+}
+
+template< typename cache_t >
+static void run(const char *name, uint64_t cache_mb, uint32_t value_size, uint64_t key_num){
+    cache_t *cache = new cache_t(cache_mb);
+    sleep(1);
+    std::vector< std::string > values;
+    for (uint64_t i = 0; i < 1024; i++){
+        values.push_back(bench_value(i, value_size));
+    }
+    auto begin = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < key_num; i++){
+        cache->set(bench_key(i), values[i % values.size()], 0);
+    }
+    double set_ns = ns_per_op(begin, key_num);
+
+    std::string val;
+    uint64_t hit = 0;
+    begin = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < key_num; i++){
+        if (cache->get(bench_key(i), val) == RINGCACHE_ERRNO_OK){
+            hit++;
+        }
+    }
+    double get_ns = ns_per_op(begin, key_num);
+
+    ringcache::stats_t stats = cache->get_stats();
+    uint64_t tried = stats.compress_num + stats.compress_skip_num;
+    printf("codec=%s value_size=%u items=%llu hit=%llu set_ns=%.0f get_ns=%.0f ratio=%.2f compress_num=%llu skip=%llu compress_ns=%.0f decompress_ns=%.0f\n",
+           name, value_size, (unsigned long long) stats.index_item_num, (unsigned long long) hit, set_ns, get_ns,
+           stats.compress_ratio(), (unsigned long long) stats.compress_num, (unsigned long long) stats.compress_skip_num,
+           tried > 0 ? (double) stats.compress_ns / tried : 0.0,
+           stats.decompress_num > 0 ? (double) stats.decompress_ns / stats.decompress_num : 0.0);
+    delete cache;
+}
+
+int main(int argc, char **argv){
+    uint64_t cache_mb = argc > 1 ? atoll(argv[1]) : 256;
+    uint32_t value_size = argc > 2 ? atoi(argv[2]) : 1024;
+    uint64_t key_num = argc > 3 ? atoll(argv[3]) : cache_mb * MB / value_size * 6;
+    run< ringcache::basic_ringcache< ringcache::jenkins_hasher > >("none", cache_mb, value_size, key_num);
+    run< ringcache::basic_ringcache< ringcache::jenkins_hasher, ringcache::zlib_codec > >("zlib", cache_mb, value_size, key_num);
+    return 0;
+}
@@ -0,0 +1,62 @@
+/*************************************************************************
+ * File:	entry_layout_bench.cpp
+ * Author:	liuyongshuai<liuyongshuai@hotmail.com>
+ * Time:	2026-10-28 10:30
+ * entry头部的空间开销：按几种value大小各写满一次缓存，统计写满后留在缓存里的数据个数，
+ * 换算成每GB缓冲区能存的个数，以及算上索引表后平均每个数据占的字节数。
+ * 同一份代码编两遍，bench_entry_layout是默认格式，bench_entry_layout_compact定义了RINGCACHE_COMPACT_ENTRY
+ * 用法：./bench_entry_layout [cache_mb] [key_size]
+ ************************************************************************/
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#define RING_BUFFER_NUM 16
+#include "ringcache/ringcache.h"
+
+static std::string bench_key(uint64_t i, uint32_t key_size){
+    std::string key = std::to_string(i);
+    if (key.length() < key_size){
+        key.insert(0, key_size - key.length(), 'k');
+    }
+    return key;
+}
+
+static void run(uint64_t cache_mb, uint32_t key_size, uint32_t value_size){
+    ringcache::ringcache *cache = new ringcache::ringcache(cache_mb);
+    std::string value(value_size, 'v');
+    //写两倍于容量的不同key，保证每个buffer都转过一圈
+    uint64_t key_num = cache_mb * MB / (key_size + value_size) * 2;
+    for (uint64_t i = 0; i < key_num; i++){
+        cache->set(bench_key(i, key_size), value, 0);
+    }
+    ringcache::stats_t stats = cache->get_stats();
+    uint64_t ring_bytes = 0;
+    for (auto &it:stats.buffer_stats){
+        ring_bytes += it.cache_byte_size;
+    }
+    uint64_t index_bytes = stats.index_capacity * sizeof(ringcache::entry_link_t);
+    uint64_t items = stats.index_item_num;
+    printf("%-8u %-8u %-12llu %-14.0f %-12.1f %-10.1f\n", key_size, value_size, (unsigned long long) items,
+           (double) items * GB / ring_bytes, items > 0 ? (double) (ring_bytes + index_bytes) / items : 0,
+           index_bytes / (double) MB);
+    delete cache;
+}
+
+int main(int argc, char **argv){
+    uint64_t cache_mb = argc > 1 ? atoll(argv[1]) : 256;
+    uint32_t key_size = argc > 2 ? atoi(argv[2]) : 16;
+    uint32_t value_sizes[] = {8, 32, 64, 128, 512};
+    printf("layout=%s sizeof(entry_t)=%u cache_mb=%llu\n",
+#ifdef RINGCACHE_COMPACT_ENTRY
+           "compact",
+#else
+           "default",
+#endif
+           (uint32_t) sizeof(ringcache::entry_t), (unsigned long long) cache_mb);
+    printf("%-8s %-8s %-12s %-14s %-12s %-10s\n", "key", "value", "items", "items_per_gb", "bytes_item", "index_mb");
+    for (auto value_size:value_sizes){
+        run(cache_mb, key_size, value_size);
+    }
+    return 0;
+}
@@ -0,0 +1,107 @@
+/*************************************************************************
+ * File:	hash_bench.cpp
+ * Author:	liuyongshuai<liuyongshuai@hotmail.com>
+ * Time:	2026-10-19 16:00
+ * hash函数压测：
+ * 1、不同key长度下各个hash函数的耗时及吞吐
+ * 2、分别用各个hash函数实例化缓存，统计端到端get的耗时
+ * 用法：./bench_hash [get_key_num]
+ ************************************************************************/
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <chrono>
+#include <vector>
+
+#define RING_BUFFER_NUM 8
+#include "ringcache/ringcache.h"
+
+#define BENCH_HASH_TIMES 20000000
+#define BENCH_CACHE_MB 256
+#define BENCH_KEY_LEN 64
+#define BENCH_VALUE_SIZE 32
+
+using namespace ringcache;
+
+/**
+ * 同一块随机数据上错开起始位置算hash，返回每次的纳秒数
+ */
+template< typename hasher_t >
+static double hash_ns(const std::vector< char > &data, size_t len, uint32_t &sum){
+    hasher_t hasher;
+    size_t span = data.size() - len;
+    auto begin = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < BENCH_HASH_TIMES; i++){
+        sum += hasher(data.data() + (i * 7) % span, len);
+    }
+    auto end = std::chrono::steady_clock::now();
+    return (double) std::chrono::duration_cast< std::chrono::nanoseconds >(end - begin).count() / BENCH_HASH_TIMES;
+}
+
+static std::string bench_key(uint64_t i){
+    char buf[BENCH_KEY_LEN + 1];
+    snprintf(buf, sizeof(buf), "user:profile:session:%0*llu", BENCH_KEY_LEN - 21, (unsigned long long) i);
+    return std::string(buf);
+}
+
+/**
+ * 写入key_num个key后随机get，返回每次get的纳秒数
+ */
+template< typename hasher_t >
+static double get_ns(const std::vector< std::string > &keys, const std::vector< uint32_t > &order, uint64_t &hit){
+    basic_ringcache< hasher_t > *cache = new basic_ringcache< hasher_t >(BENCH_CACHE_MB);
+    //等后台线程把buffer都申请好
+    sleep(1);
+    std::string value(BENCH_VALUE_SIZE, 'v');
+    for (auto &key:keys){
+        cache->set(key, value, 0);
+    }
+    std::string val;
+    hit = 0;
+    auto begin = std::chrono::steady_clock::now();
+    for (auto i:order){
+        if (cache->get(keys[i], val) == RINGCACHE_ERRNO_OK){
+            hit++;
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+    delete cache;
+    return (double) std::chrono::duration_cast< std::chrono::nanoseconds >(end - begin).count() / order.size();
+}
+
+int main(int argc, char **argv){
+    uint64_t key_num = argc > 1 ? atoll(argv[1]) : 500000;
+
+    std::vector< char > data(4096);
+    for (size_t i = 0; i < data.size(); i++){
+        data[i] = (char) (rand() & 0xff);
+    }
+    uint32_t sum = 0;
+    size_t lens[] = {8, 16, 24, 40, 64, 80, 120, 200};
+    printf("%-6s %-16s %-16s %-16s\n", "len", "jenkins ns/GBps", "wyhash ns/GBps", "crc32c ns/GBps");
+    for (size_t len:lens){
+        double j = hash_ns< jenkins_hasher >(data, len, sum);
+        double w = hash_ns< wy_hasher >(data, len, sum);
+        double c = hash_ns< crc32c_hasher >(data, len, sum);
+        printf("%-6zu %5.2f/%-10.2f %5.2f/%-10.2f %5.2f/%-10.2f\n", len, j, len / j, w, len / w, c, len / c);
+    }
+
+    std::vector< std::string > keys;
+    std::vector< uint32_t > order;
+    for (uint64_t i = 0; i < key_num; i++){
+        keys.push_back(bench_key(i));
+    }
+    uint64_t seed = 1;
+    for (uint64_t i = 0; i < key_num * 4; i++){
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        order.push_back((seed >> 33) % key_num);
+    }
+    uint64_t hit = 0;
+    double j = get_ns< jenkins_hasher >(keys, order, hit);
+    printf("get key_len=%d jenkins=%.1fns hit=%llu\n", BENCH_KEY_LEN, j, (unsigned long long) hit);
+    double w = get_ns< wy_hasher >(keys, order, hit);
+    printf("get key_len=%d wyhash=%.1fns hit=%llu\n", BENCH_KEY_LEN, w, (unsigned long long) hit);
+    double c = get_ns< crc32c_hasher >(keys, order, hit);
+    printf("get key_len=%d crc32c=%.1fns hit=%llu\n", BENCH_KEY_LEN, c, (unsigned long long) hit);
+    return sum == 0x12345678 ? 1 : 0;
+}
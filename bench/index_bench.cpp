@@ -0,0 +1,128 @@
+/*************************************************************************
+ * File:	index_bench.cpp
+ * Author:	liuyongshuai<liuyongshuai@hotmail.com>
+ * Time:	2026-10-18 16:30
+ * 索引压测：两种索引的容量都固定为2^20个槽位，在一块模拟的环形缓冲区上
+ * 按不同的装载率写入数据，分别统计命中和未命中时每次查找的耗时
+ * 用法：./bench_index [rounds]
+ ************************************************************************/
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+
+#define RING_BUFFER_NUM 4
+//固定容量，不扩容：chained_index 2^20个bucket，bucket_index 2^17个bucket * 8个槽位
+#define HASH_POWER_MAX 20
+#include "ringcache/ringcache.h"
+
+#define BENCH_SLOT_NUM ((uint64_t) 1 << HASH_POWER_MAX)
+#define BENCH_VALUE_SIZE 8
+
+using namespace ringcache;
+
+static std::string bench_key(uint64_t i){
+    char buf[64];
+    snprintf(buf, sizeof(buf), "bench:key:%014llu", (unsigned long long) i);
+    return std::string(buf);
+}
+
+/**
+ * 模拟的环形缓冲区，entry依次排开
+ */
+struct bench_buffer_t{
+    char *mem;
+    uint64_t used;
+    entry_locator_t locator;
+
+    explicit bench_buffer_t(uint64_t size){
+        this->mem = (char *) calloc(size, 1);
+        this->used = 0;
+        this->locator.offset_bits = ceil(log((double) (size / RING_ENTRY_ALIGN)) / log(2.0));
+        for (uint32_t i = 0; i < RING_BUFFER_NUM; i++){
+            this->locator.buffer_base[i] = this->mem;
+        }
+    }
+
+    ~bench_buffer_t(){
+        free(this->mem);
+    }
+
+    entry_t *add(const std::string &key, uint32_t hash_val){
+        entry_t *entry = (entry_t *) (this->mem + this->used);
+        uint64_t need_size = RING_ALIGN_SIZE(sizeof(entry_t) + key.length() + BENCH_VALUE_SIZE);
+        this->used += need_size;
+        entry->entry_len = need_size;
+        entry->hash_next = ENTRY_LINK_NONE;
+        entry->hash_val = hash_val;
+        entry->expire_ms = 0;
+        entry->key_len = key.length();
+        entry->value_len = BENCH_VALUE_SIZE;
+        memcpy(entry->data, key.c_str(), key.length());
+        return entry;
+    }
+};
+
+/**
+ * 按随机顺序查一遍，返回每次查找的纳秒数
+ */
+template< typename index_type >
+static double lookup_ns(index_type *index, const std::vector< std::string > &keys, const std::vector< uint32_t > &hashes, uint32_t rounds, uint64_t &hit){
+    hit = 0;
+    epoch_guard guard;
+    auto begin = std::chrono::steady_clock::now();
+    for (uint32_t r = 0; r < rounds; r++){
+        for (size_t i = 0; i < keys.size(); i++){
+            if (index->find(keys[i].c_str(), keys[i].length(), hashes[i]) != nullptr){
+                hit++;
+            }
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+    return (double) std::chrono::duration_cast< std::chrono::nanoseconds >(end - begin).count() / (keys.size() * rounds);
+}
+
+template< typename index_type >
+static void run(const char *name, double load_factor, uint32_t rounds){
+    uint64_t item_num = BENCH_SLOT_NUM * load_factor;
+    bench_buffer_t buffer(item_num * 64 + MB);
+    //预估量给足，两种索引都直接用最大容量
+    index_type *index = new index_type(BENCH_SLOT_NUM * 4, &buffer.locator);
+
+    std::vector< std::string > hit_keys, miss_keys;
+    std::vector< uint32_t > hit_hashes, miss_hashes;
+    for (uint64_t i = 0; i < item_num; i++){
+        std::string key = bench_key(i);
+        uint32_t hash_val = hash(key);
+        entry_t *entry = buffer.add(key, hash_val);
+        index->insert(entry, buffer.locator.loc(0, entry));
+        hit_keys.push_back(key);
+        miss_keys.push_back(bench_key(i + BENCH_SLOT_NUM * 2));
+    }
+    //打乱顺序，避免按写入顺序访问缓冲区
+    std::random_shuffle(hit_keys.begin(), hit_keys.end());
+    for (size_t i = 0; i < hit_keys.size(); i++){
+        hit_hashes.push_back(hash(hit_keys[i]));
+        miss_hashes.push_back(hash(miss_keys[i]));
+    }
+
+    uint64_t hit = 0, miss_hit = 0;
+    double hit_ns = lookup_ns(index, hit_keys, hit_hashes, rounds, hit);
+    double miss_ns = lookup_ns(index, miss_keys, miss_hashes, rounds, miss_hit);
+    printf("%-10s %-6.2f %-10llu %-10.1f %-10.1f %-10llu\n", name, load_factor, (unsigned long long) index->size(),
+           hit_ns, miss_ns, (unsigned long long) (item_num - hit / rounds));
+    delete index;
+}
+
+int main(int argc, char **argv){
+    uint32_t rounds = argc > 1 ? atoi(argv[1]) : 3;
+    double load_factors[] = {0.25, 0.5, 0.75, 0.9};
+    printf("%-10s %-6s %-10s %-10s %-10s %-10s\n", "index", "load", "items", "hit_ns", "miss_ns", "lost");
+    for (double lf:load_factors){
+        run< chained_index >("chained", lf, rounds);
+        run< bucket_index >("bucket", lf, rounds);
+    }
+    return 0;
+}
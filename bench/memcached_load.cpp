@@ -0,0 +1,461 @@
+/*************************************************************************
+ * File:	memcached_load.cpp
+ * Author:	liuyongshuai<liuyongshuai@hotmail.com>
+ * Time:	2026-10-26 15:30
+ * ringcache_server的压测客户端：每个连接一个线程，每次把pipeline个请求一起发出去再等全部回复，
+ * 输出一行JSON：每秒请求数、每秒读的key数、命中率、每个请求从发出到收到回复的p50/p99/p999。
+ * 文本或二进制协议，get一次可以带多个key（二进制协议用GETKQ...NOOP）。
+ * 用法：./ringcache_memload [--name=value ...]，--help看所有参数
+ ************************************************************************/
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include "server/mc_server.h"
+
+typedef struct _load_conf_t{
+    std::string host;
+    uint32_t port;
+    std::string proto;
+    uint32_t conns;
+    uint32_t seconds;
+    uint64_t key_num;
+    uint32_t value_size;
+    double read_ratio;
+    uint32_t pipeline;
+    uint32_t multi;
+    bool prefill;
+    std::string label;
+} load_conf_t;
+
+static void usage(const char *prog){
+    printf("usage: %s [--name=value ...]\n"
+           "  --host=127.0.0.1       server address\n"
+           "  --port=11211           server port\n"
+           "  --proto=text           text or binary\n"
+           "  --conns=4              connections, one thread each\n"
+           "  --seconds=5            run time\n"
+           "  --keys=100000          key space, keys are picked uniformly\n"
+           "  --value_size=100       value length of sets\n"
+           "  --read=0.9             fraction of requests that are gets, the rest are sets\n"
+           "  --pipeline=1           requests sent back to back before waiting for the replies\n"
+           "  --multi=1              keys per get\n"
+           "  --prefill=1            set every key once before the run\n"
+           "  --label=               free-form tag copied to the record\n", prog);
+}
+
+static bool parse_args(int argc, char **argv, load_conf_t &conf){
+    conf.host = "127.0.0.1";
+    conf.port = 11211;
+    conf.proto = "text";
+    conf.conns = 4;
+    conf.seconds = 5;
+    conf.key_num = 100000;
+    conf.value_size = 100;
+    conf.read_ratio = 0.9;
+    conf.pipeline = 1;
+    conf.multi = 1;
+    conf.prefill = true;
+    for (int i = 1; i < argc; i++){
+        std::string arg = argv[i];
+        size_t eq = arg.find('=');
+        if (arg.compare(0, 2, "--") != 0 || eq == std::string::npos){
+            return false;
+        }
+        std::string name = arg.substr(2, eq - 2), value = arg.substr(eq + 1);
+        if (name == "host") conf.host = value;
+        else if (name == "port") conf.port = atoi(value.c_str());
+        else if (name == "proto") conf.proto = value;
+        else if (name == "conns") conf.conns = atoi(value.c_str());
+        else if (name == "seconds") conf.seconds = atoi(value.c_str());
+        else if (name == "keys") conf.key_num = atoll(value.c_str());
+        else if (name == "value_size") conf.value_size = atoi(value.c_str());
+        else if (name == "read") conf.read_ratio = atof(value.c_str());
+        else if (name == "pipeline") conf.pipeline = atoi(value.c_str());
+        else if (name == "multi") conf.multi = atoi(value.c_str());
+        else if (name == "prefill") conf.prefill = atoi(value.c_str()) != 0;
+        else if (name == "label") conf.label = value;
+        else return false;
+    }
+    return (conf.proto == "text" || conf.proto == "binary") && conf.conns > 0 && conf.seconds > 0 && conf.key_num > 0 &&
+           conf.pipeline > 0 && conf.multi > 0 && conf.value_size < MAX_VALUE_SIZE - 64;
+}
+
+static uint64_t mix64(uint64_t x){
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+static uint32_t make_key(char *buf, uint64_t id){
+    return snprintf(buf, 32, "key:%010llu", (unsigned long long) id);
+}
+
+/**
+ * 一个连接：阻塞的socket，带一个读缓冲区
+ */
+class mc_client{
+public:
+    mc_client() : fd(-1), off(0), len(0){
+        this->buf.resize(256 * 1024);
+    }
+
+    ~mc_client(){
+        if (this->fd >= 0){
+            close(this->fd);
+        }
+    }
+
+    bool connect(const load_conf_t &conf){
+        this->fd = socket(AF_INET, SOCK_STREAM, 0);
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(conf.port);
+        if (this->fd < 0 || inet_pton(AF_INET, conf.host.c_str(), &addr.sin_addr) != 1 ||
+            ::connect(this->fd, (struct sockaddr *) &addr, sizeof(addr)) != 0){
+            return false;
+        }
+        int on = 1;
+        setsockopt(this->fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        return true;
+    }
+
+    bool send_all(const std::string &data){
+        size_t sent = 0;
+        while (sent < data.size()){
+            ssize_t n = write(this->fd, data.data() + sent, data.size() - sent);
+            if (n < 0 && errno == EINTR){
+                continue;
+            }
+            if (n <= 0){
+                return false;
+            }
+            sent += n;
+        }
+        return true;
+    }
+
+    /**
+     * 保证缓冲区里至少有n个字节
+     */
+    bool need(size_t n){
+        if (this->len - this->off >= n){
+            return true;
+        }
+        if (this->off > 0){
+            memmove(this->buf.data(), this->buf.data() + this->off, this->len - this->off);
+            this->len -= this->off;
+            this->off = 0;
+        }
+        if (this->buf.size() < n){
+            this->buf.resize(n);
+        }
+        while (this->len < n){
+            ssize_t r = read(this->fd, this->buf.data() + this->len, this->buf.size() - this->len);
+            if (r < 0 && errno == EINTR){
+                continue;
+            }
+            if (r <= 0){
+                return false;
+            }
+            this->len += r;
+        }
+        return true;
+    }
+
+    /**
+     * 读一行，不含\r\n
+     */
+    bool read_line(std::string &line){
+        while (true){
+            char *begin = this->buf.data() + this->off;
+            char *eol = (char *) memchr(begin, '\n', this->len - this->off);
+            if (eol != nullptr){
+                line.assign(begin, eol > begin && eol[-1] == '\r' ? eol - begin - 1 : eol - begin);
+                this->off += eol - begin + 1;
+                return true;
+            }
+            if (!this->need(this->len - this->off + 1)){
+                return false;
+            }
+        }
+    }
+
+    bool skip(size_t n){
+        if (!this->need(n)){
+            return false;
+        }
+        this->off += n;
+        return true;
+    }
+
+    bool read_header(ringcache::mc_bin_header_t &h){
+        if (!this->need(sizeof(h))){
+            return false;
+        }
+        memcpy(&h, this->buf.data() + this->off, sizeof(h));
+        this->off += sizeof(h);
+        return this->skip(ntohl(h.body_len));
+    }
+
+private:
+    int fd;
+    std::vector< char > buf;
+    size_t off;
+    size_t len;
+};
+
+static void bin_request(std::string &out, uint8_t opcode, const char *key, uint16_t key_len, const char *extras, uint8_t extras_len,
+                        const char *value, uint32_t value_len){
+    ringcache::mc_bin_header_t h;
+    memset(&h, 0, sizeof(h));
+    h.magic = ringcache::MC_BIN_REQUEST;
+    h.opcode = opcode;
+    h.key_len = htons(key_len);
+    h.extras_len = extras_len;
+    h.body_len = htonl(extras_len + key_len + value_len);
+    out.append((const char *) &h, sizeof(h));
+    out.append(extras, extras_len);
+    out.append(key, key_len);
+    out.append(value, value_len);
+}
+
+/**
+ * 一个请求：get的几个key或者set的一个key
+ */
+enum{
+    REQ_GET = 0, REQ_SET
+};
+
+static void add_set(const load_conf_t &conf, std::string &out, uint64_t id, const std::string &value){
+    char key[32];
+    uint32_t klen = make_key(key, id);
+    if (conf.proto == "text"){
+        char line[96];
+        int n = snprintf(line, sizeof(line), "set %.*s 0 0 %u\r\n", (int) klen, key, (uint32_t) value.size());
+        out.append(line, n);
+        out.append(value);
+        out.append("\r\n", 2);
+    }
+    else{
+        char extras[8] = {0};
+        bin_request(out, ringcache::MC_OP_SET, key, klen, extras, 8, value.data(), value.size());
+    }
+}
+
+static void add_get(const load_conf_t &conf, std::string &out, const std::vector< uint64_t > &ids){
+    char key[32];
+    if (conf.proto == "text"){
+        out.append("get", 3);
+        for (auto id:ids){
+            uint32_t klen = make_key(key, id);
+            out.append(" ", 1);
+            out.append(key, klen);
+        }
+        out.append("\r\n", 2);
+        return;
+    }
+    if (ids.size() == 1){
+        uint32_t klen = make_key(key, ids[0]);
+        bin_request(out, ringcache::MC_OP_GET, key, klen, nullptr, 0, nullptr, 0);
+        return;
+    }
+    for (auto id:ids){
+        uint32_t klen = make_key(key, id);
+        bin_request(out, ringcache::MC_OP_GETKQ, key, klen, nullptr, 0, nullptr, 0);
+    }
+    bin_request(out, ringcache::MC_OP_NOOP, nullptr, 0, nullptr, 0, nullptr, 0);
+}
+
+/**
+ * 读一个请求的回复，返回命中的key数，出错返回-1
+ */
+static int read_reply(const load_conf_t &conf, mc_client &client, uint32_t type, uint32_t key_num){
+    if (conf.proto == "text"){
+        std::string line;
+        if (type == REQ_SET){
+            return client.read_line(line) && line == "STORED" ? 0 : -1;
+        }
+        int hits = 0;
+        while (client.read_line(line)){
+            if (line == "END"){
+                return hits;
+            }
+            //VALUE key flags bytes
+            size_t pos = line.rfind(' ');
+            if (line.compare(0, 6, "VALUE ") != 0 || pos == std::string::npos || !client.skip(atoi(line.c_str() + pos + 1) + 2)){
+                return -1;
+            }
+            hits++;
+        }
+        return -1;
+    }
+    ringcache::mc_bin_header_t h;
+    if (type == REQ_SET || key_num == 1){
+        if (!client.read_header(h)){
+            return -1;
+        }
+        return ntohs(h.status) == ringcache::MC_STATUS_OK && type == REQ_GET ? 1 : 0;
+    }
+    int hits = 0;
+    while (client.read_header(h)){
+        if (h.opcode == ringcache::MC_OP_NOOP){
+            return hits;
+        }
+        hits++;
+    }
+    return -1;
+}
+
+typedef struct _conn_result_t{
+    uint64_t request_num;
+    uint64_t get_num;
+    uint64_t key_num;
+    uint64_t hit_num;
+    uint64_t error_num;
+    std::vector< uint64_t > lat;
+    uint64_t lat_sum;
+} conn_result_t;
+
+int main(int argc, char **argv){
+    load_conf_t conf;
+    if (!parse_args(argc, argv, conf)){
+        usage(argv[0]);
+        return 1;
+    }
+    std::string value(conf.value_size, 'v');
+    for (size_t i = 0; i < value.size(); i++){
+        value[i] = 'a' + mix64(i) % 26;
+    }
+    if (conf.prefill){
+        mc_client client;
+        if (!client.connect(conf)){
+            perror("connect");
+            return 1;
+        }
+        for (uint64_t id = 0; id < conf.key_num;){
+            std::string out;
+            uint32_t n = 0;
+            for (; n < 64 && id < conf.key_num; n++, id++){
+                add_set(conf, out, id, value);
+            }
+            if (!client.send_all(out)){
+                perror("prefill");
+                return 1;
+            }
+            for (uint32_t i = 0; i < n; i++){
+                if (read_reply(conf, client, REQ_SET, 1) < 0){
+                    fprintf(stderr, "prefill: bad reply\n");
+                    return 1;
+                }
+            }
+        }
+    }
+
+    std::atomic< bool > stop(false);
+    std::vector< conn_result_t > results(conf.conns);
+    std::vector< std::thread * > threads;
+    for (uint32_t c = 0; c < conf.conns; c++){
+        threads.push_back(new std::thread([&, c](){
+            conn_result_t &r = results[c];
+            r.request_num = r.get_num = r.key_num = r.hit_num = r.error_num = r.lat_sum = 0;
+            r.lat.assign(ringcache::latency_buckets::NUM, 0);
+            mc_client client;
+            if (!client.connect(conf)){
+                r.error_num++;
+                return;
+            }
+            uint64_t seed = mix64(c + 1);
+            std::string out;
+            std::vector< uint64_t > ids;
+            std::vector< uint32_t > types;
+            while (!stop.load(std::memory_order_relaxed)){
+                out.clear();
+                types.clear();
+                for (uint32_t p = 0; p < conf.pipeline; p++){
+                    seed = mix64(seed);
+                    if ((seed >> 11) * (1.0 / 9007199254740992.0) < conf.read_ratio){
+                        ids.clear();
+                        for (uint32_t k = 0; k < conf.multi; k++){
+                            seed = mix64(seed);
+                            ids.push_back(seed % conf.key_num);
+                        }
+                        add_get(conf, out, ids);
+                        types.push_back(REQ_GET);
+                    }
+                    else{
+                        seed = mix64(seed);
+                        add_set(conf, out, seed % conf.key_num, value);
+                        types.push_back(REQ_SET);
+                    }
+                }
+                uint64_t begin = ringcache::latency_now_ns();
+                if (!client.send_all(out)){
+                    r.error_num++;
+                    return;
+                }
+                for (auto type:types){
+                    int hits = read_reply(conf, client, type, conf.multi);
+                    if (hits < 0){
+                        r.error_num++;
+                        return;
+                    }
+                    if (type == REQ_GET){
+                        r.get_num++;
+                        r.key_num += conf.multi;
+                        r.hit_num += hits;
+                    }
+                }
+                uint64_t ns = ringcache::latency_now_ns() - begin;
+                //一批里的每个请求都算这一批的往返时间
+                r.lat[ringcache::latency_buckets::index_of(ns)] += types.size();
+                r.lat_sum += ns * types.size();
+                r.request_num += types.size();
+            }
+        }));
+    }
+    auto begin = std::chrono::steady_clock::now();
+    std::this_thread::sleep_for(std::chrono::seconds(conf.seconds));
+    stop = true;
+    for (auto it:threads){
+        it->join();
+        delete it;
+    }
+    double elapsed = std::chrono::duration_cast< std::chrono::microseconds >(std::chrono::steady_clock::now() - begin).count() / 1e6;
+
+    ringcache::latency_stats_t lat;
+    lat.buckets.assign(ringcache::latency_buckets::NUM, 0);
+    lat.count = lat.sum_ns = 0;
+    uint64_t request_num = 0, get_num = 0, key_num = 0, hit_num = 0, error_num = 0;
+    for (auto &r:results){
+        request_num += r.request_num;
+        get_num += r.get_num;
+        key_num += r.key_num;
+        hit_num += r.hit_num;
+        error_num += r.error_num;
+        for (uint32_t i = 0; i < ringcache::latency_buckets::NUM; i++){
+            lat.buckets[i] += r.lat[i];
+            lat.count += r.lat[i];
+        }
+        lat.sum_ns += r.lat_sum;
+    }
+    printf("{\"bench\":\"memcached\",\"label\":\"%s\",\"proto\":\"%s\",\"conns\":%u,\"pipeline\":%u,\"multi\":%u,\"value_size\":%u,\"read\":%.3f,"
+           "\"seconds\":%.3f,\"requests\":%llu,\"req_per_sec\":%.0f,\"keys_per_sec\":%.0f,\"hit_ratio\":%.4f,\"errors\":%llu,"
+           "\"p50_us\":%.1f,\"p99_us\":%.1f,\"p999_us\":%.1f}\n",
+           conf.label.c_str(), conf.proto.c_str(), conf.conns, conf.pipeline, conf.multi, conf.value_size, conf.read_ratio, elapsed,
+           (unsigned long long) request_num, request_num / elapsed, key_num / elapsed, key_num > 0 ? (double) hit_num / key_num : 0,
+           (unsigned long long) error_num, lat.percentile(0.5) / 1e3, lat.percentile(0.99) / 1e3, lat.percentile(0.999) / 1e3);
+    return error_num > 0 ? 1 : 0;
+}
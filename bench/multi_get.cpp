@@ -0,0 +1,121 @@
+/*************************************************************************
+ * File:	multi_get.cpp
+ * Author:	liuyongshuai<liuyongshuai@hotmail.com>
+ * Time:	2026-10-19 10:20
+ * 批量读写压测：缓存大小超过L3，随机取一批key，对比循环调用get/set
+ * 与multi_get/multi_set时平均每个key的耗时
+ * 用法：./bench_multi_get [key_num] [rounds]
+ ************************************************************************/
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <chrono>
+#include <vector>
+
+#define RING_BUFFER_NUM 8
+#include "ringcache/ringcache.h"
+
+#define BENCH_CACHE_MB 1024
+#define BENCH_VALUE_SIZE 100
+
+static std::string bench_key(uint64_t i){
+    return "bench_key_" + std::to_string(i);
+}
+
+static uint64_t next_rand(uint64_t &seed){
+    seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+    return seed >> 33;
+}
+
+/**
+ * 随机抽rounds批key，每批batch个，返回平均每个key的纳秒数
+ */
+static double get_ns(ringcache::ringcache *cache, const std::vector< std::string > &keys, uint32_t batch, uint32_t rounds, bool batched){
+    uint64_t seed = batch;
+    std::vector< std::string > req(batch), values;
+    std::vector< uint32_t > rets;
+    std::string val;
+    uint64_t ns = 0;
+    for (uint32_t r = 0; r < rounds; r++){
+        for (uint32_t i = 0; i < batch; i++){
+            req[i] = keys[next_rand(seed) % keys.size()];
+        }
+        auto begin = std::chrono::steady_clock::now();
+        if (batched){
+            cache->multi_get(req, values, rets);
+        }
+        else{
+            for (uint32_t i = 0; i < batch; i++){
+                cache->get(req[i], val);
+            }
+        }
+        ns += std::chrono::duration_cast< std::chrono::nanoseconds >(std::chrono::steady_clock::now() - begin).count();
+    }
+    return (double) ns / ((uint64_t) batch * rounds);
+}
+
+static double set_ns(ringcache::ringcache *cache, uint64_t key_num, uint32_t batch, uint32_t rounds, bool batched){
+    uint64_t seed = batch + 1;
+    std::vector< std::string > req(batch), values(batch, std::string(BENCH_VALUE_SIZE, 's'));
+    std::vector< uint32_t > rets;
+    uint64_t ns = 0;
+    for (uint32_t r = 0; r < rounds; r++){
+        for (uint32_t i = 0; i < batch; i++){
+            req[i] = bench_key(next_rand(seed) % key_num);
+        }
+        auto begin = std::chrono::steady_clock::now();
+        if (batched){
+            cache->multi_set(req, values, 0, rets);
+        }
+        else{
+            for (uint32_t i = 0; i < batch; i++){
+                cache->set(req[i], values[i], 0);
+            }
+        }
+        ns += std::chrono::duration_cast< std::chrono::nanoseconds >(std::chrono::steady_clock::now() - begin).count();
+    }
+    return (double) ns / ((uint64_t) batch * rounds);
+}
+
+int main(int argc, char **argv){
+    uint64_t key_num = argc > 1 ? atoll(argv[1]) : 4000000;
+    uint32_t rounds = argc > 2 ? atoi(argv[2]) : 2000;
+    ringcache::ringcache *cache = new ringcache::ringcache(BENCH_CACHE_MB);
+    //等后台线程把buffer都申请好
+    sleep(2);
+
+    std::vector< std::string > keys, values(200, std::string(BENCH_VALUE_SIZE, 'v'));
+    std::vector< uint32_t > rets;
+    for (uint64_t i = 0; i < key_num; i += 200){
+        keys.clear();
+        for (uint64_t j = i; j < i + 200 && j < key_num; j++){
+            keys.push_back(bench_key(j));
+        }
+        values.resize(keys.size());
+        cache->multi_set(keys, values, 0, rets);
+    }
+
+    //只拿还在缓存里的key来测，两种方式都是全部命中
+    keys.clear();
+    for (uint64_t i = 0; i < key_num; i++){
+        if (cache->check(bench_key(i))){
+            keys.push_back(bench_key(i));
+        }
+    }
+    printf("keys_in_cache=%llu\n", (unsigned long long) keys.size());
+
+    uint32_t batches[] = {20, 50, 200};
+    printf("%-8s %-8s %-12s %-12s %-8s\n", "op", "batch", "loop_ns", "batch_ns", "speedup");
+    for (uint32_t batch:batches){
+        double loop = get_ns(cache, keys, batch, rounds, false);
+        double multi = get_ns(cache, keys, batch, rounds, true);
+        printf("%-8s %-8u %-12.1f %-12.1f %-8.2f\n", "get", batch, loop, multi, loop / multi);
+    }
+    for (uint32_t batch:batches){
+        double loop = set_ns(cache, key_num, batch, rounds / 4, false);
+        double multi = set_ns(cache, key_num, batch, rounds / 4, true);
+        printf("%-8s %-8u %-12.1f %-12.1f %-8.2f\n", "set", batch, loop, multi, loop / multi);
+    }
+    delete cache;
+    return 0;
+}
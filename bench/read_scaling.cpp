@@ -0,0 +1,101 @@
+/*************************************************************************
+ * File:	read_scaling.cpp
+ * Author:	liuyongshuai<liuyongshuai@hotmail.com>
+ * Time:	2026-10-17 11:05
+ * 读扩展性压测：预先写入一批数据，后台一个写线程持续写入触发环形缓冲区覆盖，
+ * 然后分别用1..N个读线程压get，对比无锁读和外面包一把全局锁两种方式的QPS
+ * 用法：./bench_read_scaling [max_threads] [seconds_per_round]
+ ************************************************************************/
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <chrono>
+#include <vector>
+
+#define RING_BUFFER_NUM 16
+#include "ringcache/ringcache.h"
+
+//缓存大小，单位MB
+#define BENCH_CACHE_MB 256
+//预写入的key数量
+#define BENCH_KEY_NUM 200000
+#define BENCH_VALUE_SIZE 256
+
+static std::string bench_key(uint64_t i){
+    return "bench_key_" + std::to_string(i);
+}
+
+/**
+ * 跑一轮，返回总的QPS
+ */
+static double run_round(ringcache::ringcache *cache, uint32_t thread_num, uint32_t seconds, bool with_lock){
+    std::mutex global_mtx;
+    std::atomic< bool > stop(false);
+    std::atomic< uint64_t > total(0);
+    std::vector< std::thread * > threads;
+    for (uint32_t t = 0; t < thread_num; t++){
+        threads.push_back(new std::thread([&, t](){
+            std::string val;
+            uint64_t seed = t * 2654435761u + 1;
+            uint64_t ops = 0;
+            while (!stop.load(std::memory_order_relaxed)){
+                seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+                std::string key = bench_key((seed >> 33) % BENCH_KEY_NUM);
+                if (with_lock){
+                    std::lock_guard< std::mutex > lock(global_mtx);
+                    cache->get(key, val);
+                }
+                else{
+                    cache->get(key, val);
+                }
+                ops++;
+            }
+            total += ops;
+        }));
+    }
+    std::this_thread::sleep_for(std::chrono::seconds(seconds));
+    stop = true;
+    for (auto it:threads){
+        it->join();
+        delete it;
+    }
+    return (double) total.load() / seconds;
+}
+
+int main(int argc, char **argv){
+    uint32_t max_threads = argc > 1 ? atoi(argv[1]) : std::thread::hardware_concurrency();
+    uint32_t seconds = argc > 2 ? atoi(argv[2]) : 2;
+    if (max_threads == 0){
+        max_threads = 1;
+    }
+
+    ringcache::ringcache *cache = new ringcache::ringcache(BENCH_CACHE_MB);
+    std::string value(BENCH_VALUE_SIZE, 'v');
+    for (uint64_t i = 0; i < BENCH_KEY_NUM; i++){
+        cache->set(bench_key(i), value, 0);
+    }
+
+    //后台写线程，不停地覆盖环形缓冲区
+    std::atomic< bool > writer_stop(false);
+    std::thread writer([&](){
+        uint64_t i = 0;
+        while (!writer_stop.load(std::memory_order_relaxed)){
+            cache->set(bench_key(i++ % (BENCH_KEY_NUM * 4)), value, 0);
+        }
+    });
+
+    printf("%-8s %-16s %-16s %-8s\n", "threads", "lockfree_qps", "mutex_qps", "speedup");
+    for (uint32_t n = 1; n <= max_threads; n *= 2){
+        double lockfree = run_round(cache, n, seconds, false);
+        double locked = run_round(cache, n, seconds, true);
+        printf("%-8u %-16.0f %-16.0f %-8.2f\n", n, lockfree, locked, lockfree / locked);
+        if (n < max_threads && n * 2 > max_threads){
+            n = max_threads / 2;
+        }
+    }
+
+    writer_stop = true;
+    writer.join();
+    delete cache;
+    return 0;
+}
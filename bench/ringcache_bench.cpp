@@ -0,0 +1,761 @@
+/*************************************************************************
+ * File:	ringcache_bench.cpp
+ * Author:	liuyongshuai<liuyongshuai@hotmail.com>
+ * Time:	2026-10-24 10:20
+ * 综合压测：key/value长度分布、key的热度分布（zipf或均匀）、读写删比例、带TTL写入的比例都可以配，
+ * 线程数逐个跑，每一轮输出一行ops/s、get/set的p50/p99/p999延迟、命中率及每个数据的内存开销，
+ * 默认是JSON（每轮一行），--format=csv时是CSV，方便存下来和别的提交比较。
+ * --layout=single,sharded时同样的负载先跑一个大实例，再跑按NUMA节点分片的sharded_ringcache，
+ * 加上core时再跑每核一个线程的core_ringcache，线程数就是核数，每个核异步地发请求
+ * 用法：./ringcache_bench [--name=value ...]，--help看所有参数
+ ************************************************************************/
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <malloc.h>
+#include <chrono>
+#include <vector>
+#include <string>
+
+#include "ringcache/per_core.h"
+
+/**
+ * 参数，都是--name=value
+ */
+typedef struct _bench_conf_t{
+    uint64_t cache_mb;
+    uint64_t key_num;
+    std::string key_size;
+    std::string value_size;
+    std::string dist;
+    double zipf_theta;
+    double read_ratio;
+    double del_ratio;
+    double ttl_ratio;
+    uint32_t ttl_ms;
+    std::string threads;
+    uint32_t seconds;
+    uint32_t lat_sample;
+    bool prefill;
+    std::string format;
+    std::string label;
+    std::string out;
+    std::string record;
+    std::string layout;
+    uint32_t shards;
+    bool local;
+    uint32_t inflight;
+} bench_conf_t;
+
+static void usage(const char *prog){
+    printf("usage: %s [--name=value ...]\n"
+           "  --cache_mb=256         cache size in MB\n"
+           "  --keys=1000000         key space\n"
+           "  --key_size=16          key length: N, A-B (uniform) or exp:MEAN[:MAX]\n"
+           "  --value_size=256       value length, same syntax as key_size\n"
+           "  --dist=zipf            key popularity: zipf or uniform\n"
+           "  --zipf=0.99            zipf theta, between 0 and 1\n"
+           "  --read=0.9             fraction of operations that are get\n"
+           "  --del=0                fraction of operations that are del, the rest are set\n"
+           "  --ttl_ratio=0          fraction of sets written with a TTL\n"
+           "  --ttl_ms=1000          TTL of those sets\n"
+           "  --threads=1,2,4,...    thread counts to run, default powers of two up to the cpu count\n"
+           "  --seconds=3            seconds per round\n"
+           "  --lat_sample=8         time one of every N operations per thread\n"
+           "  --prefill=1            write every key once before the first round\n"
+           "  --format=json          json (one object per line) or csv\n"
+           "  --label=               free-form tag copied to every record, e.g. a commit id\n"
+           "  --out=-                write records to this file, - is stdout (the cache also logs to stdout)\n"
+           "  --record=              capture the rounds with start_trace() into this file, replay it with ringcache_replay\n"
+           "  --layout=single        layouts to run: single (one instance), sharded (sharded_ringcache) and/or core\n"
+           "                         (core_ringcache, one core per thread, async requests forwarded between cores)\n"
+           "  --shards=0             shard count of the sharded layout, 0 is one per NUMA node\n"
+           "  --local=0              bind thread t to NUMA node t%%nodes; with the sharded layout it only touches keys\n"
+           "                         whose shard lives on that node, as a server dispatching by shard_of() would;\n"
+           "                         with the core layout each core only touches the keys it owns\n"
+           "  --inflight=32          core layout: most requests a core keeps forwarded to other cores at once\n", prog);
+}
+
+static bool parse_args(int argc, char **argv, bench_conf_t &conf){
+    conf.cache_mb = 256;
+    conf.key_num = 1000000;
+    conf.key_size = "16";
+    conf.value_size = "256";
+    conf.dist = "zipf";
+    conf.zipf_theta = 0.99;
+    conf.read_ratio = 0.9;
+    conf.del_ratio = 0;
+    conf.ttl_ratio = 0;
+    conf.ttl_ms = 1000;
+    conf.seconds = 3;
+    conf.lat_sample = 8;
+    conf.prefill = true;
+    conf.format = "json";
+    conf.out = "-";
+    conf.layout = "single";
+    conf.shards = 0;
+    conf.local = false;
+    conf.inflight = 32;
+    for (int i = 1; i < argc; i++){
+        std::string arg = argv[i];
+        size_t eq = arg.find('=');
+        if (arg.compare(0, 2, "--") != 0 || eq == std::string::npos){
+            return false;
+        }
+        std::string name = arg.substr(2, eq - 2), value = arg.substr(eq + 1);
+        if (name == "cache_mb") conf.cache_mb = atoll(value.c_str());
+        else if (name == "keys") conf.key_num = atoll(value.c_str());
+        else if (name == "key_size") conf.key_size = value;
+        else if (name == "value_size") conf.value_size = value;
+        else if (name == "dist") conf.dist = value;
+        else if (name == "zipf") conf.zipf_theta = atof(value.c_str());
+        else if (name == "read") conf.read_ratio = atof(value.c_str());
+        else if (name == "del") conf.del_ratio = atof(value.c_str());
+        else if (name == "ttl_ratio") conf.ttl_ratio = atof(value.c_str());
+        else if (name == "ttl_ms") conf.ttl_ms = atoi(value.c_str());
+        else if (name == "threads") conf.threads = value;
+        else if (name == "seconds") conf.seconds = atoi(value.c_str());
+        else if (name == "lat_sample") conf.lat_sample = atoi(value.c_str());
+        else if (name == "prefill") conf.prefill = atoi(value.c_str()) != 0;
+        else if (name == "format") conf.format = value;
+        else if (name == "label") conf.label = value;
+        else if (name == "out") conf.out = value;
+        else if (name == "record") conf.record = value;
+        else if (name == "layout") conf.layout = value;
+        else if (name == "shards") conf.shards = atoi(value.c_str());
+        else if (name == "local") conf.local = atoi(value.c_str()) != 0;
+        else if (name == "inflight") conf.inflight = atoi(value.c_str());
+        else return false;
+    }
+    if (conf.key_num == 0 || conf.seconds == 0 || (conf.dist != "zipf" && conf.dist != "uniform") || (conf.format != "json" && conf.format != "csv")){
+        return false;
+    }
+    //theta为1时alpha是无穷大，Gray的算法只适用于(0,1)
+    if (conf.dist == "zipf" && (conf.zipf_theta <= 0 || conf.zipf_theta >= 1)){
+        return false;
+    }
+    if (conf.lat_sample == 0){
+        conf.lat_sample = 1;
+    }
+    if (conf.inflight == 0){
+        conf.inflight = 1;
+    }
+    for (size_t pos = 0; pos < conf.layout.size();){
+        size_t end = conf.layout.find(',', pos);
+        end = end == std::string::npos ? conf.layout.size() : end;
+        std::string layout = conf.layout.substr(pos, end - pos);
+        if (layout != "single" && layout != "sharded" && layout != "core"){
+            return false;
+        }
+        pos = end + 1;
+    }
+    //录制只支持单个实例
+    if (!conf.record.empty() && conf.layout != "single"){
+        return false;
+    }
+    return true;
+}
+
+static uint64_t mix64(uint64_t x){
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+/**
+ * [0,1)之间的均匀随机数
+ */
+static double unit(uint64_t x){
+    return (x >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/**
+ * 长度分布：N固定，A-B均匀，exp:MEAN[:MAX]指数分布。同一个key每次算出来都一样
+ */
+class size_dist{
+public:
+    bool parse(const std::string &spec, uint32_t max_len){
+        this->max_len = max_len;
+        if (spec.compare(0, 4, "exp:") == 0){
+            this->type = 2;
+            this->a = atoi(spec.c_str() + 4);
+            size_t pos = spec.find(':', 4);
+            this->b = pos != std::string::npos ? atoi(spec.c_str() + pos + 1) : max_len;
+        }
+        else if (spec.find('-') != std::string::npos){
+            this->type = 1;
+            this->a = atoi(spec.c_str());
+            this->b = atoi(spec.c_str() + spec.find('-') + 1);
+        }
+        else{
+            this->type = 0;
+            this->a = this->b = atoi(spec.c_str());
+        }
+        this->b = std::min(this->b, max_len);
+        return this->a > 0 && this->a <= this->b;
+    }
+
+    uint32_t of(uint64_t id) const{
+        uint64_t h = mix64(id ^ 0x5bd1e995);
+        uint32_t len = this->a;
+        if (this->type == 1){
+            len = this->a + h % (this->b - this->a + 1);
+        }
+        else if (this->type == 2){
+            len = (uint32_t) (-log(1.0 - unit(h)) * this->a) + 1;
+        }
+        return std::min(len, this->b);
+    }
+
+    uint32_t max() const{
+        return this->b;
+    }
+
+private:
+    uint32_t type;
+    uint32_t a;
+    uint32_t b;
+    uint32_t max_len;
+};
+
+/**
+ * zipf分布的key编号，Gray等人的算法（YCSB的ZipfianGenerator），算出的名次再打散，热点不会都挤在相邻的编号上
+ */
+class zipf_gen{
+public:
+    zipf_gen(uint64_t n, double theta) : n(n), theta(theta){
+        double zeta2 = 0;
+        this->zetan = 0;
+        for (uint64_t i = 1; i <= n; i++){
+            this->zetan += 1.0 / pow((double) i, theta);
+            if (i == 2){
+                zeta2 = this->zetan;
+            }
+        }
+        this->alpha = 1.0 / (1.0 - theta);
+        this->eta = (1.0 - pow(2.0 / n, 1.0 - theta)) / (1.0 - zeta2 / this->zetan);
+    }
+
+    uint64_t next(uint64_t rnd) const{
+        double u = unit(rnd);
+        double uz = u * this->zetan;
+        uint64_t rank;
+        if (uz < 1.0){
+            rank = 0;
+        }
+        else if (uz < 1.0 + pow(0.5, this->theta)){
+            rank = 1;
+        }
+        else{
+            rank = (uint64_t) (this->n * pow(this->eta * u - this->eta + 1.0, this->alpha));
+        }
+        return mix64(std::min(rank, this->n - 1)) % this->n;
+    }
+
+private:
+    uint64_t n;
+    double theta;
+    double zetan;
+    double alpha;
+    double eta;
+};
+
+/**
+ * 每个线程一份的结果，跑完再合并
+ */
+typedef struct _thread_result_t{
+    uint64_t get_num;
+    uint64_t hit_num;
+    uint64_t set_num;
+    uint64_t del_num;
+    uint64_t fail_num;
+    std::vector< uint64_t > lat[3];
+    uint64_t lat_sum[3];
+} thread_result_t;
+
+enum{
+    OP_GET = 0, OP_SET, OP_DEL
+};
+
+/**
+ * key：编号的十进制，不够长时后面补字符，同一个编号每次都一样
+ */
+static uint32_t make_key(char *buf, uint64_t id, const size_dist &ks){
+    uint32_t len = snprintf(buf, 32, "k%llu", (unsigned long long) id);
+    uint32_t want = ks.of(id);
+    while (len < want){
+        buf[len] = 'a' + (id + len) % 26;
+        len++;
+    }
+    return len;
+}
+
+static void reset_result(thread_result_t &r){
+    r.get_num = r.hit_num = r.set_num = r.del_num = r.fail_num = 0;
+    for (uint32_t op = 0; op < 3; op++){
+        r.lat[op].assign(ringcache::latency_buckets::NUM, 0);
+        r.lat_sum[op] = 0;
+    }
+}
+
+static void record(thread_result_t &r, uint32_t op, uint64_t ns){
+    r.lat[op][ringcache::latency_buckets::index_of(ns)]++;
+    r.lat_sum[op] += ns;
+}
+
+static uint64_t rss_bytes(){
+    FILE *fp = fopen("/proc/self/statm", "r");
+    unsigned long long size = 0, resident = 0;
+    if (fp != nullptr){
+        if (fscanf(fp, "%llu %llu", &size, &resident) != 2){
+            resident = 0;
+        }
+        fclose(fp);
+    }
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
+static ringcache::latency_stats_t merge_latency(const std::vector< thread_result_t > &results, uint32_t op){
+    ringcache::latency_stats_t s;
+    s.buckets.assign(ringcache::latency_buckets::NUM, 0);
+    s.count = s.sum_ns = 0;
+    for (auto &r:results){
+        for (uint32_t i = 0; i < ringcache::latency_buckets::NUM; i++){
+            s.buckets[i] += r.lat[op][i];
+            s.count += r.lat[op][i];
+        }
+        s.sum_ns += r.lat_sum[op];
+    }
+    return s;
+}
+
+/**
+ * 所有布局共用的负载
+ */
+typedef struct _workload_t{
+    size_dist ks;
+    size_dist vs;
+    std::string pool;
+    zipf_gen *zipf;
+    std::vector< uint32_t > thread_list;
+    FILE *out;
+} workload_t;
+
+/**
+ * 一轮的结果合并后输出一条记录
+ */
+static void print_round(const bench_conf_t &conf, const workload_t &w, const char *layout, uint32_t shards, uint32_t thread_num, double elapsed,
+                        const std::vector< thread_result_t > &results, const ringcache::stats_t &stats, uint64_t rss){
+    FILE *out = w.out;
+    uint32_t nodes = ringcache::numa_node_num();
+#ifdef RINGCACHE_ATOMIC_RESERVE
+    const char *mode = "atomic_reserve";
+#else
+    const char *mode = "buffer_lock";
+#endif
+#ifdef RINGCACHE_BUCKET_INDEX
+    const char *index = "bucket";
+#else
+    const char *index = "chained";
+#endif
+
+    uint64_t get_num = 0, hit_num = 0, set_num = 0, del_num = 0, fail_num = 0;
+    for (auto &r:results){
+        get_num += r.get_num;
+        hit_num += r.hit_num;
+        set_num += r.set_num;
+        del_num += r.del_num;
+        fail_num += r.fail_num;
+    }
+    ringcache::latency_stats_t get_lat = merge_latency(results, OP_GET);
+    ringcache::latency_stats_t set_lat = merge_latency(results, OP_SET);
+    ringcache::latency_stats_t del_lat = merge_latency(results, OP_DEL);
+    uint64_t ops = get_num + set_num + del_num;
+
+    //内存：进程常驻内存的增量（缓存的buffer、索引及其他结构）分摊到每个数据上，减去数据本身key+value的平均长度就是开销
+    uint64_t items = stats.item_num();
+    double bytes_per_item = items > 0 ? (double) rss / items : 0;
+    double payload = stats.set_num() > 0 ? (double) stats.write_bytes / stats.set_num() : 0;
+    double hit_ratio = get_num > 0 ? (double) hit_num / get_num : 0;
+
+    if (conf.format == "csv"){
+        fprintf(out, "%s,%s,%s,%s,%u,%u,%.3f,%s,%.3f,%.3f,%.3f,%llu,%.0f,%llu,%llu,%llu,%llu,%.4f,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%.1f,%.1f,%.1f\n",
+               conf.label.c_str(), mode, index, layout, shards, thread_num, elapsed, conf.dist.c_str(), conf.read_ratio, conf.del_ratio, conf.ttl_ratio,
+               (unsigned long long) ops, ops / elapsed, (unsigned long long) get_num, (unsigned long long) set_num,
+               (unsigned long long) del_num, (unsigned long long) fail_num, hit_ratio,
+               (unsigned long long) get_lat.percentile(0.5), (unsigned long long) get_lat.percentile(0.99), (unsigned long long) get_lat.percentile(0.999),
+               (unsigned long long) set_lat.percentile(0.5), (unsigned long long) set_lat.percentile(0.99), (unsigned long long) set_lat.percentile(0.999),
+               (unsigned long long) del_lat.percentile(0.99), (unsigned long long) items, (unsigned long long) rss,
+               bytes_per_item, payload, bytes_per_item - payload);
+    }
+    else{
+        fprintf(out, "{\"bench\":\"ringcache\",\"label\":\"%s\",\"mode\":\"%s\",\"index\":\"%s\",\"layout\":\"%s\",\"shards\":%u,\"numa_nodes\":%u,"
+               "\"threads\":%u,\"seconds\":%.3f,"
+               "\"config\":{\"cache_mb\":%llu,\"keys\":%llu,\"key_size\":\"%s\",\"value_size\":\"%s\",\"dist\":\"%s\",\"zipf\":%.3f,"
+               "\"read\":%.3f,\"del\":%.3f,\"ttl_ratio\":%.3f,\"ttl_ms\":%u,\"lat_sample\":%u,\"local\":%d},"
+               "\"ops\":%llu,\"ops_per_sec\":%.0f,\"get_num\":%llu,\"set_num\":%llu,\"del_num\":%llu,\"fail_num\":%llu,\"hit_ratio\":%.4f,"
+               "\"get_p50_ns\":%llu,\"get_p99_ns\":%llu,\"get_p999_ns\":%llu,\"set_p50_ns\":%llu,\"set_p99_ns\":%llu,\"set_p999_ns\":%llu,"
+               "\"del_p50_ns\":%llu,\"del_p99_ns\":%llu,\"del_p999_ns\":%llu,"
+               "\"items\":%llu,\"rss_bytes\":%llu,\"bytes_per_item\":%.1f,\"payload_per_item\":%.1f,\"overhead_per_item\":%.1f}\n",
+               conf.label.c_str(), mode, index, layout, shards, nodes, thread_num, elapsed,
+               (unsigned long long) conf.cache_mb, (unsigned long long) conf.key_num, conf.key_size.c_str(), conf.value_size.c_str(),
+               conf.dist.c_str(), conf.zipf_theta, conf.read_ratio, conf.del_ratio, conf.ttl_ratio, conf.ttl_ms, conf.lat_sample, conf.local ? 1 : 0,
+               (unsigned long long) ops, ops / elapsed, (unsigned long long) get_num, (unsigned long long) set_num,
+               (unsigned long long) del_num, (unsigned long long) fail_num, hit_ratio,
+               (unsigned long long) get_lat.percentile(0.5), (unsigned long long) get_lat.percentile(0.99), (unsigned long long) get_lat.percentile(0.999),
+               (unsigned long long) set_lat.percentile(0.5), (unsigned long long) set_lat.percentile(0.99), (unsigned long long) set_lat.percentile(0.999),
+               (unsigned long long) del_lat.percentile(0.5), (unsigned long long) del_lat.percentile(0.99), (unsigned long long) del_lat.percentile(0.999),
+               (unsigned long long) items, (unsigned long long) rss, bytes_per_item, payload, bytes_per_item - payload);
+    }
+    fflush(out);
+}
+
+/**
+ * key所在分片的NUMA节点，单个实例时为-1，表示不挑key
+ */
+static int32_t key_node(ringcache::ringcache *, const char *, uint32_t){
+    return -1;
+}
+
+static int32_t key_node(ringcache::sharded_ringcache *cache, const char *key, uint32_t key_len){
+    return cache->shard_node(cache->shard_of(key, key_len));
+}
+
+static uint32_t shard_num(ringcache::ringcache *){
+    return 1;
+}
+
+static uint32_t shard_num(ringcache::sharded_ringcache *cache){
+    return cache->shard_num();
+}
+
+static bool start_record(ringcache::ringcache *cache, const std::string &path){
+    return cache->start_trace(path) == RINGCACHE_ERRNO_OK;
+}
+
+static bool start_record(ringcache::sharded_ringcache *, const std::string &){
+    return false;
+}
+
+static void stop_record(ringcache::ringcache *cache){
+    cache->stop_trace();
+}
+
+static void stop_record(ringcache::sharded_ringcache *){
+}
+
+/**
+ * 一种布局：预热，然后按线程数逐轮跑，每轮输出一条记录
+ */
+template< typename cache_t >
+static bool run_layout(const bench_conf_t &conf, const workload_t &w, const char *layout, cache_t *cache, uint64_t rss_base){
+    const size_dist &ks = w.ks, &vs = w.vs;
+    const std::string &pool = w.pool;
+    const zipf_gen &zipf = *w.zipf;
+    uint32_t nodes = ringcache::numa_node_num();
+    if (conf.prefill){
+        char key[MAX_KEY_SIZE];
+        for (uint64_t id = 0; id < conf.key_num; id++){
+            uint32_t klen = make_key(key, id, ks);
+            cache->set(key, klen, pool.data() + id % 4096, vs.of(id), 0);
+        }
+    }
+
+    if (!conf.record.empty() && !start_record(cache, conf.record)){
+        perror(conf.record.c_str());
+        return false;
+    }
+
+    for (auto thread_num:w.thread_list){
+        std::atomic< bool > stop(false);
+        std::vector< thread_result_t > results(thread_num);
+        std::vector< std::thread * > threads;
+        for (uint32_t t = 0; t < thread_num; t++){
+            threads.push_back(new std::thread([&, t](){
+                thread_result_t &r = results[t];
+                reset_result(r);
+                int32_t node = conf.local && nodes > 1 ? (int32_t) (t % nodes) : -1;
+                if (node >= 0){
+                    ringcache::numa_bind_thread(node);
+                }
+                char key[MAX_KEY_SIZE];
+                std::string out;
+                out.reserve(vs.max());
+                uint64_t seed = mix64(t + 1);
+                uint64_t ops = 0;
+                while (!stop.load(std::memory_order_relaxed)){
+                    uint64_t rnd, id;
+                    uint32_t klen;
+                    //只挑分片在本节点上的key，试几次都不在就算了
+                    for (uint32_t tries = 0;; tries++){
+                        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+                        rnd = mix64(seed);
+                        id = conf.dist == "zipf" ? zipf.next(rnd) : rnd % conf.key_num;
+                        klen = make_key(key, id, ks);
+                        if (node < 0 || tries >= 64){
+                            break;
+                        }
+                        int32_t owner = key_node(cache, key, klen);
+                        if (owner < 0 || owner == node){
+                            break;
+                        }
+                    }
+                    double pick = unit(mix64(rnd));
+                    uint32_t op = pick < conf.read_ratio ? OP_GET : (pick < conf.read_ratio + conf.del_ratio ? OP_DEL : OP_SET);
+                    bool timed = ops++ % conf.lat_sample == 0;
+                    uint64_t begin = timed ? ringcache::latency_now_ns() : 0;
+                    if (op == OP_GET){
+                        r.get_num++;
+                        if (cache->get(key, klen, out) == RINGCACHE_ERRNO_OK){
+                            r.hit_num++;
+                        }
+                    }
+                    else if (op == OP_DEL){
+                        r.del_num++;
+                        cache->del(key, klen);
+                    }
+                    else{
+                        r.set_num++;
+                        ringcache::expire_t expire = unit(rnd) < conf.ttl_ratio ? ringcache::expire_t::after_ms(conf.ttl_ms) : ringcache::expire_t(0);
+                        if (cache->set(key, klen, pool.data() + id % 4096, vs.of(id), expire) != RINGCACHE_ERRNO_OK){
+                            r.fail_num++;
+                        }
+                    }
+                    if (timed){
+                        record(r, op, ringcache::latency_now_ns() - begin);
+                    }
+                }
+            }));
+        }
+        auto begin = std::chrono::steady_clock::now();
+        std::this_thread::sleep_for(std::chrono::seconds(conf.seconds));
+        stop = true;
+        for (auto it:threads){
+            it->join();
+            delete it;
+        }
+        double elapsed = std::chrono::duration_cast< std::chrono::microseconds >(std::chrono::steady_clock::now() - begin).count() / 1e6;
+
+        print_round(conf, w, layout, shard_num(cache), thread_num, elapsed, results, cache->get_stats(), rss_bytes() - rss_base);
+    }
+    if (!conf.record.empty()){
+        stop_record(cache);
+    }
+    return true;
+}
+
+/**
+ * core布局下每个核的压测状态，只在这个核上读写
+ */
+typedef struct _core_worker_t{
+    thread_result_t result;
+    uint64_t seed;
+    uint64_t ops;
+} core_worker_t;
+
+/**
+ * 每核一个线程：线程数就是核数，每轮都重新建一个core_ringcache。
+ * 每个核的driver不停地发请求，归属别的核的最多同时有inflight个在路上，延迟从发出算到回调
+ */
+static bool run_core_layout(const bench_conf_t &conf, const workload_t &w){
+    typedef ringcache::core_ringcache::core_t core_t;
+    const size_dist &ks = w.ks, &vs = w.vs;
+    const std::string &pool = w.pool;
+    const zipf_gen &zipf = *w.zipf;
+    for (auto core_num:w.thread_list){
+        uint64_t rss_base = rss_bytes();
+        ringcache::core_ringcache *cache = new ringcache::core_ringcache(conf.cache_mb, core_num);
+        core_num = cache->core_num();
+        sleep(1);
+        //每个核直接往自己的分区里写归属它的key
+        if (conf.prefill){
+            std::vector< std::promise< void > > prefilled(core_num);
+            for (uint32_t c = 0; c < core_num; c++){
+                std::promise< void > *done = &prefilled[c];
+                cache->submit(c, [&, done](core_t &core){
+                    char key[MAX_KEY_SIZE];
+                    for (uint64_t id = 0; id < conf.key_num; id++){
+                        uint32_t klen = make_key(key, id, ks);
+                        uint32_t hash_val = core.local().hash_key(key, klen);
+                        if (core.owns(hash_val)){
+                            core.local().set(key, klen, hash_val, pool.data() + id % 4096, vs.of(id), 0);
+                        }
+                    }
+                    done->set_value();
+                });
+            }
+            for (auto &it:prefilled){
+                it.get_future().wait();
+            }
+        }
+
+        std::atomic< bool > stop(false);
+        std::atomic< uint32_t > drained(0);
+        std::vector< core_worker_t > workers(core_num);
+        auto begin = std::chrono::steady_clock::now();
+        for (uint32_t c = 0; c < core_num; c++){
+            core_worker_t *wk = &workers[c];
+            reset_result(wk->result);
+            wk->seed = mix64(c + 1);
+            wk->ops = 0;
+            cache->submit(c, [&, wk](core_t &core){
+                core.set_driver([&, wk](core_t &core){
+                    //停下后等发出去的都回来
+                    if (stop.load(std::memory_order_relaxed)){
+                        if (core.pending() > 0){
+                            return true;
+                        }
+                        drained++;
+                        return false;
+                    }
+                    thread_result_t *r = &wk->result;
+                    char key[MAX_KEY_SIZE];
+                    for (uint32_t k = 0; k < 16 && core.pending() < conf.inflight; k++){
+                        uint64_t rnd, id;
+                        uint32_t klen;
+                        for (uint32_t tries = 0;; tries++){
+                            wk->seed = wk->seed * 6364136223846793005ULL + 1442695040888963407ULL;
+                            rnd = mix64(wk->seed);
+                            id = conf.dist == "zipf" ? zipf.next(rnd) : rnd % conf.key_num;
+                            klen = make_key(key, id, ks);
+                            if (!conf.local || tries >= 64 || core.owns(core.local().hash_key(key, klen))){
+                                break;
+                            }
+                        }
+                        double pick = unit(mix64(rnd));
+                        uint32_t op = pick < conf.read_ratio ? OP_GET : (pick < conf.read_ratio + conf.del_ratio ? OP_DEL : OP_SET);
+                        uint64_t begin = wk->ops++ % conf.lat_sample == 0 ? ringcache::latency_now_ns() : 0;
+                        if (op == OP_GET){
+                            r->get_num++;
+                            core.get(key, klen, [r, begin](uint32_t ret, const std::string &){
+                                if (ret == RINGCACHE_ERRNO_OK){
+                                    r->hit_num++;
+                                }
+                                if (begin > 0){
+                                    record(*r, OP_GET, ringcache::latency_now_ns() - begin);
+                                }
+                            });
+                        }
+                        else if (op == OP_DEL){
+                            r->del_num++;
+                            core.del(key, klen, [r, begin](uint32_t){
+                                if (begin > 0){
+                                    record(*r, OP_DEL, ringcache::latency_now_ns() - begin);
+                                }
+                            });
+                        }
+                        else{
+                            r->set_num++;
+                            ringcache::expire_t expire = unit(rnd) < conf.ttl_ratio ? ringcache::expire_t::after_ms(conf.ttl_ms) : ringcache::expire_t(0);
+                            core.set(key, klen, pool.data() + id % 4096, vs.of(id), expire, [r, begin](uint32_t ret){
+                                if (ret != RINGCACHE_ERRNO_OK){
+                                    r->fail_num++;
+                                }
+                                if (begin > 0){
+                                    record(*r, OP_SET, ringcache::latency_now_ns() - begin);
+                                }
+                            });
+                        }
+                    }
+                    return true;
+                });
+            });
+        }
+        std::this_thread::sleep_for(std::chrono::seconds(conf.seconds));
+        stop = true;
+        while (drained.load() < core_num){
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        double elapsed = std::chrono::duration_cast< std::chrono::microseconds >(std::chrono::steady_clock::now() - begin).count() / 1e6;
+
+        std::vector< thread_result_t > results;
+        for (auto &it:workers){
+            results.push_back(it.result);
+        }
+        print_round(conf, w, "core", core_num, core_num, elapsed, results, cache->get_stats(), rss_bytes() - rss_base);
+        delete cache;
+    }
+    return true;
+}
+
+int main(int argc, char **argv){
+    bench_conf_t conf;
+    if (!parse_args(argc, argv, conf)){
+        usage(argv[0]);
+        return 1;
+    }
+    //free掉上一个实例的大块后glibc会调高mmap的阈值，下一个实例的buffer就从堆上分、calloc时整块清零，
+    //常驻内存一下子变成满的。固定住阈值，每种布局的buffer都是单独mmap、写到才分配
+    mallopt(M_MMAP_THRESHOLD, 1024 * 1024);
+    workload_t w;
+    if (!w.ks.parse(conf.key_size, MAX_KEY_SIZE - 1) || !w.vs.parse(conf.value_size, MAX_VALUE_SIZE - 1)){
+        usage(argv[0]);
+        return 1;
+    }
+    if (conf.threads.empty()){
+        uint32_t cpus = std::max(1u, std::thread::hardware_concurrency());
+        for (uint32_t n = 1; n < cpus; n *= 2){
+            w.thread_list.push_back(n);
+        }
+        w.thread_list.push_back(cpus);
+    }
+    else{
+        for (size_t pos = 0; pos < conf.threads.size();){
+            w.thread_list.push_back(std::max(1, atoi(conf.threads.c_str() + pos)));
+            pos = conf.threads.find(',', pos);
+            pos = pos == std::string::npos ? conf.threads.size() : pos + 1;
+        }
+    }
+
+    //value直接从一段随机数据里截，不用每次都构造
+    w.pool.assign(w.vs.max() + 4096, 0);
+    for (size_t i = 0; i < w.pool.size(); i++){
+        w.pool[i] = 'a' + mix64(i) % 26;
+    }
+    zipf_gen zipf(conf.dist == "zipf" ? conf.key_num : 2, conf.zipf_theta);
+    w.zipf = &zipf;
+
+    w.out = conf.out == "-" ? stdout : fopen(conf.out.c_str(), "a");
+    if (w.out == nullptr){
+        perror(conf.out.c_str());
+        return 1;
+    }
+    if (conf.format == "csv"){
+        fprintf(w.out, "label,mode,index,layout,shards,threads,seconds,dist,read,del,ttl_ratio,ops,ops_per_sec,get_num,set_num,del_num,fail_num,hit_ratio,"
+                "get_p50_ns,get_p99_ns,get_p999_ns,set_p50_ns,set_p99_ns,set_p999_ns,del_p99_ns,items,rss_bytes,bytes_per_item,payload_per_item,overhead_per_item\n");
+    }
+
+    //每种布局各建一个实例，跑完释放掉再跑下一种，内存的增量各算各的
+    bool ok = true;
+    for (size_t pos = 0; ok && pos < conf.layout.size();){
+        size_t end = conf.layout.find(',', pos);
+        end = end == std::string::npos ? conf.layout.size() : end;
+        std::string layout = conf.layout.substr(pos, end - pos);
+        pos = end + 1;
+        uint64_t rss_base = rss_bytes();
+        if (layout == "single"){
+            ringcache::ringcache *cache = new ringcache::ringcache(conf.cache_mb);
+            //等后台线程把buffer都申请好
+            sleep(1);
+            ok = run_layout(conf, w, "single", cache, rss_base);
+            delete cache;
+        }
+        else if (layout == "sharded"){
+            ringcache::sharded_ringcache *cache = new ringcache::sharded_ringcache(conf.cache_mb, conf.shards);
+            sleep(1);
+            ok = run_layout(conf, w, "sharded", cache, rss_base);
+            delete cache;
+        }
+        else{
+            ok = run_core_layout(conf, w);
+        }
+    }
+    if (w.out != stdout){
+        fclose(w.out);
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,210 @@
+/*************************************************************************
+ * File:	shm_bench.cpp
+ * Author:	liuyongshuai<liuyongshuai@hotmail.com>
+ * Time:	2026-10-27 15:20
+ * 多进程压测：N个worker进程跑同样的读多写少的负载，对比两种方式
+ *   shm：    共用一个shm_ringcache，父进程建好、写满，worker按名字打开
+ *   private：每个worker自己建一个同样大小的ringcache、自己写满
+ * 输出每秒操作数、命中率，以及所有进程的PSS加起来（共享的页按映射它的进程数均摊，加起来就是实际占的内存）
+ * 用法：./bench_shm [procs] [seconds] [cache_mb] [value_size]
+ ************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <sys/wait.h>
+#include <chrono>
+#include <fstream>
+#include <vector>
+
+#define RING_BUFFER_NUM 16
+#include "ringcache/ringcache.h"
+#include "ringcache/shm.h"
+
+//读的比例，百分之几
+#define BENCH_READ_PERCENT 90
+
+typedef struct _worker_result_t{
+    uint64_t ops;
+    uint64_t gets;
+    uint64_t hits;
+    uint64_t pss_kb;
+} worker_result_t;
+
+static std::string bench_key(uint64_t i){
+    return "bench_key_" + std::to_string(i);
+}
+
+/**
+ * 当前进程的PSS，单位KB
+ */
+static uint64_t self_pss_kb(){
+    std::ifstream in("/proc/self/smaps_rollup");
+    std::string line;
+    while (std::getline(in, line)){
+        if (line.compare(0, 4, "Pss:") == 0){
+            return strtoull(line.c_str() + 4, nullptr, 10);
+        }
+    }
+    return 0;
+}
+
+/**
+ * 写满整个缓存大致要的key数
+ */
+static uint64_t key_num_of(uint64_t cache_mb, uint32_t value_size){
+    return cache_mb * MB / (value_size + 64);
+}
+
+template< typename cache_t >
+static void prefill(cache_t *cache, uint64_t key_num, const std::string &value){
+    for (uint64_t i = 0; i < key_num; i++){
+        cache->set(bench_key(i), value, 0);
+    }
+}
+
+template< typename cache_t >
+static void run_workload(cache_t *cache, uint64_t key_num, const std::string &value, uint32_t seconds, uint32_t id, worker_result_t &res){
+    std::string val;
+    uint64_t seed = id * 2654435761u + 1;
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now() + std::chrono::seconds(seconds);
+    while (true){
+        //每256次看一下时间
+        if ((res.ops & 255) == 0 && std::chrono::steady_clock::now() >= end){
+            break;
+        }
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        std::string key = bench_key((seed >> 33) % key_num);
+        if ((seed >> 17) % 100 < BENCH_READ_PERCENT){
+            res.gets++;
+            res.hits += cache->get(key, val) == RINGCACHE_ERRNO_OK;
+        }
+        else{
+            cache->set(key, value, 0);
+        }
+        res.ops++;
+    }
+}
+
+/**
+ * 跑一轮：fork出procs个worker，都准备好后同时开始，结果从管道里收回来
+ */
+static void run_round(bool shared, uint32_t procs, uint32_t seconds, uint64_t cache_mb, uint32_t value_size){
+    std::string value(value_size, 'v');
+    uint64_t key_num = key_num_of(cache_mb, value_size);
+    std::string name = "/ringcache_bench_" + std::to_string(getpid());
+    uint32_t ret = 0;
+    ringcache::shm_ringcache *cache = nullptr;
+    if (shared){
+        ringcache::shm_ringcache::unlink(name.c_str());
+        cache = ringcache::shm_ringcache::open(name.c_str(), cache_mb, ret);
+        if (cache == nullptr){
+            printf("create shm failed: %u\n", ret);
+            exit(1);
+        }
+        prefill(cache, key_num, value);
+    }
+
+    int ready_pipe[2], start_pipe[2], result_pipe[2];
+    if (pipe(ready_pipe) != 0 || pipe(start_pipe) != 0 || pipe(result_pipe) != 0){
+        perror("pipe");
+        exit(1);
+    }
+    //缓冲区里还没输出的内容不要带到子进程里
+    fflush(stdout);
+    std::vector< pid_t > children;
+    for (uint32_t i = 0; i < procs; i++){
+        pid_t pid = fork();
+        if (pid != 0){
+            children.push_back(pid);
+            continue;
+        }
+        worker_result_t res = worker_result_t();
+        char c = 0;
+        if (shared){
+            //和独立启动的worker一样按名字打开，不用fork继承下来的映射
+            ringcache::shm_ringcache *worker_cache = ringcache::shm_ringcache::open(name.c_str(), 0, ret);
+            if (worker_cache == nullptr){
+                _exit(1);
+            }
+            if (write(ready_pipe[1], &c, 1) != 1 || read(start_pipe[0], &c, 1) != 1){
+                _exit(1);
+            }
+            run_workload(worker_cache, key_num, value, seconds, i, res);
+            res.pss_kb = self_pss_kb();
+        }
+        else{
+            ringcache::ringcache *worker_cache = new ringcache::ringcache(cache_mb);
+            prefill(worker_cache, key_num, value);
+            if (write(ready_pipe[1], &c, 1) != 1 || read(start_pipe[0], &c, 1) != 1){
+                _exit(1);
+            }
+            run_workload(worker_cache, key_num, value, seconds, i, res);
+            res.pss_kb = self_pss_kb();
+        }
+        //等父进程也算完PSS再退出，共享的页在各进程间的均摊才对得上
+        if (write(result_pipe[1], &res, sizeof(res)) != sizeof(res) || read(start_pipe[0], &c, 1) != 1){
+            _exit(1);
+        }
+        _exit(0);
+    }
+
+    char c = 0;
+    for (uint32_t i = 0; i < procs; i++){
+        if (read(ready_pipe[0], &c, 1) != 1){
+            perror("read");
+            exit(1);
+        }
+    }
+    for (uint32_t i = 0; i < procs; i++){
+        if (write(start_pipe[1], &c, 1) != 1){
+            perror("write");
+            exit(1);
+        }
+    }
+    worker_result_t total = worker_result_t();
+    for (uint32_t i = 0; i < procs; i++){
+        worker_result_t res;
+        if (read(result_pipe[0], &res, sizeof(res)) != sizeof(res)){
+            perror("read");
+            exit(1);
+        }
+        total.ops += res.ops;
+        total.gets += res.gets;
+        total.hits += res.hits;
+        total.pss_kb += res.pss_kb;
+    }
+    total.pss_kb += self_pss_kb();
+    for (uint32_t i = 0; i < procs; i++){
+        if (write(start_pipe[1], &c, 1) != 1){
+            perror("write");
+            exit(1);
+        }
+    }
+    for (auto pid:children){
+        waitpid(pid, nullptr, 0);
+    }
+    printf("%-8s %-6u %-12.0f %-10.4f %-10.1f\n", shared ? "shm" : "private", procs, (double) total.ops / seconds,
+           total.gets > 0 ? (double) total.hits / total.gets : 0, total.pss_kb / 1024.0);
+    if (shared){
+        delete cache;
+        ringcache::shm_ringcache::unlink(name.c_str());
+    }
+    close(ready_pipe[0]);
+    close(ready_pipe[1]);
+    close(start_pipe[0]);
+    close(start_pipe[1]);
+    close(result_pipe[0]);
+    close(result_pipe[1]);
+}
+
+int main(int argc, char **argv){
+    uint32_t procs = argc > 1 ? atoi(argv[1]) : 4;
+    uint32_t seconds = argc > 2 ? atoi(argv[2]) : 3;
+    uint64_t cache_mb = argc > 3 ? atoll(argv[3]) : 128;
+    uint32_t value_size = argc > 4 ? atoi(argv[4]) : 256;
+    procs = procs > 0 ? procs : 1;
+    printf("%-8s %-6s %-12s %-10s %-10s\n", "mode", "procs", "ops", "hit_rate", "pss_mb");
+    run_round(true, procs, seconds, cache_mb, value_size);
+    run_round(false, procs, seconds, cache_mb, value_size);
+    return 0;
+}
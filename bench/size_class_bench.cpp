@@ -0,0 +1,91 @@
+/*************************************************************************
+ * File:	size_class_bench.cpp
+ * Author:	liuyongshuai<liuyongshuai@hotmail.com>
+ * Time:	2026-10-21 16:10
+ * 大小分档压测：一批小数据反复读写，每写big_every个小数据混入一个大value，
+ * 分别在不分档、分两档（小数据一档、其余一档）下统计小数据的读命中率
+ * 用法：./bench_size_class [cache_mb] [small_num] [big_kb] [big_every]
+ ************************************************************************/
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+
+#define RING_BUFFER_NUM 16
+#include "ringcache/ringcache.h"
+
+#define BENCH_SMALL_SIZE 100
+#define BENCH_ROUNDS 20
+
+static std::string bench_key(const char *prefix, uint64_t i){
+    return prefix + std::to_string(i);
+}
+
+/**
+ * 跑一遍，返回小数据的命中率
+ */
+static double run(ringcache::ringcache *cache, uint64_t small_num, uint32_t big_kb, uint32_t big_every){
+    std::string small(BENCH_SMALL_SIZE, 's');
+    std::string big((uint64_t) big_kb * KB, 'b');
+    std::string val;
+    uint64_t big_id = 0, hit = 0, total = 0;
+    uint64_t seed = 1;
+    for (uint64_t i = 0; i < small_num; i++){
+        cache->set(bench_key("small_", i), small, 0);
+    }
+    for (uint32_t round = 0; round < BENCH_ROUNDS; round++){
+        for (uint64_t n = 0; n < small_num; n++){
+            seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+            std::string key = bench_key("small_", (seed >> 33) % small_num);
+            total++;
+            if (cache->get(key, val) == RINGCACHE_ERRNO_OK){
+                hit++;
+            }
+            else{
+                cache->set(key, small, 0);
+            }
+            if (n % big_every == 0){
+                cache->set(bench_key("big_", big_id++), big, 0);
+            }
+        }
+    }
+    return (double) hit / total;
+}
+
+static void print_classes(ringcache::ringcache *cache){
+    for (auto &it:cache->get_stats().class_stats){
+        printf("  class%u max_size=%u buffer_num=%u item_num=%llu evict_num=%llu hit_num=%llu\n", it.index, it.max_size,
+               it.buffer_num, (unsigned long long) it.item_num, (unsigned long long) it.evict_num,
+               (unsigned long long) it.hit_num);
+    }
+}
+
+int main(int argc, char **argv){
+    uint64_t cache_mb = argc > 1 ? atoll(argv[1]) : 256;
+    uint64_t small_num = argc > 2 ? atoll(argv[2]) : 200000;
+    uint32_t big_kb = argc > 3 ? atoi(argv[3]) : 2048;
+    uint32_t big_every = argc > 4 ? atoi(argv[4]) : 1000;
+    if (big_every == 0){
+        big_every = 1;
+    }
+
+    //小数据实际要占的内存再留一倍余量，分给小数据那一档
+    uint64_t small_bytes = small_num * RING_ALIGN_SIZE(BENCH_SMALL_SIZE + 16 + sizeof(ringcache::entry_t)) * 2;
+    uint32_t small_percent = std::max((uint64_t) 1, std::min((uint64_t) 90, small_bytes * 100 / (cache_mb * MB)));
+    std::vector< ringcache::size_class_t > classes = {{1 * KB, small_percent}, {0, 100 - small_percent}};
+
+    ringcache::ringcache *cache = new ringcache::ringcache(cache_mb);
+    sleep(1);
+    double shared = run(cache, small_num, big_kb, big_every);
+    printf("classes=1 small_hit_rate=%.4f\n", shared);
+    print_classes(cache);
+    delete cache;
+
+    cache = new ringcache::ringcache(cache_mb, classes);
+    sleep(1);
+    double split = run(cache, small_num, big_kb, big_every);
+    printf("classes=2 small_percent=%u small_hit_rate=%.4f\n", small_percent, split);
+    print_classes(cache);
+    delete cache;
+    return 0;
+}
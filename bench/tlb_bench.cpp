@@ -0,0 +1,104 @@
+/*************************************************************************
+ * File:	tlb_bench.cpp
+ * Author:	liuyongshuai<liuyongshuai@hotmail.com>
+ * Time:	2026-10-20 16:20
+ * 大页压测：缓存远大于TLB能覆盖的范围，写满后随机get，统计每次get的耗时及dTLB未命中次数。
+ * 同一份代码编出两个程序：bench_tlb用calloc（4KB页），
+ * bench_tlb_huge定义了RING_BUFFER_PAGE=RING_PAGE_HUGETLB，没有预留大页时退回透明大页
+ * 用法：./bench_tlb [cache_mb] [get_num]
+ ************************************************************************/
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+
+#define RING_BUFFER_NUM 8
+#include "ringcache/ringcache.h"
+
+#define BENCH_VALUE_SIZE 200
+
+static std::string bench_key(uint64_t i){
+    return "bench_key_" + std::to_string(i);
+}
+
+/**
+ * 打开本线程dTLB读未命中的计数器，虚拟机里一般没有硬件计数器，返回-1
+ */
+static int open_dtlb_counter(){
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+int main(int argc, char **argv){
+    uint64_t cache_mb = argc > 1 ? atoll(argv[1]) : 2048;
+    uint64_t get_num = argc > 2 ? atoll(argv[2]) : 4000000;
+    ringcache::ringcache *cache = new ringcache::ringcache(cache_mb);
+    //等后台线程把buffer都申请好
+    while (cache->get_stats().buffer_stats.size() < RING_BUFFER_NUM){
+        sleep(1);
+    }
+
+    //写到正好绕一圈，key基本都还在
+    uint64_t key_num = cache_mb * MB / (BENCH_VALUE_SIZE + 64);
+    std::string value(BENCH_VALUE_SIZE, 'v');
+    for (uint64_t i = 0; i < key_num; i++){
+        cache->set(bench_key(i), value, 0);
+    }
+    std::vector< std::string > keys;
+    uint64_t seed = 1;
+    for (uint64_t i = 0; i < get_num; i++){
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        keys.push_back(bench_key((seed >> 33) % key_num));
+    }
+
+    int fd = open_dtlb_counter();
+    std::string val;
+    uint64_t hit = 0;
+    if (fd >= 0){
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+    auto begin = std::chrono::steady_clock::now();
+    for (auto &key:keys){
+        if (cache->get(key, val) == RINGCACHE_ERRNO_OK){
+            hit++;
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+    uint64_t misses = 0;
+    if (fd >= 0){
+        ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(fd, &misses, sizeof(misses)) != sizeof(misses)){
+            misses = 0;
+        }
+        close(fd);
+    }
+
+    ringcache::stats_t stats = cache->get_stats();
+    uint64_t huge = 0;
+    for (auto &it:stats.buffer_stats){
+        huge += it.huge_page_bytes;
+    }
+    double ns = (double) std::chrono::duration_cast< std::chrono::nanoseconds >(end - begin).count() / keys.size();
+    printf("page_mode=%u cache=%lluMB huge_page=%lluMB keys=%llu hit=%llu get_ns=%.1f ",
+           stats.buffer_stats[0].page_mode, (unsigned long long) cache_mb, (unsigned long long) (huge / MB),
+           (unsigned long long) key_num, (unsigned long long) hit, ns);
+    if (fd >= 0){
+        printf("dtlb_miss_per_get=%.3f\n", (double) misses / keys.size());
+    }
+    else{
+        printf("dtlb_miss_per_get=n/a\n");
+    }
+    delete cache;
+    return 0;
+}
@@ -0,0 +1,307 @@
+/*************************************************************************
+ * File:	trace_replay.cpp
+ * Author:	liuyongshuai<liuyongshuai@hotmail.com>
+ * Time:	2026-10-24 18:10
+ * 回放start_trace()录下来的流量：按时间戳排好序，用一个新的实例按原来的节奏、加速或者不限速地重放，
+ * 输出命中率（和录制时的对比）、各操作的延迟分位数及淘汰情况。
+ * 缓存大小用--cache_mb调，buffer个数要重新编：-DRING_BUFFER_NUM=64
+ * 用法：./ringcache_replay --trace=FILE [--name=value ...]，--help看所有参数
+ ************************************************************************/
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <unordered_set>
+
+#include "ringcache/ringcache.h"
+
+typedef struct _replay_conf_t{
+    std::string trace;
+    uint64_t cache_mb;
+    double speed;
+    bool scale_ttl;
+    uint32_t threads;
+    uint32_t lat_sample;
+    bool prefill;
+    std::string label;
+    std::string out;
+} replay_conf_t;
+
+static void usage(const char *prog){
+    printf("usage: %s --trace=FILE [--name=value ...]\n"
+           "  --cache_mb=256         cache size in MB, rebuild with -DRING_BUFFER_NUM=N to change the buffer count\n"
+           "  --speed=1              1 replays at the recorded rate, 10 is ten times faster, 0 is as fast as possible\n"
+           "  --scale_ttl=1          divide TTLs by speed so items expire at the same point in the traffic\n"
+           "  --threads=1            replay threads; keys are split by hash so each key keeps its order.\n"
+           "                         1 thread at speed 0 is fully deterministic\n"
+           "  --lat_sample=1         time one of every N operations per thread\n"
+           "  --prefill=1            before replaying, write the keys whose first recorded access was a hit,\n"
+           "                         so the cache starts as warm as it was when recording began\n"
+           "  --label=               free-form tag copied to the record\n"
+           "  --out=-                write the record to this file, - is stdout\n", prog);
+}
+
+static bool parse_args(int argc, char **argv, replay_conf_t &conf){
+    conf.cache_mb = 256;
+    conf.speed = 1;
+    conf.scale_ttl = true;
+    conf.threads = 1;
+    conf.lat_sample = 1;
+    conf.prefill = true;
+    conf.out = "-";
+    for (int i = 1; i < argc; i++){
+        std::string arg = argv[i];
+        size_t eq = arg.find('=');
+        if (arg.compare(0, 2, "--") != 0 || eq == std::string::npos){
+            return false;
+        }
+        std::string name = arg.substr(2, eq - 2), value = arg.substr(eq + 1);
+        if (name == "trace") conf.trace = value;
+        else if (name == "cache_mb") conf.cache_mb = atoll(value.c_str());
+        else if (name == "speed") conf.speed = atof(value.c_str());
+        else if (name == "scale_ttl") conf.scale_ttl = atoi(value.c_str()) != 0;
+        else if (name == "threads") conf.threads = atoi(value.c_str());
+        else if (name == "lat_sample") conf.lat_sample = atoi(value.c_str());
+        else if (name == "prefill") conf.prefill = atoi(value.c_str()) != 0;
+        else if (name == "label") conf.label = value;
+        else if (name == "out") conf.out = value;
+        else return false;
+    }
+    if (conf.trace.empty() || conf.speed < 0){
+        return false;
+    }
+    conf.threads = std::max(conf.threads, 1u);
+    conf.lat_sample = std::max(conf.lat_sample, 1u);
+    return true;
+}
+
+/**
+ * 读出所有记录，按时间戳稳定排序，同一个线程的记录保持原来的先后
+ */
+static bool load_trace(const std::string &path, std::vector< ringcache::trace_record_t > &records){
+    FILE *fp = fopen(path.c_str(), "rb");
+    if (fp == nullptr){
+        perror(path.c_str());
+        return false;
+    }
+    ringcache::trace_header_t header;
+    if (fread(&header, sizeof(header), 1, fp) != 1 || header.magic != TRACE_MAGIC || header.version != TRACE_VERSION
+        || header.record_size != sizeof(ringcache::trace_record_t)){
+        fprintf(stderr, "%s: not a ringcache trace or version mismatch\n", path.c_str());
+        fclose(fp);
+        return false;
+    }
+    ringcache::trace_chunk_header_t chunk;
+    while (fread(&chunk, sizeof(chunk), 1, fp) == 1){
+        size_t old = records.size();
+        records.resize(old + chunk.num);
+        if (fread(&records[old], sizeof(ringcache::trace_record_t), chunk.num, fp) != chunk.num){
+            //最后一块没写完（比如录制时进程被杀了），丢掉
+            records.resize(old);
+            break;
+        }
+    }
+    fclose(fp);
+    std::stable_sort(records.begin(), records.end(), [](const ringcache::trace_record_t &a, const ringcache::trace_record_t &b){
+        return a.ts_ms < b.ts_ms;
+    });
+    return true;
+}
+
+/**
+ * 由hash和长度还原出key：hash的16进制再补足长度，不足8字节的按8字节
+ */
+static uint32_t make_key(char *buf, const ringcache::trace_record_t &r){
+    uint32_t len = snprintf(buf, 16, "%08x", r.key_hash);
+    uint32_t want = std::min< uint32_t >(r.key_len, MAX_KEY_SIZE - 1);
+    while (len < want){
+        buf[len] = 'a' + (r.key_hash + len) % 26;
+        len++;
+    }
+    return len;
+}
+
+typedef struct _replay_result_t{
+    uint64_t op_num[4];
+    uint64_t hit_num;
+    uint64_t trace_hit_num;
+    uint64_t fail_num;
+    uint64_t max_lag_ms;
+    std::vector< uint64_t > lat[4];
+    uint64_t lat_sum[4];
+} replay_result_t;
+
+static ringcache::latency_stats_t merge_latency(const std::vector< replay_result_t > &results, uint32_t op){
+    ringcache::latency_stats_t s;
+    s.buckets.assign(ringcache::latency_buckets::NUM, 0);
+    s.count = s.sum_ns = 0;
+    for (auto &r:results){
+        for (uint32_t i = 0; i < ringcache::latency_buckets::NUM; i++){
+            s.buckets[i] += r.lat[op][i];
+            s.count += r.lat[op][i];
+        }
+        s.sum_ns += r.lat_sum[op];
+    }
+    return s;
+}
+
+int main(int argc, char **argv){
+    replay_conf_t conf;
+    if (!parse_args(argc, argv, conf)){
+        usage(argv[0]);
+        return 1;
+    }
+    std::vector< ringcache::trace_record_t > records;
+    if (!load_trace(conf.trace, records)){
+        return 1;
+    }
+    FILE *out = conf.out == "-" ? stdout : fopen(conf.out.c_str(), "a");
+    if (out == nullptr){
+        perror(conf.out.c_str());
+        return 1;
+    }
+
+    //每个线程按key分到自己的那一份，先后不变
+    std::vector< std::vector< uint32_t > > parts(conf.threads);
+    uint32_t max_value = 0;
+    for (uint32_t i = 0; i < records.size(); i++){
+        parts[(records[i].key_hash ^ records[i].key_len) % conf.threads].push_back(i);
+        max_value = std::max(max_value, records[i].value_len);
+    }
+    std::string pool(std::min< uint32_t >(max_value, MAX_VALUE_SIZE - 1) + 4096, 'v');
+
+    ringcache::ringcache *cache = new ringcache::ringcache(conf.cache_mb);
+    //等后台线程把buffer都申请好
+    sleep(1);
+
+    //录制开始前就在缓存里的key：第一次出现是一次命中的get，按读到的长度先写进去
+    uint64_t prefill_num = 0;
+    if (conf.prefill){
+        std::unordered_set< uint64_t > seen;
+        char key[MAX_KEY_SIZE + 16];
+        for (auto &r:records){
+            if (!seen.insert((uint64_t) r.key_hash << 16 | r.key_len).second){
+                continue;
+            }
+            if (r.op == ringcache::TRACE_OP_GET && r.result == RINGCACHE_ERRNO_OK){
+                uint32_t vlen = std::min< uint32_t >(r.value_len, MAX_VALUE_SIZE - 1);
+                cache->set(key, make_key(key, r), pool.data() + r.key_hash % 4096, vlen, 0);
+                prefill_num++;
+            }
+        }
+    }
+
+    std::vector< replay_result_t > results(conf.threads);
+    std::vector< std::thread * > threads;
+    auto begin = std::chrono::steady_clock::now();
+    for (uint32_t t = 0; t < conf.threads; t++){
+        threads.push_back(new std::thread([&, t](){
+            replay_result_t &res = results[t];
+            memset(res.op_num, 0, sizeof(res.op_num));
+            memset(res.lat_sum, 0, sizeof(res.lat_sum));
+            res.hit_num = res.trace_hit_num = res.fail_num = res.max_lag_ms = 0;
+            for (uint32_t op = 0; op < 4; op++){
+                res.lat[op].assign(ringcache::latency_buckets::NUM, 0);
+            }
+            char key[MAX_KEY_SIZE + 16];
+            std::string value;
+            value.reserve(pool.size());
+            uint64_t n = 0;
+            for (auto idx:parts[t]){
+                const ringcache::trace_record_t &r = records[idx];
+                //按录制时的节奏：还没到这一条的时间就等，落后了记下最多落后多少
+                if (conf.speed > 0){
+                    auto due = begin + std::chrono::microseconds((uint64_t) (r.ts_ms * 1000 / conf.speed));
+                    auto now = std::chrono::steady_clock::now();
+                    if (due > now){
+                        std::this_thread::sleep_until(due);
+                    }
+                    else{
+                        uint64_t lag = std::chrono::duration_cast< std::chrono::milliseconds >(now - due).count();
+                        res.max_lag_ms = std::max(res.max_lag_ms, lag);
+                    }
+                }
+                uint32_t klen = make_key(key, r);
+                uint32_t op = r.op < 4 ? r.op : 0;
+                bool timed = n++ % conf.lat_sample == 0;
+                uint64_t t0 = timed ? ringcache::latency_now_ns() : 0;
+                if (r.op == ringcache::TRACE_OP_GET){
+                    res.trace_hit_num += r.result == RINGCACHE_ERRNO_OK;
+                    res.hit_num += cache->get(key, klen, value) == RINGCACHE_ERRNO_OK;
+                }
+                else if (r.op == ringcache::TRACE_OP_SET){
+                    uint64_t ttl = r.ttl_ms;
+                    if (ttl > 0 && conf.scale_ttl && conf.speed > 0){
+                        ttl = std::max< uint64_t >(1, ttl / conf.speed);
+                    }
+                    ringcache::expire_t expire = ttl > 0 ? ringcache::expire_t::after_ms(ttl) : ringcache::expire_t(0);
+                    uint32_t vlen = std::min< uint32_t >(r.value_len, MAX_VALUE_SIZE - 1);
+                    res.fail_num += cache->set(key, klen, pool.data() + r.key_hash % 4096, vlen, expire) != RINGCACHE_ERRNO_OK;
+                }
+                else if (r.op == ringcache::TRACE_OP_DEL){
+                    cache->del(key, klen);
+                }
+                else{
+                    continue;
+                }
+                res.op_num[op]++;
+                if (timed){
+                    uint64_t ns = ringcache::latency_now_ns() - t0;
+                    res.lat[op][ringcache::latency_buckets::index_of(ns)]++;
+                    res.lat_sum[op] += ns;
+                }
+            }
+        }));
+    }
+    for (auto it:threads){
+        it->join();
+        delete it;
+    }
+    double elapsed = std::chrono::duration_cast< std::chrono::microseconds >(std::chrono::steady_clock::now() - begin).count() / 1e6;
+
+    uint64_t op_num[4] = {0, 0, 0, 0}, hit_num = 0, trace_hit_num = 0, fail_num = 0, max_lag_ms = 0;
+    for (auto &r:results){
+        for (uint32_t op = 0; op < 4; op++){
+            op_num[op] += r.op_num[op];
+        }
+        hit_num += r.hit_num;
+        trace_hit_num += r.trace_hit_num;
+        fail_num += r.fail_num;
+        max_lag_ms = std::max(max_lag_ms, r.max_lag_ms);
+    }
+    ringcache::latency_stats_t get_lat = merge_latency(results, ringcache::TRACE_OP_GET);
+    ringcache::latency_stats_t set_lat = merge_latency(results, ringcache::TRACE_OP_SET);
+    ringcache::latency_stats_t del_lat = merge_latency(results, ringcache::TRACE_OP_DEL);
+    uint64_t get_num = op_num[ringcache::TRACE_OP_GET];
+    uint64_t ops = get_num + op_num[ringcache::TRACE_OP_SET] + op_num[ringcache::TRACE_OP_DEL];
+    uint32_t trace_ms = records.empty() ? 0 : records.back().ts_ms;
+
+    ringcache::stats_t stats = cache->get_stats();
+    uint64_t evict_num = 0;
+    for (auto &it:stats.buffer_stats){
+        evict_num += it.evict_num;
+    }
+    fprintf(out, "{\"bench\":\"replay\",\"label\":\"%s\",\"trace\":\"%s\",\"cache_mb\":%llu,\"buffer_num\":%u,\"speed\":%.3f,\"threads\":%u,"
+                 "\"records\":%llu,\"prefill_num\":%llu,\"trace_ms\":%u,\"seconds\":%.3f,\"ops\":%llu,\"ops_per_sec\":%.0f,\"max_lag_ms\":%llu,"
+                 "\"get_num\":%llu,\"set_num\":%llu,\"del_num\":%llu,\"fail_num\":%llu,\"hit_ratio\":%.4f,\"trace_hit_ratio\":%.4f,"
+                 "\"get_p50_ns\":%llu,\"get_p99_ns\":%llu,\"get_p999_ns\":%llu,\"set_p50_ns\":%llu,\"set_p99_ns\":%llu,\"set_p999_ns\":%llu,"
+                 "\"del_p99_ns\":%llu,\"items\":%llu,\"evict_num\":%llu,\"get_expired_num\":%llu,\"sweep_num\":%llu}\n",
+            conf.label.c_str(), conf.trace.c_str(), (unsigned long long) conf.cache_mb, (uint32_t) RING_BUFFER_NUM, conf.speed, conf.threads,
+            (unsigned long long) records.size(), (unsigned long long) prefill_num, trace_ms, elapsed, (unsigned long long) ops, ops / elapsed, (unsigned long long) max_lag_ms,
+            (unsigned long long) get_num, (unsigned long long) op_num[ringcache::TRACE_OP_SET], (unsigned long long) op_num[ringcache::TRACE_OP_DEL],
+            (unsigned long long) fail_num, get_num > 0 ? (double) hit_num / get_num : 0, get_num > 0 ? (double) trace_hit_num / get_num : 0,
+            (unsigned long long) get_lat.percentile(0.5), (unsigned long long) get_lat.percentile(0.99), (unsigned long long) get_lat.percentile(0.999),
+            (unsigned long long) set_lat.percentile(0.5), (unsigned long long) set_lat.percentile(0.99), (unsigned long long) set_lat.percentile(0.999),
+            (unsigned long long) del_lat.percentile(0.99), (unsigned long long) stats.item_num(), (unsigned long long) evict_num,
+            (unsigned long long) stats.get_expired_num, (unsigned long long) stats.sweep_num());
+    if (out != stdout){
+        fclose(out);
+    }
+    delete cache;
+    return 0;
+}
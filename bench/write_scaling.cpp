@@ -0,0 +1,90 @@
+/*************************************************************************
+ * File:	write_scaling.cpp
+ * Author:	liuyongshuai<liuyongshuai@hotmail.com>
+ * Time:	2026-10-20 10:40
+ * 写扩展性压测：只有2个buffer，写线程数从1逐步翻倍到max_threads，统计set的总QPS。
+ * 同一份代码编出两个程序：bench_write_scaling是加锁拿空间，
+ * bench_write_scaling_atomic定义了RINGCACHE_ATOMIC_RESERVE，原子预留空间
+ * 用法：./bench_write_scaling [max_threads] [seconds_per_round] [value_size]
+ ************************************************************************/
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <chrono>
+#include <vector>
+
+#define RING_BUFFER_NUM 2
+#include "ringcache/ringcache.h"
+
+//缓存大小，单位MB
+#define BENCH_CACHE_MB 256
+#define BENCH_KEY_NUM 1000000
+
+static std::string bench_key(uint64_t i){
+    return "bench_key_" + std::to_string(i);
+}
+
+/**
+ * 跑一轮，返回总的QPS
+ */
+static double run_round(ringcache::ringcache *cache, uint32_t thread_num, uint32_t seconds, uint32_t value_size){
+    std::atomic< bool > stop(false);
+    std::atomic< uint64_t > total(0);
+    std::vector< std::thread * > threads;
+    for (uint32_t t = 0; t < thread_num; t++){
+        threads.push_back(new std::thread([&, t](){
+            std::string value(value_size, 'v');
+            uint64_t seed = t * 2654435761u + 1;
+            uint64_t ops = 0;
+            while (!stop.load(std::memory_order_relaxed)){
+                seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+                cache->set(bench_key((seed >> 33) % BENCH_KEY_NUM), value, 0);
+                ops++;
+            }
+            total += ops;
+        }));
+    }
+    std::this_thread::sleep_for(std::chrono::seconds(seconds));
+    stop = true;
+    for (auto it:threads){
+        it->join();
+        delete it;
+    }
+    return (double) total.load() / seconds;
+}
+
+int main(int argc, char **argv){
+    uint32_t max_threads = argc > 1 ? atoi(argv[1]) : 16;
+    uint32_t seconds = argc > 2 ? atoi(argv[2]) : 2;
+    uint32_t value_size = argc > 3 ? atoi(argv[3]) : 256;
+    if (max_threads == 0){
+        max_threads = 1;
+    }
+
+    ringcache::ringcache *cache = new ringcache::ringcache(BENCH_CACHE_MB);
+    //等后台线程把buffer都申请好
+    sleep(1);
+#ifdef RINGCACHE_ATOMIC_RESERVE
+    printf("mode=atomic_reserve value_size=%u cpus=%u\n", value_size, std::thread::hardware_concurrency());
+#else
+    printf("mode=buffer_lock value_size=%u cpus=%u\n", value_size, std::thread::hardware_concurrency());
+#endif
+    printf("%-8s %-14s %-10s\n", "threads", "set_qps", "speedup");
+    double base = 0;
+    for (uint32_t n = 1; n <= max_threads; n *= 2){
+        double qps = run_round(cache, n, seconds, value_size);
+        if (base == 0){
+            base = qps;
+        }
+        printf("%-8u %-14.0f %-10.2f\n", n, qps, qps / base);
+    }
+    ringcache::stats_t stats = cache->get_stats();
+    for (auto &it:stats.buffer_stats){
+        printf("buffer%u set_num=%llu evict_num=%llu lock_busy_num=%llu lock_wait_num=%llu reserve_wait_num=%llu\n", it.index,
+               (unsigned long long) it.set_num, (unsigned long long) it.evict_num,
+               (unsigned long long) it.lock_busy_num, (unsigned long long) it.lock_wait_num,
+               (unsigned long long) it.reserve_wait_num);
+    }
+    delete cache;
+    return 0;
+}
@@ -0,0 +1,623 @@
+/*************************************************************************
+ * File:	bucket_index.h
+ * Author:	liuyongshuai<liuyongshuai@hotmail.com>
+ * Time:	2026-10-18 14:10
+ ************************************************************************/
+#ifndef _RINGCACHE_BUCKET_INDEX_H_202610181410_
+#define _RINGCACHE_BUCKET_INDEX_H_202610181410_
+
+#include "entry.h"
+#include <iostream>
+#include <chrono>
+#include <math.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+//每个bucket的槽位数，8个16位的tag正好一条SSE2指令比较完
+#define BUCKET_SLOT_NUM 8
+
+//每8个相邻的bucket一组，溢出时只在组内往后找，一组共用一把锁
+#define BUCKET_GROUP_POWER 3
+#define BUCKET_GROUP_SIZE (1<<BUCKET_GROUP_POWER)
+
+//bucket数量的下限，保证组数不少于锁的个数，扩容前后同一组用的是同一把锁
+#define BUCKET_POWER_MIN (HASHTABLE_LOCK_POWER+BUCKET_GROUP_POWER)
+
+namespace ringcache{
+    /**
+     * 一个bucket正好一个cache line：8个tag、8个entry位置编码，以及溢出计数
+     */
+    typedef struct alignas(CACHE_LINE_SIZE) _index_bucket_t{
+        /**
+         * hash的指纹，0表示空槽位
+         */
+        uint16_t tags[BUCKET_SLOT_NUM];
+
+        /**
+         * entry的位置编码，见entry_locator_t
+         */
+        uint32_t locs[BUCKET_SLOT_NUM];
+
+        /**
+         * 路过本bucket溢出到组内后面bucket的数据个数，为0时查找到此为止
+         */
+        uint32_t overflow;
+    } index_bucket_t;
+
+    /**
+     * 一张表，自带hash_power（bucket个数的幂）
+     */
+    typedef struct _bucket_table_t{
+        uint8_t hash_power;
+        index_bucket_t *buckets;
+    } bucket_table_t;
+
+    /**
+     * 分桶的开放寻址索引：
+     * 查找时先用一条SIMD指令比较整个bucket的tag，tag对上了才去环形缓冲区里读entry，
+     * 所以未命中的查找基本只碰索引自己的一个cache line
+     * 除find外的操作都要求调用方持有lock(hash_val)
+     */
+    class bucket_index{
+    public:
+        /**
+         * expect_item_num：预估的数据量；numa_node>=0时bucket数组绑到该节点上
+         */
+        explicit bucket_index(uint64_t expect_item_num, const entry_locator_t *locator, int32_t numa_node = -1){
+            this->locator = locator;
+            this->numa_node = numa_node;
+            this->unlink_cb = nullptr;
+            this->unlink_ctx = nullptr;
+            //按75%的装载率预估bucket个数
+            uint64_t bucket_num = expect_item_num * 4 / 3 / BUCKET_SLOT_NUM + 1;
+            uint8_t init_hash_power = ceil(log((double) bucket_num) / log(2.0));
+            if (init_hash_power < BUCKET_POWER_MIN){
+                init_hash_power = BUCKET_POWER_MIN;
+            }
+            if (init_hash_power > HASH_POWER_MAX - BUCKET_GROUP_POWER){
+                init_hash_power = HASH_POWER_MAX - BUCKET_GROUP_POWER;
+            }
+            this->hash_power = init_hash_power;
+            this->primary_table = this->alloc_table(init_hash_power);
+            this->secondary_table = nullptr;
+            this->is_table_expanding = false;
+            this->is_table_full = false;
+            this->expanding_group = 0;
+            this->drop_num = 0;
+            this->need_resize = false;
+            this->group_full = false;
+            this->resize_num = 0;
+            this->last_resize_us = 0;
+            this->stripe_threshold = RESIZE_STRIPE_THRESHOLD(this->capacity());
+            this->table_locks = index_lock_t::alloc(HASH_SIZE(HASHTABLE_LOCK_POWER));
+        }
+
+        ~bucket_index(){
+            this->free_table(this->primary_table.load());
+            this->free_table(this->secondary_table.load());
+            this->retired.release(this->retired.size);
+            index_lock_t::release(this->table_locks, HASH_SIZE(HASHTABLE_LOCK_POWER));
+        }
+
+        /**
+         * 无锁查找，调用方必须处于epoch读临界区内。
+         * 同key覆盖时先摘旧的再放新的，没找到时要用本段的改动序号确认一遍，命中的路径不碰锁所在的cache line
+         */
+        entry_t *find(const char *key, uint32_t klen, uint32_t hash_val){
+            entry_t *entry = this->find_in_group(key, klen, hash_val);
+            if (entry != nullptr){
+                return entry;
+            }
+            const index_lock_t *lock = this->get_lock(hash_val);
+            while (true){
+                uint32_t seq = lock->read_begin();
+                entry = this->find_in_group(key, klen, hash_val);
+                if (entry != nullptr || !lock->read_retry(seq)){
+                    return entry;
+                }
+            }
+        }
+
+        /**
+         * 批量操作时先预取home bucket，调用方必须处于epoch读临界区内
+         */
+        void prefetch(uint32_t hash_val){
+            uint32_t bucket;
+            bucket_table_t *table = this->get_table(hash_val, bucket);
+            __builtin_prefetch(&table->buckets[bucket]);
+        }
+
+        /**
+         * bucket已经预取过了，再预取home bucket里tag对得上的entry
+         */
+        void prefetch_entry(uint32_t hash_val){
+            uint32_t bucket;
+            bucket_table_t *table = this->get_table(hash_val, bucket);
+            index_bucket_t *b = &table->buckets[bucket];
+            uint32_t mask = match_tags(b->tags, make_tag(hash_val));
+            while (mask != 0){
+                uint32_t slot = __builtin_ctz(mask) >> 1;
+                mask &= mask - 1;
+                __builtin_prefetch(this->locator->entry(__atomic_load_n(&b->locs[slot], __ATOMIC_ACQUIRE)));
+            }
+        }
+
+        /**
+         * 挂上新数据，之前已经有相同的key了直接清理了
+         * 整组都满了的话挤掉home bucket里的一个，对缓存来说丢一个数据可以接受
+         */
+        void insert(entry_t *entry, uint32_t loc){
+            uint32_t hash_val = entry->hash_val;
+            //摘掉旧数据到放上新数据之间读线程找不到这个key，标记一下让它重查
+            index_lock_t *lock = this->get_lock(hash_val);
+            lock->write_begin();
+            this->unlink_key(entry->data, entry->key_len, hash_val);
+
+            uint32_t bucket;
+            bucket_table_t *table = this->get_table(hash_val, bucket);
+            if (!this->insert_without_lock(table, bucket, make_tag(hash_val), loc)){
+                //挤掉的数据可能是从组内前面的bucket溢出过来的，要按它自己的home bucket把溢出计数减回来
+                uint32_t slot = (hash_val >> 8) % BUCKET_SLOT_NUM;
+                entry_t *victim = this->locator->entry(table->buckets[bucket].locs[slot]);
+                uint32_t victim_bucket = victim->hash_val & HASH_MASK(table->hash_power);
+                uint32_t step = (bucket - victim_bucket) & (BUCKET_GROUP_SIZE - 1);
+                this->unlink_without_lock(table, victim_bucket, step, slot);
+                this->insert_without_lock(table, bucket, make_tag(hash_val), loc);
+                this->drop_num++;
+                //还没到75%就有组满了，也提前扩容
+                if (!this->is_table_expanding && !this->is_table_full){
+                    this->group_full = true;
+                    this->need_resize = true;
+                }
+            }
+            lock->write_end();
+
+            //本段的数据量超过了平均值才去算总数，超过75%了就标记要扩容，下一次expand_step开始迁移
+            owner_add(lock->item_num, 1);
+            if (lock->item_num.load(std::memory_order_relaxed) > this->stripe_threshold && !this->need_resize && !this->is_table_expanding && this->need_expand()){
+                this->need_resize = true;
+            }
+        }
+
+        /**
+         * 按key删除
+         */
+        bool remove(const char *key, uint32_t klen, uint32_t hash_val){
+            return this->unlink_key(key, klen, hash_val) > 0;
+        }
+
+        /**
+         * 淘汰指定的entry，按位置编码精确匹配，不会误删同key后来写入的新数据
+         */
+        bool remove_entry(entry_t *entry, uint32_t loc){
+            uint32_t hash_val = entry->hash_val;
+            uint32_t bucket;
+            bucket_table_t *table = this->get_table(hash_val, bucket);
+            uint16_t tag = make_tag(hash_val);
+            for (uint32_t i = 0; i < BUCKET_GROUP_SIZE; i++){
+                index_bucket_t *b = &table->buckets[group_next(bucket, i)];
+                uint32_t mask = match_tags(b->tags, tag);
+                while (mask != 0){
+                    uint32_t slot = __builtin_ctz(mask) >> 1;
+                    mask &= mask - 1;
+                    if (b->locs[slot] == loc){
+                        this->unlink_without_lock(table, bucket, i, slot);
+                        return true;
+                    }
+                }
+                if (b->overflow == 0){
+                    break;
+                }
+            }
+            entry->mark_unlinked(epoch_domain::instance().unlink_stamp());
+            return false;
+        }
+
+        /**
+         * 获取锁，按组分段，扩容前后同一组的数据用的是同一把锁
+         */
+        std::mutex *lock(uint32_t hash_val){
+            return &this->get_lock(hash_val)->mtx;
+        }
+
+        /**
+         * 设置摘链时的回调，见unlink_callback_t
+         */
+        void on_unlink(unlink_callback_t cb, void *ctx){
+            this->unlink_cb = cb;
+            this->unlink_ctx = ctx;
+        }
+
+        /**
+         * 当前的数据个数
+         */
+        uint64_t size() const{
+            uint64_t ret = 0;
+            for (uint32_t i = 0; i < HASH_SIZE(HASHTABLE_LOCK_POWER); i++){
+                ret += this->table_locks[i].item_num.load(std::memory_order_relaxed);
+            }
+            return ret;
+        }
+
+        /**
+         * 当前的容量（槽位数）
+         */
+        uint64_t capacity() const{
+            return ((uint64_t) 1 << this->hash_power) * BUCKET_SLOT_NUM;
+        }
+
+        /**
+         * 装载率超过75%时开始扩容
+         */
+        bool need_expand() const{
+            return !this->is_table_full && (this->capacity() / 4) * 3 < this->size();
+        }
+
+        bool is_full() const{
+            return this->is_table_full;
+        }
+
+        /**
+         * 组满了被挤掉的数据个数
+         */
+        uint64_t dropped() const{
+            return this->drop_num;
+        }
+
+        /**
+         * 扩容时已迁移的bucket个数及总的bucket个数，没在扩容时都是0
+         */
+        void resize_progress(uint64_t &done, uint64_t &total) const{
+            bucket_table_t *secondary = this->secondary_table.load();
+            done = secondary == nullptr ? 0 : (uint64_t) this->expanding_group.load() << BUCKET_GROUP_POWER;
+            total = secondary == nullptr ? 0 : HASH_SIZE(secondary->hash_power);
+        }
+
+        /**
+         * 完成的扩容次数
+         */
+        uint64_t resize_count() const{
+            return this->resize_num;
+        }
+
+        /**
+         * 上一次扩容从开始到迁移完的耗时，单位微秒
+         */
+        uint64_t last_resize_cost() const{
+            return this->last_resize_us;
+        }
+
+        /**
+         * 渐进式扩容，和chained_index一样由set/del在释放锁之后调用，每次按组迁移，
+         * 一组BUCKET_GROUP_SIZE个bucket，迁移的bucket数不少于RESIZE_MIGRATE_STEP
+         */
+        void expand_step(){
+            if (!this->need_resize.load(std::memory_order_relaxed) && !this->is_table_expanding.load(std::memory_order_relaxed)
+                && this->retired.size.load(std::memory_order_relaxed) == 0){
+                return;
+            }
+            std::unique_lock< std::mutex > resize_lock(this->resize_mtx, std::try_to_lock);
+            if (!resize_lock.owns_lock()){
+                return;
+            }
+            if (!this->need_resize && !this->is_table_expanding){
+                this->retired.release(RESIZE_RELEASE_STEP);
+                return;
+            }
+            if (!this->is_table_expanding && !this->expand_begin()){
+                return;
+            }
+            this->migrate((RESIZE_MIGRATE_STEP + BUCKET_GROUP_SIZE - 1) >> BUCKET_GROUP_POWER);
+        }
+
+    private:
+        /**
+         * 开始扩容：和chained_index一样先发布旧表再发布新表，expanding_group之前的组已迁移到新表
+         */
+        bool expand_begin(){
+            //need_resize可能是上一次扩容刚开始时按旧容量算出来的，按现在的容量再确认一遍；
+            //组满了触发的，装载率过半才扩
+            this->need_resize = false;
+            bool group_full = this->group_full.exchange(false);
+            if (!this->need_expand() && !(group_full && this->size() > this->capacity() / 2)){
+                return false;
+            }
+            uint8_t new_hash_power = this->hash_power + 1;
+            if (new_hash_power + BUCKET_GROUP_POWER > HASH_POWER_MAX){
+                this->is_table_full = true;
+                return false;
+            }
+            bucket_table_t *new_table = this->alloc_table(new_hash_power);
+            if (new_table == nullptr){
+                return false;
+            }
+            std::cout << "[expand_hash_table]start expand bucket_index, capacity=" << this->capacity() << "\tcur_item_num=" << this->size() << std::endl;
+            this->resize_begin_time = std::chrono::steady_clock::now();
+            this->expanding_group = 0;
+            this->secondary_table = this->primary_table.load();
+            this->primary_table = new_table;
+            this->hash_power = new_hash_power;
+            this->stripe_threshold = RESIZE_STRIPE_THRESHOLD(this->capacity());
+            this->is_table_expanding = true;
+            return true;
+        }
+
+        /**
+         * 迁移最多num个旧组，旧组g的数据只会落到新表的g和g+旧组数这两个组里，用的是同一把锁，
+         * 全部迁移完了结束扩容
+         */
+        void migrate(uint32_t num){
+            bucket_table_t *old_table = this->secondary_table.load();
+            bucket_table_t *new_table = this->primary_table.load();
+            uint32_t old_group_num = HASH_SIZE(old_table->hash_power - BUCKET_GROUP_POWER);
+            uint32_t g = this->expanding_group.load();
+            for (uint32_t end = std::min(g + num, old_group_num); g < end; g++){
+                std::lock_guard< std::mutex > group_lock(this->table_locks[g & HASH_MASK(HASHTABLE_LOCK_POWER)].mtx);
+                for (uint32_t i = 0; i < BUCKET_GROUP_SIZE; i++){
+                    index_bucket_t *b = &old_table->buckets[(g << BUCKET_GROUP_POWER) + i];
+                    for (uint32_t slot = 0; slot < BUCKET_SLOT_NUM; slot++){
+                        if (b->tags[slot] == 0){
+                            continue;
+                        }
+                        entry_t *entry = this->locator->entry(b->locs[slot]);
+                        uint32_t hash_val = entry->hash_val;
+                        //新表的组也满了（极少见），只能丢掉
+                        if (!this->insert_without_lock(new_table, hash_val & HASH_MASK(new_table->hash_power), b->tags[slot], b->locs[slot])){
+                            if (this->unlink_cb != nullptr){
+                                this->unlink_cb(this->unlink_ctx, entry);
+                            }
+                            entry->mark_unlinked(epoch_domain::instance().unlink_stamp());
+                            owner_add(this->get_lock(hash_val)->item_num, (uint64_t) -1);
+                            this->drop_num++;
+                        }
+                    }
+                }
+                this->expanding_group = g + 1;
+            }
+            if (g < old_group_num){
+                return;
+            }
+
+            //迁移完毕，之后拿到锁的写线程都只会看到新表
+            this->secondary_table = nullptr;
+            this->is_table_expanding = false;
+
+            //拿一遍所有的锁，等之前拿着锁、可能还在用旧表的写线程离开；读线程用epoch等
+            for (uint32_t n = 0; n < HASH_SIZE(HASHTABLE_LOCK_POWER); n++){
+                std::lock_guard< std::mutex > lock(this->table_locks[n].mtx);
+            }
+            epoch_domain::instance().synchronize();
+            this->retired.retire(old_table->buckets, table_bytes(old_table->hash_power));
+            delete old_table;
+            this->resize_num++;
+            this->last_resize_us = std::chrono::duration_cast< std::chrono::microseconds >(std::chrono::steady_clock::now() - this->resize_begin_time).count();
+            std::cout << "[expand_hash_table]finish expand bucket_index, hash_power=" << (uint32_t) new_table->hash_power << "\tcost=" << (this->last_resize_us / 1000) << "ms" << std::endl;
+        }
+
+        /**
+         * tag取hash乘法散列后的高16位，和bucket编号用的低位无关；0留给空槽位
+         */
+        static uint16_t make_tag(uint32_t hash_val){
+            uint16_t tag = (uint16_t) ((hash_val * 0x9E3779B1u) >> 16);
+            return tag == 0 ? 1 : tag;
+        }
+
+        /**
+         * 组内第i个要探测的bucket，到组尾了绕回组头
+         */
+        static uint32_t group_next(uint32_t bucket, uint32_t i){
+            return (bucket & ~(uint32_t) (BUCKET_GROUP_SIZE - 1)) | ((bucket + i) & (BUCKET_GROUP_SIZE - 1));
+        }
+
+        /**
+         * 比较一个bucket的全部tag，返回的掩码里第2*slot位为1表示该槽位匹配
+         */
+        static uint32_t match_tags(const uint16_t *tags, uint16_t tag){
+#ifdef __SSE2__
+            __m128i all = _mm_load_si128((const __m128i *) tags);
+            __m128i cmp = _mm_cmpeq_epi16(all, _mm_set1_epi16((short) tag));
+            //load之后的读不能被编译器提到前面去
+            __asm__ __volatile__("":: : "memory");
+            return (uint32_t) _mm_movemask_epi8(cmp) & 0x5555;
+#else
+            uint32_t mask = 0;
+            for (uint32_t i = 0; i < BUCKET_SLOT_NUM; i++){
+                if (__atomic_load_n(&tags[i], __ATOMIC_ACQUIRE) == tag){
+                    mask |= (uint32_t) 1 << (i * 2);
+                }
+            }
+            return mask;
+#endif
+        }
+
+        /**
+         * 在组内找一个空槽位放进去，路过的满bucket溢出计数加一；整组都满了返回false
+         */
+        bool insert_without_lock(bucket_table_t *table, uint32_t bucket, uint16_t tag, uint32_t loc){
+            for (uint32_t i = 0; i < BUCKET_GROUP_SIZE; i++){
+                index_bucket_t *b = &table->buckets[group_next(bucket, i)];
+                uint32_t mask = match_tags(b->tags, 0);
+                if (mask == 0){
+                    continue;
+                }
+                uint32_t slot = __builtin_ctz(mask) >> 1;
+                //先写位置再写tag，读线程看到tag时位置一定是新的
+                __atomic_store_n(&b->locs[slot], loc, __ATOMIC_RELAXED);
+                __atomic_store_n(&b->tags[slot], tag, __ATOMIC_RELEASE);
+                for (uint32_t j = 0; j < i; j++){
+                    index_bucket_t *pass = &table->buckets[group_next(bucket, j)];
+                    __atomic_store_n(&pass->overflow, pass->overflow + 1, __ATOMIC_RELEASE);
+                }
+                return true;
+            }
+            return false;
+        }
+
+        /**
+         * 摘掉这个key的全部数据
+         */
+        uint32_t unlink_key(const char *key, uint32_t klen, uint32_t hash_val){
+            uint32_t ret = 0;
+            uint32_t bucket;
+            bucket_table_t *table = this->get_table(hash_val, bucket);
+            uint16_t tag = make_tag(hash_val);
+            for (uint32_t i = 0; i < BUCKET_GROUP_SIZE; i++){
+                index_bucket_t *b = &table->buckets[group_next(bucket, i)];
+                uint32_t mask = match_tags(b->tags, tag);
+                uint32_t overflow = b->overflow;
+                while (mask != 0){
+                    uint32_t slot = __builtin_ctz(mask) >> 1;
+                    mask &= mask - 1;
+                    if (this->locator->entry(b->locs[slot])->match(key, klen, hash_val)){
+                        this->unlink_without_lock(table, bucket, i, slot);
+                        ret++;
+                    }
+                }
+                if (overflow == 0){
+                    break;
+                }
+            }
+            return ret;
+        }
+
+        /**
+         * 清掉home bucket往后第step个bucket里的slot，并把路过的bucket的溢出计数减回来
+         * 摘掉后读线程可能还在读它，所以只置删除标志，内存等环形缓冲区覆盖时再回收
+         */
+        void unlink_without_lock(bucket_table_t *table, uint32_t bucket, uint32_t step, uint32_t slot){
+            index_bucket_t *b = &table->buckets[group_next(bucket, step)];
+            entry_t *entry = this->locator->entry(b->locs[slot]);
+            __atomic_store_n(&b->tags[slot], (uint16_t) 0, __ATOMIC_RELEASE);
+            for (uint32_t j = 0; j < step; j++){
+                index_bucket_t *pass = &table->buckets[group_next(bucket, j)];
+                __atomic_store_n(&pass->overflow, pass->overflow - 1, __ATOMIC_RELEASE);
+            }
+            if (this->unlink_cb != nullptr){
+                this->unlink_cb(this->unlink_ctx, entry);
+            }
+            entry->mark_unlinked(epoch_domain::instance().unlink_stamp());
+            owner_add(this->get_lock(entry->hash_val)->item_num, (uint64_t) -1);
+        }
+
+        index_lock_t *get_lock(uint32_t hash_val){
+            return &this->table_locks[(hash_val >> BUCKET_GROUP_POWER) & HASH_MASK(HASHTABLE_LOCK_POWER)];
+        }
+
+        /**
+         * 在hash_val所在的组里找key
+         */
+        entry_t *find_in_group(const char *key, uint32_t klen, uint32_t hash_val){
+            uint32_t bucket;
+            bucket_table_t *table = this->get_table(hash_val, bucket);
+            uint16_t tag = make_tag(hash_val);
+            for (uint32_t i = 0; i < BUCKET_GROUP_SIZE; i++){
+                index_bucket_t *b = &table->buckets[group_next(bucket, i)];
+                uint32_t mask = match_tags(b->tags, tag);
+                while (mask != 0){
+                    uint32_t slot = __builtin_ctz(mask) >> 1;
+                    mask &= mask - 1;
+                    entry_t *entry = this->locator->entry(__atomic_load_n(&b->locs[slot], __ATOMIC_ACQUIRE));
+                    if (entry->match(key, klen, hash_val)){
+                        return entry;
+                    }
+                }
+                if (__atomic_load_n(&b->overflow, __ATOMIC_ACQUIRE) == 0){
+                    break;
+                }
+            }
+            return nullptr;
+        }
+
+        /**
+         * 获取要操作的表及home bucket，需要考虑是否在扩容
+         * 扩容时先发布secondary再发布primary，所以这里先读primary再读secondary，primary变了重读，见chained_index
+         */
+        bucket_table_t *get_table(uint32_t hash_val, uint32_t &bucket){
+            bucket_table_t *primary;
+            bucket_table_t *secondary;
+            do{
+                primary = this->primary_table.load();
+                secondary = this->secondary_table.load();
+            } while (primary != this->primary_table.load());
+            if (secondary != nullptr){
+                uint32_t old_bucket = hash_val & HASH_MASK(secondary->hash_power);
+                if ((old_bucket >> BUCKET_GROUP_POWER) >= this->expanding_group.load()){
+                    bucket = old_bucket;
+                    return secondary;
+                }
+            }
+            bucket = hash_val & HASH_MASK(primary->hash_power);
+            return primary;
+        }
+
+        static uint64_t table_bytes(uint8_t power){
+            return ((uint64_t) 1 << power) * sizeof(index_bucket_t);
+        }
+
+        /**
+         * bucket数组是mmap出来的，页对齐，页面在迁移时才真正分配，开始扩容的那一次set不会因为清零整张新表而卡住
+         */
+        bucket_table_t *alloc_table(uint8_t power){
+            bucket_table_t *table = new bucket_table_t();
+            table->hash_power = power;
+            table->buckets = (index_bucket_t *) index_table_alloc(table_bytes(power), this->numa_node);
+            if (table->buckets == nullptr){
+                delete table;
+                return nullptr;
+            }
+            return table;
+        }
+
+        void free_table(bucket_table_t *table){
+            if (table == nullptr){
+                return;
+            }
+            index_table_free(table->buckets, table_bytes(table->hash_power));
+            delete table;
+        }
+
+        const entry_locator_t *locator;
+
+        /**
+         * 摘链时的回调
+         */
+        unlink_callback_t unlink_cb;
+        void *unlink_ctx;
+
+        /**
+         * bucket数组绑定的NUMA节点，不绑定为-1
+         */
+        int32_t numa_node;
+
+        /**
+         * 新旧两张表
+         */
+        std::atomic< bucket_table_t * > primary_table;
+        std::atomic< bucket_table_t * > secondary_table;
+
+        /**
+         * 分段锁
+         */
+        index_lock_t *table_locks;
+
+        std::atomic< uint8_t > hash_power;
+        std::atomic< bool > is_table_full;
+        std::atomic< bool > is_table_expanding;
+        std::atomic< uint32_t > expanding_group;
+        std::atomic< uint64_t > drop_num;
+        std::atomic< bool > need_resize;
+        std::atomic< bool > group_full;
+
+        /**
+         * 扩容相关：迁移锁、单段数据量的阈值、次数及耗时
+         */
+        std::mutex resize_mtx;
+        std::atomic< uint64_t > stripe_threshold;
+        std::chrono::steady_clock::time_point resize_begin_time;
+        std::atomic< uint64_t > resize_num;
+        std::atomic< uint64_t > last_resize_us;
+        retired_table_t retired;
+    };
+}
+#endif //_RINGCACHE_BUCKET_INDEX_H_202610181410_
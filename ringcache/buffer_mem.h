@@ -0,0 +1,171 @@
+/*************************************************************************
+ * File:	buffer_mem.h
+ * Author:	liuyongshuai<liuyongshuai@hotmail.com>
+ * Time:	2026-10-20 15:30
+ * 环形缓冲区内存的申请：calloc，或者mmap + 大页，可选按NUMA节点绑定
+ ************************************************************************/
+#ifndef _RINGCACHE_BUFFER_MEM_H_202610201530_
+#define _RINGCACHE_BUFFER_MEM_H_202610201530_
+
+#include "entry.h"
+#include "numa.h"
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <iostream>
+
+//环形缓冲区内存的申请方式
+#define RING_PAGE_DEFAULT 0
+#define RING_PAGE_THP 1
+#define RING_PAGE_HUGETLB 2
+//load()时直接mmap快照文件，只用于统计信息
+#define RING_PAGE_FILE 3
+#ifndef RING_BUFFER_PAGE
+#define RING_BUFFER_PAGE RING_PAGE_DEFAULT
+#endif
+
+#define HUGE_PAGE_SIZE (2*MB)
+#define SMALL_PAGE_SIZE (4*KB)
+
+namespace ringcache{
+    /**
+     * 一个缓冲区实际拿到的内存
+     */
+    typedef struct _buffer_mem_t{
+        char *mem;
+
+        /**
+         * mmap出来的总长度，包括尾部的保护页，calloc时为0
+         */
+        uint64_t map_size;
+
+        /**
+         * 实际用的申请方式，MAP_HUGETLB失败时会退回RING_PAGE_THP
+         */
+        uint32_t page_mode;
+
+        /**
+         * 绑定的NUMA节点，没绑定为-1
+         */
+        int32_t numa_node;
+    } buffer_mem_t;
+
+    /**
+     * 申请一个缓冲区的内存，node>=0时绑定到该NUMA节点
+     * mmap的方式按2MB对齐，尾部留一段不可访问的保护页，相邻的缓冲区不会被内核合并成一个映射，
+     * 这样每个缓冲区有多少大页可以从/proc/self/smaps里单独查出来。
+     * 绑定节点后再逐页写一遍，让内存在这个时候就按策略分配好，而不是等写入时才零散地分配
+     */
+    inline bool buffer_mem_alloc(uint64_t size, int32_t node, buffer_mem_t &m){
+        m.mem = nullptr;
+        m.map_size = 0;
+        m.page_mode = RING_BUFFER_PAGE;
+        m.numa_node = -1;
+        if (m.page_mode == RING_PAGE_DEFAULT){
+            m.mem = (char *) calloc(size, sizeof(char));
+            //calloc出来的大块是单独mmap的，还没分配页，绑上之后写到哪页就在节点上分配哪页
+            if (m.mem != nullptr && node >= 0 && numa_bind_memory(m.mem, size, node)){
+                m.numa_node = node;
+            }
+            return m.mem != nullptr;
+        }
+
+        char *ptr = (char *) MAP_FAILED;
+        uint64_t map_size = 0;
+        if (m.page_mode == RING_PAGE_HUGETLB){
+            map_size = (size + HUGE_PAGE_SIZE - 1) & ~((uint64_t) HUGE_PAGE_SIZE - 1);
+            ptr = (char *) mmap(nullptr, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            //预留的大页（/proc/sys/vm/nr_hugepages）不够时直接失败，不会等到写的时候才SIGBUS
+            if (ptr == MAP_FAILED){
+                std::cout << "[buffer_mem_alloc]MAP_HUGETLB failed, fall back to transparent huge pages" << std::endl;
+                m.page_mode = RING_PAGE_THP;
+            }
+        }
+        if (m.page_mode == RING_PAGE_THP){
+            uint64_t raw_size = size + HUGE_PAGE_SIZE;
+            char *raw = (char *) mmap(nullptr, raw_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (raw == MAP_FAILED){
+                return false;
+            }
+            uint64_t head = (HUGE_PAGE_SIZE - ((uintptr_t) raw & (HUGE_PAGE_SIZE - 1))) & (HUGE_PAGE_SIZE - 1);
+            if (head > 0){
+                munmap(raw, head);
+            }
+            ptr = raw + head;
+            map_size = raw_size - head;
+            uint64_t guard = (size + SMALL_PAGE_SIZE - 1) & ~((uint64_t) SMALL_PAGE_SIZE - 1);
+            mprotect(ptr + guard, map_size - guard, PROT_NONE);
+            madvise(ptr, size, MADV_HUGEPAGE);
+        }
+        if (ptr == MAP_FAILED){
+            return false;
+        }
+
+        if (node >= 0){
+            if (numa_bind_memory(ptr, size, node)){
+                m.numa_node = node;
+            }
+            else{
+                std::cout << "[buffer_mem_alloc]mbind to node " << node << " failed" << std::endl;
+            }
+        }
+        for (uint64_t off = 0; off < size; off += SMALL_PAGE_SIZE){
+            ptr[off] = 0;
+        }
+        m.mem = ptr;
+        m.map_size = map_size;
+        return true;
+    }
+
+    inline void buffer_mem_free(char *mem, uint64_t map_size){
+        if (map_size > 0){
+            munmap(mem, map_size);
+        }
+        else{
+            free(mem);
+        }
+    }
+
+    /**
+     * 从/proc/self/smaps里统计每段内存实际落在大页上的字节数，
+     * 透明大页看AnonHugePages，MAP_HUGETLB看Private_Hugetlb/Shared_Hugetlb。
+     * 一个映射只覆盖了一部分时按比例算，calloc出来的内存可能和别的映射合并了，只是个估计
+     */
+    inline void smaps_huge_bytes(const std::vector< const char * > &begins, uint64_t size, std::vector< uint64_t > &huge){
+        huge.assign(begins.size(), 0);
+        FILE *fp = fopen("/proc/self/smaps", "r");
+        if (fp == nullptr){
+            return;
+        }
+        char line[512];
+        uintptr_t start = 0, end = 0;
+        while (fgets(line, sizeof(line), fp) != nullptr){
+            unsigned long a, b;
+            unsigned long kb;
+            char name[64];
+            //映射的头一行："起始-结束 权限 ..."，其余是"字段: 值 kB"
+            if (sscanf(line, "%lx-%lx ", &a, &b) == 2){
+                start = a;
+                end = b;
+                continue;
+            }
+            if (sscanf(line, "%63[A-Za-z_]: %lu kB", name, &kb) != 2 || kb == 0){
+                continue;
+            }
+            if (strcmp(name, "AnonHugePages") != 0 && strcmp(name, "Private_Hugetlb") != 0 && strcmp(name, "Shared_Hugetlb") != 0){
+                continue;
+            }
+            for (size_t i = 0; i < begins.size(); i++){
+                uintptr_t lo = (uintptr_t) begins[i], hi = lo + size;
+                lo = lo > start ? lo : start;
+                hi = hi < end ? hi : end;
+                if (lo < hi){
+                    huge[i] += (uint64_t) ((double) kb * KB * (hi - lo) / (end - start));
+                }
+            }
+        }
+        fclose(fp);
+    }
+}
+#endif //_RINGCACHE_BUFFER_MEM_H_202610201530_
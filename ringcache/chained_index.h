@@ -0,0 +1,512 @@
+/*************************************************************************
+ * File:	chained_index.h
+ * Author:	liuyongshuai<liuyongshuai@hotmail.com>
+ * Time:	2026-10-18 09:40
+ ************************************************************************/
+#ifndef _RINGCACHE_CHAINED_INDEX_H_202610180940_
+#define _RINGCACHE_CHAINED_INDEX_H_202610180940_
+
+#include "entry.h"
+#include <iostream>
+#include <chrono>
+#include <math.h>
+
+namespace ringcache{
+    /**
+     * hash表，自带hash_power，扩容时新旧两张表可以各自算bucket
+     */
+    typedef struct _hashtable_t{
+        /**
+         * 当前表的容量
+         */
+        uint8_t hash_power;
+
+        /**
+         * bucket数组，存链表头的位置，见entry_link_t
+         */
+        entry_link_t buckets[];
+    } hashtable_t;
+
+    /**
+     * 数组 + 链表实现的索引，链表通过entry_t::hash_next串在环形缓冲区里
+     * 除find外的操作都要求调用方持有lock(hash_val)
+     */
+    class chained_index{
+    public:
+        /**
+         * expect_item_num：预估的数据量；numa_node>=0时hash表的内存绑到该节点上
+         */
+        explicit chained_index(uint64_t expect_item_num, const entry_locator_t *locator, int32_t numa_node = -1){
+            this->locator = locator;
+            this->numa_node = numa_node;
+            this->unlink_cb = nullptr;
+            this->unlink_ctx = nullptr;
+            //预估初始容量大小
+            uint8_t init_hash_power = HASH_POWER_INIT;
+            size_t entryPower = ceil(log((double) expect_item_num) / log(2.0));
+            if (entryPower > init_hash_power){
+                init_hash_power = entryPower + 1;
+            }
+            if (init_hash_power >= HASH_POWER_MAX){
+                init_hash_power = HASH_POWER_MAX;
+            }
+            this->hash_power = init_hash_power;
+            this->primary_hashtable = this->alloc_hashtable(init_hash_power);
+            this->secondary_hashtable = nullptr;
+            this->is_hashtable_expanding = false;
+            this->is_hashtable_full = false;
+            this->hashtable_expanding_index = 0;
+            this->need_resize = false;
+            this->resize_num = 0;
+            this->last_resize_us = 0;
+            this->stripe_threshold = RESIZE_STRIPE_THRESHOLD(this->capacity());
+            this->hashtable_locks = index_lock_t::alloc(HASH_SIZE(HASHTABLE_LOCK_POWER));
+        }
+
+        ~chained_index(){
+            this->free_hashtable(this->primary_hashtable.load());
+            this->free_hashtable(this->secondary_hashtable.load());
+            this->retired.release(this->retired.size);
+            index_lock_t::release(this->hashtable_locks, HASH_SIZE(HASHTABLE_LOCK_POWER));
+        }
+
+        /**
+         * 无锁查找，调用方必须处于epoch读临界区内。
+         * 迁移时entry是原地挪到新表的，站在被挪走节点上的读线程会顺着它走到新链表、漏掉旧链表后面的节点，
+         * 所以没找到时要用本段的改动序号确认一遍，命中的路径不碰锁所在的cache line
+         */
+        entry_t *find(const char *key, uint32_t klen, uint32_t hash_val){
+            entry_t *entry = this->find_in_bucket(key, klen, hash_val);
+            if (entry != nullptr){
+                return entry;
+            }
+            const index_lock_t *lock = this->get_lock(hash_val);
+            while (true){
+                uint32_t seq = lock->read_begin();
+                entry = this->find_in_bucket(key, klen, hash_val);
+                if (entry != nullptr || !lock->read_retry(seq)){
+                    return entry;
+                }
+            }
+        }
+
+        /**
+         * 批量操作时先预取bucket，调用方必须处于epoch读临界区内
+         */
+        void prefetch(uint32_t hash_val){
+            __builtin_prefetch(this->get_hashtable_bucket(hash_val));
+        }
+
+        /**
+         * bucket已经预取过了，再预取链表头的entry
+         */
+        void prefetch_entry(uint32_t hash_val){
+            entry_t *entry = this->entry_of(__atomic_load_n(this->get_hashtable_bucket(hash_val), __ATOMIC_ACQUIRE));
+            if (entry != nullptr){
+                __builtin_prefetch(entry);
+            }
+        }
+
+        /**
+         * 挂上新数据，之前已经有相同的key了直接清理了
+         */
+        void insert(entry_t *entry, uint32_t loc){
+            //摘掉旧数据到挂上新数据之间读线程找不到这个key，标记一下让它重查
+            index_lock_t *lock = this->get_lock(entry->hash_val);
+            lock->write_begin();
+            entry_link_t *hash_entry = this->get_hashtable_bucket(entry->hash_val);
+            this->unlink_key(hash_entry, entry->data, entry->key_len, entry->hash_val);
+
+            //数据写完后再挂到链表上，无锁的读线程要么看不到它，要么看到完整的数据
+            entry->hash_next = *hash_entry;
+            __atomic_store_n(hash_entry, link_of(entry, loc), __ATOMIC_RELEASE);
+            lock->write_end();
+
+            //本段的数据量超过了平均值才去算总数，超过75%了就标记要扩容，下一次expand_step开始迁移
+            owner_add(lock->item_num, 1);
+            if (lock->item_num.load(std::memory_order_relaxed) > this->stripe_threshold && !this->need_resize && !this->is_hashtable_expanding && this->need_expand()){
+                this->need_resize = true;
+            }
+        }
+
+        /**
+         * 按key删除
+         */
+        bool remove(const char *key, uint32_t klen, uint32_t hash_val){
+            return this->unlink_key(this->get_hashtable_bucket(hash_val), key, klen, hash_val) > 0;
+        }
+
+        /**
+         * 淘汰指定的entry：按entry里存的hash直接定位bucket，把它本身摘掉，不会误删同key后来写入的新数据
+         */
+        bool remove_entry(entry_t *entry, uint32_t loc){
+            (void) loc;
+            entry_link_t *hash_entry = this->get_hashtable_bucket(entry->hash_val);
+            entry_t *pre = nullptr;
+            entry_t *cur = this->entry_of(*hash_entry);
+            while (cur != nullptr && cur != entry){
+                pre = cur;
+                cur = this->entry_of(cur->hash_next);
+            }
+            if (cur == nullptr){
+                entry->mark_unlinked(epoch_domain::instance().unlink_stamp());
+                return false;
+            }
+            this->unlink_without_lock(hash_entry, pre, cur);
+            return true;
+        }
+
+        /**
+         * 设置摘链时的回调，见unlink_callback_t
+         */
+        void on_unlink(unlink_callback_t cb, void *ctx){
+            this->unlink_cb = cb;
+            this->unlink_ctx = ctx;
+        }
+
+        /**
+         * 获取hashtable锁
+         */
+        std::mutex *lock(uint32_t hash_val){
+            return &this->get_lock(hash_val)->mtx;
+        }
+
+        /**
+         * 当前的数据个数
+         */
+        uint64_t size() const{
+            uint64_t ret = 0;
+            for (uint32_t i = 0; i < HASH_SIZE(HASHTABLE_LOCK_POWER); i++){
+                ret += this->hashtable_locks[i].item_num.load(std::memory_order_relaxed);
+            }
+            return ret;
+        }
+
+        /**
+         * 当前的容量
+         */
+        uint64_t capacity() const{
+            return (uint64_t) 1 << this->hash_power;
+        }
+
+        /**
+         * 使用的总的小格子量超过总量75%时开始扩容
+         */
+        bool need_expand() const{
+            return !this->is_hashtable_full && (this->capacity() / 4) * 3 < this->size();
+        }
+
+        bool is_full() const{
+            return this->is_hashtable_full;
+        }
+
+        /**
+         * 链表不会丢数据，和bucket_index保持一致的接口
+         */
+        uint64_t dropped() const{
+            return 0;
+        }
+
+        /**
+         * 扩容时已迁移的bucket个数及总的bucket个数，没在扩容时都是0
+         */
+        void resize_progress(uint64_t &done, uint64_t &total) const{
+            hashtable_t *secondary = this->secondary_hashtable.load();
+            done = secondary == nullptr ? 0 : this->hashtable_expanding_index.load();
+            total = secondary == nullptr ? 0 : HASH_SIZE(secondary->hash_power);
+        }
+
+        /**
+         * 完成的扩容次数
+         */
+        uint64_t resize_count() const{
+            return this->resize_num;
+        }
+
+        /**
+         * 上一次扩容从开始到迁移完的耗时，单位微秒
+         */
+        uint64_t last_resize_cost() const{
+            return this->last_resize_us;
+        }
+
+        /**
+         * 渐进式扩容，由set/del在释放锁之后调用：
+         * 超过装载率后第一次调用时申请新表，之后每次迁移RESIZE_MIGRATE_STEP个bucket，
+         * 迁移完了旧表再每次释放RESIZE_RELEASE_STEP字节。
+         * 同一时刻只有一个线程在迁移，其他线程拿不到resize_mtx直接返回，不会等待
+         */
+        void expand_step(){
+            if (!this->need_resize.load(std::memory_order_relaxed) && !this->is_hashtable_expanding.load(std::memory_order_relaxed)
+                && this->retired.size.load(std::memory_order_relaxed) == 0){
+                return;
+            }
+            std::unique_lock< std::mutex > resize_lock(this->resize_mtx, std::try_to_lock);
+            if (!resize_lock.owns_lock()){
+                return;
+            }
+            if (!this->need_resize && !this->is_hashtable_expanding){
+                this->retired.release(RESIZE_RELEASE_STEP);
+                return;
+            }
+            if (!this->is_hashtable_expanding && !this->expand_begin()){
+                return;
+            }
+            this->migrate(RESIZE_MIGRATE_STEP);
+        }
+
+    private:
+        /**
+         * 开始扩容：先发布secondary（旧表）再发布primary（新表），
+         * hashtable_expanding_index之前的bucket已迁移到新表
+         */
+        bool expand_begin(){
+            //need_resize可能是上一次扩容刚开始时按旧容量算出来的，按现在的容量再确认一遍
+            this->need_resize = false;
+            if (!this->need_expand()){
+                return false;
+            }
+            uint8_t new_hash_power = this->hash_power + 1;
+            if (new_hash_power > HASH_POWER_MAX){
+                this->is_hashtable_full = true;
+                return false;
+            }
+
+            //新表是mmap出来的，页面在迁移时才真正分配，不会在这一次set里卡住
+            hashtable_t *new_table = this->alloc_hashtable(new_hash_power);
+            if (new_table == nullptr){
+                return false;
+            }
+            std::cout << "[expand_hash_table]start expand_hash_table, capacity=" << this->capacity() << "\tcur_item_num=" << this->size() << std::endl;
+            this->resize_begin_time = std::chrono::steady_clock::now();
+            this->hashtable_expanding_index = 0;
+            this->secondary_hashtable = this->primary_hashtable.load();
+            this->primary_hashtable = new_table;
+            this->hash_power = new_hash_power;
+            this->stripe_threshold = RESIZE_STRIPE_THRESHOLD(this->capacity());
+            this->is_hashtable_expanding = true;
+            return true;
+        }
+
+        /**
+         * 迁移最多num个旧bucket，把旧bucket的链表拆到新表的两个bucket里，全部迁移完了结束扩容
+         */
+        void migrate(uint32_t num){
+            hashtable_t *old_table = this->secondary_hashtable.load();
+            hashtable_t *new_table = this->primary_hashtable.load();
+            uint32_t old_hash_size = HASH_SIZE(old_table->hash_power);
+            uint32_t i = this->hashtable_expanding_index.load();
+            for (uint32_t end = std::min(i + num, old_hash_size); i < end; i++){
+                //旧bucket和新bucket的低位相同，用的是同一把锁
+                index_lock_t *lock = this->get_lock(i);
+                std::lock_guard< std::mutex > hash_lock(lock->mtx);
+                lock->write_begin();
+                entry_link_t old_hash_item = old_table->buckets[i];
+                while (old_hash_item != ENTRY_LINK_NONE){
+                    entry_t *entry = this->entry_of(old_hash_item);
+                    entry_link_t next = entry->hash_next;
+                    entry_link_t *bucket = &new_table->buckets[entry->hash() & HASH_MASK(new_table->hash_power)];
+                    entry->set_next(*bucket);
+                    __atomic_store_n(bucket, old_hash_item, __ATOMIC_RELEASE);
+                    old_hash_item = next;
+                }
+                __atomic_store_n(&old_table->buckets[i], ENTRY_LINK_NONE, __ATOMIC_RELAXED);
+                this->hashtable_expanding_index = i + 1;
+                lock->write_end();
+            }
+            if (i < old_hash_size){
+                return;
+            }
+
+            //迁移完毕，之后拿到锁的写线程都只会看到新表
+            this->secondary_hashtable = nullptr;
+            this->is_hashtable_expanding = false;
+
+            //拿一遍所有的锁，等之前拿着锁、可能还在用旧表的写线程离开；读线程用epoch等
+            for (uint32_t n = 0; n < HASH_SIZE(HASHTABLE_LOCK_POWER); n++){
+                std::lock_guard< std::mutex > hash_lock(this->hashtable_locks[n].mtx);
+            }
+            epoch_domain::instance().synchronize();
+            this->retired.retire(old_table, table_bytes(old_table->hash_power));
+            this->resize_num++;
+            this->last_resize_us = std::chrono::duration_cast< std::chrono::microseconds >(std::chrono::steady_clock::now() - this->resize_begin_time).count();
+            std::cout << "[expand_hash_table]finish expand_hash_table, hash_power=" << (uint32_t) new_table->hash_power << "\tcost=" << (this->last_resize_us / 1000) << "ms" << std::endl;
+        }
+
+        /**
+         * 申请一张hash表
+         */
+        static uint64_t table_bytes(uint8_t power){
+            return sizeof(hashtable_t) + ((uint64_t) 1 << power) * sizeof(entry_link_t);
+        }
+
+        hashtable_t *alloc_hashtable(uint8_t power){
+            hashtable_t *table = (hashtable_t *) index_table_alloc(table_bytes(power), this->numa_node);
+            if (table == nullptr){
+                return nullptr;
+            }
+            table->hash_power = power;
+            return table;
+        }
+
+        void free_hashtable(hashtable_t *table){
+            if (table != nullptr){
+                index_table_free(table, table_bytes(table->hash_power));
+            }
+        }
+
+        /**
+         * 摘掉bucket里所有的这个key，有可能同一个bucket会有多个相同的key
+         */
+        uint32_t unlink_key(entry_link_t *hash_entry, const char *key, uint32_t klen, uint32_t hash_val){
+            uint32_t ret = 0;
+            entry_t *pre = nullptr;
+            entry_t *cur = this->entry_of(*hash_entry);
+            while (cur != nullptr){
+                //hash值不同的直接跳过，不用比较key
+                if (cur->match(key, klen, hash_val)){
+                    this->unlink_without_lock(hash_entry, pre, cur);
+                    cur = this->entry_of(cur->hash_next);
+                    ret++;
+                    continue;
+                }
+                pre = cur;
+                cur = this->entry_of(cur->hash_next);
+            }
+            return ret;
+        }
+
+        /**
+         * 从链表上摘掉cur，调用方持有hash表的锁
+         * 摘链后读线程可能还在读它，所以只置删除标志，内存等环形缓冲区覆盖时再回收
+         */
+        void unlink_without_lock(entry_link_t *hash_entry, entry_t *pre, entry_t *cur){
+            if (pre == nullptr){
+                __atomic_store_n(hash_entry, cur->hash_next, __ATOMIC_RELEASE);
+            }
+            else{
+                pre->set_next(cur->hash_next);
+            }
+            if (this->unlink_cb != nullptr){
+                this->unlink_cb(this->unlink_ctx, cur);
+            }
+            cur->mark_unlinked(epoch_domain::instance().unlink_stamp());
+            owner_add(this->get_lock(cur->hash_val)->item_num, (uint64_t) -1);
+        }
+
+        /**
+         * 链表里存的位置和entry互转，默认格式下存的就是指针
+         */
+#ifdef RINGCACHE_COMPACT_ENTRY
+        entry_t *entry_of(entry_link_t link) const{
+            return link == ENTRY_LINK_NONE ? nullptr : this->locator->entry(link - 1);
+        }
+
+        static entry_link_t link_of(entry_t *entry, uint32_t loc){
+            (void) entry;
+            return loc + 1;
+        }
+#else
+        entry_t *entry_of(entry_link_t link) const{
+            return link;
+        }
+
+        static entry_link_t link_of(entry_t *entry, uint32_t loc){
+            (void) loc;
+            return entry;
+        }
+#endif
+
+        index_lock_t *get_lock(uint32_t hash_val){
+            return &this->hashtable_locks[hash_val & HASH_MASK(HASHTABLE_LOCK_POWER)];
+        }
+
+        /**
+         * 在hash_val所在的bucket里找key
+         */
+        entry_t *find_in_bucket(const char *key, uint32_t klen, uint32_t hash_val){
+            entry_t *entry = this->entry_of(__atomic_load_n(this->get_hashtable_bucket(hash_val), __ATOMIC_ACQUIRE));
+            while (entry != nullptr){
+                if (entry->match(key, klen, hash_val)){
+                    return entry;
+                }
+                entry = this->entry_of(entry->next());
+            }
+            return nullptr;
+        }
+
+        /**
+         * 获取所要操作的hashtable bucket，需要考虑是否在扩容
+         * 扩容时先发布secondary再发布primary，所以这里先读primary再读secondary；
+         * 两次读之间primary变了说明刚开始扩容，读到的primary可能是旧表、配上了刚发布的secondary，重读一遍
+         */
+        entry_link_t *get_hashtable_bucket(uint32_t hash_val){
+            hashtable_t *primary;
+            hashtable_t *secondary;
+            do{
+                primary = this->primary_hashtable.load();
+                secondary = this->secondary_hashtable.load();
+            } while (primary != this->primary_hashtable.load());
+            //没有扩容的、或者相应的bucket已扩容完成要用primary表
+            if (secondary == nullptr){
+                return &(primary->buckets[hash_val & HASH_MASK(primary->hash_power)]);
+            }
+            uint32_t old_bucket = hash_val & HASH_MASK(secondary->hash_power);
+            if (old_bucket < this->hashtable_expanding_index.load()){
+                return &(primary->buckets[hash_val & HASH_MASK(primary->hash_power)]);
+            }
+            return &(secondary->buckets[old_bucket]);
+        }
+
+        /**
+         * hash表
+         */
+        std::atomic< hashtable_t * > primary_hashtable;
+        std::atomic< hashtable_t * > secondary_hashtable;
+
+        /**
+         * 全局锁列表
+         */
+        index_lock_t *hashtable_locks;
+
+        /**
+         * entry位置编码，紧凑格式下链表里存的是它的编码
+         */
+        const entry_locator_t *locator;
+
+        /**
+         * 摘链时的回调
+         */
+        unlink_callback_t unlink_cb;
+        void *unlink_ctx;
+
+        /**
+         * hash表绑定的NUMA节点，不绑定为-1
+         */
+        int32_t numa_node;
+
+        /**
+         * 当前的容量
+         */
+        std::atomic< uint8_t > hash_power;
+
+        /**
+         * 几个标志
+         */
+        std::atomic< bool > is_hashtable_full;
+        std::atomic< bool > is_hashtable_expanding;
+        std::atomic< int64_t > hashtable_expanding_index;
+        std::atomic< bool > need_resize;
+
+        /**
+         * 扩容相关：迁移锁、单段数据量的阈值、次数及耗时
+         */
+        std::mutex resize_mtx;
+        std::atomic< uint64_t > stripe_threshold;
+        std::chrono::steady_clock::time_point resize_begin_time;
+        std::atomic< uint64_t > resize_num;
+        std::atomic< uint64_t > last_resize_us;
+        retired_table_t retired;
+    };
+}
+#endif //_RINGCACHE_CHAINED_INDEX_H_202610180940_
@@ -0,0 +1,116 @@
+/*************************************************************************
+ * File:	clock.h
+ * Author:	liuyongshuai<liuyongshuai@hotmail.com>
+ * Time:	2026-10-22 09:40
+ * 粗粒度时钟：后台线程每RING_CLOCK_TICK_MS毫秒取一次系统时间，读的时候只是一次原子load，
+ * get()判断是否过期时不用每次都调time()/clock_gettime()。
+ * 后台线程在第一次用到时（写入带过期时间的数据、读到带过期时间的数据、录制流量）才启动，进程退出时停掉
+ ************************************************************************/
+#ifndef _RINGCACHE_CLOCK_H_202610220940_
+#define _RINGCACHE_CLOCK_H_202610220940_
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <stdint.h>
+#include <time.h>
+
+//粗粒度时钟的刷新间隔（毫秒），也是过期判断的误差
+#ifndef RING_CLOCK_TICK_MS
+#define RING_CLOCK_TICK_MS 1
+#endif
+
+namespace ringcache{
+    class coarse_clock{
+    public:
+        /**
+         * 全局唯一，所有的ringcache实例共用。对象本身故意不析构，静态析构时别的对象可能还在读它；
+         * 后台线程在第一次用到时才启动，进程退出时由静态析构停下来，见stop()
+         */
+        static coarse_clock &instance(){
+            static coarse_clock *clock = new coarse_clock();
+            return *clock;
+        }
+
+        /**
+         * 当前时间，毫秒级的unix时间戳。
+         * 只有用到过期时间、录制流量时才会调用，第一次调用时启动后台线程；后台线程已经停了就直接取系统时间
+         */
+        uint64_t now_ms(){
+            if (this->state.load(std::memory_order_acquire) != CLOCK_RUNNING){
+                return this->start();
+            }
+            return this->ms.load(std::memory_order_relaxed);
+        }
+
+        /**
+         * 直接取系统时间，毫秒
+         */
+        static uint64_t precise_ms(){
+            struct timespec ts;
+            clock_gettime(CLOCK_REALTIME, &ts);
+            return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+        }
+
+    private:
+        enum{
+            CLOCK_IDLE = 0,
+            CLOCK_RUNNING,
+            CLOCK_STOPPED
+        };
+
+        /**
+         * 静态析构时停掉后台线程
+         */
+        typedef struct _clock_stopper_t{
+            ~_clock_stopper_t(){
+                coarse_clock::instance().stop();
+            }
+        } clock_stopper_t;
+
+        coarse_clock() : ms(0), state(CLOCK_IDLE){
+        }
+
+        /**
+         * 启动后台线程，返回当前时间
+         */
+        uint64_t start(){
+            std::lock_guard< std::mutex > lock(this->mtx);
+            if (this->state.load(std::memory_order_relaxed) == CLOCK_IDLE){
+                this->ms.store(precise_ms(), std::memory_order_relaxed);
+                this->ticker = std::thread(&coarse_clock::tick_func, this);
+                //在这之后构造的静态对象先析构，析构时还可以用时钟；之前构造的析构时时钟已经停了，取系统时间
+                static clock_stopper_t stopper;
+                (void) stopper;
+                this->state.store(CLOCK_RUNNING, std::memory_order_release);
+            }
+            return this->state.load(std::memory_order_relaxed) == CLOCK_RUNNING ? this->ms.load(std::memory_order_relaxed) : precise_ms();
+        }
+
+        /**
+         * 停掉后台线程，之后now_ms()都直接取系统时间
+         */
+        void stop(){
+            std::lock_guard< std::mutex > lock(this->mtx);
+            if (this->state.load(std::memory_order_relaxed) != CLOCK_RUNNING){
+                return;
+            }
+            this->state.store(CLOCK_STOPPED, std::memory_order_release);
+            this->ticker.join();
+        }
+
+        void tick_func(){
+            while (this->state.load(std::memory_order_acquire) != CLOCK_STOPPED){
+                std::this_thread::sleep_for(std::chrono::milliseconds(RING_CLOCK_TICK_MS));
+                this->ms.store(precise_ms(), std::memory_order_relaxed);
+            }
+        }
+
+        std::atomic< uint64_t > ms;
+        std::atomic< uint32_t > state;
+        std::mutex mtx;
+        std::thread ticker;
+    };
+}
+#endif //_RINGCACHE_CLOCK_H_202610220940_
@@ -0,0 +1,131 @@
+/*************************************************************************
+ * File:	codec.h
+ * Author:	liuyongshuai<liuyongshuai@hotmail.com>
+ * Time:	2026-10-21 18:20
+ * 可选的value压缩算法，作为basic_ringcache的模板参数，要提供：
+ * static const bool enabled：为false时set/get完全不碰压缩
+ * static size_t bound(size_t len)：压缩后最长多少
+ * bool compress(const char *src, size_t len, char *dst, size_t &dst_len)：dst_len传入dst的容量，
+ *      压缩后放不下就返回false，调用方按压缩后能接受的最大长度传容量，压不动的数据可以早点放弃
+ * bool decompress(const char *src, size_t len, char *dst, size_t raw_len)：正好解压出raw_len字节才算成功
+ ************************************************************************/
+#ifndef _RINGCACHE_CODEC_H_202610211820_
+#define _RINGCACHE_CODEC_H_202610211820_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <zlib.h>
+
+//zlib的压缩级别，缓存写入对延迟敏感，默认用最快的一级
+#ifndef RING_ZLIB_LEVEL
+#define RING_ZLIB_LEVEL 1
+#endif
+
+//deflate的hash表大小（memLevel），每次deflateReset都要清一遍hash表，value一般不大，用小一点的表
+#ifndef RING_ZLIB_MEM_LEVEL
+#define RING_ZLIB_MEM_LEVEL 4
+#endif
+
+namespace ringcache{
+    /**
+     * 默认不压缩
+     */
+    struct no_codec{
+        static const bool enabled = false;
+
+        static size_t bound(size_t len){
+            return len;
+        }
+
+        bool compress(const char *, size_t, char *, size_t &) const{
+            return false;
+        }
+
+        bool decompress(const char *, size_t, char *, size_t) const{
+            return false;
+        }
+    };
+
+    /**
+     * zlib的raw deflate，不带zlib头和adler32校验。
+     * 每次都deflateInit要申请好几百KB的状态，这里每个线程留一个z_stream，用的时候reset一下
+     */
+    struct zlib_codec{
+        static const bool enabled = true;
+
+        static size_t bound(size_t len){
+            return compressBound(len);
+        }
+
+        bool compress(const char *src, size_t len, char *dst, size_t &dst_len) const{
+            zlib_stream_t &s = deflater();
+            if (!s.ok){
+                return false;
+            }
+            deflateReset(&s.zs);
+            s.zs.next_in = (Bytef *) src;
+            s.zs.avail_in = len;
+            s.zs.next_out = (Bytef *) dst;
+            s.zs.avail_out = dst_len;
+            if (deflate(&s.zs, Z_FINISH) != Z_STREAM_END){
+                return false;
+            }
+            dst_len = s.zs.total_out;
+            return true;
+        }
+
+        bool decompress(const char *src, size_t len, char *dst, size_t raw_len) const{
+            zlib_stream_t &s = inflater();
+            if (!s.ok){
+                return false;
+            }
+            inflateReset(&s.zs);
+            s.zs.next_in = (Bytef *) src;
+            s.zs.avail_in = len;
+            s.zs.next_out = (Bytef *) dst;
+            s.zs.avail_out = raw_len;
+            return inflate(&s.zs, Z_FINISH) == Z_STREAM_END && s.zs.total_out == raw_len;
+        }
+
+    private:
+        struct zlib_stream_t{
+            z_stream zs;
+            bool ok;
+            bool is_inflate;
+
+            explicit zlib_stream_t(bool is_inflate) : is_inflate(is_inflate){
+                memset(&this->zs, 0, sizeof(this->zs));
+                if (is_inflate){
+                    this->ok = inflateInit2(&this->zs, -MAX_WBITS) == Z_OK;
+                }
+                else{
+                    this->ok = deflateInit2(&this->zs, RING_ZLIB_LEVEL, Z_DEFLATED, -MAX_WBITS, RING_ZLIB_MEM_LEVEL, Z_DEFAULT_STRATEGY) == Z_OK;
+                }
+            }
+
+            ~zlib_stream_t(){
+                if (this->ok){
+                    if (this->is_inflate){
+                        inflateEnd(&this->zs);
+                    }
+                    else{
+                        deflateEnd(&this->zs);
+                    }
+                }
+            }
+        };
+
+        //分开两个函数，只读的线程不用申请压缩的状态
+        static zlib_stream_t &deflater(){
+            static thread_local zlib_stream_t s(false);
+            return s;
+        }
+
+        static zlib_stream_t &inflater(){
+            static thread_local zlib_stream_t s(true);
+            return s;
+        }
+    };
+}
+#endif //_RINGCACHE_CODEC_H_202610211820_
@@ -0,0 +1,109 @@
+/*************************************************************************
+ * File:	counters.h
+ * Author:	liuyongshuai<liuyongshuai@hotmail.com>
+ * Time:	2026-10-22 14:20
+ * 按线程分片的统计计数器：每个线程只加自己那一片，各片独占cache line，读的时候把各片加起来
+ ************************************************************************/
+#ifndef _RINGCACHE_COUNTERS_H_202610221420_
+#define _RINGCACHE_COUNTERS_H_202610221420_
+
+#include <atomic>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "epoch.h"
+
+//计数器的分片数，要是2的幂。线程按编号落到其中一片上，线程数不超过它时各写各的
+#ifndef RING_STAT_SHARDS
+#define RING_STAT_SHARDS 16
+#endif
+
+namespace ringcache{
+    /**
+     * 只有一个线程会改的计数器（比如拿着buffer锁时改的）：读改写不用带lock前缀，读的线程也不会读到撕裂的值
+     */
+    inline void owner_add(std::atomic< uint64_t > &counter, uint64_t n){
+        counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    inline void owner_max(std::atomic< uint64_t > &counter, uint64_t n){
+        if (n > counter.load(std::memory_order_relaxed)){
+            counter.store(n, std::memory_order_relaxed);
+        }
+    }
+
+    class sharded_counters{
+    public:
+        /**
+         * num：每一片里的计数器个数
+         */
+        explicit sharded_counters(uint32_t num) : num(num){
+            //每一片按cache line对齐，片和片之间没有伪共享
+            this->stride = (num * sizeof(uint64_t) + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE * CACHE_LINE_SIZE / sizeof(uint64_t);
+            size_t bytes = (size_t) RING_STAT_SHARDS * this->stride * sizeof(uint64_t);
+            void *mem = nullptr;
+            if (posix_memalign(&mem, CACHE_LINE_SIZE, bytes) == 0){
+                memset(mem, 0, bytes);
+            }
+            this->values = (std::atomic< uint64_t > *) mem;
+        }
+
+        ~sharded_counters(){
+            free(this->values);
+        }
+
+        /**
+         * 当前线程给第i个计数器加n，减的时候传补码，加起来自然回绕
+         */
+        void add(uint32_t i, uint64_t n){
+            //同一片可能有几个线程共用，还得是原子加，只是基本碰不到竞争
+            this->values[shard_of_thread() * this->stride + i].fetch_add(n, std::memory_order_relaxed);
+        }
+
+        /**
+         * 第i个计数器各片的和
+         */
+        uint64_t sum(uint32_t i) const{
+            uint64_t ret = 0;
+            for (uint32_t s = 0; s < RING_STAT_SHARDS; s++){
+                ret += this->values[s * this->stride + i].load(std::memory_order_relaxed);
+            }
+            return ret;
+        }
+
+        /**
+         * 一次把所有计数器都加出来，out要有num个
+         */
+        void sum_all(uint64_t *out) const{
+            memset(out, 0, this->num * sizeof(uint64_t));
+            for (uint32_t s = 0; s < RING_STAT_SHARDS; s++){
+                const std::atomic< uint64_t > *shard = this->values + s * this->stride;
+                for (uint32_t i = 0; i < this->num; i++){
+                    out[i] += shard[i].load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        uint32_t size() const{
+            return this->num;
+        }
+
+    private:
+        /**
+         * 当前线程所在的分片，线程编号第一次用时分配
+         */
+        static uint32_t shard_of_thread(){
+            static std::atomic< uint32_t > next_id(0);
+            static thread_local uint32_t shard = next_id.fetch_add(1, std::memory_order_relaxed) & (RING_STAT_SHARDS - 1);
+            return shard;
+        }
+
+        sharded_counters(const sharded_counters &);
+        sharded_counters &operator=(const sharded_counters &);
+
+        uint32_t num;
+        uint32_t stride;
+        std::atomic< uint64_t > *values;
+    };
+}
+#endif //_RINGCACHE_COUNTERS_H_202610221420_
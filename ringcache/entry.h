@@ -12,18 +12,29 @@
 #include <string.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <sys/mman.h>
 #include <atomic>
 #include <assert.h>
 #include <mutex>
+#include <new>
+#include <algorithm>
 #include "jenkins_hash.h"
+#include "epoch.h"
+#include "counters.h"
+#include "histogram.h"
+#include "numa.h"
 
 //hash计算
 #define HASH_SIZE(n) ((uint32_t)1<<(n))
 #define HASH_MASK(n) (HASH_SIZE(n)-1)
 
 //hash初始容量及最大容量
+#ifndef HASH_POWER_INIT
 #define HASH_POWER_INIT 16
+#endif
+#ifndef HASH_POWER_MAX
 #define HASH_POWER_MAX 32
+#endif
 
 //大小定义
 #define KB (1<<10)
@@ -33,6 +44,39 @@
 //全局锁相关
 #define HASHTABLE_LOCK_POWER 10
 
+//multi_get每组预取的key个数，一组的bucket及entry要能同时留在L1里
+#ifndef MULTI_GET_BATCH
+#define MULTI_GET_BATCH 32
+#endif
+
+//扩容时每次set/del顺带迁移的bucket个数
+#ifndef RESIZE_MIGRATE_STEP
+#define RESIZE_MIGRATE_STEP 8
+#endif
+
+//写入线程的主buffer每调用这么多次换到下一个，单线程写也能轮流用上所有buffer
+#ifndef BUFFER_HOME_ROTATE
+#define BUFFER_HOME_ROTATE 64
+#endif
+
+//主buffer被占用时，按随机顺序try_lock其他buffer的轮数，都拿不到再阻塞等主buffer
+#ifndef BUFFER_TRY_ROUNDS
+#define BUFFER_TRY_ROUNDS 2
+#endif
+
+//原子预留模式下每个buffer切成的段数，段是预留空间、淘汰旧数据的单位，单个entry不能超过一段
+#ifndef RING_SEGMENT_NUM
+#define RING_SEGMENT_NUM 16
+#endif
+
+//扩容完后旧表分多次释放，每次set/del最多munmap这么多字节
+#ifndef RESIZE_RELEASE_STEP
+#define RESIZE_RELEASE_STEP (1<<20)
+#endif
+
+//按75%的装载率均摊到每一段锁上的数据量，某一段超过它时才去算总数，看是否要扩容
+#define RESIZE_STRIPE_THRESHOLD(capacity) ((capacity)/4*3>>HASHTABLE_LOCK_POWER)
+
 //key && value 的最大长度
 #define MAX_KEY_SIZE 255
 #define MAX_VALUE_SIZE ((uint32_t)(4*MB))
@@ -46,6 +90,44 @@
 #endif
 #define RING_BUFFER_MIN_SIZE (MAX_VALUE_SIZE*2)
 
+//entry按8字节对齐，保证hash_next可以原子读写
+#define RING_ENTRY_ALIGN 8
+#define RING_ALIGN_SIZE(n) (((n)+RING_ENTRY_ALIGN-1)&~((uint64_t)RING_ENTRY_ALIGN-1))
+
+//每次set淘汰数据个数的分布，按2的幂分档：0、1、2-3、4-7 ... 64+
+#define EVICT_HIST_SIZE 8
+
+//value压缩：不短于RING_COMPRESS_MIN_SIZE的才压，压完至少省下RING_COMPRESS_MIN_SAVING%才存压缩后的
+#ifndef RING_COMPRESS_MIN_SIZE
+#define RING_COMPRESS_MIN_SIZE 256
+#endif
+#ifndef RING_COMPRESS_MIN_SAVING
+#define RING_COMPRESS_MIN_SAVING 12
+#endif
+
+//后台清理过期数据：每隔RING_SWEEP_INTERVAL_MS毫秒给每个buffer扫一步，为0时不启动清理线程
+#ifndef RING_SWEEP_INTERVAL_MS
+#define RING_SWEEP_INTERVAL_MS 100
+#endif
+
+//加锁模式下每一步拿着buffer锁最多扫这么多字节，原子预留模式下每一步扫一段
+#ifndef RING_SWEEP_STEP
+#define RING_SWEEP_STEP (256*KB)
+#endif
+
+//清理线程的nice值，只拿空闲的CPU
+#ifndef RING_SWEEP_NICE
+#define RING_SWEEP_NICE 19
+#endif
+
+//entry的标志位：value是压缩过的，data里key后面先是4字节的原始长度，再是压缩后的数据
+#define ENTRY_FLAG_COMPRESSED 0x01
+
+//紧凑格式的entry里标志位及value长度占的位数，两者加上key_len正好4字节
+#define ENTRY_FLAG_BITS 2
+#define ENTRY_VALUE_BITS 22
+#define ENTRY_LINK_NONE ((entry_link_t) 0)
+
 //错误码相关
 #define RINGCACHE_ERRNO_OK 0
 #define RINGCACHE_ERRNO_KEY_TOO_LONG 2
@@ -53,23 +135,215 @@
 #define RINGCACHE_ERRNO_NOT_FOUND 4
 #define RINGCACHE_ERRNO_ALLOC_MEMORY_FAILED 5
 #define RINGCACHE_ERRNO_KEY_EXPIRED 6
+#define RINGCACHE_ERRNO_BUFFER_TOO_SMALL 7
+#define RINGCACHE_ERRNO_SNAPSHOT_IO 8
+#define RINGCACHE_ERRNO_SNAPSHOT_MISMATCH 9
+#define RINGCACHE_ERRNO_DECOMPRESS_FAILED 10
+#define RINGCACHE_ERRNO_TRACE_IO 11
+#define RINGCACHE_ERRNO_SHM_IO 12
+#define RINGCACHE_ERRNO_SHM_MISMATCH 13
 
 inline uint32_t hash(const std::string &key){
     return jenkins_hash(key.c_str(), key.length());
 }
 
+/**
+ * 按cache line对齐申请内存并清零
+ */
+inline void *cache_aligned_calloc(size_t size){
+    void *ptr = nullptr;
+    if (posix_memalign(&ptr, CACHE_LINE_SIZE, size) != 0){
+        return nullptr;
+    }
+    memset(ptr, 0, size);
+    return ptr;
+}
+
+/**
+ * 索引表的内存直接mmap：页对齐、按需清零，大表申请时不用等整张表清零，释放时也可以分段munmap。
+ * node>=0时绑到该NUMA节点上，迁移时不管哪个线程先写到，页都分配在这个节点上
+ */
+inline void *index_table_alloc(size_t size, int32_t node = -1){
+    void *ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ptr == MAP_FAILED){
+        return nullptr;
+    }
+    if (node >= 0){
+        ringcache::numa_bind_memory(ptr, size, node);
+    }
+    return ptr;
+}
+
+inline void index_table_free(void *ptr, size_t size){
+    if (ptr != nullptr && size > 0){
+        munmap(ptr, size);
+    }
+}
+
 namespace ringcache{
     /**
-     * buffer的统计信息
+     * 扩容完等着释放的旧表，每次release只munmap一段，不让某一次set为释放一整张大表买单
+     */
+    typedef struct _retired_table_t{
+        char *mem;
+        std::atomic< uint64_t > size;
+
+        _retired_table_t() : mem(nullptr), size(0){
+        }
+
+        /**
+         * 交给它一张已经没有任何线程在用的表
+         */
+        void retire(void *ptr, uint64_t bytes){
+            //上一张还没释放完的话直接释放掉，连着两次扩容中间隔了几十万次set，基本不会发生
+            index_table_free(this->mem, this->size);
+            this->mem = (char *) ptr;
+            this->size = bytes;
+        }
+
+        /**
+         * 释放一段，返回是否还有没释放完的
+         */
+        bool release(uint64_t step){
+            uint64_t remain = this->size;
+            uint64_t n = remain < step ? remain : step;
+            index_table_free(this->mem, n);
+            this->mem += n;
+            this->size = remain - n;
+            return remain > n;
+        }
+    } retired_table_t;
+
+    /**
+     * 按线程分片的计数器（见counters.h）的编号：整个实例的在最前面，后面是各档各CLASS_STAT_NUM个，再后面是每个buffer各BUFFER_STAT_NUM个
+     */
+    enum{
+        STAT_GET_HIT = 0,
+        STAT_GET_MISS,
+        STAT_GET_EXPIRED,
+        STAT_READ_BYTES,
+        STAT_WRITE_BYTES,
+        STAT_DEL_NUM,
+        STAT_COMPRESS_NUM,
+        STAT_COMPRESS_SKIP_NUM,
+        STAT_COMPRESS_RAW_BYTES,
+        STAT_COMPRESS_OUT_BYTES,
+        STAT_COMPRESS_NS,
+        STAT_DECOMPRESS_NUM,
+        STAT_DECOMPRESS_NS,
+        STAT_CACHE_NUM
+    };
+
+    /**
+     * 每一档的计数器，接在实例的计数器后面：命中数（多于一档时才计），以及还挂在索引上的数据个数、字节数
      */
-    typedef struct __attribute__ ((__packed__)) _buffer_stats_t{
+    enum{
+        CLASS_STAT_HIT = 0,
+        CLASS_STAT_LIVE_NUM,
+        CLASS_STAT_LIVE_BYTES,
+        CLASS_STAT_NUM
+    };
+
+    /**
+     * buffer上会被多个线程同时改的计数器：原子预留模式下的写入，以及没拿到锁、等切段的线程
+     */
+    enum{
+        BUFFER_STAT_SET_NUM = 0,
+        BUFFER_STAT_ITEM_NUM,
+        BUFFER_STAT_LOCK_BUSY_NUM,
+        BUFFER_STAT_RESERVE_WAIT_NUM,
+        BUFFER_STAT_NUM
+    };
+
+    /**
+     * buffer上只有拿着buffer锁的线程才会改的计数器，用owner_add/owner_max改，get_stats()随时可以读。
+     * 独占cache line，不和别的buffer的挤在一起
+     */
+    typedef struct alignas(CACHE_LINE_SIZE) _buffer_counters_t{
+        /**
+         * 此环形缓存区有多少次直接跳到header，清理线程也靠它判断写指针有没有转过一圈
+         */
+        std::atomic< uint64_t > reset_header_times;
+
+        /**
+         * 淘汰、清理掉的数据总数
+         */
+        std::atomic< uint64_t > del_num;
+
+        /**
+         * 写入时覆盖掉的有效数据总数、淘汰过数据的写入次数、单次写入最多淘汰了多少个，以及单次写入淘汰个数的分布
+         */
+        std::atomic< uint64_t > evict_num;
+        std::atomic< uint64_t > evict_set_num;
+        std::atomic< uint64_t > evict_max_per_set;
+        std::atomic< uint64_t > evict_hist[EVICT_HIST_SIZE];
+
+        /**
+         * 拿到锁的次数、拿到锁之前阻塞等待的次数
+         */
+        std::atomic< uint64_t > lock_num;
+        std::atomic< uint64_t > lock_wait_num;
+
+        /**
+         * 清理线程：上一整圈扫到的已过期的数据个数及字节数，以及累计清理掉的个数、字节数、扫完的圈数
+         */
+        std::atomic< uint64_t > expired_num;
+        std::atomic< uint64_t > expired_bytes;
+        std::atomic< uint64_t > sweep_num;
+        std::atomic< uint64_t > sweep_bytes;
+        std::atomic< uint64_t > sweep_rounds;
+
+        /**
+         * 内存的申请方式（见RING_BUFFER_PAGE）及绑定的NUMA节点（没绑定为-1），申请、恢复内存时设置
+         */
+        std::atomic< uint32_t > page_mode;
+        std::atomic< int32_t > numa_node;
+
+        static struct _buffer_counters_t *alloc(){
+            return new(cache_aligned_calloc(sizeof(struct _buffer_counters_t))) struct _buffer_counters_t();
+        }
+
+        static void release(struct _buffer_counters_t *c){
+            if (c != nullptr){
+                c->~_buffer_counters_t();
+                free(c);
+            }
+        }
+
+        /**
+         * 记录一次写入淘汰的个数
+         */
+        void add_evict(uint32_t num){
+            uint32_t slot = 0;
+            while (slot + 1 < EVICT_HIST_SIZE && ((uint32_t) 1 << slot) <= num){
+                slot++;
+            }
+            owner_add(this->evict_hist[slot], 1);
+            if (num == 0){
+                return;
+            }
+            owner_add(this->evict_num, num);
+            owner_add(this->evict_set_num, 1);
+            owner_max(this->evict_max_per_set, num);
+        }
+    } buffer_counters_t;
+
+    /**
+     * buffer的统计信息，get_stats()时的快照
+     */
+    typedef struct _buffer_stats_t{
         /**
          * 编号
          */
         uint32_t index;
 
         /**
-         * 总数量
+         * 所属的大小分档
+         */
+        uint32_t size_class;
+
+        /**
+         * 写进这个buffer、还没被覆盖或清理掉的数据个数，包括已被del或被同key的新数据替换、还占着空间的
          */
         uint64_t item_num;
 
@@ -79,7 +353,7 @@ namespace ringcache{
         uint64_t set_num;
 
         /**
-        * 总删除数量
+        * 淘汰、清理掉的数据总数
         */
         uint64_t del_num;
 
@@ -88,26 +362,195 @@ namespace ringcache{
          */
         uint64_t reset_header_times;
 
+        /**
+         * 写入时覆盖掉的有效数据总数
+         */
+        uint64_t evict_num;
+
+        /**
+         * 淘汰过数据的写入次数
+         */
+        uint64_t evict_set_num;
+
+        /**
+         * 单次写入最多淘汰了多少个
+         */
+        uint64_t evict_max_per_set;
+
+        /**
+         * 单次写入淘汰个数的分布
+         */
+        uint64_t evict_hist[EVICT_HIST_SIZE];
+
         /**
          * 缓存大小
          */
         uint64_t cache_byte_size;
 
+        /**
+         * 拿到锁的次数
+         */
+        uint64_t lock_num;
+
+        /**
+         * 拿到锁之前阻塞等待的次数
+         */
+        uint64_t lock_wait_num;
+
+        /**
+         * try_lock失败的次数
+         */
+        uint64_t lock_busy_num;
+
+        /**
+         * 原子预留模式下，所在的段写满了、等别的线程切到下一段的次数
+         */
+        uint64_t reserve_wait_num;
+
+        /**
+         * 内存的申请方式，见RING_BUFFER_PAGE
+         */
+        uint32_t page_mode;
+
+        /**
+         * 绑定的NUMA节点，没绑定为-1
+         */
+        int32_t numa_node;
+
+        /**
+         * 实际落在大页上的字节数，从/proc/self/smaps里查
+         */
+        uint64_t huge_page_bytes;
+
+        /**
+         * 清理线程上一整圈扫到的已过期、还占着索引和空间的数据个数及字节数，这一圈扫完前是上一圈的
+         */
+        uint64_t expired_num;
+        uint64_t expired_bytes;
+
+        /**
+         * 清理线程摘掉的过期数据总个数、总字节数，以及扫完的圈数
+         */
+        uint64_t sweep_num;
+        uint64_t sweep_bytes;
+        uint64_t sweep_rounds;
+
         /**
          * 转化为字符串
          */
-        std::string to_string(){
+        std::string to_string() const{
             std::string stats;
             stats.append("buffer" + std::to_string(this->index) + ": ");
+            stats.append("\tsize_class=" + std::to_string(this->size_class));
             stats.append("\titem_num=" + std::to_string(this->item_num));
             stats.append("\tset_num=" + std::to_string(this->set_num));
             stats.append("\tdel_num=" + std::to_string(this->del_num));
             stats.append("\tcache_byte_size=" + std::to_string(this->cache_byte_size / MB) + "MB");
             stats.append("\treset_header_times=" + std::to_string(this->reset_header_times));
+            stats.append("\tevict_num=" + std::to_string(this->evict_num));
+            stats.append("\tevict_set_num=" + std::to_string(this->evict_set_num));
+            stats.append("\tevict_max_per_set=" + std::to_string(this->evict_max_per_set));
+            stats.append("\tevict_hist=");
+            for (uint32_t i = 0; i < EVICT_HIST_SIZE; i++){
+                stats.append((i > 0 ? "," : "") + std::to_string(this->evict_hist[i]));
+            }
+            stats.append("\tlock_num=" + std::to_string(this->lock_num));
+            stats.append("\tlock_busy_num=" + std::to_string(this->lock_busy_num));
+            stats.append("\tlock_wait_num=" + std::to_string(this->lock_wait_num));
+            stats.append("\treserve_wait_num=" + std::to_string(this->reserve_wait_num));
+            stats.append("\tpage_mode=" + std::to_string(this->page_mode));
+            stats.append("\tnuma_node=" + std::to_string(this->numa_node));
+            stats.append("\thuge_page_bytes=" + std::to_string(this->huge_page_bytes / MB) + "MB");
+            stats.append("\texpired_num=" + std::to_string(this->expired_num));
+            stats.append("\texpired_bytes=" + std::to_string(this->expired_bytes));
+            stats.append("\tsweep_num=" + std::to_string(this->sweep_num));
+            stats.append("\tsweep_bytes=" + std::to_string(this->sweep_bytes));
+            stats.append("\tsweep_rounds=" + std::to_string(this->sweep_rounds));
             return stats;
         }
     } buffer_stats_t;
 
+    /**
+     * 原子预留模式下buffer里的一段
+     */
+    typedef struct alignas(CACHE_LINE_SIZE) _ring_segment_t{
+        /**
+         * 本圈已经写完的字节数，写入线程拷贝完数据、挂上索引后才加
+         */
+        std::atomic< uint64_t > committed;
+
+        /**
+         * 上一圈这一段实际用掉的字节数，段尾放不下的零头不算
+         */
+        uint64_t fill;
+    } ring_segment_t;
+
+    /**
+     * 原子预留模式下buffer的写指针：高32位是段的序号，低32位是段内偏移，
+     * 写入线程fetch_add拿空间，越过段尾的那个线程负责淘汰下一段的旧数据并切过去
+     */
+    typedef struct alignas(CACHE_LINE_SIZE) _ring_reserve_t{
+        std::atomic< uint64_t > cursor;
+        alignas(CACHE_LINE_SIZE) uint64_t seg_size;
+        uint32_t seg_num;
+        ring_segment_t *segments;
+
+        static struct _ring_reserve_t *alloc(uint64_t mem_size){
+            struct _ring_reserve_t *r = (struct _ring_reserve_t *) cache_aligned_calloc(sizeof(struct _ring_reserve_t));
+            r->seg_num = RING_SEGMENT_NUM;
+            r->seg_size = (mem_size / r->seg_num) & ~((uint64_t) RING_ENTRY_ALIGN - 1);
+            //段内偏移只有32位，还要给越过段尾的fetch_add留余量
+            if (r->seg_size > GB){
+                r->seg_size = GB;
+            }
+            r->cursor = 0;
+            r->segments = (ring_segment_t *) cache_aligned_calloc(r->seg_num * sizeof(ring_segment_t));
+            return r;
+        }
+
+        static void release(struct _ring_reserve_t *r){
+            if (r != nullptr){
+                free(r->segments);
+                free(r);
+            }
+        }
+
+        /**
+         * buffer内偏移所在的段
+         */
+        ring_segment_t *segment_at(uint64_t offset){
+            return &this->segments[offset / this->seg_size];
+        }
+    } ring_reserve_t;
+
+    /**
+     * 清理线程在一个buffer上的进度，拿着buffer的锁读写
+     */
+    typedef struct _ring_sweep_t{
+        /**
+         * 加锁模式下下一个要看的entry，为空时从写指针处开始
+         */
+        char *pos;
+
+        /**
+         * 加锁模式下上次放锁时的写指针及绕回开头的次数，用来判断pos是否已经被写入覆盖了
+         */
+        char *cur;
+        uint64_t wraps;
+
+        /**
+         * 原子预留模式下下一个要扫的段
+         */
+        uint32_t seg;
+
+        /**
+         * 这一圈已经扫过的字节数，及扫到的过期数据
+         */
+        uint64_t walked;
+        uint64_t expired_num;
+        uint64_t expired_bytes;
+    } ring_sweep_t;
+
     /**
      * 环形缓冲区
      */
@@ -124,9 +567,9 @@ namespace ringcache{
         uint64_t mem_size;
 
         /**
-         * 统计信息
+         * 只在拿着buffer锁时改的统计信息，会被多个线程同时改的在实例的分片计数器里
          */
-        buffer_stats_t *stats;
+        buffer_counters_t *stats;
 
         /**
          * 当前可以操作的指针
@@ -137,9 +580,78 @@ namespace ringcache{
          * 取空间时锁定
          */
         std::mutex *mtx;
+
+        /**
+         * 编号，和entry的位置编码里的buffer编号一致
+         */
+        uint32_t index;
+
+        /**
+         * 原子预留模式下的写指针，加锁模式下为空
+         */
+        ring_reserve_t *reserve;
+
+        /**
+         * mmap出来的总长度，calloc时为0，释放时用
+         */
+        uint64_t map_size;
+
+        /**
+         * 所属的大小分档
+         */
+        uint32_t size_class;
+
+        /**
+         * 清理过期数据的进度
+         */
+        ring_sweep_t *sweep;
     } ring_buffer_t;
 
 
+#ifdef RINGCACHE_COMPACT_ENTRY
+    /**
+     * 链表里下一个entry的位置：entry_locator_t的编码加1，0表示没有
+     */
+    typedef uint32_t entry_link_t;
+
+    /**
+     * 存数据的结构体，紧凑格式：长度按buffer及MAX_VALUE_SIZE的上限取位数，链表用32位的位置编码，
+     * 头部24字节、按自然对齐排列，不用pack(1)
+     */
+    typedef struct _entry_t{
+        /**
+         * 当前entry所占用的全部字节数，buffer不超过2GB
+         */
+        uint32_t entry_len;
+
+        /**
+         * hash表
+         */
+        entry_link_t hash_next;
+
+        /**
+         * 过期时间，毫秒级的unix时间戳，0表示不过期。摘链后存的是epoch_domain::unlink_stamp()
+         */
+        uint64_t expire_ms;
+
+        /**
+         * key的hash值
+         */
+        uint32_t hash_val;
+
+        /**
+         * key的长度，单独占一个字节，del()置0时不会改到旁边的位段
+         */
+        uint8_t key_len;
+
+        /**
+         * 标志位及value长度，value长度小于MAX_VALUE_SIZE
+         */
+        uint32_t flags:ENTRY_FLAG_BITS;
+        uint32_t value_len:ENTRY_VALUE_BITS;
+#else
+    typedef struct _entry_t *entry_link_t;
+
 #pragma pack (1)
     /**
      * 存数据的结构体
@@ -154,12 +666,17 @@ namespace ringcache{
         /**
          * hash表
          */
-        struct _entry_t *hash_next;
+        entry_link_t hash_next;
+
+        /**
+         * key的hash值，写入时算好存下，查找、扩容、淘汰时不用再对key算hash
+         */
+        uint32_t hash_val;
 
         /**
-         * 过期时间
+         * 过期时间，毫秒级的unix时间戳，0表示不过期。摘链后存的是epoch_domain::unlink_stamp()
          */
-        uint32_t expire_time;
+        uint64_t expire_ms;
 
         /**
          * key的长度
@@ -167,9 +684,15 @@ namespace ringcache{
         uint8_t key_len;
 
         /**
-         * value长度
+         * 标志位，见ENTRY_FLAG_*
+         */
+        uint8_t flags;
+
+        /**
+         * value长度，压缩过的是存下来的长度（含开头的原始长度）
          */
         uint32_t value_len;
+#endif
 
         /**
          * 存储数据的地址
@@ -202,9 +725,7 @@ namespace ringcache{
          * hash值
          */
         uint32_t hash() const{
-            std::string key;
-            this->key(key);
-            return ::hash(key);
+            return this->hash_val;
         }
 
         /**
@@ -220,11 +741,252 @@ namespace ringcache{
         uint64_t len() const{
             return this->entry_len;
         }
+
+        /**
+         * 是否为要找的key，key_len只读一次，del()并发置0时不会读错位
+         */
+        bool match(const char *k, uint32_t klen, uint32_t hval) const{
+            return this->hash_val == hval && this->key_len == klen && memcmp(this->data, k, klen) == 0;
+        }
+
+        /**
+         * 无锁读取链表的下一个节点，和set_next配对
+         */
+        entry_link_t next() const{
+            return __atomic_load_n(&this->hash_next, __ATOMIC_ACQUIRE);
+        }
+
+        /**
+         * 发布下一个节点，之前写入的数据对无锁的读线程可见
+         */
+        void set_next(entry_link_t next){
+            __atomic_store_n(&this->hash_next, next, __ATOMIC_RELEASE);
+        }
+
+        /**
+         * 摘链后置删除标志：先写回收戳，再release写key_len。
+         * 写线程不加锁用is_unlinked()看到key_len为0时，一定能读到完整的回收戳，
+         * 默认格式下expire_ms不是8字节对齐的，单独读写可能读到一半
+         */
+        void mark_unlinked(uint64_t stamp){
+            this->expire_ms = stamp;
+            __atomic_store_n(&this->key_len, (uint8_t) 0, __ATOMIC_RELEASE);
+        }
+
+        /**
+         * 不加锁判断是否已摘链，和mark_unlinked配对
+         */
+        bool is_unlinked() const{
+            return __atomic_load_n(&this->key_len, __ATOMIC_ACQUIRE) == 0;
+        }
     } entry_t;
+#ifdef RINGCACHE_COMPACT_ENTRY
+    static_assert(sizeof(entry_t) == 24, "compact entry header must be 24 bytes");
+    static_assert(MAX_VALUE_SIZE <= ((uint64_t) 1 << ENTRY_VALUE_BITS), "value_len bits too narrow for MAX_VALUE_SIZE");
+    static_assert(MAX_KEY_SIZE <= 255, "key_len is one byte");
+#else
 #pragma pack ()
+#endif
+
+    /**
+     * entry的位置编码，32位：高位是buffer编号，低位是buffer内以RING_ENTRY_ALIGN为单位的偏移。
+     * 索引里存这个编码而不是8字节的指针
+     */
+    typedef struct _entry_locator_t{
+        /**
+         * 偏移占的位数
+         */
+        uint8_t offset_bits;
+
+        /**
+         * 各个buffer的基地址
+         */
+        char *buffer_base[RING_BUFFER_NUM];
+
+        /**
+         * 编码转entry
+         */
+        entry_t *entry(uint32_t loc) const{
+            uint64_t offset = (uint64_t) (loc & HASH_MASK(this->offset_bits)) * RING_ENTRY_ALIGN;
+            return (entry_t *) (this->buffer_base[loc >> this->offset_bits] + offset);
+        }
+
+        /**
+         * entry转编码
+         */
+        uint32_t loc(uint32_t buffer_index, const entry_t *entry) const{
+            uint64_t offset = (const char *) entry - this->buffer_base[buffer_index];
+            return (buffer_index << this->offset_bits) | (uint32_t) (offset / RING_ENTRY_ALIGN);
+        }
+    } entry_locator_t;
+
+    /**
+     * entry从索引上摘下来时的回调（del、同key覆盖、淘汰、过期清理、bucket_index挤掉的），
+     * 在key_len置0之前调用，调用方持有这个entry所在段的锁
+     */
+    typedef void (*unlink_callback_t)(void *ctx, const entry_t *entry);
+
+    /**
+     * 索引的分段锁，独占一个cache line，顺便记录这一段里的数据个数
+     */
+    typedef struct alignas(CACHE_LINE_SIZE) _index_lock_t{
+        std::mutex mtx;
+        //只在拿着本段锁时改，算总数的线程不拿锁直接读
+        std::atomic< uint64_t > item_num;
+
+        /**
+         * 本段的改动序号，奇数表示正在改：扩容迁移bucket、同key覆盖时会让无锁的读线程暂时找不到key，
+         * 读线程没找到时用它确认查找期间没有这种改动，有的话重查，见read_begin/read_retry
+         */
+        std::atomic< uint32_t > seq;
+
+        /**
+         * 开始改动，调用方持有mtx
+         */
+        void write_begin(){
+            this->seq.store(this->seq.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+        }
+
+        /**
+         * 改动完成
+         */
+        void write_end(){
+            this->seq.store(this->seq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        }
+
+        /**
+         * 等到没有改动时返回当前序号
+         */
+        uint32_t read_begin() const{
+            uint32_t spin = 0;
+            while (true){
+                uint32_t s = this->seq.load(std::memory_order_acquire);
+                if ((s & 1) == 0){
+                    return s;
+                }
+                if (++spin < 1024){
+                    cpu_relax();
+                }
+                else{
+                    std::this_thread::yield();
+                }
+            }
+        }
+
+        /**
+         * 从read_begin开始的查找期间有过改动，要重查
+         */
+        bool read_retry(uint32_t s) const{
+            std::atomic_thread_fence(std::memory_order_acquire);
+            return this->seq.load(std::memory_order_relaxed) != s;
+        }
+
+        /**
+         * 申请一组对齐的锁
+         */
+        static struct _index_lock_t *alloc(uint32_t num){
+            struct _index_lock_t *locks = (struct _index_lock_t *) cache_aligned_calloc(num * sizeof(struct _index_lock_t));
+            for (uint32_t i = 0; i < num; i++){
+                new(&locks[i]) struct _index_lock_t();
+                locks[i].item_num = 0;
+                locks[i].seq = 0;
+            }
+            return locks;
+        }
+
+        static void release(struct _index_lock_t *locks, uint32_t num){
+            for (uint32_t i = 0; i < num; i++){
+                locks[i].~_index_lock_t();
+            }
+            free(locks);
+        }
+    } index_lock_t;
+
+
+    /**
+     * 写入时给的过期时间：绝对时间或者相对写入时刻的TTL，单位都是毫秒，0表示不过期。
+     * 直接传uint32_t的是原来的用法，绝对的unix时间戳，单位秒
+     */
+    typedef struct _expire_t{
+        uint64_t ms;
+        bool relative;
+
+        _expire_t(uint32_t expire_time) : ms((uint64_t) expire_time * 1000), relative(false){
+        }
+
+        /**
+         * 写入后ttl毫秒过期
+         */
+        static struct _expire_t after_ms(uint64_t ttl){
+            struct _expire_t e(0);
+            e.ms = ttl;
+            e.relative = ttl > 0;
+            return e;
+        }
+
+        /**
+         * 到毫秒级的unix时间戳at时过期
+         */
+        static struct _expire_t at_ms(uint64_t at){
+            struct _expire_t e(0);
+            e.ms = at;
+            return e;
+        }
+
+        /**
+         * 换算成entry里存的绝对时间，now是当前的毫秒时间戳
+         */
+        uint64_t deadline(uint64_t now) const{
+            return this->relative ? now + this->ms : this->ms;
+        }
+    } expire_t;
+
+    /**
+     * 大小分档：key+value的长度不超过max_size（为0表示不限）的数据写到这一档的buffer里，这一档占percent%的buffer
+     */
+    typedef struct _size_class_t{
+        uint32_t max_size;
+        uint32_t percent;
+    } size_class_t;
+
+    /**
+     * 每一档的统计信息，get_stats()时的快照，命中数来自分片计数器，其余的从所属的buffer汇总
+     */
+    typedef struct _class_stats_t{
+        uint32_t index;
+        uint32_t max_size;
+        uint32_t buffer_num;
+        uint64_t cache_byte_size;
+        uint64_t item_num;
+        uint64_t set_num;
+        uint64_t evict_num;
+        uint64_t hit_num;
+
+        /**
+         * 还挂在索引上的数据个数及其entry占的字节数；item_num是写进来还没被覆盖的entry，含已删除、已被同key覆盖的
+         */
+        uint64_t live_num;
+        uint64_t live_bytes;
+
+        std::string to_string() const{
+            std::string stats;
+            stats.append("class" + std::to_string(this->index) + ": ");
+            stats.append("\tmax_size=" + std::to_string(this->max_size));
+            stats.append("\tbuffer_num=" + std::to_string(this->buffer_num));
+            stats.append("\tcache_byte_size=" + std::to_string(this->cache_byte_size / MB) + "MB");
+            stats.append("\titem_num=" + std::to_string(this->item_num));
+            stats.append("\tset_num=" + std::to_string(this->set_num));
+            stats.append("\tevict_num=" + std::to_string(this->evict_num));
+            stats.append("\thit_num=" + std::to_string(this->hit_num));
+            stats.append("\tlive_num=" + std::to_string(this->live_num));
+            stats.append("\tlive_bytes=" + std::to_string(this->live_bytes));
+            return stats;
+        }
+    } class_stats_t;
 
     /**
-     * 总的统计信息
+     * 总的统计信息，get_stats()时的快照：每个计数器只读一次，返回后不会再变，里面也没有指向运行中数据的指针
      */
     typedef struct _stats_t{
         /**
@@ -235,15 +997,195 @@ namespace ringcache{
         /**
          * 各个缓冲区的统计信息
          */
-        std::vector< buffer_stats_t * > buffer_stats;
+        std::vector< buffer_stats_t > buffer_stats;
 
         /**
-         *  总数量大小
+         * 各个大小分档的统计信息
+         */
+        std::vector< class_stats_t > class_stats;
+
+        /**
+         * 索引的数据个数、容量，以及bucket_index组满了被挤掉的数据个数
+         */
+        uint64_t index_item_num;
+        uint64_t index_capacity;
+        uint64_t index_drop_num;
+
+        /**
+         * 索引扩容：完成的次数、正在进行的这一次已迁移及总的bucket个数、上一次从开始到迁移完的耗时（微秒）
+         */
+        uint64_t index_resize_num;
+        uint64_t index_resize_done;
+        uint64_t index_resize_total;
+        uint64_t index_last_resize_us;
+
+        /**
+         * 最近一次load()：读入的字节数、重建出的数据个数、耗时（微秒）
+         */
+        uint64_t snapshot_load_bytes;
+        uint64_t snapshot_load_items;
+        uint64_t snapshot_load_us;
+
+        /**
+         * 读：找到的、没找到的、找到了但已过期的次数，以及读出的value字节数（解压后的）
+         */
+        uint64_t get_hit_num;
+        uint64_t get_miss_num;
+        uint64_t get_expired_num;
+        uint64_t read_bytes;
+
+        /**
+         * 写：写入的key+value字节数（压缩前的），以及调用del的次数
+         */
+        uint64_t write_bytes;
+        uint64_t del_call_num;
+
+        /**
+         * value压缩：压缩了的个数、压不动没压的个数、压缩前后的总字节数、压缩总耗时（纳秒），
+         * 以及解压的个数、解压总耗时（纳秒）
+         */
+        uint64_t compress_num;
+        uint64_t compress_skip_num;
+        uint64_t compress_raw_bytes;
+        uint64_t compress_out_bytes;
+        uint64_t compress_ns;
+        uint64_t decompress_num;
+        uint64_t decompress_ns;
+
+        /**
+         * 各操作的延迟分布，按LATENCY_*的顺序，没开RINGCACHE_LATENCY时为空
+         */
+        std::vector< latency_stats_t > latency;
+
+        /**
+         * 把另一个实例的统计信息加进来，分片时汇总用：计数器相加，other的buffer接在后面、编号顺延，
+         * 同一档的分档统计相加，延迟直方图逐桶相加，上一次扩容、load的耗时取大的
+         */
+        void merge(const struct _stats_t &other){
+            for (auto it:other.buffer_stats){
+                it.index += this->buffer_num;
+                this->buffer_stats.push_back(it);
+            }
+            this->buffer_num += other.buffer_num;
+            for (size_t i = 0; i < other.class_stats.size(); i++){
+                if (i >= this->class_stats.size()){
+                    this->class_stats.push_back(other.class_stats[i]);
+                    continue;
+                }
+                class_stats_t &c = this->class_stats[i];
+                c.buffer_num += other.class_stats[i].buffer_num;
+                c.cache_byte_size += other.class_stats[i].cache_byte_size;
+                c.item_num += other.class_stats[i].item_num;
+                c.set_num += other.class_stats[i].set_num;
+                c.evict_num += other.class_stats[i].evict_num;
+                c.hit_num += other.class_stats[i].hit_num;
+                c.live_num += other.class_stats[i].live_num;
+                c.live_bytes += other.class_stats[i].live_bytes;
+            }
+            this->index_item_num += other.index_item_num;
+            this->index_capacity += other.index_capacity;
+            this->index_drop_num += other.index_drop_num;
+            this->index_resize_num += other.index_resize_num;
+            this->index_resize_done += other.index_resize_done;
+            this->index_resize_total += other.index_resize_total;
+            this->index_last_resize_us = std::max(this->index_last_resize_us, other.index_last_resize_us);
+            this->snapshot_load_bytes += other.snapshot_load_bytes;
+            this->snapshot_load_items += other.snapshot_load_items;
+            this->snapshot_load_us = std::max(this->snapshot_load_us, other.snapshot_load_us);
+            this->get_hit_num += other.get_hit_num;
+            this->get_miss_num += other.get_miss_num;
+            this->get_expired_num += other.get_expired_num;
+            this->read_bytes += other.read_bytes;
+            this->write_bytes += other.write_bytes;
+            this->del_call_num += other.del_call_num;
+            this->compress_num += other.compress_num;
+            this->compress_skip_num += other.compress_skip_num;
+            this->compress_raw_bytes += other.compress_raw_bytes;
+            this->compress_out_bytes += other.compress_out_bytes;
+            this->compress_ns += other.compress_ns;
+            this->decompress_num += other.decompress_num;
+            this->decompress_ns += other.decompress_ns;
+            for (size_t i = 0; i < other.latency.size(); i++){
+                if (i >= this->latency.size()){
+                    this->latency.push_back(other.latency[i]);
+                    continue;
+                }
+                latency_stats_t &l = this->latency[i];
+                l.count += other.latency[i].count;
+                l.sum_ns += other.latency[i].sum_ns;
+                for (size_t k = 0; k < l.buckets.size() && k < other.latency[i].buckets.size(); k++){
+                    l.buckets[k] += other.latency[i].buckets[k];
+                }
+            }
+        }
+
+        /**
+         * 压缩比，没压过时为0
+         */
+        double compress_ratio() const{
+            return this->compress_out_bytes > 0 ? (double) this->compress_raw_bytes / this->compress_out_bytes : 0;
+        }
+
+        /**
+         * 读命中率，没读过时为0
+         */
+        double hit_rate() const{
+            uint64_t total = this->get_hit_num + this->get_miss_num + this->get_expired_num;
+            return total > 0 ? (double) this->get_hit_num / total : 0;
+        }
+
+        /**
+         * 总数量大小：索引里的有效数据，已删除、被替换的不算
          */
         uint64_t item_num() const{
+            return this->index_item_num;
+        }
+
+        /**
+         * 总写入次数
+         */
+        uint64_t set_num() const{
             uint64_t ret = 0;
-            for (auto it:this->buffer_stats){
-                ret += it->item_num;
+            for (auto &it:this->buffer_stats){
+                ret += it.set_num;
+            }
+            return ret;
+        }
+
+        /**
+         * 已过期、还没清理掉的数据个数及字节数，清理线程每扫完一圈更新一次
+         */
+        uint64_t expired_num() const{
+            uint64_t ret = 0;
+            for (auto &it:this->buffer_stats){
+                ret += it.expired_num;
+            }
+            return ret;
+        }
+
+        uint64_t expired_bytes() const{
+            uint64_t ret = 0;
+            for (auto &it:this->buffer_stats){
+                ret += it.expired_bytes;
+            }
+            return ret;
+        }
+
+        /**
+         * 清理线程摘掉的过期数据个数及字节数
+         */
+        uint64_t sweep_num() const{
+            uint64_t ret = 0;
+            for (auto &it:this->buffer_stats){
+                ret += it.sweep_num;
+            }
+            return ret;
+        }
+
+        uint64_t sweep_bytes() const{
+            uint64_t ret = 0;
+            for (auto &it:this->buffer_stats){
+                ret += it.sweep_bytes;
             }
             return ret;
         }
@@ -254,8 +1196,8 @@ namespace ringcache{
         std::string cache_size() const{
             std::string csize;
             uint64_t msize = 0;
-            for (auto it:this->buffer_stats){
-                msize += it->cache_byte_size;
+            for (auto &it:this->buffer_stats){
+                msize += it.cache_byte_size;
             }
             char buf[32] = {0};
             msize = msize / MB;
@@ -274,12 +1216,55 @@ namespace ringcache{
          */
         std::string to_string() const{
             std::string stats;
+            char buf[64] = {0};
             stats.append("\n---------------------stats---------------------\n");
             stats.append("item_num=" + std::to_string(this->item_num()));
             stats.append("\tcache_size=" + this->cache_size());
             stats.append("\tbuffer_num=" + std::to_string(this->buffer_num));
-            for (auto it:this->buffer_stats){
-                stats.append("\n\t -" + it->to_string());
+            stats.append("\tindex_item_num=" + std::to_string(this->index_item_num));
+            stats.append("\tindex_capacity=" + std::to_string(this->index_capacity));
+            stats.append("\tindex_drop_num=" + std::to_string(this->index_drop_num));
+            stats.append("\tindex_resize_num=" + std::to_string(this->index_resize_num));
+            stats.append("\tindex_resize=" + std::to_string(this->index_resize_done) + "/" + std::to_string(this->index_resize_total));
+            stats.append("\tindex_last_resize_us=" + std::to_string(this->index_last_resize_us));
+            snprintf(buf, sizeof(buf), "%.4f", this->hit_rate());
+            stats.append("\tget_hit_num=" + std::to_string(this->get_hit_num));
+            stats.append("\tget_miss_num=" + std::to_string(this->get_miss_num));
+            stats.append("\tget_expired_num=" + std::to_string(this->get_expired_num));
+            stats.append("\thit_rate=" + std::string(buf));
+            stats.append("\tread_bytes=" + std::to_string(this->read_bytes));
+            stats.append("\tset_num=" + std::to_string(this->set_num()));
+            stats.append("\twrite_bytes=" + std::to_string(this->write_bytes));
+            stats.append("\tdel_call_num=" + std::to_string(this->del_call_num));
+            stats.append("\texpired_num=" + std::to_string(this->expired_num()));
+            stats.append("\texpired_bytes=" + std::to_string(this->expired_bytes()));
+            stats.append("\tsweep_num=" + std::to_string(this->sweep_num()));
+            stats.append("\tsweep_bytes=" + std::to_string(this->sweep_bytes()));
+            if (this->snapshot_load_us > 0){
+                stats.append("\tsnapshot_load_bytes=" + std::to_string(this->snapshot_load_bytes));
+                stats.append("\tsnapshot_load_items=" + std::to_string(this->snapshot_load_items));
+                stats.append("\tsnapshot_load_us=" + std::to_string(this->snapshot_load_us));
+            }
+            uint64_t tried = this->compress_num + this->compress_skip_num;
+            if (tried > 0){
+                snprintf(buf, sizeof(buf), "%.2f", this->compress_ratio());
+                stats.append("\tcompress_num=" + std::to_string(this->compress_num));
+                stats.append("\tcompress_skip_num=" + std::to_string(this->compress_skip_num));
+                stats.append("\tcompress_ratio=" + std::string(buf));
+                stats.append("\tcompress_ns_per_op=" + std::to_string(this->compress_ns / tried));
+                stats.append("\tdecompress_num=" + std::to_string(this->decompress_num));
+                if (this->decompress_num > 0){
+                    stats.append("\tdecompress_ns_per_op=" + std::to_string(this->decompress_ns / this->decompress_num));
+                }
+            }
+            for (auto &it:this->latency){
+                stats.append("\n\t -" + it.to_string());
+            }
+            for (auto &it:this->class_stats){
+                stats.append("\n\t -" + it.to_string());
+            }
+            for (auto &it:this->buffer_stats){
+                stats.append("\n\t -" + it.to_string());
             }
             return stats;
         }
@@ -0,0 +1,234 @@
+/*************************************************************************
+ * File:	epoch.h
+ * Author:	liuyongshuai<liuyongshuai@hotmail.com>
+ * Time:	2026-10-17 10:12
+ ************************************************************************/
+#ifndef _RINGCACHE_EPOCH_H_202610171012_
+#define _RINGCACHE_EPOCH_H_202610171012_
+
+#include <atomic>
+#include <thread>
+#include <stdint.h>
+
+//同时读数据的线程数上限，每个读线程独占一个槽位
+#ifndef EPOCH_SLOT_NUM
+#define EPOCH_SLOT_NUM 1024
+#endif
+
+//cache line大小
+#define CACHE_LINE_SIZE 64
+
+namespace ringcache{
+    /**
+     * 自旋等待时让出流水线
+     */
+    inline void cpu_relax(){
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#endif
+    }
+
+    /**
+     * 读线程的槽位，独占一个cache line，避免伪共享
+     */
+    typedef struct alignas(CACHE_LINE_SIZE) _epoch_slot_t{
+        /**
+         * 0表示当前没有在读，否则为进入读临界区时的全局epoch
+         */
+        std::atomic< uint64_t > epoch;
+
+        /**
+         * 是否已被某个线程占用
+         */
+        std::atomic< bool > in_use;
+    } epoch_slot_t;
+
+    /**
+     * 基于epoch的内存回收：
+     * 读线程进入临界区时登记当前epoch，离开时清零；
+     * 写线程在把已摘链的内存（环形缓冲区里被覆盖的entry、扩容后的旧hash表）
+     * 重新利用之前调用synchronize()，等所有在此之前进入的读线程都离开。
+     * 读线程全程不加锁，也就不会读到已释放或正在被改写的内存。
+     */
+    class epoch_domain{
+    public:
+        /**
+         * 全局唯一，所有的ringcache实例共用
+         */
+        static epoch_domain &instance(){
+            static epoch_domain domain;
+            return domain;
+        }
+
+        /**
+         * 进入读临界区，支持嵌套
+         */
+        void enter(){
+            epoch_thread_t &t = this->thread_state();
+            if (t.depth++ > 0){
+                return;
+            }
+            if (t.slot < 0){
+                t.slot = this->claim_slot();
+            }
+            this->slots[t.slot].epoch.store(this->global_epoch.load(std::memory_order_acquire), std::memory_order_relaxed);
+            //保证后面对hash表的读取不会被重排到登记之前
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+        }
+
+        /**
+         * 离开读临界区
+         */
+        void leave(){
+            epoch_thread_t &t = this->thread_state();
+            if (--t.depth > 0){
+                return;
+            }
+            this->slots[t.slot].epoch.store(0, std::memory_order_release);
+        }
+
+        /**
+         * 等待一个宽限期：调用之前摘链的内存，在返回之后不会再被任何读线程访问
+         * 当前线程自己若在读临界区内则跳过，避免自己等自己；
+         * 这时自己可能还在读摘链的内存，不能把synced_epoch推上去，否则别的写线程会当成已经等过宽限期
+         */
+        void synchronize(){
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            uint64_t target = this->global_epoch.fetch_add(1) + 1;
+            epoch_thread_t &t = this->thread_state();
+            int32_t self = t.depth > 0 ? t.slot : -1;
+            uint32_t slot_num = this->slot_max.load(std::memory_order_acquire);
+            for (uint32_t i = 0; i < slot_num; i++){
+                if ((int32_t) i == self){
+                    continue;
+                }
+                uint32_t spin = 0;
+                while (true){
+                    uint64_t e = this->slots[i].epoch.load(std::memory_order_acquire);
+                    if (e == 0 || e >= target){
+                        break;
+                    }
+                    if (++spin < 1024){
+                        cpu_relax();
+                    }
+                    else{
+                        std::this_thread::yield();
+                    }
+                }
+            }
+            if (self >= 0){
+                return;
+            }
+            uint64_t synced = this->synced_epoch.load();
+            while (synced < target && !this->synced_epoch.compare_exchange_weak(synced, target)){
+            }
+        }
+
+        /**
+         * 摘链之后调用，返回的回收戳存在entry里：之后开始的synchronize()完成了，这块内存才能重新利用，见is_synced()
+         */
+        uint64_t unlink_stamp(){
+            //摘链的写入不能被重排到读global_epoch之后，和synchronize()开头的fence配对
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            return this->global_epoch.load() + 1;
+        }
+
+        /**
+         * 回收戳为stamp的内存是否已经等过宽限期，是的话不用再synchronize()就能改写
+         */
+        bool is_synced(uint64_t stamp) const{
+            return this->synced_epoch.load(std::memory_order_acquire) >= stamp;
+        }
+
+        /**
+         * 线程退出时归还槽位
+         */
+        void release_slot(int32_t slot){
+            this->slots[slot].epoch.store(0, std::memory_order_release);
+            this->slots[slot].in_use.store(false, std::memory_order_release);
+        }
+
+    private:
+        /**
+         * 每个线程的状态
+         */
+        typedef struct _epoch_thread_t{
+            int32_t slot;
+            uint32_t depth;
+
+            _epoch_thread_t() : slot(-1), depth(0){}
+
+            ~_epoch_thread_t(){
+                if (this->slot >= 0){
+                    epoch_domain::instance().release_slot(this->slot);
+                }
+            }
+        } epoch_thread_t;
+
+        epoch_domain() : global_epoch(1), synced_epoch(1), slot_max(0){
+            for (uint32_t i = 0; i < EPOCH_SLOT_NUM; i++){
+                this->slots[i].epoch = 0;
+                this->slots[i].in_use = false;
+            }
+        }
+
+        epoch_thread_t &thread_state(){
+            static thread_local epoch_thread_t t;
+            return t;
+        }
+
+        /**
+         * 给当前线程找一个空闲的槽位，都被占了就等着
+         */
+        int32_t claim_slot(){
+            while (true){
+                for (uint32_t i = 0; i < EPOCH_SLOT_NUM; i++){
+                    bool used = false;
+                    if (this->slots[i].in_use.load(std::memory_order_relaxed)){
+                        continue;
+                    }
+                    if (!this->slots[i].in_use.compare_exchange_strong(used, true)){
+                        continue;
+                    }
+                    //更新槽位的高水位，synchronize只扫描到这里
+                    uint32_t cur_max = this->slot_max.load();
+                    while (cur_max < i + 1 && !this->slot_max.compare_exchange_weak(cur_max, i + 1)){
+                    }
+                    return (int32_t) i;
+                }
+                std::this_thread::yield();
+            }
+        }
+
+        /**
+         * 全局epoch，从1开始，0表示槽位空闲
+         */
+        alignas(CACHE_LINE_SIZE) std::atomic< uint64_t > global_epoch;
+
+        /**
+         * 已经完成的synchronize()里最大的那个epoch，从来没有链上过的空闲块的回收戳为1，不用等
+         */
+        alignas(CACHE_LINE_SIZE) std::atomic< uint64_t > synced_epoch;
+        alignas(CACHE_LINE_SIZE) std::atomic< uint32_t > slot_max;
+        epoch_slot_t slots[EPOCH_SLOT_NUM];
+    };
+
+    /**
+     * 读临界区的守卫
+     */
+    class epoch_guard{
+    public:
+        epoch_guard(){
+            epoch_domain::instance().enter();
+        }
+
+        ~epoch_guard(){
+            epoch_domain::instance().leave();
+        }
+
+    private:
+        epoch_guard(const epoch_guard &);
+        epoch_guard &operator=(const epoch_guard &);
+    };
+}
+#endif //_RINGCACHE_EPOCH_H_202610171012_
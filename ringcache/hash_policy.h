@@ -0,0 +1,178 @@
+/*************************************************************************
+ * File:	hash_policy.h
+ * Author:	liuyongshuai<liuyongshuai@hotmail.com>
+ * Time:	2026-10-19 15:10
+ * 可选的hash函数，作为basic_ringcache的模板参数：
+ * 重载uint32_t operator()(const char *key, size_t len) const即可
+ ************************************************************************/
+#ifndef _RINGCACHE_HASH_POLICY_H_202610191510_
+#define _RINGCACHE_HASH_POLICY_H_202610191510_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "jenkins_hash.h"
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+namespace ringcache{
+    /**
+     * 默认的Bob Jenkins hash，一次处理4个字节
+     */
+    struct jenkins_hasher{
+        uint32_t operator()(const char *key, size_t len) const{
+            return jenkins_hash(key, len);
+        }
+    };
+
+    /**
+     * wyhash（final4），一次处理8个字节，靠64x64->128位乘法混合，
+     * 参见：https://github.com/wangyi-fudan/wyhash
+     */
+    struct wy_hasher{
+        uint32_t operator()(const char *key, size_t len) const{
+            uint64_t h = wyhash((const uint8_t *) key, len, 0);
+            return (uint32_t) (h ^ (h >> 32));
+        }
+
+    private:
+        static void mum(uint64_t *a, uint64_t *b){
+            __uint128_t r = *a;
+            r *= *b;
+            *a = (uint64_t) r;
+            *b = (uint64_t) (r >> 64);
+        }
+
+        static uint64_t mix(uint64_t a, uint64_t b){
+            mum(&a, &b);
+            return a ^ b;
+        }
+
+        static uint64_t r8(const uint8_t *p){
+            uint64_t v;
+            memcpy(&v, p, 8);
+            return v;
+        }
+
+        static uint64_t r4(const uint8_t *p){
+            uint32_t v;
+            memcpy(&v, p, 4);
+            return v;
+        }
+
+        static uint64_t r3(const uint8_t *p, size_t k){
+            return (((uint64_t) p[0]) << 16) | (((uint64_t) p[k >> 1]) << 8) | p[k - 1];
+        }
+
+        static uint64_t wyhash(const uint8_t *p, size_t len, uint64_t seed){
+            static const uint64_t secret[4] = {0x2d358dccaa6c78a5ull, 0x8bb84b93962eacc9ull, 0x4b33a62ed433d4a3ull, 0x4d5a2da51de1aa47ull};
+            seed ^= mix(seed ^ secret[0], secret[1]);
+            uint64_t a, b;
+            if (len <= 16){
+                if (len >= 4){
+                    a = (r4(p) << 32) | r4(p + ((len >> 3) << 2));
+                    b = (r4(p + len - 4) << 32) | r4(p + len - 4 - ((len >> 3) << 2));
+                }
+                else if (len > 0){
+                    a = r3(p, len);
+                    b = 0;
+                }
+                else{
+                    a = b = 0;
+                }
+            }
+            else{
+                size_t i = len;
+                if (i > 48){
+                    uint64_t see1 = seed, see2 = seed;
+                    do{
+                        seed = mix(r8(p) ^ secret[1], r8(p + 8) ^ seed);
+                        see1 = mix(r8(p + 16) ^ secret[2], r8(p + 24) ^ see1);
+                        see2 = mix(r8(p + 32) ^ secret[3], r8(p + 40) ^ see2);
+                        p += 48;
+                        i -= 48;
+                    }while (i > 48);
+                    seed ^= see1 ^ see2;
+                }
+                while (i > 16){
+                    seed = mix(r8(p) ^ secret[1], r8(p + 8) ^ seed);
+                    i -= 16;
+                    p += 16;
+                }
+                a = r8(p + i - 16);
+                b = r8(p + i - 8);
+            }
+            a ^= secret[1];
+            b ^= seed;
+            mum(&a, &b);
+            return mix(a ^ secret[0] ^ len, b ^ secret[1]);
+        }
+    };
+
+    /**
+     * CRC32C：CPU支持SSE4.2时用crc32指令一次处理8个字节，否则查表。
+     * CRC是线性的，最后再用murmur3的fmix32打散一下，bucket用的低位和tag用的高位才都够均匀
+     */
+    struct crc32c_hasher{
+        uint32_t operator()(const char *key, size_t len) const{
+#if defined(__x86_64__)
+            static const bool hw = __builtin_cpu_supports("sse4.2");
+            uint32_t crc = hw ? crc32c_hw((const uint8_t *) key, len) : crc32c_sw((const uint8_t *) key, len);
+#else
+            uint32_t crc = crc32c_sw((const uint8_t *) key, len);
+#endif
+            crc ^= crc >> 16;
+            crc *= 0x85ebca6b;
+            crc ^= crc >> 13;
+            crc *= 0xc2b2ae35;
+            crc ^= crc >> 16;
+            return crc;
+        }
+
+    private:
+#if defined(__x86_64__)
+        __attribute__((target("sse4.2")))
+        static uint32_t crc32c_hw(const uint8_t *p, size_t len){
+            uint64_t crc = 0xffffffff;
+            for (; len >= 8; len -= 8, p += 8){
+                uint64_t v;
+                memcpy(&v, p, 8);
+                crc = _mm_crc32_u64(crc, v);
+            }
+            uint32_t crc32 = (uint32_t) crc;
+            for (; len > 0; len--, p++){
+                crc32 = _mm_crc32_u8(crc32, *p);
+            }
+            return ~crc32;
+        }
+#endif
+
+        static uint32_t crc32c_sw(const uint8_t *p, size_t len){
+            static const crc32c_table_t table;
+            uint32_t crc = 0xffffffff;
+            for (; len > 0; len--, p++){
+                crc = table.v[(crc ^ *p) & 0xff] ^ (crc >> 8);
+            }
+            return ~crc;
+        }
+
+        /**
+         * 查表用的，多项式0x82F63B78（反序的0x1EDC6F41）
+         */
+        struct crc32c_table_t{
+            uint32_t v[256];
+
+            crc32c_table_t(){
+                for (uint32_t i = 0; i < 256; i++){
+                    uint32_t c = i;
+                    for (uint32_t k = 0; k < 8; k++){
+                        c = (c & 1) ? (c >> 1) ^ 0x82F63B78 : c >> 1;
+                    }
+                    this->v[i] = c;
+                }
+            }
+        };
+    };
+}
+#endif //_RINGCACHE_HASH_POLICY_H_202610191510_
@@ -0,0 +1,211 @@
+/*************************************************************************
+ * File:	histogram.h
+ * Author:	liuyongshuai<liuyongshuai@hotmail.com>
+ * Time:	2026-10-23 10:30
+ * 延迟直方图：HDR式的对数线性分桶，每个2的幂区间再均分成2^RING_LATENCY_SUB_BITS份，相对误差不超过1/2^RING_LATENCY_SUB_BITS。
+ * 计数放在按线程分片的计数器里，记一次只是本线程那一片上的两次relaxed原子加
+ ************************************************************************/
+#ifndef _RINGCACHE_HISTOGRAM_H_202610231030_
+#define _RINGCACHE_HISTOGRAM_H_202610231030_
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <time.h>
+#include "counters.h"
+
+//每个2的幂区间分成几份（以2为底的对数），3即8份，误差12.5%
+#ifndef RING_LATENCY_SUB_BITS
+#define RING_LATENCY_SUB_BITS 3
+#endif
+
+//能记的最大延迟（以2为底的对数，纳秒），40约为18分钟，再大的都记到最后一个桶里
+#ifndef RING_LATENCY_MAX_BITS
+#define RING_LATENCY_MAX_BITS 40
+#endif
+
+//采样：每个线程每RING_LATENCY_SAMPLE次操作记一次，要是2的幂，1表示每次都记。锁等待不采样，等了就记
+#ifndef RING_LATENCY_SAMPLE
+#define RING_LATENCY_SAMPLE 1
+#endif
+
+namespace ringcache{
+    /**
+     * 记延迟的几种操作，multi_get/multi_set不记
+     */
+    enum{
+        LATENCY_GET = 0,            //get/get_into/visit，从查找到拷贝完
+        LATENCY_SET,                //set，含压缩
+        LATENCY_DEL,                //del
+        LATENCY_BUFFER_LOCK_WAIT,   //阻塞等buffer锁；原子预留模式下是等别的线程切段
+        LATENCY_INDEX_LOCK_WAIT,    //等索引的分段锁
+        LATENCY_EVICT,              //为写入腾空间：淘汰旧数据并等读线程离开
+        LATENCY_OP_NUM
+    };
+
+    inline const char *latency_op_name(uint32_t op){
+        static const char *names[LATENCY_OP_NUM] = {"get", "set", "del", "buffer_lock_wait", "index_lock_wait", "evict"};
+        return op < LATENCY_OP_NUM ? names[op] : "unknown";
+    }
+
+    /**
+     * 单调时钟，纳秒
+     */
+    inline uint64_t latency_now_ns(){
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+    }
+
+    /**
+     * 分桶规则：小于2^SUB_BITS的每个值一个桶，之后每个2的幂区间2^SUB_BITS个桶
+     */
+    struct latency_buckets{
+        static const uint32_t SUB_NUM = 1u << RING_LATENCY_SUB_BITS;
+        static const uint32_t NUM = (RING_LATENCY_MAX_BITS - RING_LATENCY_SUB_BITS + 1) * SUB_NUM;
+
+        static uint32_t index_of(uint64_t ns){
+            if (ns < SUB_NUM){
+                return ns;
+            }
+            uint32_t e = 63 - __builtin_clzll(ns);
+            if (e >= RING_LATENCY_MAX_BITS){
+                return NUM - 1;
+            }
+            uint32_t shift = e - RING_LATENCY_SUB_BITS;
+            return (shift + 1) * SUB_NUM + (uint32_t) (ns >> shift) - SUB_NUM;
+        }
+
+        /**
+         * 第idx个桶的下界（含），上界是下一个桶的下界
+         */
+        static uint64_t lower_of(uint32_t idx){
+            if (idx < SUB_NUM){
+                return idx;
+            }
+            uint32_t shift = idx / SUB_NUM - 1;
+            return (uint64_t) (idx % SUB_NUM + SUB_NUM) << shift;
+        }
+
+        static uint64_t upper_of(uint32_t idx){
+            return lower_of(idx + 1);
+        }
+    };
+
+    /**
+     * 一种操作的延迟分布，get_stats()时的快照
+     */
+    typedef struct _latency_stats_t{
+        std::string name;
+        uint64_t count;
+        uint64_t sum_ns;
+        std::vector< uint64_t > buckets;
+
+        /**
+         * 分位数q（0~1）对应的延迟：落在哪个桶里就取这个桶能表示的最大值，没数据时为0
+         */
+        uint64_t percentile(double q) const{
+            if (this->count == 0){
+                return 0;
+            }
+            uint64_t rank = (uint64_t) (q * this->count + 0.5);
+            rank = rank < 1 ? 1 : (rank > this->count ? this->count : rank);
+            uint64_t seen = 0;
+            for (uint32_t i = 0; i < this->buckets.size(); i++){
+                seen += this->buckets[i];
+                if (seen >= rank){
+                    return latency_buckets::upper_of(i) - 1;
+                }
+            }
+            return latency_buckets::upper_of(this->buckets.size() - 1) - 1;
+        }
+
+        uint64_t max() const{
+            return this->percentile(1.0);
+        }
+
+        double mean() const{
+            return this->count > 0 ? (double) this->sum_ns / this->count : 0;
+        }
+
+        std::string to_string() const{
+            std::string stats;
+            stats.append(this->name + ": ");
+            stats.append("\tcount=" + std::to_string(this->count));
+            stats.append("\tmean_ns=" + std::to_string((uint64_t) this->mean()));
+            stats.append("\tp50_ns=" + std::to_string(this->percentile(0.5)));
+            stats.append("\tp99_ns=" + std::to_string(this->percentile(0.99)));
+            stats.append("\tp999_ns=" + std::to_string(this->percentile(0.999)));
+            stats.append("\tmax_ns=" + std::to_string(this->max()));
+            return stats;
+        }
+    } latency_stats_t;
+
+    /**
+     * 一个实例的所有延迟直方图：每种操作NUM个桶再加一个总耗时
+     */
+    class latency_histograms{
+    public:
+        latency_histograms() : counters(LATENCY_OP_NUM * STRIDE){
+        }
+
+        /**
+         * 本线程这一次要不要记
+         */
+        static bool sampled(){
+            static thread_local uint32_t n = 0;
+            return (n++ & (RING_LATENCY_SAMPLE - 1)) == 0;
+        }
+
+        void record(uint32_t op, uint64_t ns){
+            this->counters.add(op * STRIDE + latency_buckets::index_of(ns), 1);
+            this->counters.add(op * STRIDE + latency_buckets::NUM, ns);
+        }
+
+        void snapshot(std::vector< latency_stats_t > &out) const{
+            std::vector< uint64_t > sums(this->counters.size());
+            this->counters.sum_all(sums.data());
+            out.resize(LATENCY_OP_NUM);
+            for (uint32_t op = 0; op < LATENCY_OP_NUM; op++){
+                latency_stats_t &s = out[op];
+                s.name = latency_op_name(op);
+                s.buckets.assign(sums.begin() + op * STRIDE, sums.begin() + op * STRIDE + latency_buckets::NUM);
+                s.sum_ns = sums[op * STRIDE + latency_buckets::NUM];
+                s.count = 0;
+                for (auto n:s.buckets){
+                    s.count += n;
+                }
+            }
+        }
+
+    private:
+        static const uint32_t STRIDE = latency_buckets::NUM + 1;
+        sharded_counters counters;
+    };
+
+    /**
+     * 记一段代码的耗时，析构时记上，中途return也能记到。没开RINGCACHE_LATENCY时是空的
+     */
+    class latency_scope{
+    public:
+#ifdef RINGCACHE_LATENCY
+        latency_scope(latency_histograms *h, uint32_t op) : h(h), op(op), begin(latency_histograms::sampled() ? latency_now_ns() : 0){
+        }
+
+        ~latency_scope(){
+            if (this->begin > 0){
+                this->h->record(this->op, latency_now_ns() - this->begin);
+            }
+        }
+
+    private:
+        latency_histograms *h;
+        uint32_t op;
+        uint64_t begin;
+#else
+        latency_scope(latency_histograms *, uint32_t){
+        }
+#endif
+    };
+}
+#endif //_RINGCACHE_HISTOGRAM_H_202610231030_
@@ -0,0 +1,280 @@
+/*************************************************************************
+ * File:	metrics.h
+ * Author:	liuyongshuai<liuyongshuai@hotmail.com>
+ * Time:	2026-10-23 15:10
+ * 把get_stats()的快照导出成Prometheus的文本格式或者JSON，给监控采集、报警用
+ ************************************************************************/
+#ifndef _RINGCACHE_METRICS_H_202610231510_
+#define _RINGCACHE_METRICS_H_202610231510_
+
+#include <string>
+#include <stdio.h>
+#include <stdint.h>
+#include "entry.h"
+#include "histogram.h"
+
+namespace ringcache{
+    namespace metrics_detail{
+        inline void append_metric(std::string &out, const std::string &name, const char *type, const char *help){
+            out.append("# HELP " + name + " " + help + "\n");
+            out.append("# TYPE " + name + " " + type + "\n");
+        }
+
+        inline void append_sample(std::string &out, const std::string &name, const std::string &labels, uint64_t value){
+            out.append(name);
+            if (!labels.empty()){
+                out.append("{" + labels + "}");
+            }
+            out.append(" " + std::to_string(value) + "\n");
+        }
+
+        inline std::string seconds(uint64_t ns){
+            char buf[32];
+            snprintf(buf, sizeof(buf), "%.9g", (double) ns / 1e9);
+            return buf;
+        }
+
+        inline void append_sample(std::string &out, const std::string &name, const std::string &labels, const std::string &value){
+            out.append(name + "{" + labels + "} " + value + "\n");
+        }
+
+        inline void append_json(std::string &out, const char *key, uint64_t value, bool first = false){
+            out.append(first ? "\"" : ",\"");
+            out.append(key);
+            out.append("\":" + std::to_string(value));
+        }
+
+        inline void append_json_double(std::string &out, const char *key, double value){
+            char buf[32];
+            snprintf(buf, sizeof(buf), "%.6g", value);
+            out.append(",\"");
+            out.append(key);
+            out.append("\":");
+            out.append(buf);
+        }
+    }
+
+    /**
+     * Prometheus的文本格式（exposition format 0.0.4），prefix是各指标名的前缀。
+     * 延迟按op标签导出成一个histogram，只在2的幂纳秒处给出le，另外单独导出p50/p90/p99/p999，方便直接配报警
+     */
+    inline std::string to_prometheus(const stats_t &stats, const std::string &prefix = "ringcache"){
+        using namespace metrics_detail;
+        std::string out;
+        uint64_t cache_bytes = 0, evict_num = 0, lock_wait_num = 0, lock_busy_num = 0, reserve_wait_num = 0;
+        for (auto &it:stats.buffer_stats){
+            cache_bytes += it.cache_byte_size;
+            evict_num += it.evict_num;
+            lock_wait_num += it.lock_wait_num;
+            lock_busy_num += it.lock_busy_num;
+            reserve_wait_num += it.reserve_wait_num;
+        }
+
+        append_metric(out, prefix + "_items", "gauge", "Live items in the index.");
+        append_sample(out, prefix + "_items", "", stats.item_num());
+        append_metric(out, prefix + "_cache_bytes", "gauge", "Memory held by ring buffers.");
+        append_sample(out, prefix + "_cache_bytes", "", cache_bytes);
+        append_metric(out, prefix + "_index_capacity", "gauge", "Index capacity in items.");
+        append_sample(out, prefix + "_index_capacity", "", stats.index_capacity);
+        append_metric(out, prefix + "_index_drop_total", "counter", "Items dropped because a bucket group was full.");
+        append_sample(out, prefix + "_index_drop_total", "", stats.index_drop_num);
+        append_metric(out, prefix + "_index_resize_total", "counter", "Completed index resizes.");
+        append_sample(out, prefix + "_index_resize_total", "", stats.index_resize_num);
+
+        append_metric(out, prefix + "_get_total", "counter", "Lookups by result.");
+        append_sample(out, prefix + "_get_total", "result=\"hit\"", stats.get_hit_num);
+        append_sample(out, prefix + "_get_total", "result=\"miss\"", stats.get_miss_num);
+        append_sample(out, prefix + "_get_total", "result=\"expired\"", stats.get_expired_num);
+        append_metric(out, prefix + "_read_bytes_total", "counter", "Value bytes returned by reads.");
+        append_sample(out, prefix + "_read_bytes_total", "", stats.read_bytes);
+        append_metric(out, prefix + "_set_total", "counter", "Items written.");
+        append_sample(out, prefix + "_set_total", "", stats.set_num());
+        append_metric(out, prefix + "_write_bytes_total", "counter", "Key and value bytes written, before compression.");
+        append_sample(out, prefix + "_write_bytes_total", "", stats.write_bytes);
+        append_metric(out, prefix + "_del_total", "counter", "Calls to del.");
+        append_sample(out, prefix + "_del_total", "", stats.del_call_num);
+        append_metric(out, prefix + "_evict_total", "counter", "Live items evicted to make room.");
+        append_sample(out, prefix + "_evict_total", "", evict_num);
+        append_metric(out, prefix + "_expired_items", "gauge", "Expired items still occupying space at the last sweep.");
+        append_sample(out, prefix + "_expired_items", "", stats.expired_num());
+        append_metric(out, prefix + "_sweep_total", "counter", "Expired items removed by the sweeper.");
+        append_sample(out, prefix + "_sweep_total", "", stats.sweep_num());
+        append_metric(out, prefix + "_buffer_lock_busy_total", "counter", "Buffer try_lock failures.");
+        append_sample(out, prefix + "_buffer_lock_busy_total", "", lock_busy_num);
+        append_metric(out, prefix + "_buffer_lock_wait_total", "counter", "Blocking waits for a buffer lock.");
+        append_sample(out, prefix + "_buffer_lock_wait_total", "", lock_wait_num);
+        append_metric(out, prefix + "_reserve_wait_total", "counter", "Writers that waited for a segment roll.");
+        append_sample(out, prefix + "_reserve_wait_total", "", reserve_wait_num);
+        if (stats.compress_num + stats.compress_skip_num > 0){
+            append_metric(out, prefix + "_compress_total", "counter", "Values by compression outcome.");
+            append_sample(out, prefix + "_compress_total", "result=\"compressed\"", stats.compress_num);
+            append_sample(out, prefix + "_compress_total", "result=\"skipped\"", stats.compress_skip_num);
+            append_metric(out, prefix + "_compress_raw_bytes_total", "counter", "Bytes before compression.");
+            append_sample(out, prefix + "_compress_raw_bytes_total", "", stats.compress_raw_bytes);
+            append_metric(out, prefix + "_compress_out_bytes_total", "counter", "Bytes after compression.");
+            append_sample(out, prefix + "_compress_out_bytes_total", "", stats.compress_out_bytes);
+        }
+
+        if (stats.class_stats.size() > 1){
+            append_metric(out, prefix + "_class_items", "gauge", "Items occupying space per size class.");
+            for (auto &it:stats.class_stats){
+                append_sample(out, prefix + "_class_items", "class=\"" + std::to_string(it.index) + "\"", it.item_num);
+            }
+            append_metric(out, prefix + "_class_live_items", "gauge", "Items still linked in the index per size class.");
+            for (auto &it:stats.class_stats){
+                append_sample(out, prefix + "_class_live_items", "class=\"" + std::to_string(it.index) + "\"", it.live_num);
+            }
+            append_metric(out, prefix + "_class_live_bytes", "gauge", "Bytes of entries still linked in the index per size class.");
+            for (auto &it:stats.class_stats){
+                append_sample(out, prefix + "_class_live_bytes", "class=\"" + std::to_string(it.index) + "\"", it.live_bytes);
+            }
+            append_metric(out, prefix + "_class_evict_total", "counter", "Evictions per size class.");
+            for (auto &it:stats.class_stats){
+                append_sample(out, prefix + "_class_evict_total", "class=\"" + std::to_string(it.index) + "\"", it.evict_num);
+            }
+            append_metric(out, prefix + "_class_hit_total", "counter", "Hits per size class.");
+            for (auto &it:stats.class_stats){
+                append_sample(out, prefix + "_class_hit_total", "class=\"" + std::to_string(it.index) + "\"", it.hit_num);
+            }
+        }
+
+        if (!stats.latency.empty()){
+            std::string name = prefix + "_op_latency_seconds";
+            append_metric(out, name, "histogram", "Operation latency.");
+            for (auto &it:stats.latency){
+                std::string op = "op=\"" + it.name + "\"";
+                uint64_t seen = 0;
+                uint32_t idx = 0;
+                for (uint32_t bits = RING_LATENCY_SUB_BITS; bits <= RING_LATENCY_MAX_BITS; bits++){
+                    uint64_t le = (uint64_t) 1 << bits;
+                    while (idx < it.buckets.size() && latency_buckets::upper_of(idx) <= le){
+                        seen += it.buckets[idx++];
+                    }
+                    append_sample(out, name + "_bucket", op + ",le=\"" + seconds(le) + "\"", seen);
+                }
+                append_sample(out, name + "_bucket", op + ",le=\"+Inf\"", it.count);
+                append_sample(out, name + "_sum", op, seconds(it.sum_ns));
+                append_sample(out, name + "_count", op, it.count);
+            }
+            name = prefix + "_op_latency_quantile_seconds";
+            append_metric(out, name, "gauge", "Operation latency quantiles since start.");
+            static const double qs[] = {0.5, 0.9, 0.99, 0.999};
+            static const char *qnames[] = {"0.5", "0.9", "0.99", "0.999"};
+            for (auto &it:stats.latency){
+                for (uint32_t i = 0; i < 4; i++){
+                    append_sample(out, name, "op=\"" + it.name + "\",quantile=\"" + qnames[i] + "\"", seconds(it.percentile(qs[i])));
+                }
+            }
+        }
+        return out;
+    }
+
+    /**
+     * JSON：实例级的计数器在最外层，classes、buffers是数组，latency按操作名，带分位数及非空的桶（[上界纳秒, 个数]）
+     */
+    inline std::string to_json(const stats_t &stats){
+        using namespace metrics_detail;
+        std::string out = "{";
+        append_json(out, "buffer_num", stats.buffer_num, true);
+        append_json(out, "item_num", stats.item_num());
+        append_json(out, "index_capacity", stats.index_capacity);
+        append_json(out, "index_drop_num", stats.index_drop_num);
+        append_json(out, "index_resize_num", stats.index_resize_num);
+        append_json(out, "index_resize_done", stats.index_resize_done);
+        append_json(out, "index_resize_total", stats.index_resize_total);
+        append_json(out, "index_last_resize_us", stats.index_last_resize_us);
+        append_json(out, "get_hit_num", stats.get_hit_num);
+        append_json(out, "get_miss_num", stats.get_miss_num);
+        append_json(out, "get_expired_num", stats.get_expired_num);
+        append_json_double(out, "hit_rate", stats.hit_rate());
+        append_json(out, "read_bytes", stats.read_bytes);
+        append_json(out, "set_num", stats.set_num());
+        append_json(out, "write_bytes", stats.write_bytes);
+        append_json(out, "del_call_num", stats.del_call_num);
+        append_json(out, "expired_num", stats.expired_num());
+        append_json(out, "expired_bytes", stats.expired_bytes());
+        append_json(out, "sweep_num", stats.sweep_num());
+        append_json(out, "sweep_bytes", stats.sweep_bytes());
+        append_json(out, "snapshot_load_bytes", stats.snapshot_load_bytes);
+        append_json(out, "snapshot_load_items", stats.snapshot_load_items);
+        append_json(out, "snapshot_load_us", stats.snapshot_load_us);
+        append_json(out, "compress_num", stats.compress_num);
+        append_json(out, "compress_skip_num", stats.compress_skip_num);
+        append_json(out, "compress_raw_bytes", stats.compress_raw_bytes);
+        append_json(out, "compress_out_bytes", stats.compress_out_bytes);
+        append_json(out, "compress_ns", stats.compress_ns);
+        append_json(out, "decompress_num", stats.decompress_num);
+        append_json(out, "decompress_ns", stats.decompress_ns);
+
+        out.append(",\"classes\":[");
+        for (size_t i = 0; i < stats.class_stats.size(); i++){
+            const class_stats_t &c = stats.class_stats[i];
+            out.append(i > 0 ? ",{" : "{");
+            append_json(out, "index", c.index, true);
+            append_json(out, "max_size", c.max_size);
+            append_json(out, "buffer_num", c.buffer_num);
+            append_json(out, "cache_byte_size", c.cache_byte_size);
+            append_json(out, "item_num", c.item_num);
+            append_json(out, "set_num", c.set_num);
+            append_json(out, "evict_num", c.evict_num);
+            append_json(out, "hit_num", c.hit_num);
+            append_json(out, "live_num", c.live_num);
+            append_json(out, "live_bytes", c.live_bytes);
+            out.append("}");
+        }
+        out.append("],\"buffers\":[");
+        for (size_t i = 0; i < stats.buffer_stats.size(); i++){
+            const buffer_stats_t &b = stats.buffer_stats[i];
+            out.append(i > 0 ? ",{" : "{");
+            append_json(out, "index", b.index, true);
+            append_json(out, "size_class", b.size_class);
+            append_json(out, "item_num", b.item_num);
+            append_json(out, "set_num", b.set_num);
+            append_json(out, "del_num", b.del_num);
+            append_json(out, "cache_byte_size", b.cache_byte_size);
+            append_json(out, "reset_header_times", b.reset_header_times);
+            append_json(out, "evict_num", b.evict_num);
+            append_json(out, "evict_set_num", b.evict_set_num);
+            append_json(out, "evict_max_per_set", b.evict_max_per_set);
+            append_json(out, "lock_num", b.lock_num);
+            append_json(out, "lock_busy_num", b.lock_busy_num);
+            append_json(out, "lock_wait_num", b.lock_wait_num);
+            append_json(out, "reserve_wait_num", b.reserve_wait_num);
+            append_json(out, "page_mode", b.page_mode);
+            out.append(",\"numa_node\":" + std::to_string(b.numa_node));
+            append_json(out, "huge_page_bytes", b.huge_page_bytes);
+            append_json(out, "expired_num", b.expired_num);
+            append_json(out, "expired_bytes", b.expired_bytes);
+            append_json(out, "sweep_num", b.sweep_num);
+            append_json(out, "sweep_bytes", b.sweep_bytes);
+            append_json(out, "sweep_rounds", b.sweep_rounds);
+            out.append("}");
+        }
+        out.append("],\"latency\":{");
+        for (size_t i = 0; i < stats.latency.size(); i++){
+            const latency_stats_t &l = stats.latency[i];
+            out.append((i > 0 ? ",\"" : "\"") + l.name + "\":{");
+            append_json(out, "count", l.count, true);
+            append_json(out, "sum_ns", l.sum_ns);
+            append_json_double(out, "mean_ns", l.mean());
+            append_json(out, "p50_ns", l.percentile(0.5));
+            append_json(out, "p90_ns", l.percentile(0.9));
+            append_json(out, "p99_ns", l.percentile(0.99));
+            append_json(out, "p999_ns", l.percentile(0.999));
+            append_json(out, "max_ns", l.max());
+            out.append(",\"buckets\":[");
+            bool first = true;
+            for (uint32_t b = 0; b < l.buckets.size(); b++){
+                if (l.buckets[b] > 0){
+                    out.append(first ? "[" : ",[");
+                    out.append(std::to_string(latency_buckets::upper_of(b)) + "," + std::to_string(l.buckets[b]) + "]");
+                    first = false;
+                }
+            }
+            out.append("]}");
+        }
+        out.append("}}");
+        return out;
+    }
+}
+#endif //_RINGCACHE_METRICS_H_202610231510_
@@ -0,0 +1,161 @@
+/*************************************************************************
+ * File:	numa.h
+ * Author:	liuyongshuai<liuyongshuai@hotmail.com>
+ * Time:	2026-10-25 10:20
+ * NUMA相关的几个小工具：节点数、当前线程所在节点、把一段内存或一个线程绑到某个节点上。
+ * 直接用系统调用和/sys下的文件，不依赖libnuma
+ ************************************************************************/
+#ifndef _RINGCACHE_NUMA_H_202610251020_
+#define _RINGCACHE_NUMA_H_202610251020_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <vector>
+
+//mbind的参数
+#define RING_MPOL_BIND 2
+#define RING_MPOL_MF_MOVE 2
+#define RING_NUMA_NODE_MAX 64
+
+namespace ringcache{
+    /**
+     * 解析"0-3,8-11"这种列表，每个数都回调一次
+     */
+    template< typename func_t >
+    inline void parse_id_list(const char *line, func_t func){
+        const char *p = line;
+        while (*p){
+            if (*p < '0' || *p > '9'){
+                p++;
+                continue;
+            }
+            char *end = nullptr;
+            uint32_t lo = strtoul(p, &end, 10), hi = lo;
+            if (*end == '-'){
+                hi = strtoul(end + 1, &end, 10);
+            }
+            for (uint32_t i = lo; i <= hi; i++){
+                func(i);
+            }
+            p = end;
+        }
+    }
+
+    /**
+     * 机器上的NUMA节点数，读/sys/devices/system/node/online，如"0-3"
+     */
+    inline uint32_t read_numa_node_num(){
+        uint32_t last = 0;
+        FILE *fp = fopen("/sys/devices/system/node/online", "r");
+        if (fp != nullptr){
+            char line[256];
+            if (fgets(line, sizeof(line), fp) != nullptr){
+                //只关心最大的节点号，"0-1,3"这种有空洞的也按4个算
+                parse_id_list(line, [&last](uint32_t n){
+                    last = n > last ? n : last;
+                });
+            }
+            fclose(fp);
+        }
+        return last + 1 < RING_NUMA_NODE_MAX ? last + 1 : RING_NUMA_NODE_MAX;
+    }
+
+    /**
+     * 只读一次，多个线程同时第一次调也没问题
+     */
+    inline uint32_t numa_node_num(){
+        static const uint32_t num = read_numa_node_num();
+        return num;
+    }
+
+    /**
+     * 当前线程所在CPU的NUMA节点
+     */
+    inline uint32_t current_numa_node(){
+        unsigned cpu = 0, node = 0;
+        if (syscall(SYS_getcpu, &cpu, &node, nullptr) != 0){
+            return 0;
+        }
+        return node < numa_node_num() ? node : 0;
+    }
+
+    /**
+     * 把[ptr, ptr+size)里完整的页绑到node上，已经分配了的页也迁过去。
+     * ptr可以不是页对齐的（比如calloc出来的），首尾不完整的页不动，那里可能还有别的数据
+     */
+    inline bool numa_bind_memory(void *ptr, uint64_t size, int32_t node){
+        if (ptr == nullptr || node < 0 || node >= RING_NUMA_NODE_MAX){
+            return false;
+        }
+        uintptr_t page = sysconf(_SC_PAGESIZE);
+        uintptr_t begin = ((uintptr_t) ptr + page - 1) & ~(page - 1);
+        uintptr_t end = ((uintptr_t) ptr + size) & ~(page - 1);
+        if (end <= begin){
+            return false;
+        }
+        unsigned long mask = 1UL << node;
+        return syscall(SYS_mbind, begin, end - begin, RING_MPOL_BIND, &mask, RING_NUMA_NODE_MAX, RING_MPOL_MF_MOVE) == 0;
+    }
+
+    /**
+     * 把当前线程绑到node的CPU上，读/sys/devices/system/node/nodeN/cpulist。
+     * 之后这个线程第一次写到的内存（默认的本地分配策略）也都在这个节点上，它创建的线程会继承这个绑定
+     */
+    inline bool numa_bind_thread(uint32_t node){
+        char path[64];
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%u/cpulist", node);
+        FILE *fp = fopen(path, "r");
+        if (fp == nullptr){
+            return false;
+        }
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        uint32_t cpu_num = 0;
+        char line[1024];
+        if (fgets(line, sizeof(line), fp) != nullptr){
+            parse_id_list(line, [&](uint32_t cpu){
+                if (cpu < CPU_SETSIZE){
+                    CPU_SET(cpu, &set);
+                    cpu_num++;
+                }
+            });
+        }
+        fclose(fp);
+        return cpu_num > 0 && sched_setaffinity(0, sizeof(set), &set) == 0;
+    }
+
+    /**
+     * 当前线程可以跑的CPU，按编号从小到大
+     */
+    inline std::vector< uint32_t > allowed_cpus(){
+        std::vector< uint32_t > cpus;
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        if (sched_getaffinity(0, sizeof(set), &set) == 0){
+            for (uint32_t i = 0; i < CPU_SETSIZE; i++){
+                if (CPU_ISSET(i, &set)){
+                    cpus.push_back(i);
+                }
+            }
+        }
+        return cpus;
+    }
+
+    /**
+     * 把当前线程绑到一个CPU上
+     */
+    inline bool pin_thread_cpu(uint32_t cpu){
+        if (cpu >= CPU_SETSIZE){
+            return false;
+        }
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        return sched_setaffinity(0, sizeof(set), &set) == 0;
+    }
+}
+#endif //_RINGCACHE_NUMA_H_202610251020_
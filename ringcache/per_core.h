@@ -0,0 +1,564 @@
+/*************************************************************************
+ * File:	per_core.h
+ * Author:	liuyongshuai<liuyongshuai@hotmail.com>
+ * Time:	2026-10-25 15:40
+ * 每核一个线程、互不共享：每个核有自己的一个ringcache分区（buffer + 索引），只有这个核的线程读写它，
+ * 分区里的锁都不会有人争，索引的bucket、buffer的写指针也只在这个核的cache里。
+ * key按hash归属某个核，别的核要访问时把请求经无锁的SPSC队列发过去，归属核执行完再经队列发回来，
+ * 在发起的核上调回调；核以外的线程用future拿结果。
+ * 应用的代码跑在核上：submit()把任务交给某个核执行，set_driver()让核每一轮都调一次，比如收发网络请求
+ ************************************************************************/
+#ifndef _RINGCACHE_PER_CORE_H_202610251540_
+#define _RINGCACHE_PER_CORE_H_202610251540_
+
+#include <deque>
+#include <future>
+#include <functional>
+#include "sharded.h"
+#include "spsc_queue.h"
+
+//核的个数上限
+#ifndef RING_CORE_MAX
+#define RING_CORE_MAX 256
+#endif
+
+//每两个核之间每个方向一个队列，这是它的长度；满了先放到发送方自己的积压队列里，下一轮再发
+#ifndef RING_CORE_QUEUE_SIZE
+#define RING_CORE_QUEUE_SIZE 512
+#endif
+
+//每一轮从每个队列里最多取几个，不让一个核的请求把别的核饿着
+#ifndef RING_CORE_POLL_BATCH
+#define RING_CORE_POLL_BATCH 64
+#endif
+
+//没事可做时先自旋RING_CORE_IDLE_SPINS轮，再让出CPU RING_CORE_IDLE_SPINS*16轮，之后每轮睡RING_CORE_IDLE_US微秒
+#ifndef RING_CORE_IDLE_SPINS
+#define RING_CORE_IDLE_SPINS 64
+#endif
+#ifndef RING_CORE_IDLE_US
+#define RING_CORE_IDLE_US 50
+#endif
+
+//核以外的线程发来的消息
+#define CORE_EXTERNAL UINT32_MAX
+
+namespace ringcache{
+    enum{
+        CORE_OP_GET = 1,
+        CORE_OP_SET,
+        CORE_OP_DEL,
+        CORE_OP_TASK
+    };
+
+    /**
+     * 核以外的线程拿到的结果，set/del时value为空
+     */
+    typedef struct _core_result_t{
+        uint32_t ret;
+        std::string value;
+    } core_result_t;
+
+    template< typename hasher_t, typename codec_t = no_codec >
+    class basic_core_ringcache{
+    public:
+        typedef basic_ringcache< hasher_t, codec_t > shard_t;
+        class core_t;
+
+        /**
+         * 回调都在发起请求的核上执行，get的value只在回调里有效
+         */
+        typedef std::function< void(uint32_t ret, const std::string &value) > get_callback_t;
+        typedef std::function< void(uint32_t ret) > done_callback_t;
+        typedef std::function< void(core_t &core) > task_t;
+
+        /**
+         * 核每一轮都调一次，返回false后不再调
+         */
+        typedef std::function< bool(core_t &core) > driver_t;
+
+    private:
+        /**
+         * 核之间传的消息：请求发到归属核，执行完原样发回去，回调、结果都在里面。
+         * 核发出的消息用完放回自己的空闲列表里，下次直接用，key/value的空间也不用重新申请
+         */
+        typedef struct _message_t{
+            uint8_t op;
+            uint32_t from;
+            uint32_t owner;
+            uint32_t hash_val;
+            uint32_t ret;
+            expire_t expire;
+            std::string key;
+            std::string value;
+            get_callback_t get_done;
+            done_callback_t done;
+            task_t task;
+            //核以外的线程发来的才有
+            std::promise< core_result_t > *promise;
+
+            _message_t() : op(0), from(0), owner(0), hash_val(0), ret(0), expire(0), promise(nullptr){
+            }
+        } message_t;
+
+        typedef spsc_queue< message_t * > queue_t;
+
+    public:
+        /**
+         * 一个核：只能在它自己的线程里用，也就是在submit()的任务、driver及回调里
+         */
+        class core_t{
+        public:
+            uint32_t id() const{
+                return this->core_id;
+            }
+
+            /**
+             * 本核的分区，只能放归属本核的key
+             */
+            shard_t &local(){
+                return *this->partition;
+            }
+
+            bool owns(uint32_t hash_val) const{
+                return this->cache->owner_of(hash_val) == this->core_id;
+            }
+
+            /**
+             * 发出去还没回来的请求个数
+             */
+            uint32_t pending() const{
+                return this->in_flight;
+            }
+
+            void set_driver(driver_t driver){
+                this->driver = driver;
+            }
+
+            /**
+             * 归属本核的key直接在分区里执行，回调在返回前就调了；否则发给归属核，回来后在下一轮里调
+             */
+            void get(const char *key, size_t key_len, get_callback_t done){
+                if (key_len >= MAX_KEY_SIZE){
+                    this->value_buf.clear();
+                    done(RINGCACHE_ERRNO_KEY_TOO_LONG, this->value_buf);
+                    return;
+                }
+                uint32_t hash_val = this->partition->hash_key(key, key_len);
+                uint32_t owner = this->cache->owner_of(hash_val);
+                if (owner == this->core_id){
+                    uint32_t ret = this->partition->get(key, key_len, hash_val, this->value_buf);
+                    done(ret, this->value_buf);
+                    return;
+                }
+                message_t *m = this->new_message(CORE_OP_GET, owner, hash_val, key, key_len);
+                m->get_done = std::move(done);
+                this->send(owner, m);
+                this->in_flight++;
+            }
+
+            void set(const char *key, size_t key_len, const char *val, uint32_t val_len, expire_t expire, done_callback_t done){
+                if (key_len >= MAX_KEY_SIZE){
+                    done(RINGCACHE_ERRNO_KEY_TOO_LONG);
+                    return;
+                }
+                if (val_len >= MAX_VALUE_SIZE){
+                    done(RINGCACHE_ERRNO_VALUE_TOO_LONG);
+                    return;
+                }
+                uint32_t hash_val = this->partition->hash_key(key, key_len);
+                uint32_t owner = this->cache->owner_of(hash_val);
+                if (owner == this->core_id){
+                    done(this->partition->set(key, key_len, hash_val, val, val_len, expire));
+                    return;
+                }
+                message_t *m = this->new_message(CORE_OP_SET, owner, hash_val, key, key_len);
+                m->value.assign(val, val_len);
+                m->expire = expire;
+                m->done = std::move(done);
+                this->send(owner, m);
+                this->in_flight++;
+            }
+
+            void del(const char *key, size_t key_len, done_callback_t done){
+                if (key_len >= MAX_KEY_SIZE){
+                    done(RINGCACHE_ERRNO_KEY_TOO_LONG);
+                    return;
+                }
+                uint32_t hash_val = this->partition->hash_key(key, key_len);
+                uint32_t owner = this->cache->owner_of(hash_val);
+                if (owner == this->core_id){
+                    done(this->partition->del(key, key_len, hash_val));
+                    return;
+                }
+                message_t *m = this->new_message(CORE_OP_DEL, owner, hash_val, key, key_len);
+                m->done = std::move(done);
+                this->send(owner, m);
+                this->in_flight++;
+            }
+
+        private:
+            friend class basic_core_ringcache;
+
+            core_t(basic_core_ringcache *cache, uint32_t core_id) : cache(cache), core_id(core_id), partition(nullptr), thread(nullptr),
+                                                                   in_flight(0), ready(false){
+                this->inbox = queue_t::alloc(RING_CORE_QUEUE_SIZE);
+                this->backlog.resize(cache->core_num());
+            }
+
+            message_t *new_message(uint8_t op, uint32_t owner, uint32_t hash_val, const char *key, size_t key_len){
+                message_t *m = nullptr;
+                if (!this->free_list.empty()){
+                    m = this->free_list.back();
+                    this->free_list.pop_back();
+                }
+                else{
+                    m = new message_t();
+                }
+                m->op = op;
+                m->from = this->core_id;
+                m->owner = owner;
+                m->hash_val = hash_val;
+                m->ret = RINGCACHE_ERRNO_OK;
+                m->key.assign(key, key_len);
+                m->value.clear();
+                return m;
+            }
+
+            void free_message(message_t *m){
+                m->get_done = nullptr;
+                m->done = nullptr;
+                if (this->free_list.size() < RING_CORE_QUEUE_SIZE){
+                    this->free_list.push_back(m);
+                }
+                else{
+                    delete m;
+                }
+            }
+
+            /**
+             * 发给另一个核，队列满了或者前面还有没发出去的就先积压着，保持先后
+             */
+            void send(uint32_t to, message_t *m){
+                std::deque< message_t * > &pending = this->backlog[to];
+                if (!pending.empty() || !this->cache->queue(this->core_id, to)->try_push(m)){
+                    pending.push_back(m);
+                }
+            }
+
+            /**
+             * 一轮：先发积压的，再收各个核及核以外的线程发来的，返回处理了几个
+             */
+            uint32_t poll(){
+                uint32_t n = 0;
+                for (uint32_t to = 0; to < this->backlog.size(); to++){
+                    std::deque< message_t * > &pending = this->backlog[to];
+                    while (!pending.empty() && this->cache->queue(this->core_id, to)->try_push(pending.front())){
+                        pending.pop_front();
+                        n++;
+                    }
+                }
+                message_t *m = nullptr;
+                for (uint32_t from = 0; from < this->backlog.size(); from++){
+                    if (from == this->core_id){
+                        continue;
+                    }
+                    queue_t *q = this->cache->queue(from, this->core_id);
+                    for (uint32_t k = 0; k < RING_CORE_POLL_BATCH && q->try_pop(m); k++){
+                        this->handle(m);
+                        n++;
+                    }
+                }
+                for (uint32_t k = 0; k < RING_CORE_POLL_BATCH && this->inbox->try_pop(m); k++){
+                    this->handle(m);
+                    n++;
+                }
+                return n;
+            }
+
+            void handle(message_t *m){
+                if (m->op == CORE_OP_TASK){
+                    m->task(*this);
+                    destroy_message(m);
+                    return;
+                }
+                //本核发出去的请求回来了
+                if (m->from == this->core_id){
+                    this->in_flight--;
+                    if (m->op == CORE_OP_GET){
+                        m->get_done(m->ret, m->value);
+                    }
+                    else{
+                        m->done(m->ret);
+                    }
+                    this->free_message(m);
+                    return;
+                }
+                if (m->op == CORE_OP_GET){
+                    m->ret = this->partition->get(m->key.c_str(), m->key.length(), m->hash_val, m->value);
+                }
+                else if (m->op == CORE_OP_SET){
+                    m->ret = this->partition->set(m->key.c_str(), m->key.length(), m->hash_val, m->value.data(), m->value.length(), m->expire);
+                }
+                else{
+                    m->ret = this->partition->del(m->key.c_str(), m->key.length(), m->hash_val);
+                }
+                if (m->from == CORE_EXTERNAL){
+                    core_result_t result;
+                    result.ret = m->ret;
+                    result.value.swap(m->value);
+                    m->promise->set_value(std::move(result));
+                    destroy_message(m);
+                    return;
+                }
+                this->send(m->from, m);
+            }
+
+            /**
+             * 核的线程：绑到cpu上，在这里构造分区，内存都是本核先写到的，然后一直转
+             */
+            void run(uint32_t cpu, bool pin){
+                if (pin){
+                    pin_thread_cpu(cpu);
+                }
+                int32_t node = numa_node_num() > 1 ? (int32_t) current_numa_node() : -1;
+                this->partition = new shard_t(this->cache->partition_mb, this->cache->classes, node);
+                this->ready.store(true, std::memory_order_release);
+                uint32_t idle = 0;
+                while (!this->cache->is_stop.load(std::memory_order_relaxed)){
+                    uint32_t n = this->poll();
+                    if (this->driver && !this->driver(*this)){
+                        this->driver = nullptr;
+                    }
+                    //没收到东西、只是在等别的核回复时也要退避，不然和对方挤在一个CPU上时对方一直跑不起来
+                    if (n > 0 || (this->driver && this->in_flight == 0)){
+                        idle = 0;
+                        continue;
+                    }
+                    idle++;
+                    if (idle < RING_CORE_IDLE_SPINS){
+                        cpu_relax();
+                    }
+                    else if (idle < RING_CORE_IDLE_SPINS * 16){
+                        std::this_thread::yield();
+                    }
+                    else{
+                        std::this_thread::sleep_for(std::chrono::microseconds(RING_CORE_IDLE_US));
+                    }
+                }
+            }
+
+            basic_core_ringcache *cache;
+            uint32_t core_id;
+            shard_t *partition;
+            std::thread *thread;
+
+            /**
+             * 核以外的线程发来的：多个生产者拿inbox_mtx排队，消费者只有本核
+             */
+            queue_t *inbox;
+            std::mutex inbox_mtx;
+
+            /**
+             * 发往各个核、队列满了没发出去的
+             */
+            std::vector< std::deque< message_t * > > backlog;
+            std::vector< message_t * > free_list;
+            uint32_t in_flight;
+            std::string value_buf;
+            driver_t driver;
+            std::atomic< bool > ready;
+        };
+
+        /**
+         * megabyte_size是总大小，平均分给各个核。core_num为0时每个能用的CPU一个核，
+         * pin为true时第i个核绑到第i%CPU数个能用的CPU上
+         */
+        explicit basic_core_ringcache(uint64_t megabyte_size, uint32_t core_num = 0, const std::vector< size_class_t > &classes = std::vector< size_class_t >(),
+                                      bool pin = true){
+            std::vector< uint32_t > cpus = allowed_cpus();
+            core_num = core_num > 0 ? core_num : std::max< uint32_t >(cpus.size(), 1);
+            core_num = core_num < RING_CORE_MAX ? core_num : RING_CORE_MAX;
+            this->partition_mb = megabyte_size / core_num;
+            this->classes = classes;
+            this->is_stop = false;
+            if (megabyte_size * MB / core_num < (uint64_t) RING_BUFFER_NUM * RING_BUFFER_MIN_SIZE){
+                std::cout << "[core_ringcache]" << this->partition_mb << "MB per core is rounded up to "
+                          << ((uint64_t) RING_BUFFER_NUM * RING_BUFFER_MIN_SIZE / MB) << "MB, rebuild with a smaller RING_BUFFER_NUM" << std::endl;
+            }
+            this->queues.assign(core_num * core_num, nullptr);
+            for (uint32_t from = 0; from < core_num; from++){
+                for (uint32_t to = 0; to < core_num; to++){
+                    if (from != to){
+                        this->queues[from * core_num + to] = queue_t::alloc(RING_CORE_QUEUE_SIZE);
+                    }
+                }
+            }
+            for (uint32_t i = 0; i < core_num; i++){
+                this->cores.push_back(nullptr);
+            }
+            for (uint32_t i = 0; i < core_num; i++){
+                this->cores[i] = new core_t(this, i);
+            }
+            for (uint32_t i = 0; i < core_num; i++){
+                uint32_t cpu = cpus.empty() ? 0 : cpus[i % cpus.size()];
+                this->cores[i]->thread = new std::thread(&core_t::run, this->cores[i], cpu, pin && !cpus.empty());
+            }
+            for (auto it:this->cores){
+                while (!it->ready.load(std::memory_order_acquire)){
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                }
+            }
+        }
+
+        /**
+         * 停下所有核，还没执行的请求直接丢掉，等着它们的future会拿到broken_promise
+         */
+        ~basic_core_ringcache(){
+            this->is_stop = true;
+            for (auto it:this->cores){
+                it->thread->join();
+                delete it->thread;
+            }
+            message_t *m = nullptr;
+            for (auto q:this->queues){
+                while (q != nullptr && q->try_pop(m)){
+                    destroy_message(m);
+                }
+                queue_t::release(q);
+            }
+            for (auto it:this->cores){
+                while (it->inbox->try_pop(m)){
+                    destroy_message(m);
+                }
+                queue_t::release(it->inbox);
+                for (auto &pending:it->backlog){
+                    for (auto p:pending){
+                        destroy_message(p);
+                    }
+                }
+                for (auto p:it->free_list){
+                    delete p;
+                }
+                delete it->partition;
+                delete it;
+            }
+        }
+
+        uint32_t core_num() const{
+            return this->cores.size();
+        }
+
+        /**
+         * key归属哪个核
+         */
+        uint32_t owner_of(uint32_t hash_val) const{
+            return shard_index(hash_val, this->cores.size());
+        }
+
+        uint32_t owner_of(const char *key, size_t key_len) const{
+            return this->owner_of(this->hash_key(key, key_len));
+        }
+
+        uint32_t hash_key(const char *key, size_t key_len) const{
+            return this->hasher(key, key_len);
+        }
+
+        /**
+         * 核以外的线程用：发给归属核执行，结果从future里拿。不要在核上等这些future，会把自己卡死
+         */
+        std::future< core_result_t > get(const std::string &key){
+            return this->post(CORE_OP_GET, key, nullptr, 0, expire_t(0));
+        }
+
+        std::future< core_result_t > set(const std::string &key, const std::string &value, expire_t expire){
+            return this->post(CORE_OP_SET, key, value.data(), value.length(), expire);
+        }
+
+        std::future< core_result_t > del(const std::string &key){
+            return this->post(CORE_OP_DEL, key, nullptr, 0, expire_t(0));
+        }
+
+        /**
+         * 在第core个核上执行task，任何线程都可以调
+         */
+        void submit(uint32_t core, task_t task){
+            message_t *m = new message_t();
+            m->op = CORE_OP_TASK;
+            m->from = CORE_EXTERNAL;
+            m->owner = core;
+            m->task = task;
+            this->push_inbox(core, m);
+        }
+
+        /**
+         * 各个核的分区的统计信息加在一起
+         */
+        stats_t get_stats(){
+            stats_t stats = this->cores[0]->partition->get_stats();
+            for (size_t i = 1; i < this->cores.size(); i++){
+                stats.merge(this->cores[i]->partition->get_stats());
+            }
+            return stats;
+        }
+
+    private:
+        basic_core_ringcache(const basic_core_ringcache &);
+        basic_core_ringcache &operator=(const basic_core_ringcache &);
+
+        static void destroy_message(message_t *m){
+            delete m->promise;
+            delete m;
+        }
+
+        queue_t *queue(uint32_t from, uint32_t to){
+            return this->queues[from * this->cores.size() + to];
+        }
+
+        std::future< core_result_t > post(uint8_t op, const std::string &key, const char *val, uint32_t val_len, expire_t expire){
+            if (key.length() >= MAX_KEY_SIZE || val_len >= MAX_VALUE_SIZE){
+                std::promise< core_result_t > failed;
+                core_result_t result;
+                result.ret = key.length() >= MAX_KEY_SIZE ? RINGCACHE_ERRNO_KEY_TOO_LONG : RINGCACHE_ERRNO_VALUE_TOO_LONG;
+                failed.set_value(result);
+                return failed.get_future();
+            }
+            message_t *m = new message_t();
+            m->op = op;
+            m->from = CORE_EXTERNAL;
+            m->hash_val = this->hash_key(key.c_str(), key.length());
+            m->owner = this->owner_of(m->hash_val);
+            m->key = key;
+            if (val != nullptr){
+                m->value.assign(val, val_len);
+            }
+            m->expire = expire;
+            m->promise = new std::promise< core_result_t >();
+            std::future< core_result_t > f = m->promise->get_future();
+            this->push_inbox(m->owner, m);
+            return f;
+        }
+
+        void push_inbox(uint32_t core, message_t *m){
+            core_t *c = this->cores[core];
+            std::lock_guard< std::mutex > lock(c->inbox_mtx);
+            while (!c->inbox->try_push(m)){
+                std::this_thread::yield();
+            }
+        }
+
+        std::vector< core_t * > cores;
+
+        /**
+         * queues[from*核数+to]：from发往to的消息，from是唯一的生产者，to是唯一的消费者
+         */
+        std::vector< queue_t * > queues;
+        uint64_t partition_mb;
+        std::vector< size_class_t > classes;
+        std::atomic< bool > is_stop;
+        hasher_t hasher;
+    };
+
+    typedef basic_core_ringcache< jenkins_hasher > core_ringcache;
+}
+#endif //_RINGCACHE_PER_CORE_H_202610251540_
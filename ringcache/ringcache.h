@@ -7,19 +7,62 @@
 #define _RINGCACHE_RINGBUFFER_H_202103111139_
 
 #include "entry.h"
+#include "epoch.h"
+#include "chained_index.h"
+#include "bucket_index.h"
+#include "hash_policy.h"
+#include "buffer_mem.h"
+#include "snapshot.h"
+#include "codec.h"
+#include "clock.h"
+#include "metrics.h"
+#include "trace.h"
 #include <iostream>
 #include <math.h>
 #include <thread>
+#include <chrono>
 #include <assert.h>
+#include <fcntl.h>
+#include <algorithm>
+#include <sys/resource.h>
+#include <sys/syscall.h>
 
 namespace ringcache{
-
-    class ringcache{
+    /**
+     * 索引实现，编译时选择：默认数组 + 链表，定义RINGCACHE_BUCKET_INDEX时用分桶的开放寻址索引
+     */
+#ifdef RINGCACHE_BUCKET_INDEX
+    typedef bucket_index index_t;
+#else
+    typedef chained_index index_t;
+#endif
+
+    /**
+     * hasher_t：hash函数，见hash_policy.h，默认是jenkins_hasher
+     * codec_t：value的压缩算法，见codec.h，默认不压缩
+     */
+    template< typename hasher_t, typename codec_t = no_codec >
+    class basic_ringcache{
     public:
         /**
          * 注意，这里的mem_size单位为MB
          */
-        explicit ringcache(uint64_t megabyte_size){
+        explicit basic_ringcache(uint64_t megabyte_size) : basic_ringcache(megabyte_size, std::vector< size_class_t >()){
+        }
+
+        /**
+         * classes：按key+value长度分档，每档各用一组buffer，按percent分走相应比例的内存，
+         * 大value再多也只在自己那一档里淘汰，冲不掉小value的热数据。为空时所有数据共用全部buffer
+         */
+        basic_ringcache(uint64_t megabyte_size, const std::vector< size_class_t > &classes) : basic_ringcache(megabyte_size, classes, -1){
+        }
+
+        /**
+         * numa_node>=0时整个实例都放在这个NUMA节点上：所有buffer、索引表的内存都绑到该节点，
+         * 后台线程也只在该节点的CPU上跑，忽略RING_BUFFER_NUMA的轮流绑定。见sharded.h
+         */
+        basic_ringcache(uint64_t megabyte_size, const std::vector< size_class_t > &classes, int32_t numa_node){
+            this->numa_node = numa_node < (int32_t) numa_node_num() ? numa_node : -1;
             /**
              * 将单位换算成MB
              */
@@ -29,196 +72,232 @@ namespace ringcache{
             //缓冲区的数量
             std::cout << "buffer_num=" << RING_BUFFER_NUM << std::endl;
 
-            /**
-             * 初始化统计信息
-             */
-            this->stats = new stats_t();
-            this->stats->buffer_num = RING_BUFFER_NUM;
-
+            this->snapshot_load_bytes = 0;
+            this->snapshot_load_items = 0;
+            this->snapshot_load_us = 0;
 
             /**
              * 平均每个缓冲区的大小
              */
             this->buffer_size = mem_byte_size / RING_BUFFER_NUM;
             this->buffer_size = this->buffer_size > RING_BUFFER_MIN_SIZE ? this->buffer_size : RING_BUFFER_MIN_SIZE;
-            std::cout << "avg_size=" << this->buffer_size << std::endl;
-            this->alloc_buffer_memory();
+            this->buffer_size &= ~((uint64_t) RING_ENTRY_ALIGN - 1);
 
             /**
-             * hash表的锁
+             * entry位置编码：buffer编号 + buffer内的偏移，一共32位
              */
-            for (int i = 0; i < HASH_SIZE(HASHTABLE_LOCK_POWER); i++){
-                this->hashtable_locks.push_back(new std::mutex());
+            uint8_t buffer_bits = ceil(log((double) RING_BUFFER_NUM) / log(2.0));
+            this->locator.offset_bits = ceil(log((double) (this->buffer_size / RING_ENTRY_ALIGN)) / log(2.0));
+#if defined(RINGCACHE_BUCKET_INDEX) || defined(RINGCACHE_COMPACT_ENTRY)
+            //分桶索引、紧凑格式的entry链表里都只存32位的位置编码，单个buffer的大小要能编得下
+            uint8_t max_offset_bits = 32 - buffer_bits;
+#ifdef RINGCACHE_COMPACT_ENTRY
+            //紧凑格式的entry_len只有32位，整个buffer一个空闲块时也要存得下
+            max_offset_bits = std::min(max_offset_bits, (uint8_t) 28);
+#endif
+            if (this->locator.offset_bits > max_offset_bits){
+                this->locator.offset_bits = max_offset_bits;
+                this->buffer_size = ((uint64_t) 1 << this->locator.offset_bits) * RING_ENTRY_ALIGN;
+                std::cout << "[ringcache]buffer size exceeds the 32-bit entry location, shrink to " << (this->buffer_size / MB) << "MB" << std::endl;
             }
+#endif
+            (void) buffer_bits;
+            std::cout << "avg_size=" << this->buffer_size << std::endl;
+            this->init_size_classes(classes);
 
             /**
-             * hash表初始化
+             * 统计信息：实例的计数器、各档的命中数及有效数据的个数、字节数、每个buffer会被多个线程同时改的计数器，都按线程分片
              */
-            //预估初始容量大小，一般按512字节
-            uint8_t init_hash_power = HASH_POWER_INIT;
-            //预估容量
-            uint32_t entrySize = mem_byte_size / AVG_DATA_SIZE;
-            size_t entryPower = ceil(log((double) entrySize) / log(2.0));
-            if (entryPower > init_hash_power){
-                init_hash_power = entryPower + 1;
-            }
-            if (init_hash_power >= HASH_POWER_MAX){
-                init_hash_power = HASH_POWER_MAX;
-            }
-            this->hash_power = init_hash_power;
-//            /**
-//             * hash表初始化：此处将hash_power固定为28，最大容量为2.6亿左右，容纳所有的数据足够了，就将扩容操作取消了
-//             * 此时hashtable的数组部分占了2G的额外空间。
-//             */
-//            this->hash_power = 28;
-            this->primary_hashtable = (entry_t **) calloc(HASH_SIZE(this->hash_power), sizeof(entry_t *));
-            for (uint32_t i = 0; i < HASH_SIZE(this->hash_power); i++){
-                this->primary_hashtable[i] = nullptr;
+            this->buffer_counter_base = STAT_CACHE_NUM + this->class_conf.size() * CLASS_STAT_NUM;
+            this->counters = new sharded_counters(this->buffer_counter_base + RING_BUFFER_NUM * BUFFER_STAT_NUM);
+#ifdef RINGCACHE_LATENCY
+            this->latency = new latency_histograms();
+#else
+            this->latency = nullptr;
+#endif
+            this->buffers.reserve(RING_BUFFER_NUM);
+            this->ready_num = 0;
+            //按分档交错排列，每一档的第一个buffer都在最前面，先把它们申请好，其余的交给后台线程
+            for (size_t i = 0; i < this->class_conf.size(); i++){
+                this->alloc_buffer_memory();
             }
 
+            /**
+             * hash表初始化，预估容量一般按512字节一个
+             */
+            this->index = new index_t(mem_byte_size / AVG_DATA_SIZE, &this->locator, this->numa_node);
+            this->index->on_unlink(on_entry_unlink, this);
+
             /**
              * 其他参数初始化
              */
-            this->secondary_hashtable = nullptr;
-            this->is_hashtable_expanding = false;
-            this->is_hashtable_full = false;
             this->is_thread_stop = false;
-            this->hashtable_expanding_index = -1;
 
             /**
-             * 一个扩容hash表线程、一个申请内存的线程。当hash_power固定后，就可以将hashtable扩容的线程干掉了
+             * 一个申请内存的线程。hash表的扩容由set/del渐进地完成，见index_t::expand_step
+             */
+            this->expand_buffer_thread = new std::thread(&basic_ringcache::expand_buffer_func, this);
+
+            /**
+             * 后台清理过期数据的线程。粗粒度时钟的线程等到第一次用到过期时间时才启动
              */
-            this->expand_hashtable_thread = new std::thread(&ringcache::expand_hashtable_func, this);
-            this->expand_buffer_thread = new std::thread(&ringcache::expand_buffer_func, this);
+            this->sweep_thread = RING_SWEEP_INTERVAL_MS > 0 ? new std::thread(&basic_ringcache::sweep_func, this) : nullptr;
         }
 
         /**
-         * 写入数据
+         * 写入数据。expire：传uint32_t是秒级的绝对时间，expire_t::after_ms(ttl)是写入后ttl毫秒过期，
+         * expire_t::at_ms(ts)是毫秒级的绝对时间，都是0表示不过期
          */
-        uint32_t set(const std::string &key, const std::string &value, uint32_t expire_time){
-            return this->set(key, value.c_str(), value.length(), expire_time);
+        uint32_t set(const std::string &key, const std::string &value, expire_t expire){
+            return this->set(key, value.c_str(), value.length(), expire);
         }
 
         /**
          * 写入数据
          */
-        uint32_t set(const std::string &key, const char *val, uint32_t val_len, uint32_t expire_time){
-            /**
-             * key & value 长度校验
-             */
-            if (key.length() >= MAX_KEY_SIZE){
+        uint32_t set(const std::string &key, const char *val, uint32_t val_len, expire_t expire){
+            return this->set(key.c_str(), key.length(), val, val_len, expire);
+        }
+
+        /**
+         * 写入数据，key直接给指针和长度，不用先构造std::string
+         */
+        uint32_t set(const char *key, size_t key_len, const char *val, uint32_t val_len, expire_t expire){
+            if (key_len >= MAX_KEY_SIZE){
                 return RINGCACHE_ERRNO_KEY_TOO_LONG;
             }
-            if (val_len >= MAX_VALUE_SIZE){
-                return RINGCACHE_ERRNO_VALUE_TOO_LONG;
-            }
+            return this->set(key, key_len, this->hasher(key, key_len), val, val_len, expire);
+        }
 
-            /**
-             * 提取一个要存数据的buffer
-             */
-            uint32_t hash_val = hash(key);
-            ring_buffer_t *buffer = this->get_buffer_with_lock(hash_val);
-            if (buffer == nullptr){
-                return RINGCACHE_ERRNO_ALLOC_MEMORY_FAILED;
+        /**
+         * 写入数据，hash_val是调用方已经用hash_key()算好的hash
+         */
+        uint32_t set(const char *key, size_t key_len, uint32_t hash_val, const char *val, uint32_t val_len, expire_t expire){
+            uint32_t ret = this->set_entry(key, key_len, hash_val, val, val_len, expire);
+            if (this->tracer.is_enabled()){
+                this->tracer.record(TRACE_OP_SET, hash_val, key_len, val_len, trace_ttl(expire_deadline(expire)), ret);
             }
-            if (!buffer->mem_begin){
-                buffer->mtx->unlock();
-                return RINGCACHE_ERRNO_ALLOC_MEMORY_FAILED;
+            return ret;
+        }
+
+        /**
+         * 开始录制每次get/set/del到path里，给bench/trace_replay.cpp回放用，见trace.h。
+         * 文件打不开或者已经在录制了返回RINGCACHE_ERRNO_TRACE_IO
+         */
+        uint32_t start_trace(const std::string &path){
+            return this->tracer.start(path) ? RINGCACHE_ERRNO_OK : RINGCACHE_ERRNO_TRACE_IO;
+        }
+
+        /**
+         * 停止录制，返回录下来的条数
+         */
+        uint64_t stop_trace(){
+            return this->tracer.stop();
+        }
+
+        /**
+         * 批量写入：同一批里同一档的数据写到同一个buffer里，buffer的锁只拿一次，淘汰旧数据后也只做一次epoch同步。
+         * 每个key的错误码放到rets里，返回写入成功的个数
+         */
+        uint32_t multi_set(const std::vector< std::string > &keys, const std::vector< std::string > &values, expire_t expire, std::vector< uint32_t > &rets){
+            size_t num = keys.size();
+            rets.assign(num, RINGCACHE_ERRNO_OK);
+            if (values.size() != num){
+                return 0;
             }
 
             /**
-             * 从buffer找一块合适的空间
+             * 先校验长度、算hash
              */
-            entry_t *entry = this->get_mem_without_lock(key.length() + val_len, hash_val, buffer);
-            if (entry == nullptr){
-                buffer->mtx->unlock();
-                return RINGCACHE_ERRNO_ALLOC_MEMORY_FAILED;
+            std::vector< uint32_t > hashes(num), chunk;
+            for (size_t i = 0; i < num; i++){
+                if (keys[i].length() >= MAX_KEY_SIZE){
+                    rets[i] = RINGCACHE_ERRNO_KEY_TOO_LONG;
+                    continue;
+                }
+                if (values[i].length() >= MAX_VALUE_SIZE){
+                    rets[i] = RINGCACHE_ERRNO_VALUE_TOO_LONG;
+                    continue;
+                }
+                hashes[i] = this->hasher(keys[i].c_str(), keys[i].length());
+                chunk.push_back(i);
             }
-
-
-            //锁定hash相关的项
-            std::mutex *hash_mtx = this->get_hashtable_lock(hash_val);
-            std::lock_guard< std::mutex > hash_lock(*hash_mtx);
+            if (chunk.empty()){
+                return 0;
+            }
+#ifdef RINGCACHE_ATOMIC_RESERVE
+            //空间是逐个原子预留的，没有buffer锁、也没有逐个set的epoch同步可以省，直接逐个写
+            uint32_t succ = 0;
+            for (auto i:chunk){
+                rets[i] = this->set(keys[i], values[i].c_str(), values[i].length(), expire);
+                succ += rets[i] == RINGCACHE_ERRNO_OK;
+            }
+            return succ;
+#endif
 
             /**
-             * 拷贝数据到缓存空间里
+             * 要存的value，够长的先压缩，压缩后的放在packed里
              */
-            entry->hash_next = nullptr;
-            entry->key_len = key.length();
-            entry->value_len = val_len;
-            entry->expire_time = expire_time;
-            memcpy(entry->data, key.c_str(), key.length());
-            memcpy(entry->data + key.length(), val, val_len);
-
-            entry_t **hash_entry = this->get_hashtable_bucket(hash_val);
+            std::vector< stored_value_t > stored(num);
+            std::vector< std::string > packed(codec_t::enabled ? num : 0);
+            for (auto i:chunk){
+                stored[i].data = values[i].c_str();
+                stored[i].len = values[i].length();
+                stored[i].raw_len = values[i].length();
+                stored[i].flags = 0;
+                if (codec_t::enabled && stored[i].len >= RING_COMPRESS_MIN_SIZE && this->encode_value(stored[i].data, stored[i].len, packed[i])){
+                    stored[i].data = packed[i].data();
+                    stored[i].len = packed[i].size();
+                    stored[i].flags = ENTRY_FLAG_COMPRESSED;
+                }
+            }
 
             /**
-             * 如果之前已经有相同的key了直接清理了
+             * 按大小分档，每一档各写一批，同一批的相对过期时间都从这一刻算
              */
-            entry_t *pre = nullptr;
-            entry_t *cur = *hash_entry;
-            std::string tmpKey;
-            while (cur != nullptr){
-                cur->key(tmpKey);
-                //有可能同一个bucket会有多个相同的key
-                if (cur->key_len == key.length() && tmpKey == key){
-                    if (pre == nullptr){
-                        *hash_entry = cur->hash_next;
-                    }
-                    else{
-                        pre->hash_next = cur->hash_next;
-                    }
-                    cur->key_len = 0;
-                    cur->expire_time = 1;
-                    cur = cur->hash_next;
-                    continue;
+            uint64_t expire_ms = expire_deadline(expire);
+            if (this->class_conf.size() == 1){
+                return this->multi_set_class(keys, stored, expire_ms, hashes, chunk, 0, rets);
+            }
+            std::vector< std::vector< uint32_t > > groups(this->class_conf.size());
+            for (auto i:chunk){
+                groups[this->size_class_of(keys[i].length() + stored[i].len)].push_back(i);
+            }
+            uint32_t written = 0;
+            for (uint32_t c = 0; c < groups.size(); c++){
+                if (!groups[c].empty()){
+                    written += this->multi_set_class(keys, stored, expire_ms, hashes, groups[c], c, rets);
                 }
-                pre = cur;
-                cur = cur->hash_next;
             }
-
-            entry->hash_next = *hash_entry;
-            *hash_entry = entry;
-            buffer->mtx->unlock();
-            return RINGCACHE_ERRNO_OK;
+            return written;
         }
 
         /**
          * 提取数据
          */
         uint32_t del(const std::string &key){
-            if (key.length() >= MAX_KEY_SIZE){
+            return this->del(key.c_str(), key.length());
+        }
+
+        uint32_t del(const char *key, size_t key_len){
+            if (key_len >= MAX_KEY_SIZE){
                 return RINGCACHE_ERRNO_KEY_TOO_LONG;
             }
+            return this->del(key, key_len, this->hasher(key, key_len));
+        }
 
-            uint32_t hash_val = hash(key);
-            std::mutex *hash_mtx = this->get_hashtable_lock(hash_val);
-            std::lock_guard< std::mutex > lock(*hash_mtx);
-            entry_t **hash_entry = this->get_hashtable_bucket(hash_val);
-
-            entry_t *pre = nullptr;
-            entry_t *next = nullptr;
-            entry_t *cur = *hash_entry;
-            std::string tmpKey;
-            while (cur){
-                next = cur->hash_next;
-                cur->key(tmpKey);
-                //有可能同一个bucket会有多个相同的key
-                if (tmpKey == key){
-                    if (pre == nullptr){
-                        *hash_entry = cur->hash_next;
-                    }
-                    else{
-                        pre->hash_next = cur->hash_next;
-                    }
-                    cur->key_len = 0;
-                    cur->expire_time = 1;
-                    cur = next;
-                    continue;
-                }
-                pre = cur;
-                cur = cur->hash_next;
+        uint32_t del(const char *key, size_t key_len, uint32_t hash_val){
+            if (key_len >= MAX_KEY_SIZE){
+                return RINGCACHE_ERRNO_KEY_TOO_LONG;
             }
+            latency_scope timer(this->latency, LATENCY_DEL);
+            {
+                std::lock_guard< std::mutex > lock(*this->lock_index(hash_val), std::adopt_lock);
+                this->index->remove(key, key_len, hash_val);
+            }
+            this->index->expand_step();
+            this->count(STAT_DEL_NUM, 1);
+            this->trace(TRACE_OP_DEL, hash_val, key_len, 0, 0, RINGCACHE_ERRNO_OK);
             return RINGCACHE_ERRNO_OK;
         }
 
@@ -226,8 +305,16 @@ namespace ringcache{
          * 检查数据是否存在
          */
         bool check(const std::string &key){
-            std::string v;
-            return this->get(key, v, true) == RINGCACHE_ERRNO_OK;
+            return this->check(key.c_str(), key.length());
+        }
+
+        bool check(const char *key, size_t key_len){
+            if (key_len >= MAX_KEY_SIZE){
+                return false;
+            }
+            epoch_guard guard;
+            entry_t *entry = nullptr;
+            return this->find_without_lock(key, key_len, this->hasher(key, key_len), entry) == RINGCACHE_ERRNO_OK;
         }
 
         /**
@@ -238,408 +325,1708 @@ namespace ringcache{
         }
 
         /**
-         * 提取数据，不会锁hash表
+         * 提取数据，only_check为true时只检查数据存在，并不获取数据
          */
         uint32_t get(const std::string &key, std::string &value, bool only_check){
+            if (!only_check){
+                return this->get(key.c_str(), key.length(), value);
+            }
             if (key.length() >= MAX_KEY_SIZE){
                 return RINGCACHE_ERRNO_KEY_TOO_LONG;
             }
-
-            uint32_t hash_val = hash(key);
-            entry_t **hash_entry = this->get_hashtable_bucket(hash_val);
-
-            entry_t *entry = *hash_entry;
-            entry_t *next = nullptr;
-            uint32_t klen = key.length();
-            std::string tmpKey;
-            int64_t ct = time(nullptr);
-            while (entry != nullptr){
-                next = entry->hash_next;
-                if (entry->key_len != klen){
-                    entry = next;
-                    continue;
-                }
-                entry->key(tmpKey);
-                if (tmpKey != key){
-                    entry = next;
-                    continue;
-                }
-                //过期了
-                if (entry->expire_time > 0 && entry->expire_time <= ct){
-                    return RINGCACHE_ERRNO_KEY_EXPIRED;
-                }
-                //是不是只检查数据存在，并不获取数据
-                if (!only_check){
-                    entry->value(value);
-                }
-                break;
-            }
-            //没找着
-            if (entry == nullptr){
-                return RINGCACHE_ERRNO_NOT_FOUND;
-            }
-            return RINGCACHE_ERRNO_OK;
+            epoch_guard guard;
+            entry_t *entry = nullptr;
+            return this->find_without_lock(key.c_str(), key.length(), this->hasher(key.c_str(), key.length()), entry);
         }
 
         /**
-         * 当前统计信息
+         * 提取数据，key直接给指针和长度。value的空间够时不会再申请内存
          */
-        const stats_t *get_stats(){
-            return this->stats;
+        uint32_t get(const char *key, size_t key_len, std::string &value){
+            if (key_len >= MAX_KEY_SIZE){
+                return RINGCACHE_ERRNO_KEY_TOO_LONG;
+            }
+            return this->get(key, key_len, this->hasher(key, key_len), value);
         }
 
         /**
-         * 释放空间
+         * 提取数据，hash_val是调用方已经用hash_key()算好的hash
+         * 整个查找过程处于epoch读临界区内，写线程在覆盖环形缓冲区或释放旧hash表之前
+         * 会等待所有读线程离开，所以这里读到的entry不会被释放或改写
          */
-        ~ringcache(){
-            this->is_thread_stop = true;
-            this->expand_buffer_thread->join();
-            this->expand_hashtable_thread->join();
-            free(this->primary_hashtable);
-            for (auto it:this->hashtable_locks){
-                delete (it);
+        uint32_t get(const char *key, size_t key_len, uint32_t hash_val, std::string &value){
+            if (key_len >= MAX_KEY_SIZE){
+                return RINGCACHE_ERRNO_KEY_TOO_LONG;
             }
-            for (auto it:this->buffers){
-                free(it->mem_begin);
-                delete it->stats;
-                delete it->mtx;
-                delete it;
+            latency_scope timer(this->latency, LATENCY_GET);
+            epoch_guard guard;
+            entry_t *entry = nullptr;
+            uint32_t ret = this->find_without_lock(key, key_len, hash_val, entry);
+            //del()可能并发地把key_len置0，这里用已经校验过的key长度定位value
+            if (ret == RINGCACHE_ERRNO_OK){
+                ret = this->read_value(entry, key_len, value);
+                this->count(STAT_READ_BYTES, value.size());
             }
+            this->trace(TRACE_OP_GET, hash_val, key_len, ret == RINGCACHE_ERRNO_OK ? value.size() : 0, 0, ret);
+            return ret;
         }
 
-    private:
         /**
-         * 线程
+         * 用本实例的hash函数算key的hash，批量或者多次操作同一个key时可以先算好，传给带hash_val的重载
          */
-        std::thread *expand_hashtable_thread;
-        std::thread *expand_buffer_thread;
+        uint32_t hash_key(const char *key, size_t key_len) const{
+            return this->hasher(key, key_len);
+        }
 
         /**
-         * 挑一个buffer，目前是随机选择一个buffer开始，目前看是还比较均匀
+         * 批量读：每MULTI_GET_BATCH个key一组，先算hash、预取bucket，再预取entry，最后才逐个比较，
+         * 让各个key的内存访问延迟重叠起来，而不是一个key一个key地串行等cache miss。
+         * 每个key的错误码放到rets里，没读到的value清空，返回找到的个数
          */
-        ring_buffer_t *get_buffer_with_lock(uint32_t hash_val){
-            ring_buffer_t *buffer;
-            uint32_t retry_times = 0;
-            srand(time(nullptr) & HASH_MASK(32));
-            uint32_t startIdx = rand();
-            uint32_t endIdx = this->buffers.size() + startIdx;
-            do{
-                for (uint32_t i = startIdx; i < endIdx; i++){
-                    buffer = this->buffers.at(i % this->buffers.size());
-                    if (buffer->mtx->try_lock()){
-                        return buffer;
+        uint32_t multi_get(const std::vector< std::string > &keys, std::vector< std::string > &values, std::vector< uint32_t > &rets){
+            size_t num = keys.size();
+            values.resize(num);
+            rets.resize(num);
+            uint32_t hashes[MULTI_GET_BATCH];
+            uint32_t found = 0;
+            uint64_t bytes = 0;
+            for (size_t begin = 0; begin < num; begin += MULTI_GET_BATCH){
+                size_t end = std::min(begin + MULTI_GET_BATCH, num);
+                epoch_guard guard;
+                for (size_t i = begin; i < end; i++){
+                    if (keys[i].length() >= MAX_KEY_SIZE){
+                        continue;
                     }
+                    hashes[i - begin] = this->hasher(keys[i].c_str(), keys[i].length());
+                    this->index->prefetch(hashes[i - begin]);
                 }
-            }while (retry_times++ < 5);
-            buffer = this->buffers[hash_val % this->buffers.size()];
-            buffer->mtx->lock();
-            return buffer;
+                for (size_t i = begin; i < end; i++){
+                    if (keys[i].length() < MAX_KEY_SIZE){
+                        this->index->prefetch_entry(hashes[i - begin]);
+                    }
+                }
+                for (size_t i = begin; i < end; i++){
+                    if (keys[i].length() >= MAX_KEY_SIZE){
+                        rets[i] = RINGCACHE_ERRNO_KEY_TOO_LONG;
+                        values[i].clear();
+                        continue;
+                    }
+                    entry_t *entry = nullptr;
+                    rets[i] = this->find_without_lock(keys[i].c_str(), keys[i].length(), hashes[i - begin], entry);
+                    if (rets[i] == RINGCACHE_ERRNO_OK){
+                        rets[i] = this->read_value(entry, keys[i].length(), values[i]);
+                    }
+                    //values是调用方传进来的，可能还留着上一次的结果
+                    if (rets[i] != RINGCACHE_ERRNO_OK){
+                        values[i].clear();
+                    }
+                    else{
+                        found++;
+                        bytes += values[i].size();
+                    }
+                    this->trace(TRACE_OP_GET, hashes[i - begin], keys[i].length(), rets[i] == RINGCACHE_ERRNO_OK ? values[i].size() : 0, 0, rets[i]);
+                }
+            }
+            this->count(STAT_READ_BYTES, bytes);
+            return found;
         }
 
         /**
-         * 提取多少字节：从指定buffer里获取可以存下数据的块
+         * 提取数据，直接拷贝到调用方提供的buf里，不经过std::string
+         * value_len返回value的实际长度，cap不够时返回RINGCACHE_ERRNO_BUFFER_TOO_SMALL，
+         * 调用方可以按value_len重新准备buf
          */
-        entry_t *get_mem_without_lock(uint32_t msize, uint32_t hash_val, ring_buffer_t *buffer){
-            //开始寻找空间
-            uint64_t need_size = msize + sizeof(entry_t);
-            uint64_t buffer_remain_size = buffer->mem_end - buffer->mem_cur_ptr + 1;
-
-            /**
-             * 如果当前指针后面剩余的空间不够存储当前数据，从头开始
-             */
-            if (buffer_remain_size < need_size){
-                buffer->mem_cur_ptr = buffer->mem_begin;
-                buffer->stats->reset_header_times++;
-            }
-
-            buffer->stats->item_num++;
-            buffer->stats->set_num++;
-
-            //还差多少空间
-            uint64_t reduce_size = need_size;
-
-            //寻找需要释放后面的几个空间
-            entry_t *tmpEntry = (entry_t *) buffer->mem_cur_ptr;
+        uint32_t get_into(const std::string &key, char *buf, size_t cap, uint32_t &value_len){
+            return this->get_into(key.c_str(), key.length(), buf, cap, value_len);
+        }
 
-            /**
-             * 寻找当前数据要剔除的其他数据。还要确定最后一个entry腾出来的空间。
-             * 如果够一个sizeof(entry_t)的话就留着给下一次写入用，如果不够直接全让给本数据
-             */
-            std::string tmpKey;
-            while (true){
-                assert(tmpEntry->key_len < MAX_KEY_SIZE);
-                assert(tmpEntry->entry_len <= buffer->mem_size);
-                //剔除当前的数据
-                if (tmpEntry->key_len > 0){
-                    tmpEntry->key(tmpKey);
-                    this->del(tmpKey);
-                    buffer->stats->del_num++;
-                    buffer->stats->item_num--;
-                }
-                if (tmpEntry->entry_len >= reduce_size){
-                    break;
-                }
-                assert(tmpEntry->entry_len > 0);
-                reduce_size -= tmpEntry->entry_len;
-                tmpEntry = (entry_t *) ((char *) tmpEntry + tmpEntry->entry_len);
+        uint32_t get_into(const char *key, size_t key_len, char *buf, size_t cap, uint32_t &value_len){
+            value_len = 0;
+            if (key_len >= MAX_KEY_SIZE){
+                return RINGCACHE_ERRNO_KEY_TOO_LONG;
             }
+            return this->get_into(key, key_len, this->hasher(key, key_len), buf, cap, value_len);
+        }
 
-            //最后一个剩余的空间
-            assert(tmpEntry->entry_len >= reduce_size);
-            uint64_t last_entry_remain_size = tmpEntry->entry_len - reduce_size;
-
-            /**
-             * 要返回的内存地址
-             */
-            entry_t *ret = (entry_t *) buffer->mem_cur_ptr;
-
-            /**
-             * 最后一个entry，如果剩余的空间少于sizeof(entry_t)则不再保留
-             */
-            if (last_entry_remain_size > sizeof(entry_t)){
-                buffer->mem_cur_ptr = (char *) tmpEntry + reduce_size;
-                entry_t *tmp = (entry_t *) buffer->mem_cur_ptr;
-                tmp->value_len = 0;
-                tmp->entry_len = last_entry_remain_size;
-                tmp->key_len = 0;
-                tmp->expire_time = 1;
-                tmp->hash_next = nullptr;
-                ret->entry_len = need_size;
-            }
-            else{
-                buffer->mem_cur_ptr = (char *) tmpEntry + tmpEntry->entry_len;
-                //剩下的空间不足一个entry_t结构体，直接带走对齐得了
-                ret->entry_len = need_size + last_entry_remain_size;
+        uint32_t get_into(const char *key, size_t key_len, uint32_t hash_val, char *buf, size_t cap, uint32_t &value_len){
+            value_len = 0;
+            if (key_len >= MAX_KEY_SIZE){
+                return RINGCACHE_ERRNO_KEY_TOO_LONG;
             }
-            ret->hash_next = nullptr;
-            ret->key_len = 0;
-            ret->value_len = 0;
-            ret->expire_time = 0;
-
-
-            //如果正好到末尾，修改一下当前指针的指向
-            if (buffer->mem_cur_ptr >= buffer->mem_end){
-                buffer->mem_cur_ptr = buffer->mem_begin;
-                buffer->stats->reset_header_times++;
+            latency_scope timer(this->latency, LATENCY_GET);
+            epoch_guard guard;
+            entry_t *entry = nullptr;
+            uint32_t ret = this->find_without_lock(key, key_len, hash_val, entry);
+            if (ret == RINGCACHE_ERRNO_OK){
+                value_len = this->value_raw_len(entry, key_len);
+                if (value_len > cap){
+                    ret = RINGCACHE_ERRNO_BUFFER_TOO_SMALL;
+                }
+                else if (!this->decode_value(entry, key_len, buf, value_len)){
+                    ret = RINGCACHE_ERRNO_DECOMPRESS_FAILED;
+                }
+                else{
+                    this->count(STAT_READ_BYTES, value_len);
+                }
             }
+            this->trace(TRACE_OP_GET, hash_val, key_len, ret == RINGCACHE_ERRNO_OK ? value_len : 0, 0, ret);
             return ret;
         }
 
         /**
-         * 扩容用的，当使用的总的小格子量超过总量60%时开始扩容
-         * hash_power=25时容量差不多是33554432，此时差不多可以开始以秒为单位sleep
-         * =28时差不多就是2.6亿，够可以的了，可以用10秒了
+         * 零拷贝提取数据：visitor(const char *value, uint32_t value_len)直接拿到环形缓冲区里的数据
+         * visitor在epoch读临界区内执行，期间这块内存不会被覆盖，但也会让需要覆盖内存的写线程等待，
+         * 所以visitor要尽快返回，不要保存指针，也不要在里面调用set/del。
+         * 压缩过的value先解压到本线程的临时空间里，拿到的是解压后的数据
          */
-        void expand_hashtable_func(){
-            std::cout << "[thread_func]start expand_hashtable_func" << std::endl;
-            uint64_t sleepInterval = 10000;
-            do{
-                //检查总空间的使用量
-                if ((HASH_SIZE(this->hash_power) / 4) * 3 < this->stats->item_num()){
-                    std::cout << "[expand_hashtable_func] total_thres=" << (HASH_SIZE(this->hash_power) / 10) * 6 << "\tcur_item_num=" << this->stats->item_num() << std::endl;
-                    this->expand_hash_table();
-                }
-                if (this->is_hashtable_full.load()){
-                    break;
-                }
-                usleep(sleepInterval);
+        template< typename visitor_t >
+        uint32_t visit(const std::string &key, visitor_t visitor){
+            return this->visit(key.c_str(), key.length(), visitor);
+        }
 
-                //转换一下sleep的时间
-                if (this->hash_power >= 28){//大概2.6亿个，应该到极限了
-                    sleepInterval = 10000000;
-                }
-                else if (this->hash_power >= 27){//大概1.3亿个
-                    sleepInterval = 5000000;
-                }
-                else if (this->hash_power > 25){//大概3.3千万个
-                    sleepInterval = 1000000;
-                }
-            }while (!this->is_thread_stop);
-            std::cout << "[thread_func]end expand_hashtable_func" << std::endl;
+        template< typename visitor_t >
+        uint32_t visit(const char *key, size_t key_len, visitor_t visitor){
+            if (key_len >= MAX_KEY_SIZE){
+                return RINGCACHE_ERRNO_KEY_TOO_LONG;
+            }
+            return this->visit(key, key_len, this->hasher(key, key_len), visitor);
         }
 
-        /**
-         * 在后台线程里申请内存
-         */
-        void expand_buffer_func(){
-            std::cout << "[thread_func]start expand_buffer_func" << std::endl;
-            while (this->buffers.size() < RING_BUFFER_NUM){
-                if (this->is_thread_stop){
-                    return;
+        template< typename visitor_t >
+        uint32_t visit(const char *key, size_t key_len, uint32_t hash_val, visitor_t visitor){
+            if (key_len >= MAX_KEY_SIZE){
+                return RINGCACHE_ERRNO_KEY_TOO_LONG;
+            }
+            latency_scope timer(this->latency, LATENCY_GET);
+            epoch_guard guard;
+            entry_t *entry = nullptr;
+            uint32_t ret = this->find_without_lock(key, key_len, hash_val, entry);
+            uint32_t value_len = 0;
+            if (ret == RINGCACHE_ERRNO_OK){
+                if (codec_t::enabled && (entry->flags & ENTRY_FLAG_COMPRESSED)){
+                    std::string &plain = decode_scratch();
+                    ret = this->read_value(entry, key_len, plain);
+                    if (ret == RINGCACHE_ERRNO_OK){
+                        value_len = plain.size();
+                        visitor((const char *) plain.data(), value_len);
+                    }
                 }
-                this->alloc_buffer_memory();
+                else{
+                    value_len = entry->value_len;
+                    visitor((const char *) (entry->data + key_len), value_len);
+                }
+                this->count(STAT_READ_BYTES, value_len);
             }
-            std::cout << "[thread_func]finish expand_buffer_func" << std::endl;
+            this->trace(TRACE_OP_GET, hash_val, key_len, value_len, 0, ret);
+            return ret;
         }
 
         /**
-         * 给缓冲区分配内存
+         * 当前统计信息的快照：各片计数器加起来、拷出来，不加锁，也不会和写入线程抢cache line。
+         * 每个计数器只读一次，但读的时候别的线程还在写，各个计数器之间不是同一时刻的
          */
-        void alloc_buffer_memory(){
-            ring_buffer_t *buffer = new ring_buffer_t();
-            buffer->mem_begin = (char *) calloc(this->buffer_size, sizeof(char));
-            if (buffer->mem_begin == nullptr){
-                delete buffer;
-                return;
+        stats_t get_stats(){
+            stats_t stats = stats_t();
+            stats.buffer_num = RING_BUFFER_NUM;
+            stats.index_item_num = this->index->size();
+            stats.index_capacity = this->index->capacity();
+            stats.index_drop_num = this->index->dropped();
+            stats.index_resize_num = this->index->resize_count();
+            stats.index_last_resize_us = this->index->last_resize_cost();
+            this->index->resize_progress(stats.index_resize_done, stats.index_resize_total);
+            stats.snapshot_load_bytes = this->snapshot_load_bytes;
+            stats.snapshot_load_items = this->snapshot_load_items;
+            stats.snapshot_load_us = this->snapshot_load_us;
+
+            std::vector< uint64_t > sums(this->counters->size());
+            this->counters->sum_all(sums.data());
+            stats.get_hit_num = sums[STAT_GET_HIT];
+            stats.get_miss_num = sums[STAT_GET_MISS];
+            stats.get_expired_num = sums[STAT_GET_EXPIRED];
+            stats.read_bytes = sums[STAT_READ_BYTES];
+            stats.write_bytes = sums[STAT_WRITE_BYTES];
+            stats.del_call_num = sums[STAT_DEL_NUM];
+            stats.compress_num = sums[STAT_COMPRESS_NUM];
+            stats.compress_skip_num = sums[STAT_COMPRESS_SKIP_NUM];
+            stats.compress_raw_bytes = sums[STAT_COMPRESS_RAW_BYTES];
+            stats.compress_out_bytes = sums[STAT_COMPRESS_OUT_BYTES];
+            stats.compress_ns = sums[STAT_COMPRESS_NS];
+            stats.decompress_num = sums[STAT_DECOMPRESS_NUM];
+            stats.decompress_ns = sums[STAT_DECOMPRESS_NS];
+            if (this->latency != nullptr){
+                this->latency->snapshot(stats.latency);
             }
-            std::cout << "[alloc_buffer_memory]alloc buffer success, size=" << (this->buffer_size / MB) << "MB" << std::endl;
-
-            buffer->mem_end = buffer->mem_begin + this->buffer_size - 1;
-            buffer->mem_cur_ptr = buffer->mem_begin;
-            buffer->mtx = new std::mutex();
-            buffer->mem_size = this->buffer_size;
 
-            //初始化统计信息
-            buffer->stats = new buffer_stats_t();
-            buffer->stats->index = this->buffers.size();
-            buffer->stats->item_num = 0;
-            buffer->stats->set_num = 0;
-            buffer->stats->del_num = 0;
-            buffer->stats->reset_header_times = 0;
-            buffer->stats->cache_byte_size = this->buffer_size;
-            this->stats->buffer_stats.push_back(buffer->stats);
-
-            //初始化内存块header信息
-            entry_t *tmpEntry = (entry_t *) buffer->mem_begin;
-            tmpEntry->expire_time = 1;
-            tmpEntry->key_len = 0;
-            tmpEntry->entry_len = this->buffer_size;
-            tmpEntry->value_len = 0;
-            tmpEntry->hash_next = nullptr;
+            //各个buffer实际拿到了多少大页
+            std::vector< const char * > begins;
+            std::vector< uint64_t > huge;
+            size_t num = this->ready_num.load(std::memory_order_acquire);
+            for (size_t i = 0; i < num; i++){
+                begins.push_back(this->buffers[i]->mem_begin);
+            }
+            smaps_huge_bytes(begins, this->buffer_size, huge);
+
+            for (size_t i = 0; i < num; i++){
+                ring_buffer_t *buffer = this->buffers[i];
+                const buffer_counters_t *c = buffer->stats;
+                const uint64_t *shared = &sums[this->buffer_counter_base + buffer->index * BUFFER_STAT_NUM];
+                buffer_stats_t bs = buffer_stats_t();
+                bs.index = buffer->index;
+                bs.size_class = buffer->size_class;
+                bs.item_num = shared[BUFFER_STAT_ITEM_NUM];
+                bs.set_num = shared[BUFFER_STAT_SET_NUM];
+                bs.del_num = c->del_num.load(std::memory_order_relaxed);
+                bs.reset_header_times = c->reset_header_times.load(std::memory_order_relaxed);
+                bs.evict_num = c->evict_num.load(std::memory_order_relaxed);
+                bs.evict_set_num = c->evict_set_num.load(std::memory_order_relaxed);
+                bs.evict_max_per_set = c->evict_max_per_set.load(std::memory_order_relaxed);
+                for (uint32_t h = 0; h < EVICT_HIST_SIZE; h++){
+                    bs.evict_hist[h] = c->evict_hist[h].load(std::memory_order_relaxed);
+                }
+                bs.cache_byte_size = this->buffer_size;
+                bs.lock_num = c->lock_num.load(std::memory_order_relaxed);
+                bs.lock_wait_num = c->lock_wait_num.load(std::memory_order_relaxed);
+                bs.lock_busy_num = shared[BUFFER_STAT_LOCK_BUSY_NUM];
+                bs.reserve_wait_num = shared[BUFFER_STAT_RESERVE_WAIT_NUM];
+                bs.page_mode = c->page_mode.load(std::memory_order_relaxed);
+                bs.numa_node = c->numa_node.load(std::memory_order_relaxed);
+                bs.huge_page_bytes = huge[i];
+                bs.expired_num = c->expired_num.load(std::memory_order_relaxed);
+                bs.expired_bytes = c->expired_bytes.load(std::memory_order_relaxed);
+                bs.sweep_num = c->sweep_num.load(std::memory_order_relaxed);
+                bs.sweep_bytes = c->sweep_bytes.load(std::memory_order_relaxed);
+                bs.sweep_rounds = c->sweep_rounds.load(std::memory_order_relaxed);
+                stats.buffer_stats.push_back(bs);
+            }
 
-            this->buffers.push_back(buffer);
+            //各档的占用及淘汰从所属的buffer汇总
+            for (uint32_t k = 0; k < this->class_conf.size(); k++){
+                class_stats_t cs = class_stats_t();
+                cs.index = k;
+                cs.max_size = this->class_conf[k].max_size;
+                //只有一档时查找不分档计数，就是总的命中数
+                cs.hit_num = this->class_conf.size() > 1 ? sums[this->class_counter(k, CLASS_STAT_HIT)] : sums[STAT_GET_HIT];
+                cs.live_num = sums[this->class_counter(k, CLASS_STAT_LIVE_NUM)];
+                cs.live_bytes = sums[this->class_counter(k, CLASS_STAT_LIVE_BYTES)];
+                stats.class_stats.push_back(cs);
+            }
+            for (auto &bs:stats.buffer_stats){
+                class_stats_t &cs = stats.class_stats[bs.size_class];
+                cs.buffer_num++;
+                cs.cache_byte_size += bs.cache_byte_size;
+                cs.item_num += bs.item_num;
+                cs.set_num += bs.set_num;
+                cs.evict_num += bs.evict_num;
+            }
+            return stats;
         }
 
         /**
-         * 扩容hash表
+         * 把所有buffer原样写到快照文件里：先写到path.tmp，写完再改名，不会留下写了一半的快照。
+         * 整个拷贝期间所有buffer都冻结着（见freeze_buffers），写入会等着，快照里同一个key不会有两份有效数据
          */
-        void expand_hash_table(){
-            if (this->hash_power >= HASH_POWER_MAX){
-                this->is_hashtable_full = true;
+        uint32_t save(const std::string &path){
+            this->wait_buffers();
+            uint32_t num = this->ready_num.load(std::memory_order_acquire);
+            snapshot_header_t header;
+            memset(&header, 0, sizeof(header));
+            header.magic = SNAPSHOT_MAGIC;
+            header.version = SNAPSHOT_VERSION;
+            header.buffer_num = num;
+            header.buffer_size = this->buffer_size;
+            header.seg_num = this->segment_num();
+            header.hash_check = this->hasher(project_name(), strlen(project_name()));
+            header.class_check = this->class_check();
+            header.entry_size = sizeof(entry_t);
+            header.item_num = this->index->size();
+            header.data_offset = SNAPSHOT_ALIGN_SIZE(sizeof(snapshot_header_t) + num * sizeof(snapshot_buffer_t));
+            header.data_stride = SNAPSHOT_ALIGN_SIZE(this->buffer_size);
+
+            std::string tmp = path + ".tmp";
+            int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if (fd < 0){
+                return RINGCACHE_ERRNO_SNAPSHOT_IO;
             }
-            //已经满了
-            if (this->is_hashtable_full.load()){
-                return;
+            std::vector< snapshot_buffer_t > metas(num);
+            memset(metas.data(), 0, num * sizeof(snapshot_buffer_t));
+            std::vector< uint64_t > cursors(num, 0);
+            this->freeze_buffers(num, cursors);
+            bool ok = true;
+            for (uint32_t i = 0; i < num && ok; i++){
+                ring_buffer_t *buffer = this->buffers[i];
+                snapshot_buffer_t &meta = metas[i];
+                meta.cur_offset = buffer->mem_cur_ptr - buffer->mem_begin;
+                if (buffer->reserve != nullptr){
+                    ring_reserve_t *r = buffer->reserve;
+                    meta.cursor = cursors[i];
+                    for (uint32_t seg = 0; seg < r->seg_num; seg++){
+                        meta.fill[seg] = r->segments[seg].fill;
+                    }
+                    //正在写的这一段还没有fill，冻结时的写指针没有越过段尾，就是这一段已经写完的字节数
+                    meta.fill[(meta.cursor >> 32) % r->seg_num] = (uint32_t) meta.cursor;
+                }
+                ok = snapshot_pwrite(fd, buffer->mem_begin, this->buffer_size, header.data_offset + i * header.data_stride);
             }
-            std::cout << "[expand_hash_table]start expand_hash_table......" << std::endl;
-
-            //扩容标志检查
-            this->secondary_hashtable = this->primary_hashtable;
-            bool expanding = false;
-            this->is_hashtable_expanding.compare_exchange_strong(expanding, true);
-            if (expanding){
-                std::cout << "[expand_hash_table] is_hashtable_expanding=true......" << std::endl;
-                return;
+            this->thaw_buffers(num, cursors);
+            ok = ok && snapshot_pwrite(fd, (const char *) metas.data(), num * sizeof(snapshot_buffer_t), sizeof(snapshot_header_t));
+            ok = ok && snapshot_pwrite(fd, (const char *) &header, sizeof(header), 0);
+            ok = ok && fsync(fd) == 0;
+            close(fd);
+            if (!ok || rename(tmp.c_str(), path.c_str()) != 0){
+                unlink(tmp.c_str());
+                return RINGCACHE_ERRNO_SNAPSHOT_IO;
             }
+            return RINGCACHE_ERRNO_OK;
+        }
 
-            //新的容量
-            this->hashtable_expanding_index = -1;
-            uint8_t new_hash_power = this->hash_power + 1;
-            if (new_hash_power > HASH_POWER_MAX){
-                this->is_hashtable_full = true;
-                return;
+        /**
+         * 从快照恢复，只能在刚构造完、还没有任何读写之前调用，buffer个数及大小、大小分档、原子预留的段数、hash函数都要和保存时一致。
+         * use_mmap为true时直接把快照文件MAP_PRIVATE地映射成buffer，不用先整个读进内存。
+         * 之后thread_num（0表示CPU个数）个线程各自认领buffer，扫一遍entry重建索引，跳过已删除、已过期的
+         */
+        uint32_t load(const std::string &path, bool use_mmap = false, uint32_t thread_num = 0){
+            auto begin = std::chrono::steady_clock::now();
+            this->wait_buffers();
+            //换buffer内存、重建索引期间不能让清理线程去扫
+            std::lock_guard< std::mutex > sweep_lock(this->sweep_mtx);
+            if (this->index->size() > 0){
+                return RINGCACHE_ERRNO_SNAPSHOT_MISMATCH;
             }
-
-            //申请新的空间
-            uint32_t new_hash_size = HASH_SIZE(new_hash_power);
-            this->primary_hashtable = (entry_t **) calloc(new_hash_size, sizeof(entry_t *));
-            if (this->primary_hashtable == nullptr){
-                this->primary_hashtable = this->secondary_hashtable;
-                this->is_hashtable_expanding = false;
-                return;
+            int fd = open(path.c_str(), O_RDONLY);
+            if (fd < 0){
+                return RINGCACHE_ERRNO_SNAPSHOT_IO;
             }
-            for (uint32_t i = 0; i < new_hash_size; i++){
-                this->primary_hashtable[i] = nullptr;
+            snapshot_header_t header;
+            if (!snapshot_pread(fd, (char *) &header, sizeof(header), 0)){
+                close(fd);
+                return RINGCACHE_ERRNO_SNAPSHOT_IO;
+            }
+            if (header.magic != SNAPSHOT_MAGIC || header.version != SNAPSHOT_VERSION || header.buffer_num != this->buffers.size()
+                || header.buffer_size != this->buffer_size || header.seg_num != this->segment_num()
+                || header.hash_check != this->hasher(project_name(), strlen(project_name())) || header.class_check != this->class_check()
+                || header.entry_size != sizeof(entry_t)){
+                close(fd);
+                return RINGCACHE_ERRNO_SNAPSHOT_MISMATCH;
+            }
+            std::vector< snapshot_buffer_t > metas(header.buffer_num);
+            if (!snapshot_pread(fd, (char *) metas.data(), header.buffer_num * sizeof(snapshot_buffer_t), sizeof(snapshot_header_t))){
+                close(fd);
+                return RINGCACHE_ERRNO_SNAPSHOT_IO;
             }
 
-            entry_t *old_hash_item;
-            //拷贝数据
-            uint32_t old_hash_size = HASH_SIZE(this->hash_power);
-            for (int i = 0; i < old_hash_size; i++){
-                old_hash_item = this->secondary_hashtable[i];
-                //忽略掉空的
-                if (old_hash_item == nullptr){
-                    continue;
-                }
-
-                //此时会锁hash表的
-                std::mutex *hash_mtx = this->get_hashtable_lock(old_hash_item->hash());
-                hash_mtx->lock();
+            //还没有任何读写，直接换一个按快照里的数据量开好的索引，恢复时不用边插入边扩容
+            if (header.item_num > this->index->capacity() / 2){
+                delete this->index;
+                this->index = new index_t(header.item_num, &this->locator, this->numa_node);
+                this->index->on_unlink(on_entry_unlink, this);
+            }
 
-                //迁移数据
-                uint32_t hash_val = old_hash_item->hash();
-                uint32_t bucket = hash_val & HASH_MASK(new_hash_power);
-                while (old_hash_item != nullptr){
-                    old_hash_item->hash_next = this->primary_hashtable[bucket];
-                    this->primary_hashtable[bucket] = old_hash_item;
-                    old_hash_item = old_hash_item->hash_next;
+            if (thread_num == 0){
+                thread_num = std::thread::hardware_concurrency();
+            }
+            thread_num = std::max(1u, std::min(thread_num, header.buffer_num));
+            std::atomic< uint32_t > next(0);
+            std::atomic< uint64_t > items(0);
+            std::atomic< bool > ok(true);
+            auto worker = [&](){
+                uint32_t i;
+                while ((i = next.fetch_add(1)) < header.buffer_num){
+                    uint64_t offset = header.data_offset + (uint64_t) i * header.data_stride;
+                    if (!this->restore_buffer(this->buffers[i], fd, offset, header.data_stride, use_mmap, metas[i])){
+                        ok = false;
+                        continue;
+                    }
+                    items += this->rebuild_index(this->buffers[i], metas[i]);
                 }
-                this->hashtable_expanding_index = i;
-                hash_mtx->unlock();
+            };
+            std::vector< std::thread > threads;
+            for (uint32_t t = 1; t < thread_num; t++){
+                threads.emplace_back(worker);
             }
+            worker();
+            for (auto &t:threads){
+                t.join();
+            }
+            close(fd);
 
-            //扩容完毕
-            entry_t **tmp = this->secondary_hashtable;
-            this->secondary_hashtable = this->primary_hashtable;
-            this->hash_power = new_hash_power;
-            this->is_hashtable_expanding = false;
-            this->hashtable_expanding_index = -1;
-            free(tmp);
-        }
-
-        /**
-         * 获取hashtable锁
-         */
-        std::mutex *get_hashtable_lock(uint32_t hash_val){
-            return this->hashtable_locks[hash_val & HASH_MASK(HASHTABLE_LOCK_POWER)];
+            this->snapshot_load_bytes = (uint64_t) header.buffer_num * this->buffer_size;
+            this->snapshot_load_items = items;
+            this->snapshot_load_us = std::chrono::duration_cast< std::chrono::microseconds >(std::chrono::steady_clock::now() - begin).count();
+            return ok ? RINGCACHE_ERRNO_OK : RINGCACHE_ERRNO_SNAPSHOT_IO;
         }
 
         /**
-         * 获取所要操作的hashtable bucket，需要考虑是否在扩容
+         * 释放空间
          */
-        entry_t **get_hashtable_bucket(uint64_t hash_val){
-            uint32_t old_bucket = hash_val & HASH_MASK(this->hash_power);
-            uint32_t new_bucket = hash_val & HASH_MASK(this->hash_power + 1);
-            //没有扩容的、或者相应的bucket已扩容完成要用primary表
-            if (!this->is_hashtable_expanding){
-                return &(this->primary_hashtable[old_bucket]);
+        ~basic_ringcache(){
+            this->is_thread_stop = true;
+            this->expand_buffer_thread->join();
+            delete this->expand_buffer_thread;
+            if (this->sweep_thread != nullptr){
+                this->sweep_thread->join();
+                delete this->sweep_thread;
             }
-            if (this->hashtable_expanding_index >= 0 && old_bucket <= this->hashtable_expanding_index){
-                return &(this->primary_hashtable[new_bucket]);
+            delete this->index;
+            for (auto it:this->buffers){
+                buffer_mem_free(it->mem_begin, it->map_size);
+                ring_reserve_t::release(it->reserve);
+                buffer_counters_t::release(it->stats);
+                delete it->sweep;
+                delete it->mtx;
+                delete it;
             }
-            return &(this->secondary_hashtable[old_bucket]);
+            delete this->counters;
+            delete this->latency;
         }
 
+    private:
         /**
-         * hash表
+         * 线程
          */
-        entry_t **primary_hashtable;
-        entry_t **secondary_hashtable;
+        std::thread *expand_buffer_thread;
+        std::thread *sweep_thread;
 
         /**
-         * 全局锁列表
+         * 清理线程每一轮都拿着，load()时拿着它让清理线程停下来
          */
-        std::vector< std::mutex * > hashtable_locks;
+        std::mutex sweep_mtx;
 
         /**
-         * 当前的容量
+         * set的实际写入，见set
          */
-        std::atomic< uint8_t > hash_power;
+        uint32_t set_entry(const char *key, size_t key_len, uint32_t hash_val, const char *val, uint32_t val_len, expire_t expire){
+            /**
+             * key & value 长度校验
+             */
+            if (key_len >= MAX_KEY_SIZE){
+                return RINGCACHE_ERRNO_KEY_TOO_LONG;
+            }
+            if (val_len >= MAX_VALUE_SIZE){
+                return RINGCACHE_ERRNO_VALUE_TOO_LONG;
+            }
+            latency_scope timer(this->latency, LATENCY_SET);
 
-        /**
-         * 几个标志
+            /**
+             * 够长的value先试着压缩，压完省得不多就还存原始数据
+             */
+            uint64_t raw_bytes = key_len + val_len;
+            uint8_t flags = 0;
+            if (codec_t::enabled && val_len >= RING_COMPRESS_MIN_SIZE){
+                std::string &packed = encode_scratch();
+                if (this->encode_value(val, val_len, packed)){
+                    val = packed.data();
+                    val_len = packed.size();
+                    flags = ENTRY_FLAG_COMPRESSED;
+                }
+            }
+            uint64_t expire_ms = expire_deadline(expire);
+#ifdef RINGCACHE_ATOMIC_RESERVE
+            /**
+             * 原子地预留一块空间，buffer不加锁，拷贝数据也在所有锁外面
+             */
+            ring_buffer_t *buffer = this->get_buffer(this->size_class_of(key_len + val_len));
+            if (buffer == nullptr || !buffer->mem_begin){
+                return RINGCACHE_ERRNO_ALLOC_MEMORY_FAILED;
+            }
+            uint64_t entry_len = RING_ALIGN_SIZE(key_len + val_len + sizeof(entry_t));
+            if (entry_len > buffer->reserve->seg_size){
+                return RINGCACHE_ERRNO_VALUE_TOO_LONG;
+            }
+            entry_t *entry = this->reserve_mem(buffer, entry_len);
+            entry->entry_len = entry_len;
+            entry->hash_next = ENTRY_LINK_NONE;
+            entry->hash_val = hash_val;
+            entry->key_len = key_len;
+            entry->flags = flags;
+            entry->value_len = val_len;
+            entry->expire_ms = expire_ms;
+            memcpy(entry->data, key, key_len);
+            memcpy(entry->data + key_len, val, val_len);
+            {
+                std::lock_guard< std::mutex > hash_lock(*this->lock_index(hash_val), std::adopt_lock);
+                this->link_entry(buffer, entry);
+            }
+            this->commit_mem(buffer, entry);
+#else
+            /**
+             * 提取一个要存数据的buffer，只在数据大小所在的那一档里挑
+             */
+            ring_buffer_t *buffer = this->get_buffer_with_lock(this->size_class_of(key_len + val_len));
+            if (buffer == nullptr){
+                return RINGCACHE_ERRNO_ALLOC_MEMORY_FAILED;
+            }
+            if (!buffer->mem_begin){
+                buffer->mtx->unlock();
+                return RINGCACHE_ERRNO_ALLOC_MEMORY_FAILED;
+            }
+
+            /**
+             * 从buffer找一块合适的空间
+             */
+            uint32_t msize = key_len + val_len;
+            entry_t *entry = nullptr;
+            uint64_t entry_len = 0;
+            this->get_mem_without_lock(&msize, 1, buffer, &entry, &entry_len);
+
+            {
+                //锁定hash相关的项
+                std::lock_guard< std::mutex > hash_lock(*this->lock_index(hash_val), std::adopt_lock);
+
+                /**
+                 * 拷贝数据到缓存空间里
+                 */
+                entry->hash_next = ENTRY_LINK_NONE;
+                entry->hash_val = hash_val;
+                entry->key_len = key_len;
+                entry->flags = flags;
+                entry->value_len = val_len;
+                entry->expire_ms = expire_ms;
+                memcpy(entry->data, key, key_len);
+                memcpy(entry->data + key_len, val, val_len);
+
+                /**
+                 * 挂到索引上，如果之前已经有相同的key了直接清理了
+                 */
+                this->link_entry(buffer, entry);
+            }
+            buffer->mtx->unlock();
+#endif
+
+            //锁都放掉了再顺带做一点扩容的迁移
+            this->index->expand_step();
+            this->count(STAT_WRITE_BYTES, raw_bytes);
+            return RINGCACHE_ERRNO_OK;
+        }
+
+        /**
+         * 给本实例的第i个分片计数器加n，见STAT_*
+         */
+        void count(uint32_t i, uint64_t n){
+            this->counters->add(i, n);
+        }
+
+        /**
+         * 第k档的第i个分片计数器的编号，见CLASS_STAT_*
+         */
+        uint32_t class_counter(uint32_t k, uint32_t i) const{
+            return STAT_CACHE_NUM + k * CLASS_STAT_NUM + i;
+        }
+
+        /**
+         * 挂到索引上，之前已经有相同的key了直接清理了，调用方持有lock_index(entry->hash_val)
+         */
+        void link_entry(ring_buffer_t *buffer, entry_t *entry){
+            this->index->insert(entry, this->locator.loc(buffer->index, entry));
+            this->count_live(entry, 1);
+        }
+
+        /**
+         * 所在档的有效数据个数加n、字节数加n个entry_len，减的时候传补码
+         */
+        void count_live(const entry_t *entry, uint64_t n){
+            uint32_t k = this->size_class_of(entry->key_len + entry->value_len);
+            this->count(this->class_counter(k, CLASS_STAT_LIVE_NUM), n);
+            this->count(this->class_counter(k, CLASS_STAT_LIVE_BYTES), n * entry->entry_len);
+        }
+
+        /**
+         * 索引摘链时的回调，见unlink_callback_t
+         */
+        static void on_entry_unlink(void *ctx, const entry_t *entry){
+            ((basic_ringcache *) ctx)->count_live(entry, (uint64_t) -1);
+        }
+
+        /**
+         * 给buffer的第i个分片计数器加n，见BUFFER_STAT_*，减的时候传补码
+         */
+        void count_buffer(const ring_buffer_t *buffer, uint32_t i, uint64_t n){
+            this->counters->add(this->buffer_counter_base + buffer->index * BUFFER_STAT_NUM + i, n);
+        }
+
+        /**
+         * 正在录制时记一条，见trace.h
+         */
+        void trace(uint8_t op, uint32_t hash_val, size_t key_len, uint32_t value_len, uint32_t ttl_ms, uint32_t ret){
+            if (this->tracer.is_enabled()){
+                this->tracer.record(op, hash_val, key_len, value_len, ttl_ms, ret);
+            }
+        }
+
+        /**
+         * 换算成entry里存的绝对时间，只有相对的TTL才读时钟，不用过期时间的写入不会启动时钟线程
+         */
+        static uint64_t expire_deadline(const expire_t &expire){
+            return expire.relative ? expire.deadline(coarse_clock::instance().now_ms()) : expire.ms;
+        }
+
+        /**
+         * 过期时刻换成录制用的TTL：0不过期，已经过期的记1毫秒
+         */
+        static uint32_t trace_ttl(uint64_t deadline){
+            if (deadline == 0){
+                return 0;
+            }
+            uint64_t now = coarse_clock::instance().now_ms();
+            return deadline > now ? (uint32_t) std::min(deadline - now, (uint64_t) UINT32_MAX) : 1;
+        }
+
+        /**
+         * 开始计时，sample为false时不采样。没开RINGCACHE_LATENCY或者这一次没采到时返回0，latency_end就不记
+         */
+        uint64_t latency_begin(bool sample = true){
+#ifdef RINGCACHE_LATENCY
+            return !sample || latency_histograms::sampled() ? latency_now_ns() : 0;
+#else
+            (void) sample;
+            return 0;
+#endif
+        }
+
+        void latency_end(uint32_t op, uint64_t begin){
+#ifdef RINGCACHE_LATENCY
+            if (begin > 0){
+                this->latency->record(op, latency_now_ns() - begin);
+            }
+#else
+            (void) op;
+            (void) begin;
+#endif
+        }
+
+        /**
+         * 锁上hash_val所在的索引分段，调用方用std::adopt_lock接管。被占用时才计时，记等锁的耗时
+         */
+        std::mutex *lock_index(uint32_t hash_val){
+            std::mutex *mtx = this->index->lock(hash_val);
+            if (!mtx->try_lock()){
+                uint64_t begin = this->latency_begin(false);
+                mtx->lock();
+                this->latency_end(LATENCY_INDEX_LOCK_WAIT, begin);
+            }
+            return mtx;
+        }
+
+        /**
+         * 在hash表里查找key，调用方必须处于epoch读临界区内
+         */
+        uint32_t find_without_lock(const char *key, size_t key_len, uint32_t hash_val, entry_t *&found){
+            entry_t *entry = this->index->find(key, key_len, hash_val);
+            if (entry != nullptr){
+                //过期了，用粗粒度时钟，不用每次查找都取一次系统时间
+                uint64_t expire_ms = entry->expire_ms;
+                if (expire_ms > 0 && expire_ms <= coarse_clock::instance().now_ms()){
+                    this->count(STAT_GET_EXPIRED, 1);
+                    return RINGCACHE_ERRNO_KEY_EXPIRED;
+                }
+                found = entry;
+                this->count(STAT_GET_HIT, 1);
+                //只有一档时不用分档统计
+                if (this->class_conf.size() > 1){
+                    this->count(this->class_counter(this->size_class_of(key_len + entry->value_len), CLASS_STAT_HIT), 1);
+                }
+                return RINGCACHE_ERRNO_OK;
+            }
+            //没找着
+            this->count(STAT_GET_MISS, 1);
+            return RINGCACHE_ERRNO_NOT_FOUND;
+        }
+
+        /**
+         * 要写入的value：原始数据，或者压缩后的，raw_len是压缩前的长度
+         */
+        typedef struct _stored_value_t{
+            const char *data;
+            uint32_t len;
+            uint32_t raw_len;
+            uint8_t flags;
+        } stored_value_t;
+
+        /**
+         * 本线程压缩、解压用的临时空间，反复用，不用每次都申请
+         */
+        static std::string &encode_scratch(){
+            static thread_local std::string s;
+            return s;
+        }
+
+        static std::string &decode_scratch(){
+            static thread_local std::string s;
+            return s;
+        }
+
+        /**
+         * 压缩value，结果放到packed里：开头4字节是原始长度，后面是压缩后的数据。
+         * 压缩后的长度给codec的容量只给到正好省下RING_COMPRESS_MIN_SAVING%，压不动的数据会早早放弃，返回false
+         */
+        bool encode_value(const char *val, uint32_t val_len, std::string &packed){
+            uint64_t keep = (uint64_t) val_len * (100 - RING_COMPRESS_MIN_SAVING) / 100;
+            if (keep <= sizeof(uint32_t)){
+                return false;
+            }
+            size_t limit = keep - sizeof(uint32_t);
+            packed.resize(sizeof(uint32_t) + limit);
+            auto begin = std::chrono::steady_clock::now();
+            bool ok = this->codec.compress(val, val_len, &packed[sizeof(uint32_t)], limit);
+            uint64_t ns = std::chrono::duration_cast< std::chrono::nanoseconds >(std::chrono::steady_clock::now() - begin).count();
+            this->count(STAT_COMPRESS_NS, ns);
+            if (!ok){
+                this->count(STAT_COMPRESS_SKIP_NUM, 1);
+                return false;
+            }
+            memcpy(&packed[0], &val_len, sizeof(uint32_t));
+            packed.resize(sizeof(uint32_t) + limit);
+            this->count(STAT_COMPRESS_NUM, 1);
+            this->count(STAT_COMPRESS_RAW_BYTES, val_len);
+            this->count(STAT_COMPRESS_OUT_BYTES, packed.size());
+            return true;
+        }
+
+        /**
+         * entry里value的原始长度，调用方必须处于epoch读临界区内
+         */
+        uint32_t value_raw_len(const entry_t *entry, uint32_t key_len){
+            if (codec_t::enabled && (entry->flags & ENTRY_FLAG_COMPRESSED)){
+                uint32_t raw_len = 0;
+                memcpy(&raw_len, entry->data + key_len, sizeof(raw_len));
+                return raw_len;
+            }
+            return entry->value_len;
+        }
+
+        /**
+         * 把value的原始数据放到dst里，dst要有raw_len（见value_raw_len）字节，压缩过的解压出来
+         */
+        bool decode_value(const entry_t *entry, uint32_t key_len, char *dst, uint32_t raw_len){
+            const char *src = entry->data + key_len;
+            if (!codec_t::enabled || !(entry->flags & ENTRY_FLAG_COMPRESSED)){
+                memcpy(dst, src, raw_len);
+                return true;
+            }
+            auto begin = std::chrono::steady_clock::now();
+            bool ok = this->codec.decompress(src + sizeof(uint32_t), entry->value_len - sizeof(uint32_t), dst, raw_len);
+            uint64_t ns = std::chrono::duration_cast< std::chrono::nanoseconds >(std::chrono::steady_clock::now() - begin).count();
+            this->count(STAT_DECOMPRESS_NUM, 1);
+            this->count(STAT_DECOMPRESS_NS, ns);
+            return ok;
+        }
+
+        uint32_t read_value(const entry_t *entry, uint32_t key_len, std::string &value){
+            if (!codec_t::enabled || !(entry->flags & ENTRY_FLAG_COMPRESSED)){
+                value.assign(entry->data + key_len, entry->value_len);
+                return RINGCACHE_ERRNO_OK;
+            }
+            value.resize(this->value_raw_len(entry, key_len));
+            return this->decode_value(entry, key_len, &value[0], value.size()) ? RINGCACHE_ERRNO_OK : RINGCACHE_ERRNO_DECOMPRESS_FAILED;
+        }
+
+        /**
+         * 写入线程各自的buffer选择状态
+         */
+        typedef struct _writer_thread_t{
+            /**
+             * 线程编号，第一次写入时分配
+             */
+            uint32_t id;
+
+            /**
+             * 调用次数，主buffer按它轮换
+             */
+            uint32_t calls;
+
+            /**
+             * xorshift随机数，主buffer被占用时决定从哪个buffer开始试
+             */
+            uint32_t rnd;
+
+            /**
+             * 所在的NUMA节点，主buffer轮换时重新取一次
+             */
+            uint32_t node;
+        } writer_thread_t;
+
+        static writer_thread_t &writer_state(){
+            static std::atomic< uint32_t > next_id(0);
+            static thread_local writer_thread_t t = {UINT32_MAX, 0, 0, 0};
+            if (t.id == UINT32_MAX){
+                t.id = next_id.fetch_add(1, std::memory_order_relaxed);
+                t.rnd = jenkins_hash((const char *) &t.id, sizeof(t.id)) | 1;
+            }
+            return t;
+        }
+
+        /**
+         * 第size_class档里已经申请好的buffer，按编号从小到大
+         */
+        const uint32_t *class_buffers(uint32_t size_class, uint32_t &avail){
+            const std::vector< uint32_t > &all = this->class_all[size_class];
+            avail = std::lower_bound(all.begin(), all.end(), this->ready_num.load(std::memory_order_acquire)) - all.begin();
+            return all.data();
+        }
+
+        uint32_t home_buffer(writer_thread_t &t, uint32_t size_class){
+            uint32_t avail = 0;
+            const uint32_t *cands = this->class_buffers(size_class, avail);
+#ifdef RING_BUFFER_NUMA
+            //第i个buffer绑在i%节点数上，本节点上有这一档的buffer时只在它们里面轮换
+            uint32_t nodes = numa_node_num();
+            if (t.calls % BUFFER_HOME_ROTATE == 0){
+                t.node = current_numa_node();
+            }
+            //整个实例绑在一个节点上时，所有buffer都是本节点的
+            if (nodes > 1 && this->numa_node < 0){
+                const std::vector< uint32_t > &local = this->class_node[size_class * nodes + t.node % nodes];
+                uint32_t count = std::lower_bound(local.begin(), local.end(), this->ready_num.load(std::memory_order_acquire)) - local.begin();
+                if (count > 0){
+                    return local[(t.id + t.calls++ / BUFFER_HOME_ROTATE) % count];
+                }
+            }
+#endif
+            return cands[(t.id + t.calls++ / BUFFER_HOME_ROTATE) % avail];
+        }
+
+        /**
+         * 原子预留模式下挑一个buffer，不加锁，多个线程可以同时写同一个buffer
+         */
+        ring_buffer_t *get_buffer(uint32_t size_class){
+            writer_thread_t &t = writer_state();
+            return this->buffers[this->home_buffer(t, size_class)];
+        }
+
+        /**
+         * 挑一个buffer并锁上：每个线程有自己的主buffer，线程编号错开，
+         * 速度差不多的几个线程各写各的，主buffer每BUFFER_HOME_ROTATE次往后挪一个，单线程写也不会只写一个buffer。
+         * 主buffer被占用时从随机位置开始try_lock同一档的其他buffer，都不行再阻塞等主buffer
+         */
+        ring_buffer_t *get_buffer_with_lock(uint32_t size_class){
+            writer_thread_t &t = writer_state();
+            uint32_t num = 0;
+            const uint32_t *cands = this->class_buffers(size_class, num);
+            uint32_t home = this->home_buffer(t, size_class);
+            ring_buffer_t *buffer = this->buffers[home];
+            if (buffer->mtx->try_lock()){
+                owner_add(buffer->stats->lock_num, 1);
+                return buffer;
+            }
+            this->count_buffer(buffer, BUFFER_STAT_LOCK_BUSY_NUM, 1);
+            for (uint32_t round = 0; round < BUFFER_TRY_ROUNDS && num > 1; round++){
+                t.rnd ^= t.rnd << 13;
+                t.rnd ^= t.rnd >> 17;
+                t.rnd ^= t.rnd << 5;
+                uint32_t start = t.rnd % num;
+                for (uint32_t i = 0; i < num; i++){
+                    uint32_t idx = cands[(start + i) % num];
+                    if (idx == home){
+                        continue;
+                    }
+                    ring_buffer_t *other = this->buffers[idx];
+                    if (other->mtx->try_lock()){
+                        owner_add(other->stats->lock_num, 1);
+                        return other;
+                    }
+                    this->count_buffer(other, BUFFER_STAT_LOCK_BUSY_NUM, 1);
+                }
+            }
+            uint64_t wait_begin = this->latency_begin(false);
+            buffer->mtx->lock();
+            this->latency_end(LATENCY_BUFFER_LOCK_WAIT, wait_begin);
+            owner_add(buffer->stats->lock_num, 1);
+            owner_add(buffer->stats->lock_wait_num, 1);
+            return buffer;
+        }
+
+        /**
+         * 同一档的一批数据写到这一档的同一个buffer里，见multi_set
+         */
+        uint32_t multi_set_class(const std::vector< std::string > &keys, const std::vector< stored_value_t > &values, uint64_t expire_ms,
+                                 const std::vector< uint32_t > &hashes, const std::vector< uint32_t > &todo, uint32_t size_class, std::vector< uint32_t > &rets){
+            ring_buffer_t *buffer = this->get_buffer_with_lock(size_class);
+            if (buffer == nullptr || !buffer->mem_begin){
+                if (buffer != nullptr){
+                    buffer->mtx->unlock();
+                }
+                for (auto i:todo){
+                    rets[i] = RINGCACHE_ERRNO_ALLOC_MEMORY_FAILED;
+                }
+                return 0;
+            }
+
+            /**
+             * 按总长度不超过buffer的1/4分段，每段一次性拿空间，见get_mem_without_lock
+             */
+            std::vector< uint32_t > sizes, chunk;
+            std::vector< entry_t * > entries;
+            std::vector< uint64_t > entry_lens;
+            size_t pos = 0;
+            while (pos < todo.size()){
+                uint64_t total = 0;
+                chunk.clear();
+                sizes.clear();
+                while (pos < todo.size()){
+                    uint32_t i = todo[pos];
+                    uint32_t msize = keys[i].length() + values[i].len;
+                    uint64_t need_size = RING_ALIGN_SIZE(msize + sizeof(entry_t));
+                    if (!chunk.empty() && total + need_size > buffer->mem_size / 4){
+                        break;
+                    }
+                    total += need_size;
+                    chunk.push_back(i);
+                    sizes.push_back(msize);
+                    pos++;
+                }
+                entries.resize(chunk.size());
+                entry_lens.resize(chunk.size());
+                this->get_mem_without_lock(sizes.data(), chunk.size(), buffer, entries.data(), entry_lens.data());
+
+                //先把要改的bucket都预取上
+                {
+                    epoch_guard guard;
+                    for (auto i:chunk){
+                        this->index->prefetch(hashes[i]);
+                    }
+                }
+                for (size_t n = 0; n < chunk.size(); n++){
+                    uint32_t i = chunk[n];
+                    entry_t *entry = entries[n];
+                    std::lock_guard< std::mutex > hash_lock(*this->lock_index(hashes[i]), std::adopt_lock);
+                    entry->hash_next = ENTRY_LINK_NONE;
+                    entry->hash_val = hashes[i];
+                    entry->key_len = keys[i].length();
+                    entry->flags = values[i].flags;
+                    entry->value_len = values[i].len;
+                    entry->expire_ms = expire_ms;
+                    memcpy(entry->data, keys[i].c_str(), keys[i].length());
+                    memcpy(entry->data + keys[i].length(), values[i].data, values[i].len);
+                    this->link_entry(buffer, entry);
+                }
+            }
+            buffer->mtx->unlock();
+
+            //每个key都顺带做一点扩容的迁移，和逐个set时一样
+            uint64_t raw_bytes = 0;
+            uint32_t ttl_ms = this->tracer.is_enabled() ? trace_ttl(expire_ms) : 0;
+            for (auto i:todo){
+                this->index->expand_step();
+                raw_bytes += keys[i].length() + values[i].raw_len;
+                this->trace(TRACE_OP_SET, hashes[i], keys[i].length(), values[i].raw_len, ttl_ms, RINGCACHE_ERRNO_OK);
+            }
+            this->count(STAT_WRITE_BYTES, raw_bytes);
+            return todo.size();
+        }
+
+        /**
+         * 从指定buffer里一次拿出num块空间，sizes是每块要存的key+value的长度，拿到的entry及其长度放到entries、entry_lens里。
+         * 先把要覆盖的entry全部摘掉，只做一次epoch同步，同步完了再统一写header。
+         * 同步之前不能往被覆盖的内存里写东西，所以切剩下的空闲块的header也要晚点写，
+         * 这之前用virt_len记着当前指针处还没写header的空闲块的长度。
+         * 调用方保证这一批的总长度不超过buffer的1/4，不会绕一圈踩到本批前面拿到的空间
+         */
+        void get_mem_without_lock(const uint32_t *sizes, uint32_t num, ring_buffer_t *buffer, entry_t **entries, uint64_t *entry_lens){
+            uint64_t evict_begin = this->latency_begin();
+            char *cur = buffer->mem_cur_ptr;
+            uint64_t virt_len = 0;
+
+            //同步完要补写header的空闲块：绕回开头时丢在末尾的一个，以及最后剩下的一个
+            char *free_ptr[2];
+            uint64_t free_len[2];
+            uint32_t free_num = 0;
+            uint32_t evict_total = 0;
+            bool need_sync = false;
+
+            for (uint32_t i = 0; i < num; i++){
+                uint64_t need_size = RING_ALIGN_SIZE(sizes[i] + sizeof(entry_t));
+
+                /**
+                 * 如果当前指针后面剩余的空间不够存储当前数据，从头开始
+                 */
+                if ((uint64_t) (buffer->mem_end - cur + 1) < need_size){
+                    if (virt_len > 0){
+                        assert(free_num < 2);
+                        free_ptr[free_num] = cur;
+                        free_len[free_num++] = virt_len;
+                    }
+                    cur = buffer->mem_begin;
+                    virt_len = 0;
+                    owner_add(buffer->stats->reset_header_times, 1);
+                }
+
+                /**
+                 * 寻找当前数据要剔除的其他数据。还要确定最后一个entry腾出来的空间。
+                 * 如果够一个sizeof(entry_t)的话就留着给下一次写入用，如果不够直接全让给本数据
+                 */
+                uint64_t reduce_size = need_size;
+                char *ptr = cur;
+                uint64_t len = 0;
+                uint32_t evict_num = 0;
+                while (true){
+                    if (ptr == cur && virt_len > 0){
+                        len = virt_len;
+                    }
+                    else{
+                        entry_t *tmpEntry = (entry_t *) ptr;
+                        assert(tmpEntry->key_len < MAX_KEY_SIZE);
+                        assert(tmpEntry->entry_len <= buffer->mem_size);
+                        //剔除当前的数据
+                        if (!tmpEntry->is_unlinked() && this->evict_without_lock(buffer, tmpEntry)){
+                            evict_num++;
+                        }
+                        //刚淘汰的，以及之前被del、被同key覆盖后还没等过宽限期的，读线程可能还在读。
+                        //回收戳要么是看到key_len为0时配对读到的，要么是拿着索引锁摘链时写的
+                        need_sync = need_sync || !epoch_domain::instance().is_synced(tmpEntry->expire_ms);
+                        len = tmpEntry->entry_len;
+                    }
+                    if (len >= reduce_size){
+                        break;
+                    }
+                    assert(len > 0);
+                    reduce_size -= len;
+                    ptr += len;
+                }
+                buffer->stats->add_evict(evict_num);
+                evict_total += evict_num;
+
+                /**
+                 * 最后一个entry，如果剩余的空间少于sizeof(entry_t)则不再保留
+                 */
+                uint64_t last_entry_remain_size = len - reduce_size;
+                entries[i] = (entry_t *) cur;
+                if (last_entry_remain_size > sizeof(entry_t)){
+                    entry_lens[i] = need_size;
+                    cur = ptr + reduce_size;
+                    virt_len = last_entry_remain_size;
+                }
+                else{
+                    //剩下的空间不足一个entry_t结构体，直接带走对齐得了
+                    entry_lens[i] = need_size + last_entry_remain_size;
+                    cur = ptr + len;
+                    virt_len = 0;
+                }
+
+                //如果正好到末尾，修改一下当前指针的指向
+                if (cur >= buffer->mem_end){
+                    cur = buffer->mem_begin;
+                    virt_len = 0;
+                    owner_add(buffer->stats->reset_header_times, 1);
+                }
+            }
+            if (virt_len > 0){
+                assert(free_num < 2);
+                free_ptr[free_num] = cur;
+                free_len[free_num++] = virt_len;
+            }
+            this->count_buffer(buffer, BUFFER_STAT_SET_NUM, num);
+            this->count_buffer(buffer, BUFFER_STAT_ITEM_NUM, num - (uint64_t) evict_total);
+            owner_add(buffer->stats->del_num, evict_total);
+
+            /**
+             * 要覆盖的entry都已经摘链了，等还在读它们的线程都离开后再改写这块内存。
+             * 覆盖的都是空闲块、或者摘链后已经等过宽限期的，就不用再等
+             */
+            if (need_sync){
+                epoch_domain::instance().synchronize();
+            }
+            if (evict_total > 0){
+                this->latency_end(LATENCY_EVICT, evict_begin);
+            }
+
+            for (uint32_t i = 0; i < free_num; i++){
+                entry_t *tmp = (entry_t *) free_ptr[i];
+                tmp->value_len = 0;
+                tmp->entry_len = free_len[i];
+                tmp->key_len = 0;
+                tmp->flags = 0;
+                tmp->expire_ms = 1;
+                tmp->hash_next = ENTRY_LINK_NONE;
+                tmp->hash_val = 0;
+            }
+            for (uint32_t i = 0; i < num; i++){
+                entry_t *ret = entries[i];
+                ret->entry_len = entry_lens[i];
+                ret->hash_next = ENTRY_LINK_NONE;
+                ret->hash_val = 0;
+                ret->key_len = 0;
+                ret->flags = 0;
+                ret->value_len = 0;
+                ret->expire_ms = 0;
+            }
+            buffer->mem_cur_ptr = cur;
+        }
+
+        /**
+         * 原子预留模式下从buffer里拿need_size字节：对写指针fetch_add，没越过段尾就归自己。
+         * 正好越过段尾的那个线程负责切到下一段，其他越过的线程等它切完再重新拿
+         */
+        entry_t *reserve_mem(ring_buffer_t *buffer, uint64_t need_size){
+            ring_reserve_t *r = buffer->reserve;
+            while (true){
+                uint64_t cur = r->cursor.load(std::memory_order_acquire);
+                if ((uint32_t) cur > r->seg_size){
+                    //已经有线程越过段尾了，不再fetch_add，免得段内偏移一直往上涨。
+                    //正好写到段尾时还得有一个线程来fetch_add，它就是越过段尾的那个
+                    this->count_buffer(buffer, BUFFER_STAT_RESERVE_WAIT_NUM, 1);
+                    uint64_t wait_begin = this->latency_begin(false);
+                    while (r->cursor.load(std::memory_order_acquire) == cur){
+                        std::this_thread::yield();
+                    }
+                    this->latency_end(LATENCY_BUFFER_LOCK_WAIT, wait_begin);
+                    continue;
+                }
+                uint64_t old = r->cursor.fetch_add(need_size, std::memory_order_acq_rel);
+                uint32_t seq = old >> 32;
+                uint64_t offset = (uint32_t) old;
+                if (offset + need_size <= r->seg_size){
+                    return (entry_t *) (buffer->mem_begin + (uint64_t) (seq % r->seg_num) * r->seg_size + offset);
+                }
+                if (offset <= r->seg_size){
+                    this->roll_segment(buffer, seq, offset);
+                }
+            }
+        }
+
+        /**
+         * 数据拷贝完、挂上索引后记到所在的段上，下一圈淘汰这一段时要等本圈的写入都完成
+         */
+        void commit_mem(ring_buffer_t *buffer, entry_t *entry){
+            this->count_buffer(buffer, BUFFER_STAT_SET_NUM, 1);
+            this->count_buffer(buffer, BUFFER_STAT_ITEM_NUM, 1);
+            ring_segment_t *seg = buffer->reserve->segment_at((char *) entry - buffer->mem_begin);
+            seg->committed.fetch_add(entry->entry_len, std::memory_order_release);
+        }
+
+        /**
+         * 第seq段用到fill字节写满了，淘汰下一段上一圈的数据后把写指针切过去。
+         * 同一时刻只有越过段尾的那一个线程会走到这里，拿着buffer锁是为了和清理线程错开，见sweep_step
+         */
+        void roll_segment(ring_buffer_t *buffer, uint32_t seq, uint64_t fill){
+            std::lock_guard< std::mutex > lock(*buffer->mtx);
+            uint64_t evict_begin = this->latency_begin();
+            ring_reserve_t *r = buffer->reserve;
+            r->segments[seq % r->seg_num].fill = fill;
+            uint32_t next = seq + 1;
+            ring_segment_t *seg = &r->segments[next % r->seg_num];
+
+            //上一圈写到这一段的线程可能还没写完，entry的header要等它们写完才能读
+            while (seg->committed.load(std::memory_order_acquire) < seg->fill){
+                std::this_thread::yield();
+            }
+            char *begin = buffer->mem_begin + (uint64_t) (next % r->seg_num) * r->seg_size;
+            uint32_t evict_num = 0;
+            bool need_sync = false;
+            for (char *ptr = begin; ptr < begin + seg->fill;){
+                entry_t *tmpEntry = (entry_t *) ptr;
+                assert(tmpEntry->entry_len > 0 && tmpEntry->entry_len <= r->seg_size);
+                if (!tmpEntry->is_unlinked() && this->evict_without_lock(buffer, tmpEntry)){
+                    evict_num++;
+                }
+                need_sync = need_sync || !epoch_domain::instance().is_synced(tmpEntry->expire_ms);
+                ptr += tmpEntry->entry_len;
+            }
+            this->count_buffer(buffer, BUFFER_STAT_ITEM_NUM, -(uint64_t) evict_num);
+            owner_add(buffer->stats->del_num, evict_num);
+            owner_add(buffer->stats->evict_num, evict_num);
+            if (next % r->seg_num == 0){
+                owner_add(buffer->stats->reset_header_times, 1);
+            }
+
+            //等还在读被淘汰数据的线程都离开后再放别的线程进来写
+            if (need_sync){
+                epoch_domain::instance().synchronize();
+            }
+            this->latency_end(LATENCY_EVICT, evict_begin);
+            seg->committed.store(0, std::memory_order_relaxed);
+            seg->fill = 0;
+            r->cursor.store((uint64_t) next << 32, std::memory_order_release);
+        }
+
+        /**
+         * 淘汰环形缓冲区里要被覆盖的entry：按entry里存的hash直接定位bucket，把这个entry本身摘掉，
+         * 不拷贝key、不重新算hash，也不会误删同一个key后来写入的新数据。返回是否真的淘汰了一个有效数据
+         */
+        bool evict_without_lock(ring_buffer_t *buffer, entry_t *entry){
+            std::lock_guard< std::mutex > hash_lock(*this->lock_index(entry->hash_val), std::adopt_lock);
+            //拿到锁之前可能已经被del或者被同key的set清理了
+            if (entry->key_len == 0){
+                return false;
+            }
+            return this->index->remove_entry(entry, this->locator.loc(buffer->index, entry));
+        }
+
+        /**
+         * key+value长度为msize的数据属于哪一档，档数很少，直接顺序找
+         */
+        uint32_t size_class_of(uint32_t msize){
+            uint32_t c = 0;
+            while (msize > this->class_conf[c].max_size){
+                c++;
+            }
+            return c;
+        }
+
+        /**
+         * 整理分档配置并把RING_BUFFER_NUM个buffer按比例分给各档：max_size为0表示不限，按max_size排好序，最后一档兜底所有长度，
+         * 每档至少一个buffer，剩下的按percent分。buffer按分档交错编号，每次都给离自己的份额差得最多的那一档，
+         * 这样后台线程陆续申请buffer的过程中各档拿到的内存也一直大致按比例
+         */
+        void init_size_classes(const std::vector< size_class_t > &classes){
+            this->class_conf = classes;
+            if (this->class_conf.empty()){
+                this->class_conf.push_back({UINT32_MAX, 100});
+            }
+            for (auto &it:this->class_conf){
+                it.max_size = it.max_size > 0 ? it.max_size : UINT32_MAX;
+            }
+            std::sort(this->class_conf.begin(), this->class_conf.end(), [](const size_class_t &a, const size_class_t &b){
+                return a.max_size < b.max_size;
+            });
+            if (this->class_conf.size() > RING_BUFFER_NUM){
+                this->class_conf.resize(RING_BUFFER_NUM);
+            }
+            this->class_conf.back().max_size = UINT32_MAX;
+            uint32_t class_num = this->class_conf.size();
+            double percent_sum = 0;
+            for (auto &it:this->class_conf){
+                percent_sum += it.percent;
+            }
+
+            std::vector< uint32_t > assigned(class_num, 0);
+            uint32_t nodes = 1;
+#ifdef RING_BUFFER_NUMA
+            nodes = numa_node_num();
+#endif
+            this->class_all.assign(class_num, std::vector< uint32_t >());
+            this->class_node.assign(class_num * nodes, std::vector< uint32_t >());
+            for (uint32_t i = 0; i < RING_BUFFER_NUM; i++){
+                uint32_t c = i;
+                if (i >= class_num){
+                    double best = -1e30;
+                    for (uint32_t k = 0; k < class_num; k++){
+                        double share = percent_sum > 0 ? this->class_conf[k].percent / percent_sum : 1.0 / class_num;
+                        double lack = share * (i + 1) - assigned[k];
+                        if (lack > best){
+                            best = lack;
+                            c = k;
+                        }
+                    }
+                }
+                assigned[c]++;
+                this->buffer_class[i] = c;
+                this->class_all[c].push_back(i);
+                this->class_node[c * nodes + i % nodes].push_back(i);
+            }
+
+            for (uint32_t c = 0; c < class_num; c++){
+                std::cout << "size_class" << c << ": max_size=" << this->class_conf[c].max_size << "\tbuffer_num=" << assigned[c] << std::endl;
+            }
+        }
+
+        /**
+         * 快照里用来校验hash函数的固定字符串
+         */
+        static const char *project_name(){
+            //jenkins_hash按4字节读，留足余量
+            static const char name[16] = "ringcache";
+            return name;
+        }
+
+        /**
+         * 分档配置的校验值，buffer按分档交错编号，配置不同时同一个buffer可能属于另一档
+         */
+        uint32_t class_check(){
+            return jenkins_hash((const char *) this->class_conf.data(), this->class_conf.size() * sizeof(size_class_t));
+        }
+
+        /**
+         * 原子预留模式下每个buffer的段数，加锁模式下为0
+         */
+        uint32_t segment_num(){
+#ifdef RINGCACHE_ATOMIC_RESERVE
+            return RING_SEGMENT_NUM;
+#else
+            return 0;
+#endif
+        }
+
+        /**
+         * 保存快照前冻结前num个buffer：拿着全部buffer锁，加锁模式下写入就都进不来了。
+         * 原子预留模式下再把写指针换成越过段尾的值，新的预留都会在reserve_mem里等着，
+         * 之前已经预留到的等它们写完、挂上索引（committed追上fill）。冻结前的写指针放到cursors里，解冻时恢复
+         */
+        void freeze_buffers(uint32_t num, std::vector< uint64_t > &cursors){
+            for (uint32_t i = 0; i < num; i++){
+                ring_buffer_t *buffer = this->buffers[i];
+                buffer->mtx->lock();
+                ring_reserve_t *r = buffer->reserve;
+                if (r == nullptr){
+                    continue;
+                }
+                while (true){
+                    uint64_t cur = r->cursor.load(std::memory_order_acquire);
+                    uint64_t frozen = (cur & ~(uint64_t) UINT32_MAX) | (r->seg_size + 1);
+                    if ((uint32_t) cur <= r->seg_size && r->cursor.compare_exchange_strong(cur, frozen)){
+                        cursors[i] = cur;
+                        break;
+                    }
+                    //有线程越过了段尾，正等着buffer锁去切段（roll_segment），先放它过去
+                    buffer->mtx->unlock();
+                    std::this_thread::yield();
+                    buffer->mtx->lock();
+                }
+                uint32_t cur_seg = (cursors[i] >> 32) % r->seg_num;
+                for (uint32_t seg = 0; seg < r->seg_num; seg++){
+                    uint64_t fill = seg == cur_seg ? (uint32_t) cursors[i] : r->segments[seg].fill;
+                    while (r->segments[seg].committed.load(std::memory_order_acquire) < fill){
+                        std::this_thread::yield();
+                    }
+                }
+            }
+        }
+
+        /**
+         * 恢复写指针，放开buffer锁，见freeze_buffers
+         */
+        void thaw_buffers(uint32_t num, const std::vector< uint64_t > &cursors){
+            for (uint32_t i = 0; i < num; i++){
+                ring_buffer_t *buffer = this->buffers[i];
+                if (buffer->reserve != nullptr){
+                    buffer->reserve->cursor.store(cursors[i], std::memory_order_release);
+                }
+                buffer->mtx->unlock();
+            }
+        }
+
+        /**
+         * 等后台线程把buffer都申请好
+         */
+        void wait_buffers(){
+            while (this->ready_num.load(std::memory_order_acquire) < RING_BUFFER_NUM){
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+
+        /**
+         * 把快照里的一个buffer恢复过来：读进已经申请好的内存，或者直接映射快照文件
+         */
+        bool restore_buffer(ring_buffer_t *buffer, int fd, uint64_t offset, uint64_t stride, bool use_mmap, const snapshot_buffer_t &meta){
+            if (use_mmap){
+                char *mem = (char *) mmap(nullptr, stride, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, offset);
+                if (mem == MAP_FAILED){
+                    return false;
+                }
+                madvise(mem, stride, MADV_WILLNEED);
+                buffer_mem_free(buffer->mem_begin, buffer->map_size);
+                buffer->mem_begin = mem;
+                buffer->mem_end = mem + this->buffer_size - 1;
+                buffer->map_size = stride;
+                this->locator.buffer_base[buffer->index] = mem;
+                buffer->stats->page_mode = RING_PAGE_FILE;
+                buffer->stats->numa_node = -1;
+            }
+            else if (!snapshot_pread(fd, buffer->mem_begin, this->buffer_size, offset)){
+                return false;
+            }
+            buffer->mem_cur_ptr = buffer->mem_begin + meta.cur_offset;
+            memset(buffer->sweep, 0, sizeof(ring_sweep_t));
+            if (buffer->reserve != nullptr){
+                ring_reserve_t *r = buffer->reserve;
+                uint32_t cur = (meta.cursor >> 32) % r->seg_num;
+                for (uint32_t seg = 0; seg < r->seg_num; seg++){
+                    //正在写的这一段还没写满，没有fill，已写完的字节数记在committed上
+                    r->segments[seg].fill = seg == cur ? 0 : meta.fill[seg];
+                    r->segments[seg].committed = meta.fill[seg];
+                }
+                r->cursor = meta.cursor;
+            }
+            return true;
+        }
+
+        /**
+         * 扫一遍buffer里的entry，重建索引，返回恢复的数据个数
+         */
+        uint64_t rebuild_index(ring_buffer_t *buffer, const snapshot_buffer_t &meta){
+            uint64_t now = coarse_clock::precise_ms();
+            uint64_t items = 0;
+            if (buffer->reserve == nullptr){
+                items = this->rebuild_range(buffer, buffer->mem_begin, this->buffer_size, now);
+            }
+            else{
+                ring_reserve_t *r = buffer->reserve;
+                for (uint32_t seg = 0; seg < r->seg_num; seg++){
+                    items += this->rebuild_range(buffer, buffer->mem_begin + seg * r->seg_size, meta.fill[seg], now);
+                }
+            }
+            this->count_buffer(buffer, BUFFER_STAT_ITEM_NUM, items);
+            this->count_buffer(buffer, BUFFER_STAT_SET_NUM, items);
+            return items;
+        }
+
+        uint64_t rebuild_range(ring_buffer_t *buffer, char *begin, uint64_t len, uint64_t now){
+            uint64_t items = 0;
+            char *end = begin + len;
+            for (char *ptr = begin; ptr + sizeof(entry_t) <= end;){
+                entry_t *entry = (entry_t *) ptr;
+                //长度不对说明快照坏了，这个buffer后面的都不要了
+                if (entry->entry_len < sizeof(entry_t) || entry->entry_len > (uint64_t) (end - ptr) || entry->entry_len % RING_ENTRY_ALIGN != 0){
+                    std::cout << "[rebuild_index]bad entry in buffer " << buffer->index << " at " << (ptr - buffer->mem_begin) << std::endl;
+                    break;
+                }
+                ptr += entry->entry_len;
+                //已删除、已过期的不挂索引。回收戳是上一个进程的epoch，改成没挂过索引的1，覆盖时不用等宽限期；
+                //已经是1的不写，mmap恢复时不用为它复制页面
+                if (entry->key_len == 0 || entry->key_len >= MAX_KEY_SIZE || sizeof(entry_t) + entry->key_len + entry->value_len > entry->entry_len
+                    || (entry->expire_ms > 0 && entry->expire_ms <= now)){
+                    if (entry->key_len != 0 || entry->expire_ms != 1){
+                        entry->key_len = 0;
+                        entry->expire_ms = 1;
+                    }
+                    continue;
+                }
+                entry->hash_next = ENTRY_LINK_NONE;
+                {
+                    std::lock_guard< std::mutex > hash_lock(*this->lock_index(entry->hash_val), std::adopt_lock);
+                    this->link_entry(buffer, entry);
+                }
+                this->index->expand_step();
+                items++;
+            }
+            return items;
+        }
+
+        /**
+         * 在后台线程里申请内存
+         */
+        void expand_buffer_func(){
+            std::cout << "[thread_func]start expand_buffer_func" << std::endl;
+            if (this->numa_node >= 0){
+                numa_bind_thread(this->numa_node);
+            }
+            while (this->buffers.size() < RING_BUFFER_NUM){
+                if (this->is_thread_stop){
+                    return;
+                }
+                this->alloc_buffer_memory();
+            }
+            std::cout << "[thread_func]finish expand_buffer_func" << std::endl;
+        }
+
+        /**
+         * 后台清理过期数据：把nice调到最低，每RING_SWEEP_INTERVAL_MS毫秒给每个buffer扫一步
+         */
+        void sweep_func(){
+            setpriority(PRIO_PROCESS, syscall(SYS_gettid), RING_SWEEP_NICE);
+            if (this->numa_node >= 0){
+                numa_bind_thread(this->numa_node);
+            }
+            uint32_t slice = std::min(RING_SWEEP_INTERVAL_MS, 10);
+            while (!this->is_thread_stop){
+                for (uint32_t waited = 0; waited < RING_SWEEP_INTERVAL_MS && !this->is_thread_stop; waited += slice){
+                    std::this_thread::sleep_for(std::chrono::milliseconds(slice));
+                }
+                std::lock_guard< std::mutex > sweep_lock(this->sweep_mtx);
+                size_t num = this->ready_num.load(std::memory_order_acquire);
+                for (size_t i = 0; i < num && !this->is_thread_stop; i++){
+                    this->sweep_step(this->buffers[i]);
+                }
+            }
+        }
+
+        /**
+         * 拿着buffer锁扫一步，把已过期的数据从索引上摘掉：hash链变短，空间变成空洞，写指针转到这里时不用再淘汰。
+         * 加锁模式下从上次停下的entry接着往后扫RING_SWEEP_STEP字节，停下的地方放锁后被写入覆盖了就从写指针处重新开始，
+         * 写指针前面就是最老的数据。原子预留模式下一步扫一段，正在写的那一段跳过，
+         * 切段（roll_segment）也要拿buffer锁，扫的时候其他段不会被改写
+         */
+        void sweep_step(ring_buffer_t *buffer){
+            std::lock_guard< std::mutex > lock(*buffer->mtx);
+            ring_sweep_t &sw = *buffer->sweep;
+            //每RING_SWEEP_INTERVAL_MS毫秒一次，直接取系统时间，没用过期时间的实例不用启动时钟线程
+            uint64_t now = coarse_clock::precise_ms();
+#ifdef RINGCACHE_ATOMIC_RESERVE
+            ring_reserve_t *r = buffer->reserve;
+            uint32_t seg = sw.seg;
+            sw.seg = (seg + 1) % r->seg_num;
+            ring_segment_t *s = &r->segments[seg];
+            bool writing = (r->cursor.load(std::memory_order_acquire) >> 32) % r->seg_num == seg;
+            //上一圈写这一段的线程可能还没写完
+            if (!writing && s->fill > 0 && s->committed.load(std::memory_order_acquire) >= s->fill){
+                char *begin = buffer->mem_begin + (uint64_t) seg * r->seg_size;
+                for (char *ptr = begin; ptr < begin + s->fill;){
+                    entry_t *entry = (entry_t *) ptr;
+                    ptr += entry->entry_len;
+                    this->sweep_entry(buffer, entry, now);
+                }
+            }
+            if (sw.seg == 0){
+                this->sweep_round_done(buffer);
+            }
+#else
+            char *cur = buffer->mem_cur_ptr;
+            uint64_t wraps = buffer->stats->reset_header_times.load(std::memory_order_relaxed) - sw.wraps;
+            bool overwritten = wraps > 1 || (wraps == 1 && (sw.pos >= sw.cur || sw.pos < cur)) || (wraps == 0 && sw.pos >= sw.cur && sw.pos < cur);
+            if (sw.pos == nullptr || overwritten){
+                sw.pos = cur;
+            }
+            for (uint64_t walked = 0; walked < RING_SWEEP_STEP;){
+                entry_t *entry = (entry_t *) sw.pos;
+                uint64_t len = entry->entry_len;
+                assert(len > 0 && len <= buffer->mem_size);
+                this->sweep_entry(buffer, entry, now);
+                walked += len;
+                sw.walked += len;
+                sw.pos += len;
+                if (sw.pos > buffer->mem_end){
+                    sw.pos = buffer->mem_begin;
+                }
+                if (sw.walked >= buffer->mem_size){
+                    this->sweep_round_done(buffer);
+                }
+            }
+            sw.cur = buffer->mem_cur_ptr;
+            sw.wraps = buffer->stats->reset_header_times.load(std::memory_order_relaxed);
+#endif
+        }
+
+        /**
+         * 看一个entry，已过期的从索引上摘掉，调用方拿着buffer锁
+         */
+        void sweep_entry(ring_buffer_t *buffer, entry_t *entry, uint64_t now){
+            if (entry->key_len == 0 || entry->expire_ms == 0 || entry->expire_ms > now){
+                return;
+            }
+            ring_sweep_t &sw = *buffer->sweep;
+            sw.expired_num++;
+            sw.expired_bytes += entry->entry_len;
+            if (this->evict_without_lock(buffer, entry)){
+                this->count_buffer(buffer, BUFFER_STAT_ITEM_NUM, -(uint64_t) 1);
+                owner_add(buffer->stats->del_num, 1);
+                owner_add(buffer->stats->sweep_num, 1);
+                owner_add(buffer->stats->sweep_bytes, entry->entry_len);
+            }
+        }
+
+        /**
+         * 扫完一圈，把这一圈扫到的过期数据记到统计信息里
+         */
+        void sweep_round_done(ring_buffer_t *buffer){
+            ring_sweep_t &sw = *buffer->sweep;
+            buffer->stats->expired_num.store(sw.expired_num, std::memory_order_relaxed);
+            buffer->stats->expired_bytes.store(sw.expired_bytes, std::memory_order_relaxed);
+            owner_add(buffer->stats->sweep_rounds, 1);
+            sw.walked = 0;
+            sw.expired_num = 0;
+            sw.expired_bytes = 0;
+        }
+
+        /**
+         * 给缓冲区分配内存
+         */
+        void alloc_buffer_memory(){
+            ring_buffer_t *buffer = new ring_buffer_t();
+            int32_t node = this->numa_node;
+#ifdef RING_BUFFER_NUMA
+            if (node < 0){
+                node = this->buffers.size() % numa_node_num();
+            }
+#endif
+            buffer_mem_t mem;
+            if (!buffer_mem_alloc(this->buffer_size, node, mem)){
+                delete buffer;
+                return;
+            }
+            buffer->mem_begin = mem.mem;
+            buffer->map_size = mem.map_size;
+            std::cout << "[alloc_buffer_memory]alloc buffer success, size=" << (this->buffer_size / MB) << "MB" << std::endl;
+
+            buffer->mem_end = buffer->mem_begin + this->buffer_size - 1;
+            buffer->mem_cur_ptr = buffer->mem_begin;
+            buffer->mtx = new std::mutex();
+            buffer->sweep = new ring_sweep_t();
+            buffer->mem_size = this->buffer_size;
+            buffer->index = this->buffers.size();
+            buffer->size_class = this->buffer_class[buffer->index];
+            this->locator.buffer_base[buffer->index] = buffer->mem_begin;
+#ifdef RINGCACHE_ATOMIC_RESERVE
+            buffer->reserve = ring_reserve_t::alloc(buffer->mem_size);
+#else
+            buffer->reserve = nullptr;
+#endif
+
+            //初始化统计信息，其余的计数器都从0开始
+            buffer->stats = buffer_counters_t::alloc();
+            buffer->stats->page_mode = mem.page_mode;
+            buffer->stats->numa_node = mem.numa_node;
+
+            //初始化内存块header信息
+            entry_t *tmpEntry = (entry_t *) buffer->mem_begin;
+            tmpEntry->expire_ms = 1;
+            tmpEntry->key_len = 0;
+            tmpEntry->flags = 0;
+            tmpEntry->entry_len = this->buffer_size;
+            tmpEntry->value_len = 0;
+            tmpEntry->hash_next = ENTRY_LINK_NONE;
+            tmpEntry->hash_val = 0;
+
+            this->buffers.push_back(buffer);
+            //buffers提前reserve过不会搬家，数组里的指针先写好再发布个数，其他线程只看ready_num以内的
+            this->ready_num.store(this->buffers.size(), std::memory_order_release);
+        }
+
+        /**
+         * 索引
+         */
+        index_t *index;
+        entry_locator_t locator;
+
+        /**
+         * 几个标志
          */
         std::atomic< bool > is_thread_stop;
-        std::atomic< bool > is_hashtable_full;
-        std::atomic< bool > is_hashtable_expanding;
-        std::atomic< int64_t > hashtable_expanding_index;
 
         /**
          * 环形缓冲区
          */
         std::vector< ring_buffer_t * > buffers;
+        std::atomic< uint32_t > ready_num;
         uint64_t buffer_size;
-        stats_t *stats;
+
+        /**
+         * 整个实例绑定的NUMA节点，不绑定为-1
+         */
+        int32_t numa_node;
+
+        /**
+         * 大小分档：各档的配置，每个buffer属于哪一档，每一档有哪些buffer，以及其中各NUMA节点上的
+         */
+        std::vector< size_class_t > class_conf;
+        uint32_t buffer_class[RING_BUFFER_NUM];
+        std::vector< std::vector< uint32_t > > class_all;
+        std::vector< std::vector< uint32_t > > class_node;
+
+        /**
+         * 按线程分片的计数器，buffer_counter_base之后是各buffer的，见count、count_buffer
+         */
+        sharded_counters *counters;
+        uint32_t buffer_counter_base;
+
+        /**
+         * 各操作的延迟直方图，没开RINGCACHE_LATENCY时为空
+         */
+        latency_histograms *latency;
+
+        /**
+         * 流量录制，见start_trace
+         */
+        trace_recorder tracer;
+
+        /**
+         * 最近一次load()的字节数、数据个数、耗时（微秒）
+         */
+        uint64_t snapshot_load_bytes;
+        uint64_t snapshot_load_items;
+        uint64_t snapshot_load_us;
+
+        hasher_t hasher;
+        codec_t codec;
     };
+
+    typedef basic_ringcache< jenkins_hasher > ringcache;
 }
 #endif //_RINGCACHE_RINGBUFFER_H_202103111139_
@@ -0,0 +1,330 @@
+/*************************************************************************
+ * File:	sharded.h
+ * Author:	liuyongshuai<liuyongshuai@hotmail.com>
+ * Time:	2026-10-25 11:00
+ * 按NUMA节点分片：一个ringcache的hash表、分段锁是所有线程共用的，两路机器上一半的查找要跨节点。
+ * 这里每个分片是一个独立的ringcache，分片的buffer、索引表都绑在它所在的节点上，后台线程也只在那个节点上跑，
+ * key按hash分到各分片。调用方再按shard_of()把请求交给分片所在节点上的线程处理，访问的就全是本节点的内存
+ ************************************************************************/
+#ifndef _RINGCACHE_SHARDED_H_202610251100_
+#define _RINGCACHE_SHARDED_H_202610251100_
+
+#include "ringcache.h"
+#include "numa.h"
+
+//分片数的上限
+#ifndef RING_SHARD_MAX
+#define RING_SHARD_MAX 64
+#endif
+
+namespace ringcache{
+    /**
+     * hash_val分到shard_num个分片里的哪一个。分片里的索引用的是hash的低位，这里先乘一个奇数打散，
+     * 再按高位分，每个分片里hash的低位还是均匀的
+     */
+    inline uint32_t shard_index(uint32_t hash_val, uint32_t shard_num){
+        return (uint32_t) (((uint64_t) (uint32_t) (hash_val * 0x9e3779b1u) * shard_num) >> 32);
+    }
+
+    /**
+     * 接口和basic_ringcache一样，多了分片相关的几个方法。hash只算一次，分片里用带hash_val的重载
+     */
+    template< typename hasher_t, typename codec_t = no_codec >
+    class basic_sharded_ringcache{
+    public:
+        typedef basic_ringcache< hasher_t, codec_t > shard_t;
+
+        /**
+         * megabyte_size是总大小，平均分给各分片。shard_num为0时每个NUMA节点一个分片，
+         * 第i个分片放在第i%节点数个节点上；只有一个节点时不绑定，分片只是把锁和buffer分开
+         */
+        explicit basic_sharded_ringcache(uint64_t megabyte_size, uint32_t shard_num = 0, const std::vector< size_class_t > &classes = std::vector< size_class_t >()){
+            uint32_t nodes = numa_node_num();
+            shard_num = shard_num > 0 ? shard_num : nodes;
+            shard_num = shard_num < RING_SHARD_MAX ? shard_num : RING_SHARD_MAX;
+            //每个分片都有RING_BUFFER_NUM个buffer，每个至少RING_BUFFER_MIN_SIZE，分得太细时实际占的比给的多
+            if (megabyte_size * MB / shard_num < (uint64_t) RING_BUFFER_NUM * RING_BUFFER_MIN_SIZE){
+                std::cout << "[sharded_ringcache]" << (megabyte_size / shard_num) << "MB per shard is rounded up to "
+                          << ((uint64_t) RING_BUFFER_NUM * RING_BUFFER_MIN_SIZE / MB) << "MB, rebuild with a smaller RING_BUFFER_NUM" << std::endl;
+            }
+            this->shards.resize(shard_num);
+            this->nodes.resize(shard_num);
+            for (uint32_t i = 0; i < shard_num; i++){
+                int32_t node = nodes > 1 ? (int32_t) (i % nodes) : -1;
+                this->nodes[i] = node;
+                //在绑到该节点上的线程里构造：锁、计数器这些构造时就写过的内存也在本节点上，后台线程继承这个绑定
+                std::thread builder([&, i, node](){
+                    if (node >= 0){
+                        numa_bind_thread(node);
+                    }
+                    this->shards[i] = new shard_t(megabyte_size / shard_num, classes, node);
+                });
+                builder.join();
+            }
+        }
+
+        ~basic_sharded_ringcache(){
+            for (auto it:this->shards){
+                delete it;
+            }
+        }
+
+        uint32_t shard_num() const{
+            return this->shards.size();
+        }
+
+        shard_t &shard(uint32_t i){
+            return *this->shards[i];
+        }
+
+        /**
+         * 第i个分片所在的NUMA节点，不绑定为-1
+         */
+        int32_t shard_node(uint32_t i) const{
+            return this->nodes[i];
+        }
+
+        uint32_t shard_of(uint32_t hash_val) const{
+            return shard_index(hash_val, this->shards.size());
+        }
+
+        uint32_t shard_of(const char *key, size_t key_len) const{
+            return this->shard_of(this->hash_key(key, key_len));
+        }
+
+        uint32_t hash_key(const char *key, size_t key_len) const{
+            return this->shards[0]->hash_key(key, key_len);
+        }
+
+        /**
+         * 写入数据，expire的含义同basic_ringcache::set
+         */
+        uint32_t set(const std::string &key, const std::string &value, expire_t expire){
+            return this->set(key.c_str(), key.length(), value.c_str(), value.length(), expire);
+        }
+
+        uint32_t set(const std::string &key, const char *val, uint32_t val_len, expire_t expire){
+            return this->set(key.c_str(), key.length(), val, val_len, expire);
+        }
+
+        uint32_t set(const char *key, size_t key_len, const char *val, uint32_t val_len, expire_t expire){
+            if (key_len >= MAX_KEY_SIZE){
+                return RINGCACHE_ERRNO_KEY_TOO_LONG;
+            }
+            return this->set(key, key_len, this->hash_key(key, key_len), val, val_len, expire);
+        }
+
+        uint32_t set(const char *key, size_t key_len, uint32_t hash_val, const char *val, uint32_t val_len, expire_t expire){
+            return this->shards[this->shard_of(hash_val)]->set(key, key_len, hash_val, val, val_len, expire);
+        }
+
+        /**
+         * 删除数据
+         */
+        uint32_t del(const std::string &key){
+            return this->del(key.c_str(), key.length());
+        }
+
+        uint32_t del(const char *key, size_t key_len){
+            if (key_len >= MAX_KEY_SIZE){
+                return RINGCACHE_ERRNO_KEY_TOO_LONG;
+            }
+            return this->del(key, key_len, this->hash_key(key, key_len));
+        }
+
+        uint32_t del(const char *key, size_t key_len, uint32_t hash_val){
+            return this->shards[this->shard_of(hash_val)]->del(key, key_len, hash_val);
+        }
+
+        /**
+         * 检查数据是否存在
+         */
+        bool check(const std::string &key){
+            return this->check(key.c_str(), key.length());
+        }
+
+        bool check(const char *key, size_t key_len){
+            if (key_len >= MAX_KEY_SIZE){
+                return false;
+            }
+            return this->shards[this->shard_of(key, key_len)]->check(key, key_len);
+        }
+
+        /**
+         * 提取数据
+         */
+        uint32_t get(const std::string &key, std::string &value){
+            return this->get(key.c_str(), key.length(), value);
+        }
+
+        uint32_t get(const std::string &key, std::string &value, bool only_check){
+            if (key.length() >= MAX_KEY_SIZE){
+                return RINGCACHE_ERRNO_KEY_TOO_LONG;
+            }
+            return this->shards[this->shard_of(key.c_str(), key.length())]->get(key, value, only_check);
+        }
+
+        uint32_t get(const char *key, size_t key_len, std::string &value){
+            if (key_len >= MAX_KEY_SIZE){
+                return RINGCACHE_ERRNO_KEY_TOO_LONG;
+            }
+            return this->get(key, key_len, this->hash_key(key, key_len), value);
+        }
+
+        uint32_t get(const char *key, size_t key_len, uint32_t hash_val, std::string &value){
+            return this->shards[this->shard_of(hash_val)]->get(key, key_len, hash_val, value);
+        }
+
+        uint32_t get_into(const std::string &key, char *buf, size_t cap, uint32_t &value_len){
+            return this->get_into(key.c_str(), key.length(), buf, cap, value_len);
+        }
+
+        uint32_t get_into(const char *key, size_t key_len, char *buf, size_t cap, uint32_t &value_len){
+            value_len = 0;
+            if (key_len >= MAX_KEY_SIZE){
+                return RINGCACHE_ERRNO_KEY_TOO_LONG;
+            }
+            return this->get_into(key, key_len, this->hash_key(key, key_len), buf, cap, value_len);
+        }
+
+        uint32_t get_into(const char *key, size_t key_len, uint32_t hash_val, char *buf, size_t cap, uint32_t &value_len){
+            return this->shards[this->shard_of(hash_val)]->get_into(key, key_len, hash_val, buf, cap, value_len);
+        }
+
+        template< typename visitor_t >
+        uint32_t visit(const std::string &key, visitor_t visitor){
+            return this->visit(key.c_str(), key.length(), visitor);
+        }
+
+        template< typename visitor_t >
+        uint32_t visit(const char *key, size_t key_len, visitor_t visitor){
+            if (key_len >= MAX_KEY_SIZE){
+                return RINGCACHE_ERRNO_KEY_TOO_LONG;
+            }
+            return this->visit(key, key_len, this->hash_key(key, key_len), visitor);
+        }
+
+        template< typename visitor_t >
+        uint32_t visit(const char *key, size_t key_len, uint32_t hash_val, visitor_t visitor){
+            return this->shards[this->shard_of(hash_val)]->visit(key, key_len, hash_val, visitor);
+        }
+
+        /**
+         * 批量读：按分片分组，每个分片一次multi_get，结果再按原来的顺序放回去
+         */
+        uint32_t multi_get(const std::vector< std::string > &keys, std::vector< std::string > &values, std::vector< uint32_t > &rets){
+            if (this->shards.size() == 1){
+                return this->shards[0]->multi_get(keys, values, rets);
+            }
+            values.resize(keys.size());
+            rets.resize(keys.size());
+            std::vector< std::vector< uint32_t > > groups;
+            this->group_keys(keys, groups);
+            uint32_t found = 0;
+            std::vector< std::string > sub_keys, sub_values;
+            std::vector< uint32_t > sub_rets;
+            for (uint32_t s = 0; s < groups.size(); s++){
+                if (groups[s].empty()){
+                    continue;
+                }
+                sub_keys.clear();
+                for (auto i:groups[s]){
+                    sub_keys.push_back(keys[i]);
+                }
+                found += this->shards[s]->multi_get(sub_keys, sub_values, sub_rets);
+                //分片的multi_get已经把没读到的清空了，换过来的不会是调用方上一次的结果
+                for (size_t k = 0; k < groups[s].size(); k++){
+                    values[groups[s][k]].swap(sub_values[k]);
+                    rets[groups[s][k]] = sub_rets[k];
+                }
+            }
+            return found;
+        }
+
+        /**
+         * 批量写：按分片分组，每个分片一次multi_set
+         */
+        uint32_t multi_set(const std::vector< std::string > &keys, const std::vector< std::string > &values, expire_t expire, std::vector< uint32_t > &rets){
+            if (this->shards.size() == 1 || values.size() != keys.size()){
+                return this->shards[0]->multi_set(keys, values, expire, rets);
+            }
+            rets.assign(keys.size(), RINGCACHE_ERRNO_OK);
+            std::vector< std::vector< uint32_t > > groups;
+            this->group_keys(keys, groups);
+            uint32_t written = 0;
+            std::vector< std::string > sub_keys, sub_values;
+            std::vector< uint32_t > sub_rets;
+            for (uint32_t s = 0; s < groups.size(); s++){
+                if (groups[s].empty()){
+                    continue;
+                }
+                sub_keys.clear();
+                sub_values.clear();
+                for (auto i:groups[s]){
+                    sub_keys.push_back(keys[i]);
+                    sub_values.push_back(values[i]);
+                }
+                written += this->shards[s]->multi_set(sub_keys, sub_values, expire, sub_rets);
+                for (size_t k = 0; k < groups[s].size(); k++){
+                    rets[groups[s][k]] = sub_rets[k];
+                }
+            }
+            return written;
+        }
+
+        /**
+         * 各分片的统计信息加在一起，buffer依次排开，每个buffer的numa_node是它所在分片的节点
+         */
+        stats_t get_stats(){
+            stats_t stats = this->shards[0]->get_stats();
+            for (size_t i = 1; i < this->shards.size(); i++){
+                stats.merge(this->shards[i]->get_stats());
+            }
+            return stats;
+        }
+
+        /**
+         * 每个分片各存一个快照：path.0、path.1...，load时分片数要和保存时一样
+         */
+        uint32_t save(const std::string &path){
+            for (size_t i = 0; i < this->shards.size(); i++){
+                uint32_t ret = this->shards[i]->save(path + "." + std::to_string(i));
+                if (ret != RINGCACHE_ERRNO_OK){
+                    return ret;
+                }
+            }
+            return RINGCACHE_ERRNO_OK;
+        }
+
+        uint32_t load(const std::string &path, bool use_mmap = false, uint32_t thread_num = 0){
+            for (size_t i = 0; i < this->shards.size(); i++){
+                uint32_t ret = this->shards[i]->load(path + "." + std::to_string(i), use_mmap, thread_num);
+                if (ret != RINGCACHE_ERRNO_OK){
+                    return ret;
+                }
+            }
+            return RINGCACHE_ERRNO_OK;
+        }
+
+    private:
+        basic_sharded_ringcache(const basic_sharded_ringcache &);
+        basic_sharded_ringcache &operator=(const basic_sharded_ringcache &);
+
+        /**
+         * 每个分片分到哪些key，太长的key随便放到一个分片里，由分片返回错误码
+         */
+        void group_keys(const std::vector< std::string > &keys, std::vector< std::vector< uint32_t > > &groups) const{
+            groups.assign(this->shards.size(), std::vector< uint32_t >());
+            for (uint32_t i = 0; i < keys.size(); i++){
+                uint32_t s = keys[i].length() < MAX_KEY_SIZE ? this->shard_of(keys[i].c_str(), keys[i].length()) : 0;
+                groups[s].push_back(i);
+            }
+        }
+
+        std::vector< shard_t * > shards;
+        std::vector< int32_t > nodes;
+    };
+
+    typedef basic_sharded_ringcache< jenkins_hasher > sharded_ringcache;
+}
+#endif //_RINGCACHE_SHARDED_H_202610251100_
@@ -0,0 +1,997 @@
+/*************************************************************************
+ * File:	shm.h
+ * Author:	liuyongshuai<liuyongshuai@hotmail.com>
+ * Time:	2026-10-27 10:30
+ * 多进程共用一份缓存：环形缓冲区、索引、锁、epoch槽位全都放在一个POSIX共享内存（或memfd）的segment里，
+ * 链表和bucket里存的是相对segment开头的偏移而不是指针，各进程把它mmap到不同的地址上也能用；
+ * 锁是进程间共享的robust mutex，拿着锁的进程挂了，别的进程还能接着拿。
+ * prefork的多个worker打开同一个名字，读写的就是同一份数据，进程之间不用拷贝
+ ************************************************************************/
+#ifndef _RINGCACHE_SHM_H_202610271030_
+#define _RINGCACHE_SHM_H_202610271030_
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <iostream>
+#include <thread>
+#include <chrono>
+#include <functional>
+#include <math.h>
+#include "entry.h"
+#include "clock.h"
+#include "hash_policy.h"
+
+//一个segment里的buffer个数上限，每个至少RING_BUFFER_MIN_SIZE，segment小时按大小减少
+#ifndef SHM_BUFFER_NUM
+#define SHM_BUFFER_NUM 64
+#endif
+
+//所有进程加起来同时读数据的线程数上限
+#ifndef SHM_EPOCH_SLOT_NUM
+#define SHM_EPOCH_SLOT_NUM 1024
+#endif
+
+//打开已有的segment时，最多等创建它的进程这么久把它初始化完（毫秒）
+#ifndef SHM_ATTACH_WAIT_MS
+#define SHM_ATTACH_WAIT_MS 5000
+#endif
+
+//写入时等一个读槽位自旋这么多轮后，看一下占着它的进程是否还活着
+#ifndef SHM_DEAD_CHECK_SPINS
+#define SHM_DEAD_CHECK_SPINS 4096
+#endif
+
+//segment开头的标识及布局版本，布局变了要改版本号
+#define SHM_MAGIC 0x6873656863676e72ULL
+#define SHM_VERSION 1
+
+//segment的状态：创建的进程初始化完才置为READY，打开的进程等到READY才用
+#define SHM_STATE_INIT 0
+#define SHM_STATE_READY 1
+
+namespace ringcache{
+    /**
+     * 共享内存里存数据的结构体，和entry_t一样，只是hash_next存的是偏移
+     */
+    typedef struct __attribute__ ((__packed__)) _shm_entry_t{
+        /**
+         * 当前entry所占用的全部字节数，包括元数据、数据、补齐填充用的字节数
+         */
+        uint64_t entry_len;
+
+        /**
+         * 链表的下一个entry相对segment开头的偏移，0表示没有了
+         */
+        uint64_t hash_next;
+
+        /**
+         * key的hash值
+         */
+        uint32_t hash_val;
+
+        /**
+         * 过期时间，毫秒级的unix时间戳，0表示不过期
+         */
+        uint64_t expire_ms;
+
+        /**
+         * key的长度，为0时是已经删掉的数据或者空闲块
+         */
+        uint8_t key_len;
+
+        /**
+         * value长度
+         */
+        uint32_t value_len;
+
+        /**
+         * 存储数据的地址
+         */
+        char data[];
+
+        /**
+         * 是否为要找的key，key_len只读一次，del()并发置0时不会读错位
+         */
+        bool match(const char *k, uint32_t klen, uint32_t hval) const{
+            return this->hash_val == hval && this->key_len == klen && memcmp(this->data, k, klen) == 0;
+        }
+
+        /**
+         * 无锁读取链表的下一个节点，和set_next配对
+         */
+        uint64_t next() const{
+            return __atomic_load_n(&this->hash_next, __ATOMIC_ACQUIRE);
+        }
+
+        void set_next(uint64_t next){
+            __atomic_store_n(&this->hash_next, next, __ATOMIC_RELEASE);
+        }
+    } shm_entry_t;
+
+    /**
+     * 索引的分段锁，独占一个cache line，顺便记录这一段里的数据个数及删除次数，都只在拿着本段锁时改
+     */
+    typedef struct alignas(CACHE_LINE_SIZE) _shm_lock_t{
+        pthread_mutex_t mtx;
+        std::atomic< uint64_t > item_num;
+        std::atomic< uint64_t > del_num;
+    } shm_lock_t;
+
+    /**
+     * 共享内存里的环形缓冲区，位置都是偏移
+     */
+    typedef struct alignas(CACHE_LINE_SIZE) _shm_buffer_t{
+        /**
+         * 取空间时锁定
+         */
+        pthread_mutex_t mtx;
+
+        /**
+         * 数据区相对segment开头的偏移及字节数
+         */
+        uint64_t begin;
+        uint64_t size;
+
+        /**
+         * 下一次写入的位置，buffer内的偏移
+         */
+        uint64_t cur;
+
+        /**
+         * 正在进行的这一次写入：entry的位置、长度，以及覆盖掉的旧数据一共占的字节数，写完挪好写指针后清零。
+         * 拿着buffer锁的进程挂了时，下一个拿到锁的进程按它收尾
+         */
+        uint64_t pending_cur;
+        uint64_t pending_len;
+        uint64_t pending_covered;
+
+        /**
+         * 写入、淘汰及绕回开头的次数，只在拿着buffer锁时改
+         */
+        std::atomic< uint64_t > set_num;
+        std::atomic< uint64_t > evict_num;
+        std::atomic< uint64_t > reset_header_times;
+    } shm_buffer_t;
+
+    /**
+     * 读线程的槽位：读之前把owner从0改成自己的pid占住，登记epoch，读完都清零。
+     * 读的计数器也放在这里，只有占着槽位的线程会改
+     */
+    typedef struct alignas(CACHE_LINE_SIZE) _shm_epoch_slot_t{
+        /**
+         * 占着槽位的进程，0表示空闲，-1表示正在回收挂掉的进程留下的
+         */
+        std::atomic< int32_t > owner;
+
+        /**
+         * 0表示当前没有在读，否则为进入读临界区时的全局epoch
+         */
+        std::atomic< uint64_t > epoch;
+
+        std::atomic< uint64_t > get_hit_num;
+        std::atomic< uint64_t > get_miss_num;
+        std::atomic< uint64_t > get_expired_num;
+        std::atomic< uint64_t > read_bytes;
+    } shm_epoch_slot_t;
+
+    /**
+     * segment开头的元数据，后面依次是分段锁、buffer、读槽位、bucket数组，最后是各buffer的数据区
+     */
+    typedef struct alignas(CACHE_LINE_SIZE) _shm_header_t{
+        uint64_t magic;
+        uint32_t version;
+        std::atomic< uint32_t > state;
+
+        /**
+         * segment的总字节数
+         */
+        uint64_t segment_size;
+
+        /**
+         * 写入时用的hash函数的校验值，各进程要用同一个hash函数
+         */
+        uint32_t hash_check;
+
+        /**
+         * buffer个数、读槽位个数、hash表的容量
+         */
+        uint32_t buffer_num;
+        uint32_t slot_num;
+        uint8_t hash_power;
+
+        /**
+         * 各部分相对segment开头的偏移
+         */
+        uint64_t locks_off;
+        uint64_t buffers_off;
+        uint64_t slots_off;
+        uint64_t buckets_off;
+
+        /**
+         * 全局epoch，从1开始，0表示槽位空闲
+         */
+        alignas(CACHE_LINE_SIZE) std::atomic< uint64_t > global_epoch;
+
+        /**
+         * 用过的槽位的高水位，写入时只扫描到这里
+         */
+        alignas(CACHE_LINE_SIZE) std::atomic< uint32_t > slot_max;
+    } shm_header_t;
+
+    /**
+     * shm_ringcache的统计信息，读的计数器是所有进程加起来的
+     */
+    typedef struct _shm_stats_t{
+        uint64_t segment_size;
+        uint64_t buffer_num;
+        uint64_t buffer_size;
+        uint64_t index_capacity;
+        uint64_t item_num;
+        uint64_t set_num;
+        uint64_t evict_num;
+        uint64_t del_num;
+        uint64_t reset_header_times;
+        uint64_t get_hit_num;
+        uint64_t get_miss_num;
+        uint64_t get_expired_num;
+        uint64_t read_bytes;
+
+        /**
+         * 用过的读槽位个数，大致是所有进程里读过数据的线程数
+         */
+        uint64_t reader_slot_num;
+
+        /**
+         * 命中率：找到的次数占所有get的比例
+         */
+        double hit_rate() const{
+            uint64_t total = this->get_hit_num + this->get_miss_num + this->get_expired_num;
+            return total > 0 ? (double) this->get_hit_num / total : 0;
+        }
+    } shm_stats_t;
+
+    /**
+     * 当前进程的pid。glibc不再缓存getpid()，这里自己缓存，fork出来的子进程里由atfork刷新
+     */
+    inline pid_t &shm_pid_cache(){
+        static pid_t pid = 0;
+        return pid;
+    }
+
+    inline void shm_pid_refresh(){
+        shm_pid_cache() = getpid();
+    }
+
+    inline pid_t shm_self_pid(){
+        static bool registered = (pthread_atfork(nullptr, nullptr, shm_pid_refresh), shm_pid_refresh(), true);
+        (void) registered;
+        return shm_pid_cache();
+    }
+
+    /**
+     * 接口是basic_ringcache的一个子集：没有压缩、大小分档、后台清理，hash表按segment大小一次建好、不扩容。
+     * 对象只是当前进程对segment的一个映射，析构时解除映射，segment留着，要删掉名字用unlink()
+     */
+    template< typename hasher_t >
+    class basic_shm_ringcache{
+    public:
+        /**
+         * 按名字打开，名字以/开头，见shm_open(3)。不存在时创建一个，数据区为megabyte_size MB，
+         * 元数据另算；已经存在时直接用已有的，megabyte_size不起作用，为0时只打开、不创建。
+         * name为空时创建一个匿名的memfd，fork出来的子进程直接用，或者把fd()传给别的进程用open_fd()打开。
+         * 失败时返回nullptr，ret为错误码
+         */
+        static basic_shm_ringcache *open(const char *name, uint64_t megabyte_size, uint32_t &ret){
+            bool anonymous = name == nullptr || name[0] == '\0';
+            int fd = -1;
+            if (anonymous){
+                fd = memfd_create("ringcache", 0);
+            }
+            else if (megabyte_size > 0){
+                fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+            }
+            if (fd >= 0){
+                basic_shm_ringcache *cache = create(fd, megabyte_size, ret);
+                if (cache == nullptr && !anonymous){
+                    shm_unlink(name);
+                }
+                return cache;
+            }
+            if (anonymous || (megabyte_size > 0 && errno != EEXIST)){
+                std::cout << "[shm_ringcache]create " << (anonymous ? "memfd" : name) << " failed: " << strerror(errno) << std::endl;
+                ret = RINGCACHE_ERRNO_SHM_IO;
+                return nullptr;
+            }
+            fd = shm_open(name, O_RDWR, 0600);
+            if (fd < 0){
+                std::cout << "[shm_ringcache]open " << name << " failed: " << strerror(errno) << std::endl;
+                ret = RINGCACHE_ERRNO_SHM_IO;
+                return nullptr;
+            }
+            return attach(fd, ret);
+        }
+
+        /**
+         * 打开别的进程传过来的fd，fd交给返回的对象，失败时关掉
+         */
+        static basic_shm_ringcache *open_fd(int fd, uint32_t &ret){
+            return attach(fd, ret);
+        }
+
+        /**
+         * 删掉名字，已经打开的进程不受影响，都解除映射后内存才释放
+         */
+        static bool unlink(const char *name){
+            return shm_unlink(name) == 0;
+        }
+
+        ~basic_shm_ringcache(){
+            munmap(this->base, this->header->segment_size);
+            close(this->shm_fd);
+        }
+
+        /**
+         * segment的fd，memfd要靠它传给别的进程
+         */
+        int fd() const{
+            return this->shm_fd;
+        }
+
+        /**
+         * 是否是当前进程创建的segment
+         */
+        bool is_creator() const{
+            return this->creator;
+        }
+
+        /**
+         * 写入数据，用法和basic_ringcache一样
+         */
+        uint32_t set(const std::string &key, const std::string &value, expire_t expire){
+            return this->set(key.c_str(), key.length(), value.c_str(), value.length(), expire);
+        }
+
+        uint32_t set(const char *key, size_t key_len, const char *val, uint32_t val_len, expire_t expire){
+            if (key_len >= MAX_KEY_SIZE){
+                return RINGCACHE_ERRNO_KEY_TOO_LONG;
+            }
+            return this->set(key, key_len, this->hasher(key, key_len), val, val_len, expire);
+        }
+
+        uint32_t set(const char *key, size_t key_len, uint32_t hash_val, const char *val, uint32_t val_len, expire_t expire){
+            if (key_len >= MAX_KEY_SIZE){
+                return RINGCACHE_ERRNO_KEY_TOO_LONG;
+            }
+            if (val_len >= MAX_VALUE_SIZE){
+                return RINGCACHE_ERRNO_VALUE_TOO_LONG;
+            }
+            //粗粒度时钟的线程fork后不会跟到子进程里，这里直接取系统时间
+            uint64_t expire_ms = expire.ms > 0 ? expire.deadline(coarse_clock::precise_ms()) : 0;
+            shm_buffer_t *buffer = this->lock_buffer();
+            uint64_t entry_len = 0;
+            shm_entry_t *entry = this->get_mem_without_lock(buffer, key_len + val_len, entry_len);
+            entry->entry_len = entry_len;
+            entry->hash_next = 0;
+            entry->hash_val = hash_val;
+            entry->expire_ms = expire_ms;
+            entry->key_len = key_len;
+            entry->value_len = val_len;
+            memcpy(entry->data, key, key_len);
+            memcpy(entry->data + key_len, val, val_len);
+            {
+                shm_lock_t *lock = this->lock_index(hash_val);
+                //数据写完后再挂到链表上，无锁的读进程要么看不到它，要么看到完整的数据
+                uint64_t *bucket = this->bucket_of(hash_val);
+                this->unlink_key(lock, bucket, key, key_len, hash_val);
+                entry->hash_next = *bucket;
+                __atomic_store_n(bucket, this->offset_of(entry), __ATOMIC_RELEASE);
+                owner_add(lock->item_num, 1);
+                pthread_mutex_unlock(&lock->mtx);
+            }
+            owner_add(buffer->set_num, 1);
+            this->commit_mem(buffer);
+            pthread_mutex_unlock(&buffer->mtx);
+            return RINGCACHE_ERRNO_OK;
+        }
+
+        /**
+         * 提取数据，不会锁hash表
+         */
+        uint32_t get(const std::string &key, std::string &value){
+            return this->get(key.c_str(), key.length(), value);
+        }
+
+        uint32_t get(const char *key, size_t key_len, std::string &value){
+            if (key_len >= MAX_KEY_SIZE){
+                return RINGCACHE_ERRNO_KEY_TOO_LONG;
+            }
+            return this->visit(key, key_len, this->hasher(key, key_len), [&value](const char *v, uint32_t v_len){
+                value.assign(v, v_len);
+            });
+        }
+
+        /**
+         * 检查数据是否存在
+         */
+        bool check(const std::string &key){
+            return this->check(key.c_str(), key.length());
+        }
+
+        bool check(const char *key, size_t key_len){
+            if (key_len >= MAX_KEY_SIZE){
+                return false;
+            }
+            return this->visit(key, key_len, this->hasher(key, key_len), [](const char *, uint32_t){
+            }) == RINGCACHE_ERRNO_OK;
+        }
+
+        /**
+         * 零拷贝提取数据：visitor(const char *value, uint32_t value_len)直接拿到共享内存里的数据。
+         * visitor执行期间占着一个读槽位，所有进程的写入都可能要等它，要尽快返回，不要保存指针，也不要在里面调用set/del
+         */
+        template< typename visitor_t >
+        uint32_t visit(const std::string &key, visitor_t visitor){
+            return this->visit(key.c_str(), key.length(), visitor);
+        }
+
+        template< typename visitor_t >
+        uint32_t visit(const char *key, size_t key_len, visitor_t visitor){
+            if (key_len >= MAX_KEY_SIZE){
+                return RINGCACHE_ERRNO_KEY_TOO_LONG;
+            }
+            return this->visit(key, key_len, this->hasher(key, key_len), visitor);
+        }
+
+        template< typename visitor_t >
+        uint32_t visit(const char *key, size_t key_len, uint32_t hash_val, visitor_t visitor){
+            if (key_len >= MAX_KEY_SIZE){
+                return RINGCACHE_ERRNO_KEY_TOO_LONG;
+            }
+            shm_epoch_slot_t *slot = this->read_enter();
+            uint32_t ret = RINGCACHE_ERRNO_NOT_FOUND;
+            uint64_t off = __atomic_load_n(this->bucket_of(hash_val), __ATOMIC_ACQUIRE);
+            while (off != 0){
+                shm_entry_t *entry = this->entry_at(off);
+                if (entry->match(key, key_len, hash_val)){
+                    uint64_t expire_ms = entry->expire_ms;
+                    if (expire_ms > 0 && expire_ms <= coarse_clock::precise_ms()){
+                        ret = RINGCACHE_ERRNO_KEY_EXPIRED;
+                        break;
+                    }
+                    //del()可能并发地把key_len置0，这里用已经校验过的key长度定位value
+                    visitor((const char *) (entry->data + key_len), entry->value_len);
+                    owner_add(slot->read_bytes, entry->value_len);
+                    ret = RINGCACHE_ERRNO_OK;
+                    break;
+                }
+                off = entry->next();
+            }
+            if (ret == RINGCACHE_ERRNO_OK){
+                owner_add(slot->get_hit_num, 1);
+            }
+            else if (ret == RINGCACHE_ERRNO_KEY_EXPIRED){
+                owner_add(slot->get_expired_num, 1);
+            }
+            else{
+                owner_add(slot->get_miss_num, 1);
+            }
+            this->read_leave(slot);
+            return ret;
+        }
+
+        /**
+         * 删除数据
+         */
+        uint32_t del(const std::string &key){
+            return this->del(key.c_str(), key.length());
+        }
+
+        uint32_t del(const char *key, size_t key_len){
+            if (key_len >= MAX_KEY_SIZE){
+                return RINGCACHE_ERRNO_KEY_TOO_LONG;
+            }
+            uint32_t hash_val = this->hasher(key, key_len);
+            shm_lock_t *lock = this->lock_index(hash_val);
+            this->unlink_key(lock, this->bucket_of(hash_val), key, key_len, hash_val);
+            owner_add(lock->del_num, 1);
+            pthread_mutex_unlock(&lock->mtx);
+            return RINGCACHE_ERRNO_OK;
+        }
+
+        /**
+         * 用本实例的hash函数算key的hash
+         */
+        uint32_t hash_key(const char *key, size_t key_len) const{
+            return this->hasher(key, key_len);
+        }
+
+        /**
+         * 当前统计信息的快照，不加锁，各个计数器之间不是同一时刻的
+         */
+        shm_stats_t get_stats() const{
+            shm_stats_t stats = shm_stats_t();
+            stats.segment_size = this->header->segment_size;
+            stats.buffer_num = this->header->buffer_num;
+            stats.buffer_size = this->buffers[0].size;
+            stats.index_capacity = HASH_SIZE(this->header->hash_power);
+            for (uint32_t i = 0; i < HASH_SIZE(HASHTABLE_LOCK_POWER); i++){
+                stats.item_num += this->locks[i].item_num.load(std::memory_order_relaxed);
+                stats.del_num += this->locks[i].del_num.load(std::memory_order_relaxed);
+            }
+            for (uint32_t i = 0; i < this->header->buffer_num; i++){
+                stats.set_num += this->buffers[i].set_num.load(std::memory_order_relaxed);
+                stats.evict_num += this->buffers[i].evict_num.load(std::memory_order_relaxed);
+                stats.reset_header_times += this->buffers[i].reset_header_times.load(std::memory_order_relaxed);
+            }
+            stats.reader_slot_num = this->header->slot_max.load(std::memory_order_relaxed);
+            for (uint32_t i = 0; i < stats.reader_slot_num; i++){
+                stats.get_hit_num += this->slots[i].get_hit_num.load(std::memory_order_relaxed);
+                stats.get_miss_num += this->slots[i].get_miss_num.load(std::memory_order_relaxed);
+                stats.get_expired_num += this->slots[i].get_expired_num.load(std::memory_order_relaxed);
+                stats.read_bytes += this->slots[i].read_bytes.load(std::memory_order_relaxed);
+            }
+            return stats;
+        }
+
+    private:
+        basic_shm_ringcache(int fd, char *base, bool creator) : shm_fd(fd), creator(creator), base(base){
+            this->header = (shm_header_t *) base;
+            this->locks = (shm_lock_t *) (base + this->header->locks_off);
+            this->buffers = (shm_buffer_t *) (base + this->header->buffers_off);
+            this->slots = (shm_epoch_slot_t *) (base + this->header->slots_off);
+            this->buckets = (uint64_t *) (base + this->header->buckets_off);
+        }
+
+        basic_shm_ringcache(const basic_shm_ringcache &);
+        basic_shm_ringcache &operator=(const basic_shm_ringcache &);
+
+        static uint64_t align_up(uint64_t n, uint64_t align){
+            return (n + align - 1) / align * align;
+        }
+
+        /**
+         * 把hash函数的校验值写进segment，打开的进程用的hash函数不一样时拒绝打开
+         */
+        static uint32_t hash_check(){
+            //jenkins_hash按4字节一次读，数组留够整字
+            static const char name[12] = "ringcache";
+            return hasher_t()(name, 9);
+        }
+
+        /**
+         * 初始化新建的segment：算好布局、ftruncate、mmap，锁都初始化成进程间共享的robust mutex，
+         * 每个buffer先放一个占满整个buffer的空闲块，最后才置READY
+         */
+        static basic_shm_ringcache *create(int fd, uint64_t megabyte_size, uint32_t &ret){
+            uint64_t data_size = std::max(megabyte_size * MB, (uint64_t) RING_BUFFER_MIN_SIZE);
+            uint32_t buffer_num = std::min((uint64_t) SHM_BUFFER_NUM, data_size / RING_BUFFER_MIN_SIZE);
+            uint64_t buffer_size = (data_size / buffer_num) & ~((uint64_t) RING_ENTRY_ALIGN - 1);
+
+            //hash表不扩容，一次按平均AVG_DATA_SIZE一个、不到50%的装载率建好
+            uint8_t hash_power = HASH_POWER_INIT;
+            uint8_t item_power = ceil(log((double) (data_size / AVG_DATA_SIZE)) / log(2.0));
+            if (item_power >= hash_power){
+                hash_power = std::min(item_power + 1, HASH_POWER_MAX);
+            }
+
+            uint64_t locks_off = align_up(sizeof(shm_header_t), CACHE_LINE_SIZE);
+            uint64_t buffers_off = locks_off + HASH_SIZE(HASHTABLE_LOCK_POWER) * sizeof(shm_lock_t);
+            uint64_t slots_off = buffers_off + buffer_num * sizeof(shm_buffer_t);
+            uint64_t buckets_off = slots_off + SHM_EPOCH_SLOT_NUM * sizeof(shm_epoch_slot_t);
+            uint64_t data_off = align_up(buckets_off + (uint64_t) HASH_SIZE(hash_power) * sizeof(uint64_t), getpagesize());
+            uint64_t segment_size = data_off + buffer_size * buffer_num;
+
+            char *base = nullptr;
+            if (ftruncate(fd, segment_size) != 0 || (base = (char *) mmap(nullptr, segment_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED){
+                std::cout << "[shm_ringcache]create segment of " << segment_size << " bytes failed: " << strerror(errno) << std::endl;
+                close(fd);
+                ret = RINGCACHE_ERRNO_SHM_IO;
+                return nullptr;
+            }
+            //ftruncate出来的都是0，bucket、计数器不用再清
+            shm_header_t *header = new(base) shm_header_t();
+            header->magic = SHM_MAGIC;
+            header->version = SHM_VERSION;
+            header->segment_size = segment_size;
+            header->hash_check = hash_check();
+            header->buffer_num = buffer_num;
+            header->slot_num = SHM_EPOCH_SLOT_NUM;
+            header->hash_power = hash_power;
+            header->locks_off = locks_off;
+            header->buffers_off = buffers_off;
+            header->slots_off = slots_off;
+            header->buckets_off = buckets_off;
+            header->global_epoch = 1;
+            header->slot_max = 0;
+
+            shm_lock_t *locks = (shm_lock_t *) (base + locks_off);
+            for (uint32_t i = 0; i < HASH_SIZE(HASHTABLE_LOCK_POWER); i++){
+                new(&locks[i]) shm_lock_t();
+                init_mutex(&locks[i].mtx);
+            }
+            shm_buffer_t *buffers = (shm_buffer_t *) (base + buffers_off);
+            for (uint32_t i = 0; i < buffer_num; i++){
+                new(&buffers[i]) shm_buffer_t();
+                init_mutex(&buffers[i].mtx);
+                buffers[i].begin = data_off + i * buffer_size;
+                buffers[i].size = buffer_size;
+                buffers[i].cur = 0;
+                init_free(base + buffers[i].begin, buffer_size);
+            }
+            shm_epoch_slot_t *slots = (shm_epoch_slot_t *) (base + slots_off);
+            for (uint32_t i = 0; i < SHM_EPOCH_SLOT_NUM; i++){
+                new(&slots[i]) shm_epoch_slot_t();
+            }
+            std::cout << "[shm_ringcache]segment_size=" << segment_size << " buffer_num=" << buffer_num << " buffer_size=" << buffer_size
+                      << " hash_power=" << (uint32_t) hash_power << std::endl;
+            header->state.store(SHM_STATE_READY, std::memory_order_release);
+            ret = RINGCACHE_ERRNO_OK;
+            return new basic_shm_ringcache(fd, base, true);
+        }
+
+        /**
+         * 打开已有的segment：等创建的进程ftruncate、初始化完，再校验布局版本及hash函数
+         */
+        static basic_shm_ringcache *attach(int fd, uint32_t &ret){
+            ret = RINGCACHE_ERRNO_SHM_IO;
+            struct stat st;
+            uint64_t begin = coarse_clock::precise_ms();
+            while (fstat(fd, &st) == 0 && (uint64_t) st.st_size < sizeof(shm_header_t)){
+                if (coarse_clock::precise_ms() - begin > SHM_ATTACH_WAIT_MS){
+                    break;
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            char *base = nullptr;
+            if ((uint64_t) st.st_size < sizeof(shm_header_t)
+                || (base = (char *) mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED){
+                std::cout << "[shm_ringcache]attach failed: " << ((uint64_t) st.st_size < sizeof(shm_header_t) ? "segment not created" : strerror(errno)) << std::endl;
+                close(fd);
+                return nullptr;
+            }
+            shm_header_t *header = (shm_header_t *) base;
+            while (header->state.load(std::memory_order_acquire) != SHM_STATE_READY && coarse_clock::precise_ms() - begin <= SHM_ATTACH_WAIT_MS){
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            if (header->state.load(std::memory_order_acquire) != SHM_STATE_READY){
+                std::cout << "[shm_ringcache]attach failed: segment is not initialized, the creator may have died, unlink it and retry" << std::endl;
+            }
+            else if (header->magic != SHM_MAGIC || header->version != SHM_VERSION || header->segment_size != (uint64_t) st.st_size
+                     || header->hash_check != hash_check()){
+                std::cout << "[shm_ringcache]attach failed: segment layout or hash function mismatch" << std::endl;
+                ret = RINGCACHE_ERRNO_SHM_MISMATCH;
+            }
+            else{
+                ret = RINGCACHE_ERRNO_OK;
+                return new basic_shm_ringcache(fd, base, false);
+            }
+            munmap(base, st.st_size);
+            close(fd);
+            return nullptr;
+        }
+
+        /**
+         * 进程间共享、robust的锁：拿着锁的进程挂了，下一个拿锁的进程拿到EOWNERDEAD，标记一下接着用
+         */
+        static void init_mutex(pthread_mutex_t *mtx){
+            pthread_mutexattr_t attr;
+            pthread_mutexattr_init(&attr);
+            pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+            pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+            pthread_mutex_init(mtx, &attr);
+            pthread_mutexattr_destroy(&attr);
+        }
+
+        /**
+         * 加锁，block为false时只try_lock，返回是否拿到了锁。拿着锁的进程挂了时拿到的是EOWNERDEAD，
+         * 标记一下接着用，owner_dead置为true
+         */
+        static bool lock_mutex(pthread_mutex_t *mtx, bool block, bool &owner_dead){
+            int r = block ? pthread_mutex_lock(mtx) : pthread_mutex_trylock(mtx);
+            owner_dead = r == EOWNERDEAD;
+            if (owner_dead){
+                pthread_mutex_consistent(mtx);
+            }
+            return r == 0 || owner_dead;
+        }
+
+        /**
+         * 在ptr处写一个len字节的空闲块
+         */
+        static void init_free(char *ptr, uint64_t len){
+            shm_entry_t *entry = (shm_entry_t *) ptr;
+            entry->entry_len = len;
+            entry->hash_next = 0;
+            entry->hash_val = 0;
+            entry->expire_ms = 1;
+            entry->key_len = 0;
+            entry->value_len = 0;
+        }
+
+        shm_entry_t *entry_at(uint64_t off) const{
+            return (shm_entry_t *) (this->base + off);
+        }
+
+        uint64_t offset_of(const shm_entry_t *entry) const{
+            return (const char *) entry - this->base;
+        }
+
+        uint64_t *bucket_of(uint32_t hash_val) const{
+            return &this->buckets[hash_val & HASH_MASK(this->header->hash_power)];
+        }
+
+        /**
+         * 锁上hash_val所在的索引分段，调用方负责解锁。
+         * 链表每次只改一个偏移，拿着锁的进程挂了链表也还是完整的，最多本段的数据个数差一个
+         */
+        shm_lock_t *lock_index(uint32_t hash_val){
+            shm_lock_t *lock = &this->locks[hash_val & HASH_MASK(HASHTABLE_LOCK_POWER)];
+            bool owner_dead = false;
+            lock_mutex(&lock->mtx, true, owner_dead);
+            return lock;
+        }
+
+        /**
+         * 挑一个buffer并锁上：每个线程有自己的主buffer，每BUFFER_HOME_ROTATE次换一个；
+         * 主buffer被别的进程占着时顺着往后try_lock一轮，都拿不到再阻塞等主buffer
+         */
+        shm_buffer_t *lock_buffer(){
+            static thread_local uint32_t home = (uint32_t) shm_self_pid() * 2654435761u + (uint32_t) std::hash< std::thread::id >()(std::this_thread::get_id());
+            static thread_local uint32_t calls = 0;
+            uint32_t num = this->header->buffer_num;
+            if (++calls % BUFFER_HOME_ROTATE == 0){
+                home++;
+            }
+            bool owner_dead = false;
+            shm_buffer_t *buffer = nullptr;
+            for (uint32_t i = 0; i < num && buffer == nullptr; i++){
+                if (lock_mutex(&this->buffers[(home + i) % num].mtx, false, owner_dead)){
+                    buffer = &this->buffers[(home + i) % num];
+                }
+            }
+            if (buffer == nullptr){
+                buffer = &this->buffers[home % num];
+                lock_mutex(&buffer->mtx, true, owner_dead);
+            }
+            if (owner_dead){
+                this->recover_buffer(buffer);
+            }
+            return buffer;
+        }
+
+        /**
+         * 收拾拿着buffer锁挂掉的进程没写完的数据：覆盖的旧数据在记下pending之前都已经摘链了，
+         * 等读线程离开后补上剩下的空闲块；entry已经挂到索引上的是写完了的，留着，没挂上的当空闲块，最后挪好写指针
+         */
+        void recover_buffer(shm_buffer_t *buffer){
+            if (buffer->pending_len == 0){
+                return;
+            }
+            std::cout << "[shm_ringcache]recover the unfinished write in buffer at " << buffer->begin << " left by a dead process" << std::endl;
+            char *mem = this->base + buffer->begin;
+            shm_entry_t *entry = (shm_entry_t *) (mem + buffer->pending_cur);
+            this->synchronize();
+            if (buffer->pending_len < buffer->pending_covered){
+                init_free(mem + buffer->pending_cur + buffer->pending_len, buffer->pending_covered - buffer->pending_len);
+            }
+            //没写完的entry头里的hash可能是旧的，只用来找bucket，按偏移比较
+            uint32_t hash_val = entry->hash_val;
+            shm_lock_t *lock = this->lock_index(hash_val);
+            uint64_t target = this->offset_of(entry);
+            uint64_t off = *this->bucket_of(hash_val);
+            while (off != 0 && off != target){
+                off = this->entry_at(off)->hash_next;
+            }
+            if (off == 0){
+                init_free((char *) entry, buffer->pending_len);
+            }
+            pthread_mutex_unlock(&lock->mtx);
+            this->commit_mem(buffer);
+        }
+
+        /**
+         * 这一次写入完成，挪好写指针
+         */
+        void commit_mem(shm_buffer_t *buffer){
+            uint64_t next = buffer->pending_cur + buffer->pending_len;
+            buffer->cur = next < buffer->size ? next : 0;
+            buffer->pending_len = 0;
+        }
+
+        /**
+         * 在拿着锁的buffer里从写指针处取一块能放下msize字节数据的空间：
+         * 先把要覆盖的entry都从索引上摘掉，等所有进程里还在读它们的线程离开后，再写剩下的空闲块，
+         * entry_len返回entry实际占的字节数。写指针等数据挂到索引上以后由commit_mem挪
+         */
+        shm_entry_t *get_mem_without_lock(shm_buffer_t *buffer, uint32_t msize, uint64_t &entry_len){
+            char *mem = this->base + buffer->begin;
+            uint64_t need_size = RING_ALIGN_SIZE(msize + sizeof(shm_entry_t));
+            uint64_t cur = buffer->cur;
+            //后面不够了从头开始，尾巴上的那几个entry留着，下一圈再淘汰
+            if (buffer->size - cur < need_size){
+                cur = 0;
+                owner_add(buffer->reset_header_times, 1);
+            }
+            uint64_t ptr = cur;
+            uint64_t covered = 0;
+            uint32_t evict_num = 0;
+            while (covered < need_size){
+                shm_entry_t *tmp = (shm_entry_t *) (mem + ptr);
+                assert(tmp->entry_len > 0 && ptr + tmp->entry_len <= buffer->size);
+                if (tmp->key_len > 0 && this->evict_without_lock(tmp)){
+                    evict_num++;
+                }
+                covered += tmp->entry_len;
+                ptr += tmp->entry_len;
+            }
+            owner_add(buffer->evict_num, evict_num);
+
+            //剩下的不够一个entry头就直接带走
+            uint64_t remain = covered - need_size;
+            entry_len = remain > sizeof(shm_entry_t) ? need_size : covered;
+            buffer->pending_cur = cur;
+            buffer->pending_covered = covered;
+            buffer->pending_len = entry_len;
+
+            //要覆盖的entry都已经摘链了，等还在读它们的线程都离开后再改写这块内存
+            this->synchronize();
+            if (entry_len < covered){
+                init_free(mem + cur + entry_len, remain);
+            }
+            return (shm_entry_t *) (mem + cur);
+        }
+
+        /**
+         * 淘汰要被覆盖的entry：按entry里存的hash直接定位bucket，把这个entry本身摘掉，返回是否真的淘汰了一个有效数据
+         */
+        bool evict_without_lock(shm_entry_t *entry){
+            shm_lock_t *lock = this->lock_index(entry->hash_val);
+            bool ret = false;
+            //拿到锁之前可能已经被del或者被同key的set清理了
+            if (entry->key_len > 0){
+                uint64_t target = this->offset_of(entry);
+                uint64_t *bucket = this->bucket_of(entry->hash_val);
+                shm_entry_t *pre = nullptr;
+                uint64_t off = *bucket;
+                while (off != 0 && off != target){
+                    pre = this->entry_at(off);
+                    off = pre->hash_next;
+                }
+                if (off != 0){
+                    this->unlink_without_lock(lock, bucket, pre, entry);
+                    ret = true;
+                }
+                else{
+                    entry->key_len = 0;
+                    entry->expire_ms = 1;
+                }
+            }
+            pthread_mutex_unlock(&lock->mtx);
+            return ret;
+        }
+
+        /**
+         * 摘掉bucket里所有的这个key，调用方持有本段的锁
+         */
+        void unlink_key(shm_lock_t *lock, uint64_t *bucket, const char *key, uint32_t klen, uint32_t hash_val){
+            shm_entry_t *pre = nullptr;
+            uint64_t off = *bucket;
+            while (off != 0){
+                shm_entry_t *cur = this->entry_at(off);
+                off = cur->hash_next;
+                if (cur->match(key, klen, hash_val)){
+                    this->unlink_without_lock(lock, bucket, pre, cur);
+                    continue;
+                }
+                pre = cur;
+            }
+        }
+
+        /**
+         * 从链表上摘掉cur。摘链后读线程可能还在读它，所以只置删除标志，内存等环形缓冲区覆盖时再回收
+         */
+        void unlink_without_lock(shm_lock_t *lock, uint64_t *bucket, shm_entry_t *pre, shm_entry_t *cur){
+            if (pre == nullptr){
+                __atomic_store_n(bucket, cur->hash_next, __ATOMIC_RELEASE);
+            }
+            else{
+                pre->set_next(cur->hash_next);
+            }
+            cur->key_len = 0;
+            cur->expire_ms = 1;
+            owner_add(lock->item_num, (uint64_t) -1);
+        }
+
+        /**
+         * 进入读临界区：占一个空闲的槽位，登记当前epoch。每个线程记着上次用的槽位，一般一次就占到，
+         * 槽位是按次占的，线程退出、进程fork都不用额外处理
+         */
+        shm_epoch_slot_t *read_enter(){
+            static thread_local uint32_t hint = 0;
+            pid_t pid = shm_self_pid();
+            uint32_t slot_num = this->header->slot_num;
+            while (true){
+                for (uint32_t n = 0; n < slot_num; n++){
+                    uint32_t i = (hint + n) % slot_num;
+                    shm_epoch_slot_t *slot = &this->slots[i];
+                    int32_t owner = 0;
+                    if (slot->owner.load(std::memory_order_relaxed) != 0 || !slot->owner.compare_exchange_strong(owner, pid)){
+                        continue;
+                    }
+                    hint = i;
+                    uint32_t cur_max = this->header->slot_max.load();
+                    while (cur_max < i + 1 && !this->header->slot_max.compare_exchange_weak(cur_max, i + 1)){
+                    }
+                    //seq_cst的store保证后面对hash表的读取不会被重排到登记之前
+                    slot->epoch.store(this->header->global_epoch.load(std::memory_order_acquire), std::memory_order_seq_cst);
+                    return slot;
+                }
+                std::this_thread::yield();
+            }
+        }
+
+        void read_leave(shm_epoch_slot_t *slot){
+            slot->epoch.store(0, std::memory_order_release);
+            slot->owner.store(0, std::memory_order_release);
+        }
+
+        /**
+         * 等一个宽限期：调用之前摘链的内存，返回之后不会再被任何进程的读线程访问。
+         * 等得久了看一下占着槽位的进程，已经不在了就替它把槽位清掉，被kill -9的进程不会把所有写入卡住
+         */
+        void synchronize(){
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            uint64_t target = this->header->global_epoch.fetch_add(1) + 1;
+            uint32_t slot_num = this->header->slot_max.load(std::memory_order_acquire);
+            for (uint32_t i = 0; i < slot_num; i++){
+                shm_epoch_slot_t *slot = &this->slots[i];
+                uint32_t spin = 0;
+                while (true){
+                    uint64_t e = slot->epoch.load(std::memory_order_acquire);
+                    if (e == 0 || e >= target){
+                        break;
+                    }
+                    if (++spin < 1024){
+                        cpu_relax();
+                        continue;
+                    }
+                    std::this_thread::yield();
+                    if (spin % SHM_DEAD_CHECK_SPINS == 0){
+                        this->reclaim_slot(slot);
+                    }
+                }
+            }
+        }
+
+        /**
+         * 占着槽位的进程已经退出时把槽位清掉
+         */
+        void reclaim_slot(shm_epoch_slot_t *slot){
+            int32_t owner = slot->owner.load(std::memory_order_acquire);
+            if (owner <= 0 || kill(owner, 0) == 0 || errno != ESRCH){
+                return;
+            }
+            if (slot->owner.compare_exchange_strong(owner, -1)){
+                std::cout << "[shm_ringcache]reclaim reader slot of dead process " << owner << std::endl;
+                slot->epoch.store(0, std::memory_order_release);
+                slot->owner.store(0, std::memory_order_release);
+            }
+        }
+
+        int shm_fd;
+        bool creator;
+        char *base;
+        shm_header_t *header;
+        shm_lock_t *locks;
+        shm_buffer_t *buffers;
+        shm_epoch_slot_t *slots;
+        uint64_t *buckets;
+        hasher_t hasher;
+    };
+
+    typedef basic_shm_ringcache< jenkins_hasher > shm_ringcache;
+}
+#endif //_RINGCACHE_SHM_H_202610271030_
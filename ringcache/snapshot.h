@@ -0,0 +1,109 @@
+/*************************************************************************
+ * File:	snapshot.h
+ * Author:	liuyongshuai<liuyongshuai@hotmail.com>
+ * Time:	2026-10-21 09:50
+ * 快照文件格式：
+ * 1、开头是snapshot_header_t，紧跟着每个buffer一个snapshot_buffer_t，整体按4KB对齐
+ * 2、之后依次是各个buffer的原始内存，每个按4KB对齐，可以直接mmap
+ * 头部最后才写，没写完的快照没有magic，load时直接拒绝
+ ************************************************************************/
+#ifndef _RINGCACHE_SNAPSHOT_H_202610210950_
+#define _RINGCACHE_SNAPSHOT_H_202610210950_
+
+#include "entry.h"
+#include <unistd.h>
+#include <errno.h>
+
+#define SNAPSHOT_MAGIC 0x50414e53474e4952ULL
+#define SNAPSHOT_VERSION 5
+#define SNAPSHOT_ALIGN (4*KB)
+#define SNAPSHOT_ALIGN_SIZE(n) (((n)+SNAPSHOT_ALIGN-1)&~((uint64_t)SNAPSHOT_ALIGN-1))
+
+namespace ringcache{
+    typedef struct _snapshot_header_t{
+        uint64_t magic;
+        uint32_t version;
+
+        /**
+         * 以下几项load时要和当前实例完全一致
+         */
+        uint32_t buffer_num;
+        uint64_t buffer_size;
+        uint32_t seg_num;
+
+        /**
+         * 用当前的hash函数算一个固定字符串的hash，entry里存的hash_val是要直接拿来用的
+         */
+        uint32_t hash_check;
+
+        /**
+         * 大小分档配置的校验值
+         */
+        uint32_t class_check;
+
+        /**
+         * entry头部的大小，默认格式和紧凑格式（RINGCACHE_COMPACT_ENTRY）的buffer不能互相load
+         */
+        uint32_t entry_size;
+
+        /**
+         * 保存时索引里的数据个数，含已过期还没被淘汰的，load时按它预先把索引开够
+         */
+        uint64_t item_num;
+
+        /**
+         * 第一个buffer的数据在文件里的偏移，以及相邻两个buffer的间隔
+         */
+        uint64_t data_offset;
+        uint64_t data_stride;
+    } snapshot_header_t;
+
+    typedef struct _snapshot_buffer_t{
+        /**
+         * 加锁模式下的当前指针相对buffer开头的偏移
+         */
+        uint64_t cur_offset;
+
+        /**
+         * 原子预留模式下的写指针，以及每一段上一圈用掉的字节数
+         */
+        uint64_t cursor;
+        uint64_t fill[RING_SEGMENT_NUM];
+    } snapshot_buffer_t;
+
+    /**
+     * pwrite/pread一次不一定写完、读完，大块的要循环
+     */
+    inline bool snapshot_pwrite(int fd, const char *buf, uint64_t len, uint64_t offset){
+        while (len > 0){
+            ssize_t n = pwrite(fd, buf, len, offset);
+            if (n < 0 && errno == EINTR){
+                continue;
+            }
+            if (n <= 0){
+                return false;
+            }
+            buf += n;
+            len -= n;
+            offset += n;
+        }
+        return true;
+    }
+
+    inline bool snapshot_pread(int fd, char *buf, uint64_t len, uint64_t offset){
+        while (len > 0){
+            ssize_t n = pread(fd, buf, len, offset);
+            if (n < 0 && errno == EINTR){
+                continue;
+            }
+            if (n <= 0){
+                return false;
+            }
+            buf += n;
+            len -= n;
+            offset += n;
+        }
+        return true;
+    }
+}
+#endif //_RINGCACHE_SNAPSHOT_H_202610210950_
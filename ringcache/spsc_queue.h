@@ -0,0 +1,100 @@
+/*************************************************************************
+ * File:	spsc_queue.h
+ * Author:	liuyongshuai<liuyongshuai@hotmail.com>
+ * Time:	2026-10-25 15:20
+ * 单生产者单消费者的无锁有界队列：生产者只写tail、消费者只写head，各占一个cache line，
+ * 双方各自缓存一份对方的位置，只有看起来满了/空了时才去读对方的那个cache line
+ ************************************************************************/
+#ifndef _RINGCACHE_SPSC_QUEUE_H_202610251520_
+#define _RINGCACHE_SPSC_QUEUE_H_202610251520_
+
+#include <atomic>
+#include <new>
+#include <stdint.h>
+#include <stdlib.h>
+#include "entry.h"
+
+namespace ringcache{
+    template< typename T >
+    class spsc_queue{
+    public:
+        /**
+         * 申请一个对齐到cache line的队列，容量向上取到2的幂
+         */
+        static spsc_queue *alloc(uint32_t capacity){
+            uint64_t size = 2;
+            while (size < capacity){
+                size <<= 1;
+            }
+            spsc_queue *q = (spsc_queue *) cache_aligned_calloc(sizeof(spsc_queue));
+            new(q) spsc_queue();
+            q->mask = size - 1;
+            q->slots = new T[size];
+            return q;
+        }
+
+        static void release(spsc_queue *q){
+            if (q == nullptr){
+                return;
+            }
+            delete[] q->slots;
+            q->~spsc_queue();
+            free(q);
+        }
+
+        /**
+         * 只能由生产者调用，满了返回false
+         */
+        bool try_push(const T &v){
+            uint64_t t = this->tail.load(std::memory_order_relaxed);
+            if (t - this->cached_head > this->mask){
+                this->cached_head = this->head.load(std::memory_order_acquire);
+                if (t - this->cached_head > this->mask){
+                    return false;
+                }
+            }
+            this->slots[t & this->mask] = v;
+            this->tail.store(t + 1, std::memory_order_release);
+            return true;
+        }
+
+        /**
+         * 只能由消费者调用，空了返回false
+         */
+        bool try_pop(T &v){
+            uint64_t h = this->head.load(std::memory_order_relaxed);
+            if (h == this->cached_tail){
+                this->cached_tail = this->tail.load(std::memory_order_acquire);
+                if (h == this->cached_tail){
+                    return false;
+                }
+            }
+            v = this->slots[h & this->mask];
+            this->head.store(h + 1, std::memory_order_release);
+            return true;
+        }
+
+    private:
+        spsc_queue() : tail(0), cached_head(0), head(0), cached_tail(0), mask(0), slots(nullptr){
+        }
+
+        /**
+         * 生产者的cache line
+         */
+        alignas(CACHE_LINE_SIZE) std::atomic< uint64_t > tail;
+        uint64_t cached_head;
+
+        /**
+         * 消费者的cache line
+         */
+        alignas(CACHE_LINE_SIZE) std::atomic< uint64_t > head;
+        uint64_t cached_tail;
+
+        /**
+         * 只读的部分
+         */
+        alignas(CACHE_LINE_SIZE) uint64_t mask;
+        T *slots;
+    };
+}
+#endif //_RINGCACHE_SPSC_QUEUE_H_202610251520_
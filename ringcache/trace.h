@@ -0,0 +1,322 @@
+/*************************************************************************
+ * File:	trace.h
+ * Author:	liuyongshuai<liuyongshuai@hotmail.com>
+ * Time:	2026-10-24 15:30
+ * 线上流量录制：每次get/set/del记一条trace_record_t，回放工具（bench/trace_replay.cpp）拿它驱动一个新的实例。
+ * 文件格式：开头是trace_header_t，之后是一个个块，每块trace_chunk_header_t后面跟着num条记录。
+ * 每个线程往自己的块里写，不加锁也不用原子的读改写，块写满了才交给后台线程落盘。
+ * 同一个线程的块按顺序落盘，不同线程的块互相穿插，回放时按时间戳稳定排序。
+ * 写记录时处于epoch读临界区内，停止录制时等一个宽限期，之后这次录制的块不会再有线程写，全部落盘释放
+ ************************************************************************/
+#ifndef _RINGCACHE_TRACE_H_202610241530_
+#define _RINGCACHE_TRACE_H_202610241530_
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <stdio.h>
+#include <stdint.h>
+#include "clock.h"
+#include "epoch.h"
+
+#define TRACE_MAGIC 0x4543415254474e52ULL
+#define TRACE_VERSION 1
+
+//每个线程的块能放多少条记录，写满一块才交给后台线程，约64KB
+#ifndef RING_TRACE_CHUNK_RECORDS
+#define RING_TRACE_CHUNK_RECORDS 3270
+#endif
+
+//每个线程按录制编号直接映射的块位置数，一个线程轮流访问分片的几个实例时各用各的块，不用每次切换都重新领
+#ifndef RING_TRACE_THREAD_SLOTS
+#define RING_TRACE_THREAD_SLOTS 64
+#endif
+
+//后台线程落盘的间隔（毫秒）
+#ifndef RING_TRACE_FLUSH_MS
+#define RING_TRACE_FLUSH_MS 50
+#endif
+
+namespace ringcache{
+    enum{
+        TRACE_OP_GET = 1,
+        TRACE_OP_SET,
+        TRACE_OP_DEL
+    };
+
+    typedef struct _trace_header_t{
+        uint64_t magic;
+        uint32_t version;
+        uint32_t record_size;
+        //开始录制时的unix时间戳（毫秒），记录里的时间戳是相对它的
+        uint64_t start_ms;
+    } trace_header_t;
+
+    typedef struct _trace_chunk_header_t{
+        uint32_t thread_id;
+        uint32_t num;
+    } trace_chunk_header_t;
+
+    /**
+     * 一条记录20字节。key只记hash和长度，回放时由这两个重新构造出key，
+     * 所以两个不同的key只有hash和长度都一样时才会被当成同一个
+     */
+    typedef struct __attribute__((packed)) _trace_record_t{
+        //相对开始录制的毫秒数，用的是粗粒度时钟
+        uint32_t ts_ms;
+        uint32_t key_hash;
+        //set是写入的value长度（压缩前），get是读到的value长度，没读到为0
+        uint32_t value_len;
+        //set的TTL（毫秒），0为不过期
+        uint32_t ttl_ms;
+        uint16_t key_len;
+        uint8_t op;
+        //本次操作的错误码，get时可以看出命中、未命中还是过期
+        uint8_t result;
+    } trace_record_t;
+
+    typedef struct _trace_chunk_t{
+        uint64_t session;
+        uint32_t thread_id;
+        //已写好的条数，写线程每写一条release一次，停止录制时按它取已写好的部分
+        std::atomic< uint32_t > num;
+        trace_record_t records[RING_TRACE_CHUNK_RECORDS];
+    } trace_chunk_t;
+
+    class trace_recorder{
+    public:
+        trace_recorder() : enabled(false), session(0), fp(nullptr), writer(nullptr), start_ms(0), thread_num(0), record_num(0){
+        }
+
+        ~trace_recorder(){
+            this->stop();
+        }
+
+        /**
+         * 开始往path里录制，已经在录制时返回false
+         */
+        bool start(const std::string &path){
+            std::lock_guard< std::mutex > lock(this->ctl_mtx);
+            if (this->fp != nullptr){
+                return false;
+            }
+            FILE *f = fopen(path.c_str(), "wb");
+            if (f == nullptr){
+                return false;
+            }
+            trace_header_t header;
+            header.magic = TRACE_MAGIC;
+            header.version = TRACE_VERSION;
+            header.record_size = sizeof(trace_record_t);
+            header.start_ms = coarse_clock::instance().now_ms();
+            if (fwrite(&header, sizeof(header), 1, f) != 1){
+                fclose(f);
+                return false;
+            }
+            this->fp = f;
+            this->start_ms.store(header.start_ms, std::memory_order_relaxed);
+            this->record_num = 0;
+            this->thread_num = 0;
+            //每次开始都换一个编号，线程手里上一次的块就不会再用了
+            {
+                std::lock_guard< std::mutex > chunk_lock(this->chunk_mtx);
+                this->session.store(next_session().fetch_add(1, std::memory_order_relaxed) + 1, std::memory_order_release);
+            }
+            this->stop_writer = false;
+            this->writer = new std::thread(&trace_recorder::writer_func, this);
+            this->enabled.store(true, std::memory_order_release);
+            return true;
+        }
+
+        /**
+         * 停止录制：把写满的块和各线程手里写了一部分的块都落盘，返回一共写了多少条
+         */
+        uint64_t stop(){
+            std::lock_guard< std::mutex > lock(this->ctl_mtx);
+            if (this->fp == nullptr){
+                return 0;
+            }
+            this->enabled.store(false, std::memory_order_release);
+            this->stop_writer = true;
+            this->writer->join();
+            delete this->writer;
+            this->writer = nullptr;
+
+            //编号清零后，停止前刚好写满的块、新领的块都直接放到retired里，不会再落盘。
+            //等一个宽限期，还拿着这次编号在写的线程都写完了，线程手里的块也就可以释放了
+            {
+                std::lock_guard< std::mutex > chunk_lock(this->chunk_mtx);
+                this->session.store(0, std::memory_order_release);
+            }
+            epoch_domain::instance().synchronize();
+            std::vector< trace_chunk_t * > full, active, retired;
+            {
+                std::lock_guard< std::mutex > chunk_lock(this->chunk_mtx);
+                full.swap(this->full);
+                active.swap(this->active);
+                retired.swap(this->retired);
+            }
+            for (auto it:full){
+                this->write_chunk(it, RING_TRACE_CHUNK_RECORDS);
+                delete it;
+            }
+            for (auto it:active){
+                this->write_chunk(it, it->num.load(std::memory_order_acquire));
+                delete it;
+            }
+            for (auto it:retired){
+                delete it;
+            }
+            fclose(this->fp);
+            this->fp = nullptr;
+            return this->record_num;
+        }
+
+        bool is_enabled() const{
+            return this->enabled.load(std::memory_order_relaxed);
+        }
+
+        /**
+         * 记一条，只有本线程会写自己的块。get本来就在读临界区内，再进一次只是加个计数
+         */
+        void record(uint8_t op, uint32_t key_hash, uint32_t key_len, uint32_t value_len, uint32_t ttl_ms, uint32_t result){
+            epoch_guard guard;
+            uint64_t session = this->session.load(std::memory_order_acquire);
+            if (session == 0){
+                return;
+            }
+            thread_slot_t &slot = local_slot(session);
+            if (slot.owner != this || slot.session != session){
+                slot.owner = this;
+                slot.session = session;
+                slot.thread_id = this->thread_num.fetch_add(1, std::memory_order_relaxed);
+                slot.chunk = this->new_chunk(session, slot.thread_id);
+            }
+            trace_chunk_t *chunk = slot.chunk;
+            uint32_t n = chunk->num.load(std::memory_order_relaxed);
+            trace_record_t &r = chunk->records[n];
+            r.ts_ms = (uint32_t) (coarse_clock::instance().now_ms() - this->start_ms.load(std::memory_order_relaxed));
+            r.key_hash = key_hash;
+            r.value_len = value_len;
+            r.ttl_ms = ttl_ms;
+            r.key_len = key_len;
+            r.op = op;
+            r.result = result;
+            chunk->num.store(n + 1, std::memory_order_release);
+            if (n + 1 == RING_TRACE_CHUNK_RECORDS){
+                this->retire_chunk(chunk);
+                slot.chunk = this->new_chunk(session, slot.thread_id);
+            }
+        }
+
+    private:
+        typedef struct _thread_slot_t{
+            trace_recorder *owner;
+            uint64_t session;
+            uint32_t thread_id;
+            trace_chunk_t *chunk;
+        } thread_slot_t;
+
+        /**
+         * 本线程在这次录制里用的块位置。编号是所有实例共用的，同时在录的几个实例编号相邻，基本不会映射到同一个位置；
+         * 真撞上了就重新领一块，被挤掉的块还在active里，停止时照样落盘。
+         * 位置里留着的上一次录制的块在stop()时已经释放了，编号对不上，不会再碰它
+         */
+        static thread_slot_t &local_slot(uint64_t session){
+            static thread_local thread_slot_t slots[RING_TRACE_THREAD_SLOTS];
+            return slots[session % RING_TRACE_THREAD_SLOTS];
+        }
+
+        //所有实例共用的录制编号，换了实例或者重新开始录制，线程都会重新领一块
+        static std::atomic< uint64_t > &next_session(){
+            static std::atomic< uint64_t > n(0);
+            return n;
+        }
+
+        trace_chunk_t *new_chunk(uint64_t session, uint32_t thread_id){
+            trace_chunk_t *chunk = new trace_chunk_t();
+            chunk->num.store(0, std::memory_order_relaxed);
+            chunk->session = session;
+            chunk->thread_id = thread_id;
+            std::lock_guard< std::mutex > lock(this->chunk_mtx);
+            if (session == this->session.load(std::memory_order_relaxed)){
+                this->active.push_back(chunk);
+            }
+            else{
+                this->retired.push_back(chunk);
+            }
+            return chunk;
+        }
+
+        /**
+         * 写满的块交给后台线程
+         */
+        void retire_chunk(trace_chunk_t *chunk){
+            std::lock_guard< std::mutex > lock(this->chunk_mtx);
+            //录制已经停了，这一块还在active里，stop()等完宽限期后落盘
+            if (chunk->session != this->session.load(std::memory_order_relaxed)){
+                return;
+            }
+            for (size_t i = 0; i < this->active.size(); i++){
+                if (this->active[i] == chunk){
+                    this->active[i] = this->active.back();
+                    this->active.pop_back();
+                    break;
+                }
+            }
+            this->full.push_back(chunk);
+        }
+
+        void write_chunk(const trace_chunk_t *chunk, uint32_t num){
+            if (num == 0){
+                return;
+            }
+            trace_chunk_header_t header;
+            header.thread_id = chunk->thread_id;
+            header.num = num;
+            fwrite(&header, sizeof(header), 1, this->fp);
+            fwrite(chunk->records, sizeof(trace_record_t), num, this->fp);
+            this->record_num += num;
+        }
+
+        void writer_func(){
+            std::vector< trace_chunk_t * > todo;
+            while (!this->stop_writer){
+                std::this_thread::sleep_for(std::chrono::milliseconds(RING_TRACE_FLUSH_MS));
+                {
+                    std::lock_guard< std::mutex > lock(this->chunk_mtx);
+                    todo.swap(this->full);
+                }
+                for (auto it:todo){
+                    this->write_chunk(it, RING_TRACE_CHUNK_RECORDS);
+                    delete it;
+                }
+                todo.clear();
+                fflush(this->fp);
+            }
+        }
+
+        std::atomic< bool > enabled;
+        std::atomic< uint64_t > session;
+        std::atomic< bool > stop_writer;
+        FILE *fp;
+        std::thread *writer;
+        //上一次录制停止时还没写完的线程可能正在读
+        std::atomic< uint64_t > start_ms;
+        std::atomic< uint32_t > thread_num;
+        uint64_t record_num;
+
+        /**
+         * start/stop之间互斥；chunk_mtx只在领新块、交出写满的块时拿，每RING_TRACE_CHUNK_RECORDS条一次
+         */
+        std::mutex ctl_mtx;
+        std::mutex chunk_mtx;
+        std::vector< trace_chunk_t * > active;
+        std::vector< trace_chunk_t * > full;
+        std::vector< trace_chunk_t * > retired;
+    };
+}
+#endif //_RINGCACHE_TRACE_H_202610241530_
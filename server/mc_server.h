@@ -0,0 +1,1004 @@
+/*************************************************************************
+ * File:	mc_server.h
+ * Author:	liuyongshuai<liuyongshuai@hotmail.com>
+ * Time:	2026-10-26 10:30
+ * memcached协议的服务：文本协议的get/gets/set/delete/version/quit（get后面可以跟多个key），
+ * 二进制协议的GET/GETQ/GETK/GETKQ/SET/SETQ/DELETE/DELETEQ/NOOP/VERSION/QUIT，每个连接按第一个字节区分。
+ * 多个reactor线程，每个一个epoll，各自用SO_REUSEPORT监听同一个端口，连接一直在接受它的那个线程里。
+ * 一次读进来的请求挨个解析完（流水线），回复攒在一起用writev一次发出去，value直接指向环形缓冲区，不拷贝：
+ * 第一次查找时进入epoch读临界区，期间这些内存不会被覆盖，发完（没发完的部分拷到连接自己的缓冲区里）才离开。
+ * 写入可能要等所有读线程离开临界区，所以遇到set/delete时先把攒下的回复发掉、离开临界区再写，不会和别的reactor互相等
+ ************************************************************************/
+#ifndef _RINGCACHE_MC_SERVER_H_202610261030_
+#define _RINGCACHE_MC_SERVER_H_202610261030_
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unordered_map>
+#include "ringcache/ringcache.h"
+
+//一批回复攒到这么多字节就先发一次
+#ifndef MC_FLUSH_BYTES
+#define MC_FLUSH_BYTES (256 * 1024)
+#endif
+
+//每次read的大小
+#ifndef MC_READ_SIZE
+#define MC_READ_SIZE (64 * 1024)
+#endif
+
+//文本协议一行的最大长度，get后面的key多时会很长
+#ifndef MC_LINE_MAX
+#define MC_LINE_MAX (64 * 1024)
+#endif
+
+//memcached的key最长250
+#define MC_KEY_MAX 250
+
+//exptime不超过30天时是相对时间（秒），否则是unix时间戳
+#define MC_RELATIVE_EXPIRE_MAX (60 * 60 * 24 * 30)
+
+#define MC_VERSION "1.6.0-ringcache"
+
+namespace ringcache{
+    /**
+     * 二进制协议的magic、命令及状态码
+     */
+    enum{
+        MC_BIN_REQUEST = 0x80,
+        MC_BIN_RESPONSE = 0x81
+    };
+
+    enum{
+        MC_OP_GET = 0x00,
+        MC_OP_SET = 0x01,
+        MC_OP_DELETE = 0x04,
+        MC_OP_QUIT = 0x07,
+        MC_OP_GETQ = 0x09,
+        MC_OP_NOOP = 0x0a,
+        MC_OP_VERSION = 0x0b,
+        MC_OP_GETK = 0x0c,
+        MC_OP_GETKQ = 0x0d,
+        MC_OP_SETQ = 0x11,
+        MC_OP_DELETEQ = 0x14,
+        MC_OP_QUITQ = 0x17
+    };
+
+    enum{
+        MC_STATUS_OK = 0x00,
+        MC_STATUS_NOT_FOUND = 0x01,
+        MC_STATUS_TOO_LARGE = 0x03,
+        MC_STATUS_INVALID = 0x04,
+        MC_STATUS_NOT_STORED = 0x05,
+        MC_STATUS_UNKNOWN = 0x81,
+        MC_STATUS_NO_MEMORY = 0x82
+    };
+
+    /**
+     * 二进制协议的包头，24字节，多字节的字段都是网络字节序
+     */
+    typedef struct __attribute__((packed)) _mc_bin_header_t{
+        uint8_t magic;
+        uint8_t opcode;
+        uint16_t key_len;
+        uint8_t extras_len;
+        uint8_t data_type;
+        uint16_t status;
+        uint32_t body_len;
+        uint32_t opaque;
+        uint64_t cas;
+    } mc_bin_header_t;
+
+    /**
+     * 存到ringcache里的value前面带的12字节：客户端的flags及cas，本机字节序
+     */
+    typedef struct __attribute__((packed)) _mc_item_t{
+        uint32_t flags;
+        uint64_t cas;
+    } mc_item_t;
+
+    inline uint64_t mc_htonll(uint64_t v){
+        return ((uint64_t) htonl((uint32_t) v) << 32) | htonl((uint32_t) (v >> 32));
+    }
+
+    /**
+     * 客户端给的exptime换成expire_t：0不过期，不超过30天是相对秒数，否则是unix时间戳
+     */
+    inline expire_t mc_expire(int64_t exptime){
+        if (exptime <= 0){
+            return expire_t(0);
+        }
+        if (exptime <= MC_RELATIVE_EXPIRE_MAX){
+            return expire_t::after_ms((uint64_t) exptime * 1000);
+        }
+        return expire_t::at_ms((uint64_t) exptime * 1000);
+    }
+
+    /**
+     * 一批回复：自己生成的部分（回复头、END等）拷到arena里，value只记指针和长度
+     */
+    class mc_output_t{
+    public:
+        void append(const char *data, size_t len){
+            if (!this->segs.empty() && this->segs.back().ptr == nullptr && this->segs.back().off + this->segs.back().len == this->arena.size()){
+                this->segs.back().len += len;
+            }
+            else{
+                seg_t s = {nullptr, this->arena.size(), len};
+                this->segs.push_back(s);
+            }
+            this->arena.append(data, len);
+            this->bytes += len;
+        }
+
+        void append(const std::string &s){
+            this->append(s.data(), s.length());
+        }
+
+        /**
+         * 环形缓冲区里的数据，只在当前的epoch读临界区内有效
+         */
+        void reference(const char *data, size_t len){
+            if (len == 0){
+                return;
+            }
+            seg_t s = {data, 0, len};
+            this->segs.push_back(s);
+            this->bytes += len;
+        }
+
+        size_t size() const{
+            return this->bytes;
+        }
+
+        void clear(){
+            this->arena.clear();
+            this->segs.clear();
+            this->bytes = 0;
+        }
+
+        /**
+         * 第i段的起始地址，arena扩容后地址会变，所以发的时候才算
+         */
+        const char *seg_data(size_t i) const{
+            return this->segs[i].ptr != nullptr ? this->segs[i].ptr : this->arena.data() + this->segs[i].off;
+        }
+
+        size_t seg_len(size_t i) const{
+            return this->segs[i].len;
+        }
+
+        size_t seg_num() const{
+            return this->segs.size();
+        }
+
+        mc_output_t() : bytes(0){
+        }
+
+    private:
+        typedef struct _seg_t{
+            const char *ptr;
+            size_t off;
+            size_t len;
+        } seg_t;
+
+        std::string arena;
+        std::vector< seg_t > segs;
+        size_t bytes;
+    };
+
+    enum{
+        MC_PROTO_UNKNOWN = 0,
+        MC_PROTO_TEXT,
+        MC_PROTO_BINARY
+    };
+
+    /**
+     * 一个客户端连接，只在它所在的reactor线程里用
+     */
+    typedef struct _mc_conn_t{
+        int fd;
+        uint8_t proto;
+        bool closing;
+        uint32_t events;
+
+        /**
+         * 读进来还没解析的在[in_off, in_len)
+         */
+        std::vector< char > in;
+        size_t in_off;
+        size_t in_len;
+
+        /**
+         * 文本协议的set太大时要跳过的数据字节数
+         */
+        size_t swallow;
+
+        /**
+         * 上一批没发完的回复
+         */
+        std::string pending;
+        size_t pending_off;
+
+        explicit _mc_conn_t(int fd) : fd(fd), proto(MC_PROTO_UNKNOWN), closing(false), events(0), in_off(0), in_len(0), swallow(0), pending_off(0){
+        }
+    } mc_conn_t;
+
+    /**
+     * 各个reactor的计数，get_stats()时加在一起
+     */
+    typedef struct _mc_server_stats_t{
+        std::atomic< uint64_t > conn_num;
+        std::atomic< uint64_t > request_num;
+        std::atomic< uint64_t > writev_num;
+        std::atomic< uint64_t > copied_bytes;
+    } mc_server_stats_t;
+
+    /**
+     * 一个reactor线程：自己的epoll、自己的监听socket、自己的连接
+     */
+    class mc_reactor{
+    public:
+        mc_reactor(ringcache *cache, uint32_t id) : cache(cache), id(id), epfd(-1), listen_fd(-1), cas_seq(0), in_read(false), thread(nullptr){
+            this->stats.conn_num = 0;
+            this->stats.request_num = 0;
+            this->stats.writev_num = 0;
+            this->stats.copied_bytes = 0;
+        }
+
+        ~mc_reactor(){
+            for (auto &it:this->conns){
+                close(it.first);
+                delete it.second;
+            }
+            if (this->listen_fd >= 0){
+                close(this->listen_fd);
+            }
+            if (this->epfd >= 0){
+                close(this->epfd);
+            }
+        }
+
+        /**
+         * 建epoll、监听端口，失败返回false
+         */
+        bool listen(const char *host, uint16_t port){
+            this->epfd = epoll_create1(EPOLL_CLOEXEC);
+            this->listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            if (this->epfd < 0 || this->listen_fd < 0){
+                return false;
+            }
+            int on = 1;
+            setsockopt(this->listen_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+            setsockopt(this->listen_fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+            struct sockaddr_in addr;
+            memset(&addr, 0, sizeof(addr));
+            addr.sin_family = AF_INET;
+            addr.sin_port = htons(port);
+            if (inet_pton(AF_INET, host, &addr.sin_addr) != 1){
+                return false;
+            }
+            if (bind(this->listen_fd, (struct sockaddr *) &addr, sizeof(addr)) != 0 || ::listen(this->listen_fd, 1024) != 0){
+                return false;
+            }
+            struct epoll_event ev;
+            ev.events = EPOLLIN;
+            ev.data.fd = this->listen_fd;
+            return epoll_ctl(this->epfd, EPOLL_CTL_ADD, this->listen_fd, &ev) == 0;
+        }
+
+        void start(const std::atomic< bool > *is_stop){
+            this->thread = new std::thread(&mc_reactor::run, this, is_stop);
+        }
+
+        void join(){
+            if (this->thread != nullptr){
+                this->thread->join();
+                delete this->thread;
+                this->thread = nullptr;
+            }
+        }
+
+        mc_server_stats_t stats;
+
+    private:
+        mc_reactor(const mc_reactor &);
+        mc_reactor &operator=(const mc_reactor &);
+
+        void run(const std::atomic< bool > *is_stop){
+            struct epoll_event events[256];
+            while (!is_stop->load(std::memory_order_relaxed)){
+                int n = epoll_wait(this->epfd, events, 256, 100);
+                for (int i = 0; i < n; i++){
+                    if (events[i].data.fd == this->listen_fd){
+                        this->accept_all();
+                        continue;
+                    }
+                    auto it = this->conns.find(events[i].data.fd);
+                    if (it == this->conns.end()){
+                        continue;
+                    }
+                    mc_conn_t *conn = it->second;
+                    if (events[i].events & (EPOLLERR | EPOLLHUP)){
+                        conn->closing = true;
+                    }
+                    else if (events[i].events & EPOLLOUT){
+                        this->on_writable(conn);
+                    }
+                    else if (events[i].events & EPOLLIN){
+                        this->on_readable(conn);
+                    }
+                    this->update(conn);
+                }
+            }
+        }
+
+        void accept_all(){
+            while (true){
+                int fd = accept4(this->listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+                if (fd < 0){
+                    return;
+                }
+                int on = 1;
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+                mc_conn_t *conn = new mc_conn_t(fd);
+                struct epoll_event ev;
+                ev.events = EPOLLIN;
+                ev.data.fd = fd;
+                if (epoll_ctl(this->epfd, EPOLL_CTL_ADD, fd, &ev) != 0){
+                    close(fd);
+                    delete conn;
+                    continue;
+                }
+                conn->events = EPOLLIN;
+                this->conns[fd] = conn;
+                this->stats.conn_num++;
+            }
+        }
+
+        /**
+         * 有没发完的回复时只等可写，不再读新请求，慢的客户端不会让回复无限地攒下去
+         */
+        void update(mc_conn_t *conn){
+            if (conn->closing){
+                epoll_ctl(this->epfd, EPOLL_CTL_DEL, conn->fd, nullptr);
+                close(conn->fd);
+                this->conns.erase(conn->fd);
+                delete conn;
+                return;
+            }
+            uint32_t want = conn->pending_off < conn->pending.size() ? EPOLLOUT : EPOLLIN;
+            if (want != conn->events){
+                struct epoll_event ev;
+                ev.events = want;
+                ev.data.fd = conn->fd;
+                epoll_ctl(this->epfd, EPOLL_CTL_MOD, conn->fd, &ev);
+                conn->events = want;
+            }
+        }
+
+        void on_writable(mc_conn_t *conn){
+            while (conn->pending_off < conn->pending.size()){
+                ssize_t n = write(conn->fd, conn->pending.data() + conn->pending_off, conn->pending.size() - conn->pending_off);
+                if (n < 0){
+                    if (errno != EAGAIN && errno != EINTR){
+                        conn->closing = true;
+                    }
+                    return;
+                }
+                conn->pending_off += n;
+            }
+            conn->pending.clear();
+            conn->pending_off = 0;
+        }
+
+        void on_readable(mc_conn_t *conn){
+            //前面解析过的挪掉
+            if (conn->in_off > 0){
+                memmove(conn->in.data(), conn->in.data() + conn->in_off, conn->in_len - conn->in_off);
+                conn->in_len -= conn->in_off;
+                conn->in_off = 0;
+            }
+            if (conn->in.size() < conn->in_len + MC_READ_SIZE){
+                conn->in.resize(conn->in_len + MC_READ_SIZE);
+            }
+            ssize_t n = read(conn->fd, conn->in.data() + conn->in_len, conn->in.size() - conn->in_len);
+            if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR)){
+                conn->closing = true;
+                return;
+            }
+            if (n < 0){
+                return;
+            }
+            conn->in_len += n;
+            if (conn->proto == MC_PROTO_UNKNOWN){
+                conn->proto = (uint8_t) conn->in[0] == MC_BIN_REQUEST ? MC_PROTO_BINARY : MC_PROTO_TEXT;
+            }
+            if (conn->proto == MC_PROTO_BINARY){
+                while (!conn->closing && this->parse_binary(conn)){
+                }
+            }
+            else{
+                while (!conn->closing && this->parse_text(conn)){
+                }
+            }
+            this->flush(conn);
+            this->read_leave(conn);
+            //缓冲区被一个大的set撑大了就还回去
+            if (conn->in_len == conn->in_off && conn->in.size() > 4 * MC_READ_SIZE){
+                std::vector< char >().swap(conn->in);
+                conn->in_len = conn->in_off = 0;
+            }
+        }
+
+        /**
+         * 把攒下的回复用writev发出去，发不完的拷到pending里，之后等可写
+         */
+        void flush(mc_conn_t *conn){
+            mc_output_t &out = this->out;
+            size_t seg = 0, seg_off = 0;
+            if (conn->pending.empty()){
+                struct iovec iov[IOV_MAX];
+                while (seg < out.seg_num()){
+                    int cnt = 0;
+                    size_t total = 0;
+                    for (size_t i = seg; i < out.seg_num() && cnt < IOV_MAX; i++, cnt++){
+                        size_t skip = i == seg ? seg_off : 0;
+                        iov[cnt].iov_base = (void *) (out.seg_data(i) + skip);
+                        iov[cnt].iov_len = out.seg_len(i) - skip;
+                        total += iov[cnt].iov_len;
+                    }
+                    ssize_t n = writev(conn->fd, iov, cnt);
+                    this->stats.writev_num++;
+                    if (n < 0){
+                        if (errno != EAGAIN && errno != EINTR){
+                            conn->closing = true;
+                        }
+                        break;
+                    }
+                    //往后挪n个字节
+                    size_t left = n;
+                    while (left > 0){
+                        size_t avail = out.seg_len(seg) - seg_off;
+                        if (left < avail){
+                            seg_off += left;
+                            break;
+                        }
+                        left -= avail;
+                        seg++;
+                        seg_off = 0;
+                    }
+                    if ((size_t) n < total){
+                        break;
+                    }
+                }
+            }
+            if (!conn->closing){
+                //关闭前最后一批没发完的就不要了
+                for (; seg < out.seg_num(); seg++, seg_off = 0){
+                    conn->pending.append(out.seg_data(seg) + seg_off, out.seg_len(seg) - seg_off);
+                    this->stats.copied_bytes += out.seg_len(seg) - seg_off;
+                }
+            }
+            out.clear();
+        }
+
+        /**
+         * 回复太多时先发一部分，还在读临界区里，引用的value仍然有效
+         */
+        void maybe_flush(mc_conn_t *conn){
+            if (this->out.size() >= MC_FLUSH_BYTES){
+                this->flush(conn);
+            }
+        }
+
+        uint64_t next_cas(){
+            return (++this->cas_seq << 8) | (this->id & 0xff);
+        }
+
+        /**
+         * 把value前面的12字节改成item头再写入，这12字节是已经解析过的请求，key要先拷出来
+         */
+        uint32_t store(mc_conn_t *conn, const char *key, size_t key_len, char *data, uint32_t data_len, uint32_t flags, int64_t exptime, uint64_t &cas){
+            this->read_leave(conn);
+            if (exptime < 0){
+                //已经过期了，相当于删掉
+                this->cache->del(key, key_len);
+                cas = 0;
+                return RINGCACHE_ERRNO_OK;
+            }
+            mc_item_t item;
+            item.flags = flags;
+            item.cas = cas = this->next_cas();
+            char *raw = data - sizeof(mc_item_t);
+            memcpy(raw, &item, sizeof(item));
+            return this->cache->set(key, key_len, raw, data_len + sizeof(mc_item_t), mc_expire(exptime));
+        }
+
+        /**
+         * del()不区分key在不在，先查一下，好回NOT_FOUND；和别的连接同时删同一个key时可能都回删掉了
+         */
+        bool remove(mc_conn_t *conn, const char *key, size_t key_len){
+            this->read_leave(conn);
+            bool found = this->cache->check(key, key_len);
+            this->cache->del(key, key_len);
+            return found;
+        }
+
+        /**
+         * 进入读临界区，之后查到的value在read_leave()之前一直有效
+         */
+        void read_enter(){
+            if (!this->in_read){
+                epoch_domain::instance().enter();
+                this->in_read = true;
+            }
+        }
+
+        /**
+         * 离开读临界区，之前先把引用着环形缓冲区的回复发掉或者拷走
+         */
+        void read_leave(mc_conn_t *conn){
+            if (this->in_read){
+                this->flush(conn);
+                epoch_domain::instance().leave();
+                this->in_read = false;
+            }
+        }
+
+        /**
+         * 读出item，value指向环形缓冲区，在read_leave()之前有效
+         */
+        bool lookup(const char *key, size_t key_len, mc_item_t &item, const char *&value, uint32_t &value_len){
+            this->read_enter();
+            bool found = false;
+            this->cache->visit(key, key_len, [&](const char *v, uint32_t len){
+                if (len >= sizeof(mc_item_t)){
+                    memcpy(&item, v, sizeof(item));
+                    value = v + sizeof(mc_item_t);
+                    value_len = len - sizeof(mc_item_t);
+                    found = true;
+                }
+            });
+            return found;
+        }
+
+        /**
+         * 解析一个文本协议的请求，数据不够时返回false等下次读
+         */
+        bool parse_text(mc_conn_t *conn){
+            char *begin = conn->in.data() + conn->in_off;
+            size_t avail = conn->in_len - conn->in_off;
+            if (conn->swallow > 0){
+                size_t n = std::min(avail, conn->swallow);
+                conn->in_off += n;
+                conn->swallow -= n;
+                return conn->swallow == 0 && n < avail;
+            }
+            char *eol = (char *) memchr(begin, '\n', avail);
+            if (eol == nullptr){
+                if (avail > MC_LINE_MAX){
+                    this->out.append("CLIENT_ERROR line too long\r\n", 28);
+                    conn->closing = true;
+                }
+                return false;
+            }
+            size_t line_len = eol - begin + 1;
+            char *end = eol > begin && eol[-1] == '\r' ? eol - 1 : eol;
+            //按空格切开
+            const char *tokens[24];
+            size_t lens[24];
+            size_t token_num = 0;
+            for (char *p = begin; p < end;){
+                while (p < end && *p == ' '){
+                    p++;
+                }
+                char *q = p;
+                while (q < end && *q != ' '){
+                    q++;
+                }
+                if (q == p){
+                    break;
+                }
+                if (token_num == 24){
+                    //get后面的key太多，先处理这24个，剩下的在下一轮接着处理
+                    break;
+                }
+                tokens[token_num] = p;
+                lens[token_num] = q - p;
+                token_num++;
+                p = q;
+            }
+            this->stats.request_num++;
+            if (token_num == 0){
+                conn->in_off += line_len;
+                this->out.append("ERROR\r\n", 7);
+                return true;
+            }
+            std::string cmd(tokens[0], lens[0]);
+            if (cmd == "get" || cmd == "gets"){
+                return this->text_get(conn, line_len, tokens, lens, token_num, end, cmd == "gets");
+            }
+            if (cmd == "set"){
+                return this->text_set(conn, begin, line_len, tokens, lens, token_num);
+            }
+            conn->in_off += line_len;
+            if (cmd == "delete"){
+                if (token_num < 2 || lens[1] > MC_KEY_MAX){
+                    this->out.append("CLIENT_ERROR bad command line format\r\n", 38);
+                    return true;
+                }
+                bool noreply = token_num > 2 && std::string(tokens[token_num - 1], lens[token_num - 1]) == "noreply";
+                bool found = this->remove(conn, tokens[1], lens[1]);
+                if (!noreply){
+                    if (found){
+                        this->out.append("DELETED\r\n", 9);
+                    }
+                    else{
+                        this->out.append("NOT_FOUND\r\n", 11);
+                    }
+                }
+                return true;
+            }
+            if (cmd == "version"){
+                this->out.append("VERSION " MC_VERSION "\r\n");
+                return true;
+            }
+            if (cmd == "quit"){
+                conn->closing = true;
+                return false;
+            }
+            this->out.append("ERROR\r\n", 7);
+            return true;
+        }
+
+        /**
+         * get/gets key1 key2 ...，key超过24个时先回这一部分，剩下的key改写成一个新的get命令留到下一轮
+         */
+        bool text_get(mc_conn_t *conn, size_t line_len, const char **tokens, size_t *lens, size_t token_num, char *end, bool with_cas){
+            for (size_t i = 1; i < token_num; i++){
+                if (lens[i] > MC_KEY_MAX){
+                    this->out.append("CLIENT_ERROR bad command line format\r\n", 38);
+                    conn->in_off += line_len;
+                    return true;
+                }
+            }
+            char header[64 + MC_KEY_MAX];
+            for (size_t i = 1; i < token_num; i++){
+                mc_item_t item;
+                const char *value = nullptr;
+                uint32_t value_len = 0;
+                if (!this->lookup(tokens[i], lens[i], item, value, value_len)){
+                    continue;
+                }
+                int n = 0;
+                if (with_cas){
+                    n = snprintf(header, sizeof(header), "VALUE %.*s %u %u %llu\r\n", (int) lens[i], tokens[i], item.flags, value_len,
+                                 (unsigned long long) item.cas);
+                }
+                else{
+                    n = snprintf(header, sizeof(header), "VALUE %.*s %u %u\r\n", (int) lens[i], tokens[i], item.flags, value_len);
+                }
+                this->out.append(header, n);
+                this->out.reference(value, value_len);
+                this->out.append("\r\n", 2);
+                this->maybe_flush(conn);
+            }
+            const char *rest = tokens[token_num - 1] + lens[token_num - 1];
+            while (rest < end && *rest == ' '){
+                rest++;
+            }
+            if (rest < end){
+                //把"get "/"gets "挪到剩下的key前面，这一行的其余部分下一轮再解析
+                size_t cmd_len = with_cas ? 5 : 4;
+                char *p = (char *) rest - cmd_len;
+                memcpy(p, with_cas ? "gets " : "get ", cmd_len);
+                conn->in_off = p - conn->in.data();
+                return true;
+            }
+            this->out.append("END\r\n", 5);
+            conn->in_off += line_len;
+            return true;
+        }
+
+        /**
+         * 把一个token整个按十进制解析，后面有多余的字符、溢出、不在[min, max]里都返回false
+         */
+        static bool parse_number(const char *token, size_t len, int64_t min, int64_t max, int64_t &val){
+            char *p = nullptr;
+            errno = 0;
+            val = strtoll(token, &p, 10);
+            return len > 0 && p == token + len && errno == 0 && val >= min && val <= max;
+        }
+
+        /**
+         * set key flags exptime bytes [noreply]\r\n<data>\r\n
+         * flags、exptime、bytes有一个不是完整的数字就和memcached一样回CLIENT_ERROR，不当成0
+         */
+        bool text_set(mc_conn_t *conn, char *begin, size_t line_len, const char **tokens, size_t *lens, size_t token_num){
+            if (token_num < 5 || lens[1] > MC_KEY_MAX){
+                conn->in_off += line_len;
+                this->out.append("CLIENT_ERROR bad command line format\r\n", 38);
+                return true;
+            }
+            int64_t flags = 0, exptime = 0, bytes = 0;
+            bool noreply = token_num > 5 && std::string(tokens[5], lens[5]) == "noreply";
+            if (!parse_number(tokens[2], lens[2], 0, UINT32_MAX, flags) || !parse_number(tokens[3], lens[3], INT64_MIN, INT64_MAX, exptime)
+                || !parse_number(tokens[4], lens[4], 0, INT_MAX, bytes)){
+                conn->in_off += line_len;
+                this->out.append("CLIENT_ERROR bad command line format\r\n", 38);
+                return true;
+            }
+            if ((uint64_t) bytes + sizeof(mc_item_t) >= MAX_VALUE_SIZE){
+                conn->in_off += line_len;
+                conn->swallow = bytes + 2;
+                this->out.append("SERVER_ERROR object too large for cache\r\n", 41);
+                return true;
+            }
+            size_t need = line_len + bytes + 2;
+            if (conn->in_len - conn->in_off < need){
+                //数据还没收全，缓冲区不够大时下次读之前先扩好
+                if (conn->in.size() < conn->in_off + need){
+                    conn->in.resize(conn->in_off + need);
+                }
+                return false;
+            }
+            char *data = begin + line_len;
+            conn->in_off += need;
+            if (data[bytes] != '\r' || data[bytes + 1] != '\n'){
+                this->out.append("CLIENT_ERROR bad data chunk\r\n", 29);
+                return true;
+            }
+            char key[MC_KEY_MAX];
+            size_t key_len = lens[1];
+            memcpy(key, tokens[1], key_len);
+            uint64_t cas = 0;
+            uint32_t ret = this->store(conn, key, key_len, data, bytes, (uint32_t) flags, exptime, cas);
+            if (noreply){
+                return true;
+            }
+            if (ret == RINGCACHE_ERRNO_OK){
+                this->out.append("STORED\r\n", 8);
+            }
+            else if (ret == RINGCACHE_ERRNO_VALUE_TOO_LONG){
+                this->out.append("SERVER_ERROR object too large for cache\r\n", 41);
+            }
+            else{
+                this->out.append("SERVER_ERROR out of memory storing object\r\n", 43);
+            }
+            return true;
+        }
+
+        void bin_response(const mc_bin_header_t &req, uint16_t status, uint8_t extras_len, uint16_t key_len, uint32_t body_len, uint64_t cas){
+            mc_bin_header_t res;
+            res.magic = MC_BIN_RESPONSE;
+            res.opcode = req.opcode;
+            res.key_len = htons(key_len);
+            res.extras_len = extras_len;
+            res.data_type = 0;
+            res.status = htons(status);
+            res.body_len = htonl(body_len);
+            res.opaque = req.opaque;
+            res.cas = mc_htonll(cas);
+            this->out.append((const char *) &res, sizeof(res));
+        }
+
+        void bin_error(const mc_bin_header_t &req, uint16_t status){
+            static const char *msgs[] = {"Not found", "Too large", "Invalid arguments", "Not stored", "Unknown command", "Out of memory"};
+            const char *msg = status == MC_STATUS_NOT_FOUND ? msgs[0] : status == MC_STATUS_TOO_LARGE ? msgs[1] :
+                              status == MC_STATUS_INVALID ? msgs[2] : status == MC_STATUS_NOT_STORED ? msgs[3] :
+                              status == MC_STATUS_UNKNOWN ? msgs[4] : msgs[5];
+            this->bin_response(req, status, 0, 0, strlen(msg), 0);
+            this->out.append(msg, strlen(msg));
+        }
+
+        /**
+         * 解析一个二进制协议的请求
+         */
+        bool parse_binary(mc_conn_t *conn){
+            char *begin = conn->in.data() + conn->in_off;
+            size_t avail = conn->in_len - conn->in_off;
+            if (avail < sizeof(mc_bin_header_t)){
+                return false;
+            }
+            mc_bin_header_t req;
+            memcpy(&req, begin, sizeof(req));
+            uint16_t key_len = ntohs(req.key_len);
+            uint32_t body_len = ntohl(req.body_len);
+            if (req.magic != MC_BIN_REQUEST || body_len > MAX_VALUE_SIZE + MC_KEY_MAX + 64 || key_len + req.extras_len > body_len){
+                conn->closing = true;
+                return false;
+            }
+            size_t need = sizeof(mc_bin_header_t) + body_len;
+            if (avail < need){
+                if (conn->in.size() < conn->in_off + need){
+                    conn->in.resize(conn->in_off + need);
+                }
+                return false;
+            }
+            conn->in_off += need;
+            this->stats.request_num++;
+            char *extras = begin + sizeof(mc_bin_header_t);
+            char *key = extras + req.extras_len;
+            char *value = key + key_len;
+            uint32_t value_len = body_len - req.extras_len - key_len;
+            uint8_t op = req.opcode;
+            bool quiet = op == MC_OP_GETQ || op == MC_OP_GETKQ || op == MC_OP_SETQ || op == MC_OP_DELETEQ || op == MC_OP_QUITQ;
+            if (op == MC_OP_GET || op == MC_OP_GETQ || op == MC_OP_GETK || op == MC_OP_GETKQ){
+                bool with_key = op == MC_OP_GETK || op == MC_OP_GETKQ;
+                if (key_len == 0 || key_len > MC_KEY_MAX){
+                    this->bin_error(req, MC_STATUS_INVALID);
+                    return true;
+                }
+                mc_item_t item;
+                const char *data = nullptr;
+                uint32_t data_len = 0;
+                if (!this->lookup(key, key_len, item, data, data_len)){
+                    if (!quiet){
+                        if (with_key){
+                            this->bin_response(req, MC_STATUS_NOT_FOUND, 0, key_len, key_len, 0);
+                            this->out.append(key, key_len);
+                        }
+                        else{
+                            this->bin_error(req, MC_STATUS_NOT_FOUND);
+                        }
+                    }
+                    return true;
+                }
+                uint16_t res_key_len = with_key ? key_len : 0;
+                this->bin_response(req, MC_STATUS_OK, 4, res_key_len, 4 + res_key_len + data_len, item.cas);
+                uint32_t flags = htonl(item.flags);
+                this->out.append((const char *) &flags, 4);
+                if (with_key){
+                    this->out.append(key, key_len);
+                }
+                this->out.reference(data, data_len);
+                this->maybe_flush(conn);
+                return true;
+            }
+            if (op == MC_OP_SET || op == MC_OP_SETQ){
+                //不支持按cas比较后再写，请求里的cas忽略
+                if (req.extras_len != 8 || key_len == 0 || key_len > MC_KEY_MAX){
+                    this->bin_error(req, MC_STATUS_INVALID);
+                    return true;
+                }
+                if ((uint64_t) value_len + sizeof(mc_item_t) >= MAX_VALUE_SIZE){
+                    this->bin_error(req, MC_STATUS_TOO_LARGE);
+                    return true;
+                }
+                uint32_t flags = 0, exptime = 0;
+                memcpy(&flags, extras, 4);
+                memcpy(&exptime, extras + 4, 4);
+                char key_buf[MC_KEY_MAX];
+                memcpy(key_buf, key, key_len);
+                uint64_t cas = 0;
+                uint32_t ret = this->store(conn, key_buf, key_len, value, value_len, ntohl(flags), (int32_t) ntohl(exptime), cas);
+                if (ret == RINGCACHE_ERRNO_OK){
+                    if (!quiet){
+                        this->bin_response(req, MC_STATUS_OK, 0, 0, 0, cas);
+                    }
+                }
+                else{
+                    this->bin_error(req, ret == RINGCACHE_ERRNO_VALUE_TOO_LONG ? MC_STATUS_TOO_LARGE : MC_STATUS_NO_MEMORY);
+                }
+                return true;
+            }
+            if (op == MC_OP_DELETE || op == MC_OP_DELETEQ){
+                if (key_len == 0 || key_len > MC_KEY_MAX){
+                    this->bin_error(req, MC_STATUS_INVALID);
+                    return true;
+                }
+                if (this->remove(conn, key, key_len)){
+                    if (!quiet){
+                        this->bin_response(req, MC_STATUS_OK, 0, 0, 0, 0);
+                    }
+                }
+                else{
+                    this->bin_error(req, MC_STATUS_NOT_FOUND);
+                }
+                return true;
+            }
+            if (op == MC_OP_NOOP){
+                this->bin_response(req, MC_STATUS_OK, 0, 0, 0, 0);
+                return true;
+            }
+            if (op == MC_OP_VERSION){
+                this->bin_response(req, MC_STATUS_OK, 0, 0, strlen(MC_VERSION), 0);
+                this->out.append(MC_VERSION, strlen(MC_VERSION));
+                return true;
+            }
+            if (op == MC_OP_QUIT || op == MC_OP_QUITQ){
+                if (!quiet){
+                    this->bin_response(req, MC_STATUS_OK, 0, 0, 0, 0);
+                }
+                conn->closing = true;
+                return false;
+            }
+            this->bin_error(req, MC_STATUS_UNKNOWN);
+            return true;
+        }
+
+        ringcache *cache;
+        uint32_t id;
+        int epfd;
+        int listen_fd;
+        uint64_t cas_seq;
+        bool in_read;
+        std::thread *thread;
+        std::unordered_map< int, mc_conn_t * > conns;
+        mc_output_t out;
+    };
+
+    /**
+     * 服务：threads个reactor共用一个ringcache
+     */
+    class mc_server{
+    public:
+        mc_server(ringcache *cache, uint32_t threads) : cache(cache), is_stop(false){
+            for (uint32_t i = 0; i < std::max(threads, 1u); i++){
+                this->reactors.push_back(new mc_reactor(cache, i));
+            }
+        }
+
+        ~mc_server(){
+            this->stop();
+            for (auto it:this->reactors){
+                delete it;
+            }
+        }
+
+        bool start(const char *host, uint16_t port){
+            for (auto it:this->reactors){
+                if (!it->listen(host, port)){
+                    return false;
+                }
+            }
+            for (auto it:this->reactors){
+                it->start(&this->is_stop);
+            }
+            return true;
+        }
+
+        void stop(){
+            this->is_stop = true;
+            for (auto it:this->reactors){
+                it->join();
+            }
+        }
+
+        /**
+         * 各个reactor的计数加在一起
+         */
+        void get_stats(uint64_t &conn_num, uint64_t &request_num, uint64_t &writev_num, uint64_t &copied_bytes){
+            conn_num = request_num = writev_num = copied_bytes = 0;
+            for (auto it:this->reactors){
+                conn_num += it->stats.conn_num.load(std::memory_order_relaxed);
+                request_num += it->stats.request_num.load(std::memory_order_relaxed);
+                writev_num += it->stats.writev_num.load(std::memory_order_relaxed);
+                copied_bytes += it->stats.copied_bytes.load(std::memory_order_relaxed);
+            }
+        }
+
+    private:
+        mc_server(const mc_server &);
+        mc_server &operator=(const mc_server &);
+
+        ringcache *cache;
+        std::vector< mc_reactor * > reactors;
+        std::atomic< bool > is_stop;
+    };
+}
+#endif //_RINGCACHE_MC_SERVER_H_202610261030_
@@ -0,0 +1,84 @@
+/*************************************************************************
+ * File:	ringcache_server.cpp
+ * Author:	liuyongshuai<liuyongshuai@hotmail.com>
+ * Time:	2026-10-26 14:10
+ * 独立的缓存服务：一个ringcache，用memcached的文本及二进制协议对外提供，多个进程可以共用同一份热数据。
+ * 用法：./ringcache_server [--name=value ...]，--help看所有参数；收到SIGINT/SIGTERM后退出
+ ************************************************************************/
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include "server/mc_server.h"
+
+static volatile sig_atomic_t is_stop = 0;
+
+static void on_signal(int){
+    is_stop = 1;
+}
+
+static void usage(const char *prog){
+    printf("usage: %s [--name=value ...]\n"
+           "  --host=0.0.0.0         address to listen on\n"
+           "  --port=11211           port to listen on\n"
+           "  --threads=0            reactor threads, 0 is one per cpu\n"
+           "  --cache_mb=1024        cache size in MB\n"
+           "  --stats=0              print server and cache counters every N seconds, 0 is never\n", prog);
+}
+
+int main(int argc, char **argv){
+    std::string host = "0.0.0.0";
+    uint32_t port = 11211, threads = 0, stats_interval = 0;
+    uint64_t cache_mb = 1024;
+    for (int i = 1; i < argc; i++){
+        std::string arg = argv[i];
+        size_t eq = arg.find('=');
+        if (arg.compare(0, 2, "--") != 0 || eq == std::string::npos){
+            usage(argv[0]);
+            return 1;
+        }
+        std::string name = arg.substr(2, eq - 2), value = arg.substr(eq + 1);
+        if (name == "host") host = value;
+        else if (name == "port") port = atoi(value.c_str());
+        else if (name == "threads") threads = atoi(value.c_str());
+        else if (name == "cache_mb") cache_mb = atoll(value.c_str());
+        else if (name == "stats") stats_interval = atoi(value.c_str());
+        else{
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (threads == 0){
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    //对方断开后再写不要被SIGPIPE杀掉，writev返回EPIPE就关连接
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+
+    ringcache::ringcache *cache = new ringcache::ringcache(cache_mb);
+    ringcache::mc_server *server = new ringcache::mc_server(cache, threads);
+    if (!server->start(host.c_str(), port)){
+        perror("listen");
+        delete server;
+        delete cache;
+        return 1;
+    }
+    std::cout << "[ringcache_server]listening on " << host << ":" << port << " threads=" << threads << " cache_mb=" << cache_mb << std::endl;
+    uint32_t tick = 0;
+    while (!is_stop){
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+        if (stats_interval > 0 && ++tick % stats_interval == 0){
+            uint64_t conn_num, request_num, writev_num, copied_bytes;
+            server->get_stats(conn_num, request_num, writev_num, copied_bytes);
+            ringcache::stats_t stats = cache->get_stats();
+            std::cout << "[ringcache_server]conn_num=" << conn_num << " request_num=" << request_num << " writev_num=" << writev_num
+                      << " copied_bytes=" << copied_bytes << " items=" << stats.item_num() << " hit_ratio=" << stats.hit_rate() << std::endl;
+        }
+    }
+    std::cout << "[ringcache_server]stopping" << std::endl;
+    server->stop();
+    delete server;
+    delete cache;
+    return 0;
+}
@@ -9,10 +9,898 @@
 #include<string.h>
 #include<stdio.h>
 #include<stdint.h>
+#include<time.h>
 
 //目前划分为2个缓冲区
 #define RING_BUFFER_NUM 2
 #include "ringcache/ringcache.h"
+#include "ringcache/sharded.h"
+#include "ringcache/per_core.h"
+#include "server/mc_server.h"
+#include "ringcache/shm.h"
+#include <sys/wait.h>
+#include <poll.h>
+
+//统计本线程申请内存的次数，用来确认读写的热路径上没有申请内存
+static thread_local uint64_t alloc_num = 0;
+
+void *operator new(size_t size){
+    alloc_num++;
+    void *ptr = malloc(size);
+    if (ptr == nullptr){
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void operator delete(void *ptr) noexcept{
+    free(ptr);
+}
+
+//有检查没通过时main返回非0
+static bool test_failed = false;
+
+static void expect(bool ok, const std::string &what){
+    if (!ok){
+        std::cout << "FAILED: " << what << std::endl;
+        test_failed = true;
+    }
+}
+
+/**
+ * 扩容测试：几个线程写入的数据量超过索引的扩容阈值，其中一部分删掉、一部分改写，
+ * 同时几个读线程一直从头到尾读所有key，迁移中、释放旧表时读到的value都要是对的，
+ * 已经写完、没有删掉的key也不能读不到（bucket_index整组满了挤掉的除外）。
+ * 写完后每个key都要是最终的状态，并且确实扩过容。默认的链表索引和RINGCACHE_BUCKET_INDEX（test_bucket_index）都跑
+ */
+#define RESIZE_TEST_KEY_NUM 160000
+#define RESIZE_TEST_WRITERS 3
+#define RESIZE_TEST_READERS 2
+
+static std::string resize_test_key(uint32_t i){
+    return "resize_key_" + std::to_string(i);
+}
+
+static bool resize_test(){
+    ringcache::ringcache *cache = new ringcache::ringcache(32);
+    std::atomic< bool > is_stop(false);
+    std::atomic< uint64_t > bad_num(0), hit_num(0);
+    //每个写线程下一个要写的key，之前的都已经写完了
+    std::atomic< uint32_t > progress[RESIZE_TEST_WRITERS];
+    //读线程没读到的、应该在的key，最后不在被挤掉的之列就是查找漏掉了
+    std::vector< uint32_t > missed[RESIZE_TEST_READERS];
+    std::vector< std::thread > writers, readers;
+    for (uint32_t t = 0; t < RESIZE_TEST_WRITERS; t++){
+        progress[t] = t;
+    }
+    for (uint32_t t = 0; t < RESIZE_TEST_WRITERS; t++){
+        writers.emplace_back([&, t](){
+            for (uint32_t i = t; i < RESIZE_TEST_KEY_NUM; i += RESIZE_TEST_WRITERS){
+                std::string key = resize_test_key(i);
+                cache->set(key, "v" + std::to_string(i), 0);
+                //i%5==0的删掉，i%5==1的改写
+                if (i % 5 == 0){
+                    cache->del(key);
+                }
+                else if (i % 5 == 1){
+                    cache->set(key, "w" + std::to_string(i), 0);
+                }
+                progress[t].store(i + RESIZE_TEST_WRITERS, std::memory_order_release);
+            }
+        });
+    }
+    for (uint32_t t = 0; t < RESIZE_TEST_READERS; t++){
+        readers.emplace_back([&, t](){
+            std::string val;
+            while (!is_stop){
+                for (uint32_t i = 0; i < RESIZE_TEST_KEY_NUM; i++){
+                    bool written = i < progress[i % RESIZE_TEST_WRITERS].load(std::memory_order_acquire);
+                    if (cache->get(resize_test_key(i), val) != RINGCACHE_ERRNO_OK){
+                        if (written && i % 5 != 0){
+                            missed[t].push_back(i);
+                        }
+                        continue;
+                    }
+                    hit_num++;
+                    if (val != "v" + std::to_string(i) && (i % 5 != 1 || val != "w" + std::to_string(i))){
+                        bad_num++;
+                    }
+                }
+            }
+        });
+    }
+    for (auto &it:writers){
+        it.join();
+    }
+    //写完后扩容可能还没迁移完、旧表也可能还没释放完，接着用del推进，读线程继续读
+    for (uint32_t n = 0; n < RESIZE_TEST_KEY_NUM; n++){
+        cache->del(resize_test_key(RESIZE_TEST_KEY_NUM + n));
+    }
+    is_stop = true;
+    for (auto &it:readers){
+        it.join();
+    }
+
+    //每个key的最终状态，bucket_index整组满了会挤掉数据，找不到的个数要正好是index_drop_num
+    std::string val;
+    uint64_t wrong_num = 0, lost_num = 0, miss_num = 0;
+    for (uint32_t t = 0; t < RESIZE_TEST_READERS; t++){
+        for (auto i:missed[t]){
+            miss_num += cache->get(resize_test_key(i), val) != RINGCACHE_ERRNO_NOT_FOUND;
+        }
+    }
+    for (uint32_t i = 0; i < RESIZE_TEST_KEY_NUM; i++){
+        uint32_t ret = cache->get(resize_test_key(i), val);
+        if (i % 5 == 0){
+            wrong_num += ret != RINGCACHE_ERRNO_NOT_FOUND;
+        }
+        else if (ret == RINGCACHE_ERRNO_NOT_FOUND){
+            lost_num++;
+        }
+        else{
+            wrong_num += ret != RINGCACHE_ERRNO_OK || val != (i % 5 == 1 ? "w" : "v") + std::to_string(i);
+        }
+    }
+    ringcache::stats_t stats = cache->get_stats();
+    std::cout << "resize test: resize_num=" << stats.index_resize_num << "\tindex_item_num=" << stats.index_item_num << "\tcapacity=" << stats.index_capacity
+              << "\tdrop=" << stats.index_drop_num << "\thit=" << hit_num << "\tbad=" << bad_num << "\tmiss=" << miss_num << "\twrong=" << wrong_num << "\tlost=" << lost_num << std::endl;
+    bool ok = bad_num == 0 && miss_num == 0 && wrong_num == 0 && lost_num == stats.index_drop_num && stats.index_resize_num > 0
+              && stats.index_item_num + lost_num == RESIZE_TEST_KEY_NUM / 5 * 4;
+    delete cache;
+    return ok;
+}
+
+/**
+ * 并发写测试：几个线程同时写同一批key，写入量是缓存的好几倍，buffer反复绕圈淘汰，同时几个读线程校验读到的value。
+ * value由key和长度决定内容，写了一半、被覆盖了一半的数据都能查出来。最后每个能读到的key都要是完整的，
+ * 索引里的个数要正好等于能读到的个数。RINGCACHE_ATOMIC_RESERVE（test_atomic_reserve）下写入不拿buffer锁，主要测它
+ */
+#define WRITE_TEST_KEY_NUM 20000
+#define WRITE_TEST_WRITERS 4
+#define WRITE_TEST_READERS 2
+#define WRITE_TEST_ROUNDS 5
+
+static std::string write_test_value(const std::string &key, uint32_t writer, uint32_t len){
+    return key + ":" + std::to_string(writer) + ":" + std::string(len, (char) ('a' + len % 26));
+}
+
+static bool write_test_check(const std::string &key, const std::string &val){
+    if (val.compare(0, key.length() + 1, key + ":") != 0){
+        return false;
+    }
+    size_t pos = val.find(':', key.length() + 1);
+    if (pos == std::string::npos){
+        return false;
+    }
+    size_t len = val.length() - pos - 1;
+    return len > 0 && val.find_first_not_of((char) ('a' + len % 26), pos + 1) == std::string::npos;
+}
+
+static bool write_test(){
+    ringcache::ringcache *cache = new ringcache::ringcache(16);
+    std::atomic< bool > is_stop(false);
+    std::atomic< uint64_t > bad_num(0), fail_num(0);
+    std::vector< std::thread > writers, readers;
+    for (uint32_t t = 0; t < WRITE_TEST_WRITERS; t++){
+        writers.emplace_back([&, t](){
+            uint32_t seed = t + 1;
+            for (uint32_t r = 0; r < WRITE_TEST_ROUNDS; r++){
+                for (uint32_t i = 0; i < WRITE_TEST_KEY_NUM; i++){
+                    seed = seed * 1103515245 + 12345;
+                    std::string key = "write_key_" + std::to_string((i + t * 997) % WRITE_TEST_KEY_NUM);
+                    fail_num += cache->set(key, write_test_value(key, t, 100 + (seed >> 16) % 1500), 0) != RINGCACHE_ERRNO_OK;
+                }
+            }
+        });
+    }
+    for (uint32_t t = 0; t < WRITE_TEST_READERS; t++){
+        readers.emplace_back([&](){
+            std::string val;
+            while (!is_stop){
+                for (uint32_t i = 0; i < WRITE_TEST_KEY_NUM; i++){
+                    std::string key = "write_key_" + std::to_string(i);
+                    if (cache->get(key, val) == RINGCACHE_ERRNO_OK && !write_test_check(key, val)){
+                        bad_num++;
+                    }
+                }
+            }
+        });
+    }
+    for (auto &it:writers){
+        it.join();
+    }
+    is_stop = true;
+    for (auto &it:readers){
+        it.join();
+    }
+
+    std::string val;
+    uint64_t found_num = 0;
+    for (uint32_t i = 0; i < WRITE_TEST_KEY_NUM; i++){
+        std::string key = "write_key_" + std::to_string(i);
+        if (cache->get(key, val) == RINGCACHE_ERRNO_OK){
+            found_num++;
+            bad_num += !write_test_check(key, val);
+        }
+    }
+    ringcache::stats_t stats = cache->get_stats();
+    uint64_t evict_num = 0;
+    for (auto &bs:stats.buffer_stats){
+        evict_num += bs.evict_num;
+    }
+#ifdef RINGCACHE_ATOMIC_RESERVE
+    //一个entry不能超过一段
+    bool too_long_ok = cache->set("write_too_long", std::string(stats.buffer_stats[0].cache_byte_size / RING_SEGMENT_NUM, 'x'), 0) == RINGCACHE_ERRNO_VALUE_TOO_LONG;
+#else
+    bool too_long_ok = true;
+#endif
+    std::cout << "write test: found=" << found_num << "\tindex_item_num=" << stats.index_item_num << "\tevict=" << evict_num
+              << "\tbad=" << bad_num << "\tfail=" << fail_num << std::endl;
+    bool ok = bad_num == 0 && fail_num == 0 && found_num == stats.index_item_num && evict_num > 0 && too_long_ok;
+    delete cache;
+    return ok;
+}
+
+/**
+ * 大小分档测试：1KB以内和以上各一档，各占一个buffer。写入、删除、换档改写后每档的live_num要对得上，
+ * 之后大value写入量是它那一档的好几倍，只在大的那一档里淘汰，小数据一个都不能丢
+ */
+#define CLASS_TEST_SMALL_NUM 100
+#define CLASS_TEST_LARGE_NUM 6000
+
+static bool size_class_test(){
+    std::vector< ringcache::size_class_t > classes = {{0, 50}, {1 * KB, 50}};
+    ringcache::ringcache *cache = new ringcache::ringcache(16, classes);
+    bool ok = true;
+    for (uint32_t i = 0; i < CLASS_TEST_SMALL_NUM; i++){
+        ok &= cache->set("small" + std::to_string(i), std::string(100, 's'), 0) == RINGCACHE_ERRNO_OK;
+    }
+    for (uint32_t i = 0; i < 20; i++){
+        ok &= cache->set("large" + std::to_string(i), std::string(4 * KB, 'l'), 0) == RINGCACHE_ERRNO_OK;
+    }
+    ringcache::stats_t stats = cache->get_stats();
+    //max_size为0的是兜底的一档，排在后面
+    ok &= stats.class_stats.size() == 2 && stats.class_stats[0].max_size == 1 * KB && stats.class_stats[1].max_size == UINT32_MAX;
+    ok &= stats.class_stats[0].live_num == CLASS_TEST_SMALL_NUM && stats.class_stats[1].live_num == 20;
+    ok &= stats.class_stats[0].set_num == CLASS_TEST_SMALL_NUM && stats.class_stats[1].set_num == 20;
+
+    //删掉10个小的，一个小的改写成大value换到另一档
+    for (uint32_t i = 0; i < 10; i++){
+        cache->del("small" + std::to_string(i));
+    }
+    cache->set("small10", std::string(2 * KB, 'l'), 0);
+    stats = cache->get_stats();
+    ok &= stats.class_stats[0].live_num == CLASS_TEST_SMALL_NUM - 11 && stats.class_stats[1].live_num == 21;
+
+    std::string val;
+    for (uint32_t i = 0; i < CLASS_TEST_LARGE_NUM; i++){
+        cache->set("flood" + std::to_string(i), std::string(4 * KB, 'f'), 0);
+    }
+    uint32_t small_found = 0;
+    for (uint32_t i = 11; i < CLASS_TEST_SMALL_NUM; i++){
+        small_found += cache->get("small" + std::to_string(i), val) == RINGCACHE_ERRNO_OK && val == std::string(100, 's');
+    }
+    stats = cache->get_stats();
+    std::cout << "size class test: small_found=" << small_found << "\tsmall_live=" << stats.class_stats[0].live_num << "\tsmall_evict=" << stats.class_stats[0].evict_num
+              << "\tlarge_live=" << stats.class_stats[1].live_num << "\tlarge_evict=" << stats.class_stats[1].evict_num << std::endl;
+    ok &= small_found == CLASS_TEST_SMALL_NUM - 11 && stats.class_stats[0].evict_num == 0 && stats.class_stats[1].evict_num > 0;
+    ok &= stats.class_stats[0].live_num == CLASS_TEST_SMALL_NUM - 11 && stats.class_stats[1].live_num < CLASS_TEST_LARGE_NUM;
+    ok &= stats.class_stats[0].live_num + stats.class_stats[1].live_num == stats.index_item_num;
+    delete cache;
+    return ok;
+}
+
+/**
+ * 压缩测试：压得动的、压不动的、太短不压的value，各种读法读出来都要和写入的一样，压缩计数要对得上
+ */
+static bool codec_test(){
+    ringcache::basic_ringcache< ringcache::jenkins_hasher, ringcache::zlib_codec > *cache =
+            new ringcache::basic_ringcache< ringcache::jenkins_hasher, ringcache::zlib_codec >(16);
+    std::string text;
+    while (text.size() < 4 * KB){
+        text.append("{\"id\":" + std::to_string(text.size()) + ",\"name\":\"ringcache\",\"tags\":[\"a\",\"b\"]},");
+    }
+    std::string noise(4 * KB, 0);
+    uint32_t seed = 12345;
+    for (auto &c:noise){
+        seed = seed * 1103515245 + 12345;
+        c = (char) (seed >> 16);
+    }
+    std::string tiny(100, 't');
+    bool ok = true;
+    ok &= cache->set("text", text, 0) == RINGCACHE_ERRNO_OK;
+    ok &= cache->set("noise", noise, 0) == RINGCACHE_ERRNO_OK;
+    ok &= cache->set("tiny", tiny, 0) == RINGCACHE_ERRNO_OK;
+    ringcache::stats_t stats = cache->get_stats();
+    ok &= stats.compress_num == 1 && stats.compress_skip_num == 1 && stats.compress_raw_bytes == text.size() && stats.compress_out_bytes < text.size() / 2;
+
+    std::string val;
+    std::vector< std::string > names = {"text", "noise", "tiny"};
+    std::vector< std::string > values = {text, noise, tiny};
+    for (size_t i = 0; i < names.size(); i++){
+        ok &= cache->get(names[i], val) == RINGCACHE_ERRNO_OK && val == values[i];
+        std::string visited;
+        cache->visit(names[i], [&](const char *v, uint32_t len){
+            visited.assign(v, len);
+        });
+        ok &= visited == values[i];
+        //value_len是解压后的长度，buf不够时也是
+        std::vector< char > buf(values[i].size());
+        uint32_t len = 0;
+        ok &= cache->get_into(names[i], buf.data(), buf.size(), len) == RINGCACHE_ERRNO_OK && std::string(buf.data(), len) == values[i];
+        ok &= cache->get_into(names[i], buf.data(), buf.size() - 1, len) == RINGCACHE_ERRNO_BUFFER_TOO_SMALL && len == values[i].size();
+    }
+    std::vector< uint32_t > rets;
+    std::vector< std::string > batch_keys = {"text2", "noise2"};
+    std::vector< std::string > batch_values = {text, noise};
+    ok &= cache->multi_set(batch_keys, batch_values, 0, rets) == 2;
+    names.insert(names.end(), batch_keys.begin(), batch_keys.end());
+    ok &= cache->multi_get(names, values, rets) == names.size();
+    ok &= values.size() == 5 && values[0] == text && values[1] == noise && values[2] == tiny && values[3] == text && values[4] == noise;
+    stats = cache->get_stats();
+    std::cout << "codec test: compress=" << stats.compress_num << "\tskip=" << stats.compress_skip_num << "\traw=" << stats.compress_raw_bytes
+              << "\tout=" << stats.compress_out_bytes << "\tdecompress=" << stats.decompress_num << std::endl;
+    ok &= stats.compress_num == 2 && stats.compress_skip_num == 2 && stats.decompress_num > 0;
+    delete cache;
+    return ok;
+}
+
+/**
+ * 录制测试：几个线程同时读写时录下来的条数和每种操作的个数都要对得上；
+ * 单线程录一段set/get/del，按文件里的顺序用由hash和长度构造的key在新实例上重放，每次get的结果和读到的长度都要和录制时一样
+ */
+#define TRACE_TEST_PATH "/tmp/ringcache_test.trace"
+#define TRACE_TEST_THREADS 3
+#define TRACE_TEST_OPS 5000
+
+static bool trace_test_load(std::vector< ringcache::trace_record_t > &records){
+    FILE *fp = fopen(TRACE_TEST_PATH, "rb");
+    if (fp == nullptr){
+        return false;
+    }
+    ringcache::trace_header_t header;
+    bool ok = fread(&header, sizeof(header), 1, fp) == 1 && header.magic == TRACE_MAGIC && header.version == TRACE_VERSION
+              && header.record_size == sizeof(ringcache::trace_record_t);
+    ringcache::trace_chunk_header_t chunk;
+    while (ok && fread(&chunk, sizeof(chunk), 1, fp) == 1){
+        size_t old = records.size();
+        records.resize(old + chunk.num);
+        ok = chunk.num > 0 && fread(&records[old], sizeof(ringcache::trace_record_t), chunk.num, fp) == chunk.num;
+    }
+    fclose(fp);
+    return ok;
+}
+
+static bool trace_test(){
+    ringcache::ringcache *cache = new ringcache::ringcache(16);
+    bool ok = cache->start_trace(TRACE_TEST_PATH) == RINGCACHE_ERRNO_OK;
+    //已经在录制时不能再开始
+    ok &= cache->start_trace(TRACE_TEST_PATH) == RINGCACHE_ERRNO_TRACE_IO;
+    std::vector< std::thread > threads;
+    for (uint32_t t = 0; t < TRACE_TEST_THREADS; t++){
+        threads.emplace_back([&, t](){
+            std::string val;
+            for (uint32_t i = 0; i < TRACE_TEST_OPS; i++){
+                std::string key = "trace_mt_" + std::to_string(t) + "_" + std::to_string(i % 500);
+                if (i % 4 == 0){
+                    cache->set(key, "value", 0);
+                }
+                else if (i % 4 == 3){
+                    cache->del(key);
+                }
+                else{
+                    cache->get(key, val);
+                }
+            }
+        });
+    }
+    for (auto &it:threads){
+        it.join();
+    }
+    uint64_t recorded = cache->stop_trace();
+    std::vector< ringcache::trace_record_t > records;
+    ok &= trace_test_load(records);
+    uint64_t op_num[4] = {0, 0, 0, 0};
+    for (auto &r:records){
+        op_num[r.op < 4 ? r.op : 0]++;
+    }
+    ok &= recorded == TRACE_TEST_THREADS * TRACE_TEST_OPS && records.size() == recorded;
+    ok &= op_num[ringcache::TRACE_OP_SET] == TRACE_TEST_THREADS * TRACE_TEST_OPS / 4 && op_num[ringcache::TRACE_OP_DEL] == TRACE_TEST_THREADS * TRACE_TEST_OPS / 4
+          && op_num[ringcache::TRACE_OP_GET] == TRACE_TEST_THREADS * TRACE_TEST_OPS / 2 && op_num[0] == 0;
+    delete cache;
+
+    //单线程录一段，文件里就是操作的顺序
+    cache = new ringcache::ringcache(16);
+    ok &= cache->start_trace(TRACE_TEST_PATH) == RINGCACHE_ERRNO_OK;
+    std::string val;
+    uint64_t hit_num = 0;
+    for (uint32_t i = 0; i < 200; i++){
+        cache->set("trace_key_" + std::to_string(i), std::string(10 + i, 'v'), 0);
+    }
+    for (uint32_t i = 0; i < 300; i++){
+        hit_num += cache->get("trace_key_" + std::to_string(i), val) == RINGCACHE_ERRNO_OK;
+    }
+    for (uint32_t i = 0; i < 200; i += 3){
+        cache->del("trace_key_" + std::to_string(i));
+    }
+    std::vector< std::string > keys = {"trace_key_0", "trace_key_1", "trace_key_2", "trace_key_250"}, values;
+    std::vector< uint32_t > rets;
+    hit_num += cache->multi_get(keys, values, rets);
+    cache->set("trace_ttl", "value", ringcache::expire_t::after_ms(60000));
+    recorded = cache->stop_trace();
+    delete cache;
+    records.clear();
+    ok &= trace_test_load(records) && recorded == 200 + 300 + 67 + 4 + 1 && records.size() == recorded;
+    ok &= !records.empty() && records.back().op == ringcache::TRACE_OP_SET && records.back().ttl_ms > 59000 && records.back().ttl_ms <= 60000;
+
+    cache = new ringcache::ringcache(16);
+    uint64_t get_num = 0, replay_hit_num = 0, diff_num = 0;
+    for (auto &r:records){
+        std::string key = std::to_string(r.key_hash) + "_" + std::to_string(r.key_len);
+        if (r.op == ringcache::TRACE_OP_SET){
+            cache->set(key, std::string(r.value_len, 'v'), 0);
+        }
+        else if (r.op == ringcache::TRACE_OP_DEL){
+            cache->del(key);
+        }
+        else{
+            uint32_t ret = cache->get(key, val);
+            get_num++;
+            replay_hit_num += ret == RINGCACHE_ERRNO_OK;
+            diff_num += ret != r.result || (ret == RINGCACHE_ERRNO_OK ? val.size() : 0) != r.value_len;
+        }
+    }
+    std::cout << "trace test: records=" << records.size() << "\tget=" << get_num << "\thit=" << hit_num << "\treplay_hit=" << replay_hit_num << "\tdiff=" << diff_num << std::endl;
+    ok &= get_num == 304 && hit_num == 202 && replay_hit_num == hit_num && diff_num == 0;
+    delete cache;
+    unlink(TRACE_TEST_PATH);
+    return ok;
+}
+
+/**
+ * 分片测试：每个key只在shard_of()算出的那个分片里，各种接口的结果和单个实例一样，统计是各分片之和，
+ * multi_get没读到的位置要清空，按分片存的快照能原样加载回来
+ */
+#define SHARD_TEST_SHARDS 4
+#define SHARD_TEST_KEY_NUM 2000
+
+static bool sharded_test(){
+    ringcache::sharded_ringcache *cache = new ringcache::sharded_ringcache(SHARD_TEST_SHARDS * 16, SHARD_TEST_SHARDS);
+    bool ok = cache->shard_num() == SHARD_TEST_SHARDS;
+    std::vector< uint32_t > per_shard(SHARD_TEST_SHARDS, 0);
+    for (uint32_t i = 0; i < SHARD_TEST_KEY_NUM; i++){
+        std::string key = "shard_key_" + std::to_string(i);
+        ok &= cache->set(key, "value" + std::to_string(i), 0) == RINGCACHE_ERRNO_OK;
+        per_shard[cache->shard_of(key.c_str(), key.length())]++;
+    }
+    for (uint32_t i = 0; i < SHARD_TEST_KEY_NUM; i += 2){
+        std::string key = "shard_key_" + std::to_string(i);
+        cache->del(key);
+        per_shard[cache->shard_of(key.c_str(), key.length())]--;
+    }
+    std::string val;
+    uint64_t wrong_num = 0;
+    for (uint32_t i = 0; i < SHARD_TEST_KEY_NUM; i++){
+        std::string key = "shard_key_" + std::to_string(i);
+        uint32_t s = cache->shard_of(key.c_str(), key.length());
+        if (i % 2 == 0){
+            wrong_num += cache->get(key, val) != RINGCACHE_ERRNO_NOT_FOUND || cache->check(key);
+            continue;
+        }
+        //在自己的分片里，别的分片里没有
+        wrong_num += cache->get(key, val) != RINGCACHE_ERRNO_OK || val != "value" + std::to_string(i);
+        wrong_num += cache->shard(s).get(key, val) != RINGCACHE_ERRNO_OK || cache->shard((s + 1) % SHARD_TEST_SHARDS).get(key, val) != RINGCACHE_ERRNO_NOT_FOUND;
+        std::string visited;
+        cache->visit(key, [&](const char *v, uint32_t len){
+            visited.assign(v, len);
+        });
+        char buf[32];
+        uint32_t len = 0;
+        wrong_num += visited != "value" + std::to_string(i) || cache->get_into(key, buf, sizeof(buf), len) != RINGCACHE_ERRNO_OK
+                     || std::string(buf, len) != visited;
+    }
+    uint32_t used_shards = 0;
+    for (uint32_t s = 0; s < SHARD_TEST_SHARDS; s++){
+        used_shards += per_shard[s] > 0;
+        wrong_num += cache->shard(s).get_stats().index_item_num != per_shard[s];
+    }
+    ringcache::stats_t stats = cache->get_stats();
+    ok &= wrong_num == 0 && used_shards == SHARD_TEST_SHARDS && stats.index_item_num == SHARD_TEST_KEY_NUM / 2
+          && stats.buffer_num == SHARD_TEST_SHARDS * RING_BUFFER_NUM;
+
+    //批量读写跨几个分片，没读到的位置清空
+    std::vector< std::string > keys, values;
+    std::vector< uint32_t > rets;
+    for (uint32_t i = 0; i < 16; i++){
+        keys.push_back("shard_batch_" + std::to_string(i));
+        values.push_back("batch" + std::to_string(i));
+    }
+    ok &= cache->multi_set(keys, values, 0, rets) == 16;
+    keys.push_back("shard_key_0");
+    values.assign(keys.size(), "stale");
+    ok &= cache->multi_get(keys, values, rets) == 16 && rets.size() == 17 && values.size() == 17;
+    for (uint32_t i = 0; i < 16; i++){
+        ok &= rets[i] == RINGCACHE_ERRNO_OK && values[i] == "batch" + std::to_string(i);
+    }
+    ok &= rets[16] == RINGCACHE_ERRNO_NOT_FOUND && values[16].empty();
+
+    //每个分片一个快照文件
+    ok &= cache->save("/tmp/ringcache_test.sharded") == RINGCACHE_ERRNO_OK;
+    delete cache;
+    cache = new ringcache::sharded_ringcache(SHARD_TEST_SHARDS * 16, SHARD_TEST_SHARDS);
+    ok &= cache->load("/tmp/ringcache_test.sharded") == RINGCACHE_ERRNO_OK;
+    uint64_t loaded_num = 0;
+    for (uint32_t i = 1; i < SHARD_TEST_KEY_NUM; i += 2){
+        loaded_num += cache->get("shard_key_" + std::to_string(i), val) == RINGCACHE_ERRNO_OK && val == "value" + std::to_string(i);
+    }
+    stats = cache->get_stats();
+    std::cout << "sharded test: wrong=" << wrong_num << "\tused_shards=" << used_shards << "\tloaded=" << loaded_num << "\tindex_item_num=" << stats.index_item_num << std::endl;
+    ok &= loaded_num == SHARD_TEST_KEY_NUM / 2 && stats.index_item_num == SHARD_TEST_KEY_NUM / 2 + 16;
+    for (uint32_t s = 0; s < SHARD_TEST_SHARDS; s++){
+        unlink(("/tmp/ringcache_test.sharded." + std::to_string(s)).c_str());
+    }
+    delete cache;
+    return ok;
+}
+
+/**
+ * 每核一个线程测试：核以外的线程用future读写，核0上的driver异步读写归属各个核的key，
+ * 结果都要对，每个key只在归属核的分区里
+ */
+#define CORE_TEST_CORES 4
+#define CORE_TEST_KEY_NUM 400
+
+static bool core_test(){
+    ringcache::core_ringcache *cache = new ringcache::core_ringcache(CORE_TEST_CORES * 16, CORE_TEST_CORES, std::vector< ringcache::size_class_t >(), false);
+    bool ok = cache->core_num() == CORE_TEST_CORES;
+    for (uint32_t i = 0; i < CORE_TEST_KEY_NUM; i++){
+        ok &= cache->set("core_ext_" + std::to_string(i), "value" + std::to_string(i), 0).get().ret == RINGCACHE_ERRNO_OK;
+    }
+    for (uint32_t i = 0; i < CORE_TEST_KEY_NUM; i += 2){
+        ok &= cache->del("core_ext_" + std::to_string(i)).get().ret == RINGCACHE_ERRNO_OK;
+    }
+    uint64_t wrong_num = 0;
+    for (uint32_t i = 0; i < CORE_TEST_KEY_NUM; i++){
+        ringcache::core_result_t res = cache->get("core_ext_" + std::to_string(i)).get();
+        wrong_num += i % 2 == 0 ? res.ret != RINGCACHE_ERRNO_NOT_FOUND : res.ret != RINGCACHE_ERRNO_OK || res.value != "value" + std::to_string(i);
+    }
+
+    //核0上分几步：写入，读一遍，删掉一半，再读一遍，每一步等发出去的都回来了再开始下一步
+    std::vector< std::string > keys;
+    for (uint32_t i = 0; i < CORE_TEST_KEY_NUM; i++){
+        keys.push_back("core_key_" + std::to_string(i));
+    }
+    uint32_t step = 0, done_num = 0, core_wrong_num = 0, remote_num = 0;
+    std::promise< void > finished;
+    cache->submit(0, [&](ringcache::core_ringcache::core_t &core){
+        for (auto &key:keys){
+            remote_num += !core.owns(cache->hash_key(key.c_str(), key.length()));
+            core.set(key.c_str(), key.length(), key.c_str(), key.length(), 0, [&](uint32_t ret){
+                core_wrong_num += ret != RINGCACHE_ERRNO_OK;
+                done_num++;
+            });
+        }
+        core.set_driver([&](ringcache::core_ringcache::core_t &core){
+            if (core.pending() > 0){
+                return true;
+            }
+            step++;
+            for (uint32_t i = 0; i < keys.size() && step < 4; i++){
+                const std::string &key = keys[i];
+                if (step == 2){
+                    if (i % 2 == 0){
+                        core.del(key.c_str(), key.length(), [&](uint32_t ret){
+                            core_wrong_num += ret != RINGCACHE_ERRNO_OK;
+                            done_num++;
+                        });
+                    }
+                    continue;
+                }
+                bool deleted = step == 3 && i % 2 == 0;
+                core.get(key.c_str(), key.length(), [&, deleted, i](uint32_t ret, const std::string &value){
+                    core_wrong_num += deleted ? ret != RINGCACHE_ERRNO_NOT_FOUND : ret != RINGCACHE_ERRNO_OK || value != keys[i];
+                    done_num++;
+                });
+            }
+            if (step < 4){
+                return true;
+            }
+            finished.set_value();
+            return false;
+        });
+    });
+    ok &= finished.get_future().wait_for(std::chrono::seconds(30)) == std::future_status::ready;
+
+    //每个核数一下自己分区里的数据个数
+    uint64_t local_num = 0, misplaced_num = 0;
+    for (uint32_t c = 0; c < CORE_TEST_CORES; c++){
+        std::promise< void > counted;
+        cache->submit(c, [&](ringcache::core_ringcache::core_t &core){
+            local_num += core.local().get_stats().index_item_num;
+            std::string val;
+            for (uint32_t i = 1; i < CORE_TEST_KEY_NUM; i += 2){
+                const std::string &key = keys[i];
+                bool here = core.local().get(key, val) == RINGCACHE_ERRNO_OK;
+                misplaced_num += here != core.owns(cache->hash_key(key.c_str(), key.length()));
+            }
+            counted.set_value();
+        });
+        counted.get_future().wait();
+    }
+    std::cout << "core test: wrong=" << wrong_num << "\tcore_wrong=" << core_wrong_num << "\tdone=" << done_num << "\tremote=" << remote_num
+              << "\tlocal=" << local_num << "\tmisplaced=" << misplaced_num << std::endl;
+    ok &= wrong_num == 0 && core_wrong_num == 0 && done_num == CORE_TEST_KEY_NUM * 3 + CORE_TEST_KEY_NUM / 2 && remote_num > 0
+          && local_num == CORE_TEST_KEY_NUM && misplaced_num == 0 && cache->get_stats().index_item_num == CORE_TEST_KEY_NUM;
+    delete cache;
+    return ok;
+}
+
+/**
+ * memcached协议测试：起一个服务，文本协议一次发多条请求（流水线）、get超过24个key、超过上限的set、flags不是数字的set，
+ * 二进制协议的SET/GETK/GETQ/NOOP/DELETE，回复都要和memcached一样
+ */
+#define MC_TEST_PORT_BASE 21300
+
+static int mc_test_connect(uint16_t port){
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (fd >= 0 && connect(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0){
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * 发出请求，读到want个字节为止，5秒没读够就返回已经读到的
+ */
+static std::string mc_test_request(int fd, const std::string &req, size_t want){
+    for (size_t off = 0; off < req.size();){
+        ssize_t n = write(fd, req.data() + off, req.size() - off);
+        if (n <= 0){
+            return "";
+        }
+        off += n;
+    }
+    std::string res;
+    char buf[4096];
+    while (res.size() < want){
+        struct pollfd pfd = {fd, POLLIN, 0};
+        if (poll(&pfd, 1, 5000) <= 0){
+            break;
+        }
+        ssize_t n = read(fd, buf, std::min(sizeof(buf), want - res.size()));
+        if (n <= 0){
+            break;
+        }
+        res.append(buf, n);
+    }
+    return res;
+}
+
+static std::string mc_test_bin(uint8_t op, const std::string &extras, const std::string &key, const std::string &value, uint32_t opaque){
+    ringcache::mc_bin_header_t req;
+    memset(&req, 0, sizeof(req));
+    req.magic = ringcache::MC_BIN_REQUEST;
+    req.opcode = op;
+    req.key_len = htons(key.size());
+    req.extras_len = extras.size();
+    req.body_len = htonl(extras.size() + key.size() + value.size());
+    req.opaque = opaque;
+    return std::string((const char *) &req, sizeof(req)) + extras + key + value;
+}
+
+static bool mc_test_bin_check(const std::string &res, size_t off, uint8_t op, uint16_t status, uint32_t opaque, const std::string &body){
+    if (res.size() < off + sizeof(ringcache::mc_bin_header_t) + body.size()){
+        return false;
+    }
+    ringcache::mc_bin_header_t h;
+    memcpy(&h, res.data() + off, sizeof(h));
+    return h.magic == ringcache::MC_BIN_RESPONSE && h.opcode == op && ntohs(h.status) == status && h.opaque == opaque
+           && ntohl(h.body_len) == body.size() && res.compare(off + sizeof(h), body.size(), body) == 0;
+}
+
+static bool mc_test(){
+    ringcache::ringcache *cache = new ringcache::ringcache(16);
+    ringcache::mc_server *server = nullptr;
+    uint16_t port = 0;
+    for (uint32_t i = 0; i < 20 && server == nullptr; i++){
+        port = MC_TEST_PORT_BASE + (getpid() + i * 7) % 1000;
+        server = new ringcache::mc_server(cache, 2);
+        if (!server->start("127.0.0.1", port)){
+            delete server;
+            server = nullptr;
+        }
+    }
+    if (server == nullptr){
+        std::cout << "memcached test: no port to listen on" << std::endl;
+        delete cache;
+        return false;
+    }
+    bool ok = true;
+    int fd = mc_test_connect(port);
+    ok &= fd >= 0;
+
+    //一次发出去的几条请求按顺序回复
+    std::string want = "STORED\r\nVALUE a 5 3\r\nabc\r\nEND\r\nDELETED\r\nNOT_FOUND\r\nEND\r\nVERSION " MC_VERSION "\r\n";
+    std::string res = mc_test_request(fd, "set a 5 0 3\r\nabc\r\nget a\r\ndelete a\r\ndelete a\r\nget a\r\nversion\r\n", want.size());
+    bool pipeline_ok = res == want;
+    ok &= pipeline_ok;
+
+    //超过24个key的get，中间夹着不存在的key，只回一个END
+    std::string sets, get = "get", values;
+    for (uint32_t i = 0; i < 40; i++){
+        std::string key = "mk" + std::to_string(i);
+        get += " " + key;
+        if (i % 4 == 3){
+            continue;
+        }
+        std::string val = "v" + std::to_string(i);
+        sets += "set " + key + " " + std::to_string(i) + " 0 " + std::to_string(val.size()) + " noreply\r\n" + val + "\r\n";
+        values += "VALUE " + key + " " + std::to_string(i) + " " + std::to_string(val.size()) + "\r\n" + val + "\r\n";
+    }
+    want = values + "END\r\n";
+    res = mc_test_request(fd, sets + get + "\r\n", want.size());
+    bool many_keys_ok = res == want;
+    ok &= many_keys_ok;
+
+    //超过上限的set回SERVER_ERROR，数据部分整个跳过，后面的请求照常处理
+    std::string big(MAX_VALUE_SIZE, 'b');
+    want = "SERVER_ERROR object too large for cache\r\nVALUE mk0 0 2\r\nv0\r\nEND\r\n";
+    res = mc_test_request(fd, "set big 0 0 " + std::to_string(big.size()) + "\r\n" + big + "\r\nget mk0\r\n", want.size());
+    bool oversized_ok = res == want;
+    ok &= oversized_ok;
+
+    //flags、exptime不是数字：命令行回CLIENT_ERROR，数据那一行当成一个未知命令
+    want = "CLIENT_ERROR bad command line format\r\nERROR\r\nCLIENT_ERROR bad command line format\r\nERROR\r\nEND\r\n";
+    res = mc_test_request(fd, "set bad abc 0 1\r\nz\r\nset bad 0 1x 1\r\nz\r\nget bad\r\n", want.size());
+    bool bad_set_ok = res == want;
+    ok &= bad_set_ok;
+    close(fd);
+
+    //二进制协议：SET带flags，GETK带回key和flags，GETQ没找到不回复，NOOP收尾，DELETE后GET找不到
+    fd = mc_test_connect(port);
+    ok &= fd >= 0;
+    std::string extras(8, 0);
+    uint32_t flags = htonl(7);
+    memcpy(&extras[0], &flags, 4);
+    std::string req = mc_test_bin(ringcache::MC_OP_SET, extras, "bk", "hello", 1) + mc_test_bin(ringcache::MC_OP_GETK, "", "bk", "", 2)
+                      + mc_test_bin(ringcache::MC_OP_GETQ, "", "missing", "", 3) + mc_test_bin(ringcache::MC_OP_NOOP, "", "", "", 4)
+                      + mc_test_bin(ringcache::MC_OP_DELETE, "", "bk", "", 5) + mc_test_bin(ringcache::MC_OP_GET, "", "bk", "", 6);
+    size_t header = sizeof(ringcache::mc_bin_header_t);
+    std::string getk_body = std::string((const char *) &flags, 4) + "bk" + "hello";
+    size_t off_getk = header, off_noop = off_getk + header + getk_body.size(), off_del = off_noop + header, off_get = off_del + header;
+    res = mc_test_request(fd, req, off_get + header + strlen("Not found"));
+    bool binary_ok = mc_test_bin_check(res, 0, ringcache::MC_OP_SET, ringcache::MC_STATUS_OK, 1, "")
+                     && mc_test_bin_check(res, off_getk, ringcache::MC_OP_GETK, ringcache::MC_STATUS_OK, 2, getk_body)
+                     && mc_test_bin_check(res, off_noop, ringcache::MC_OP_NOOP, ringcache::MC_STATUS_OK, 4, "")
+                     && mc_test_bin_check(res, off_del, ringcache::MC_OP_DELETE, ringcache::MC_STATUS_OK, 5, "")
+                     && mc_test_bin_check(res, off_get, ringcache::MC_OP_GET, ringcache::MC_STATUS_NOT_FOUND, 6, "Not found")
+                     && res.size() == off_get + header + strlen("Not found");
+    ok &= binary_ok;
+    close(fd);
+
+    std::cout << "memcached test: pipeline=" << pipeline_ok << "\tmany_keys=" << many_keys_ok << "\toversized=" << oversized_ok
+              << "\tbad_set=" << bad_set_ok << "\tbinary=" << binary_ok << std::endl;
+    delete server;
+    delete cache;
+    return ok;
+}
+
+/**
+ * 共享内存测试：按名字创建、另一个对象按名字打开后两边读写的是同一份数据；
+ * memfd的segment在fork出来的子进程里和父进程同时写，写完两边都能读到对方的数据，索引里的个数对得上
+ */
+#define SHM_TEST_KEY_NUM 2000
+
+static bool shm_test(){
+    std::string name = "/ringcache_test_" + std::to_string(getpid());
+    ringcache::shm_ringcache::unlink(name.c_str());
+    uint32_t ret = 0;
+    //只打开不创建，不存在时失败
+    ringcache::shm_ringcache *cache = ringcache::shm_ringcache::open(name.c_str(), 0, ret);
+    bool ok = cache == nullptr && ret == RINGCACHE_ERRNO_SHM_IO;
+    cache = ringcache::shm_ringcache::open(name.c_str(), 16, ret);
+    if (cache == nullptr){
+        std::cout << "shm test: create " << name << " failed, errno=" << ret << std::endl;
+        return false;
+    }
+    ringcache::shm_ringcache *other = ringcache::shm_ringcache::open(name.c_str(), 16, ret);
+    ok &= other != nullptr && cache->is_creator() && !other->is_creator();
+    std::string val;
+    if (other != nullptr){
+        ok &= cache->set("shm_key", "from_creator", 0) == RINGCACHE_ERRNO_OK;
+        ok &= other->get("shm_key", val) == RINGCACHE_ERRNO_OK && val == "from_creator";
+        ok &= other->set("shm_key", "from_other", 0) == RINGCACHE_ERRNO_OK && other->del("shm_key2") == RINGCACHE_ERRNO_OK;
+        ok &= cache->get("shm_key", val) == RINGCACHE_ERRNO_OK && val == "from_other" && cache->get_stats().item_num == 1;
+        delete other;
+    }
+    delete cache;
+    ringcache::shm_ringcache::unlink(name.c_str());
+
+    //fork之后父子进程同时写各自的key，子进程还要读父进程fork之前写的
+    cache = ringcache::shm_ringcache::open(nullptr, 16, ret);
+    if (cache == nullptr){
+        std::cout << "shm test: create memfd failed, errno=" << ret << std::endl;
+        return false;
+    }
+    for (uint32_t i = 0; i < SHM_TEST_KEY_NUM; i++){
+        cache->set("shm_before_" + std::to_string(i), "b" + std::to_string(i), 0);
+    }
+    pid_t pid = fork();
+    if (pid == 0){
+        //子进程不跑析构，直接_exit，退出码是出错的个数
+        uint32_t bad_num = 0;
+        for (uint32_t i = 0; i < SHM_TEST_KEY_NUM; i++){
+            bad_num += cache->set("shm_child_" + std::to_string(i), "c" + std::to_string(i), 0) != RINGCACHE_ERRNO_OK;
+            bad_num += cache->get("shm_before_" + std::to_string(i), val) != RINGCACHE_ERRNO_OK || val != "b" + std::to_string(i);
+        }
+        _exit(std::min< uint32_t >(bad_num, 100));
+    }
+    uint64_t bad_num = 0;
+    for (uint32_t i = 0; i < SHM_TEST_KEY_NUM; i++){
+        bad_num += cache->set("shm_parent_" + std::to_string(i), "p" + std::to_string(i), 0) != RINGCACHE_ERRNO_OK;
+    }
+    int status = -1;
+    ok &= pid > 0 && waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    for (uint32_t i = 0; i < SHM_TEST_KEY_NUM; i++){
+        bad_num += cache->get("shm_child_" + std::to_string(i), val) != RINGCACHE_ERRNO_OK || val != "c" + std::to_string(i);
+        bad_num += cache->get("shm_parent_" + std::to_string(i), val) != RINGCACHE_ERRNO_OK || val != "p" + std::to_string(i);
+    }
+    ringcache::shm_stats_t stats = cache->get_stats();
+    std::cout << "shm test: child_status=" << status << "\tbad=" << bad_num << "\titem_num=" << stats.item_num << "\treader_slots=" << stats.reader_slot_num << std::endl;
+    ok &= bad_num == 0 && stats.item_num == SHM_TEST_KEY_NUM * 3;
+    delete cache;
+    return ok;
+}
+
+/**
+ * entry格式测试：头部的大小、字段对齐，每个entry按RING_ENTRY_ALIGN对齐，
+ * 最长的key、各个位数边界上的value长度都能原样读回来。RINGCACHE_COMPACT_ENTRY（test_compact_entry）下value_len是位段，主要测它
+ */
+static bool entry_layout_test(){
+    bool ok = true;
+#ifdef RINGCACHE_COMPACT_ENTRY
+    ok &= sizeof(ringcache::entry_t) == 24 && sizeof(ringcache::entry_link_t) == 4 && offsetof(ringcache::entry_t, expire_ms) % 8 == 0;
+#else
+    ok &= sizeof(ringcache::entry_t) == 34 && sizeof(ringcache::entry_link_t) == 8;
+#endif
+#ifdef RINGCACHE_ATOMIC_RESERVE
+    //单个entry不能超过一段
+    uint32_t max_value = 256 * KB;
+#else
+    uint32_t max_value = MAX_VALUE_SIZE - 1;
+#endif
+    ringcache::ringcache *cache = new ringcache::ringcache(16);
+    std::vector< uint32_t > lens = {0, 1, 7, 8, 255, 256, 65535, 65536, (1u << 21) - 1, 1u << 21, max_value};
+    std::string long_key(MAX_KEY_SIZE - 1, 'k'), val;
+    uint64_t bad_num = 0, misaligned_num = 0;
+    for (auto len:lens){
+        if (len > max_value){
+            continue;
+        }
+        for (auto &key:{long_key, "len" + std::to_string(len)}){
+            std::string value(len, (char) ('a' + len % 26));
+            bad_num += cache->set(key, value, 0) != RINGCACHE_ERRNO_OK;
+            bad_num += cache->get(key, val) != RINGCACHE_ERRNO_OK || val != value;
+            //没压缩的数据，value前面是key，再前面是entry头部
+            cache->visit(key, [&](const char *v, uint32_t value_len){
+                misaligned_num += (uintptr_t) (v - key.length() - sizeof(ringcache::entry_t)) % RING_ENTRY_ALIGN != 0;
+                bad_num += value_len != len;
+            });
+        }
+    }
+    ok &= cache->set(std::string(MAX_KEY_SIZE, 'k'), "v", 0) == RINGCACHE_ERRNO_KEY_TOO_LONG;
+    ok &= cache->set("too_long", std::string(MAX_VALUE_SIZE, 'v'), 0) == RINGCACHE_ERRNO_VALUE_TOO_LONG;
+    std::cout << "entry layout test: entry_size=" << sizeof(ringcache::entry_t) << "\tbad=" << bad_num << "\tmisaligned=" << misaligned_num << std::endl;
+    ok &= bad_num == 0 && misaligned_num == 0;
+    delete cache;
+    return ok;
+}
 
 int main(){
     //16M大小的缓存
@@ -21,11 +909,174 @@ int main(){
     cache->set("key2", "value2", 0);
     cache->set("key3", "value3", 0);
     std::string val;
-    cache->get("key1", val);
-    std::cout << "val1=" << val << std::endl;
-    cache->get("key2", val);
-    std::cout << "val2=" << val << std::endl;
-    cache->get("key3", val);
-    std::cout << "val3=" << val << std::endl;
+    for (int i = 1; i <= 3; i++){
+        std::string key = "key" + std::to_string(i);
+        uint32_t ret = cache->get(key, val);
+        std::cout << "val" << i << "=" << val << std::endl;
+        expect(ret == RINGCACHE_ERRNO_OK && val == "value" + std::to_string(i), "get " + key);
+    }
+
+    //零拷贝读取，回调里直接拿到缓存里的数据
+    std::string visited;
+    uint32_t ret = cache->visit("key1", [&](const char *v, uint32_t len){
+        visited.assign(v, len);
+        std::cout << "visit key1=" << visited << std::endl;
+    });
+    expect(ret == RINGCACHE_ERRNO_OK && visited == "value1", "visit key1");
+    visited.clear();
+    ret = cache->visit("no_such_key", [&](const char *v, uint32_t len){
+        visited.assign(v, len);
+    });
+    expect(ret == RINGCACHE_ERRNO_NOT_FOUND && visited.empty(), "visit a missing key");
+    //直接拷贝到自己的buf里，放不下时返回RINGCACHE_ERRNO_BUFFER_TOO_SMALL，value_len是需要的长度
+    char buf[64];
+    uint32_t len = 0;
+    ret = cache->get_into("key2", buf, sizeof(buf), len);
+    if (ret == RINGCACHE_ERRNO_OK){
+        std::cout << "get_into key2=" << std::string(buf, len) << std::endl;
+    }
+    expect(ret == RINGCACHE_ERRNO_OK && std::string(buf, len) == "value2", "get_into key2");
+    ret = cache->get_into("key2", buf, 3, len);
+    expect(ret == RINGCACHE_ERRNO_BUFFER_TOO_SMALL && len == 6, "get_into key2 into a short buf");
+
+    //批量读写，每个key的错误码在rets里
+    std::vector< std::string > keys = {"key4", "key5"};
+    std::vector< std::string > values = {"value4", "value5"};
+    std::vector< uint32_t > rets;
+    uint32_t written = cache->multi_set(keys, values, 0, rets);
+    expect(written == 2 && rets.size() == 2 && rets[0] == RINGCACHE_ERRNO_OK && rets[1] == RINGCACHE_ERRNO_OK, "multi_set key4 key5");
+    //没读到的key，values里对应的位置会被清空，不会留着上一次的内容
+    keys.push_back("key1");
+    keys.push_back("no_such_key");
+    values.assign(keys.size(), "stale");
+    uint32_t found = cache->multi_get(keys, values, rets);
+    for (size_t i = 0; i < keys.size(); i++){
+        std::cout << "multi_get " << keys[i] << "=" << values[i] << "\terrno=" << rets[i] << std::endl;
+    }
+    expect(found == 3 && values.size() == 4 && rets.size() == 4, "multi_get found 3 of 4");
+    expect(rets[0] == RINGCACHE_ERRNO_OK && values[0] == "value4" && rets[1] == RINGCACHE_ERRNO_OK && values[1] == "value5", "multi_get key4 key5");
+    expect(rets[2] == RINGCACHE_ERRNO_OK && values[2] == "value1", "multi_get key1");
+    expect(rets[3] == RINGCACHE_ERRNO_NOT_FOUND && values[3].empty(), "multi_get clears a missing key");
+
+    //写入后100毫秒过期，过期后后台的清理线程会把它从索引上摘掉
+    cache->set("key7", "value7", ringcache::expire_t::after_ms(100));
+    ret = cache->get("key7", val);
+    std::cout << "ttl key7 errno=" << ret;
+    expect(ret == RINGCACHE_ERRNO_OK && val == "value7", "ttl key7 before expiry");
+    std::this_thread::sleep_for(std::chrono::milliseconds(150));
+    ret = cache->get("key7", val);
+    std::cout << "\tafter 150ms errno=" << ret << std::endl;
+    expect(ret == RINGCACHE_ERRNO_KEY_EXPIRED || ret == RINGCACHE_ERRNO_NOT_FOUND, "ttl key7 after expiry");
+    //绝对时间：毫秒级的已经过了，秒级的还没到
+    cache->set("key9", "value9", ringcache::expire_t::at_ms(ringcache::coarse_clock::precise_ms() - 1000));
+    ret = cache->get("key9", val);
+    expect(ret == RINGCACHE_ERRNO_KEY_EXPIRED || ret == RINGCACHE_ERRNO_NOT_FOUND, "key9 expired at a past time");
+    cache->set("key10", "value10", (uint32_t) time(nullptr) + 3600);
+    expect(cache->get("key10", val) == RINGCACHE_ERRNO_OK && val == "value10", "key10 expires in an hour");
+    cache->del("key10");
+    //清理线程扫到后从索引上摘掉，之后就是找不到。原子预留模式下正在写的那一段不扫，先写点别的数据让写指针离开这一段
+    for (int i = 0; i < 40; i++){
+        cache->set("filler" + std::to_string(i), std::string(64 * 1024, 'f'), 0);
+    }
+    for (int i = 0; i < 40; i++){
+        cache->del("filler" + std::to_string(i));
+    }
+    for (int i = 0; i < 100 && cache->get("key7", val) != RINGCACHE_ERRNO_NOT_FOUND; i++){
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    expect(cache->get("key7", val) == RINGCACHE_ERRNO_NOT_FOUND && cache->get("key9", val) == RINGCACHE_ERRNO_NOT_FOUND, "sweep expired keys");
+    expect(cache->get_stats().sweep_num() >= 2, "sweep_num after sweep");
+
+    //key直接给指针和长度，hash预先算好，热路径上一次内存都不用申请
+    const char *long_key = "a_key_longer_than_the_std_string_sso_buffer";
+    size_t long_key_len = strlen(long_key);
+    uint32_t hash_val = cache->hash_key(long_key, long_key_len);
+    std::string out;
+    out.reserve(64);
+    cache->set(long_key, long_key_len, hash_val, "value6", 6, 0);
+    uint64_t alloc_before = alloc_num;
+    for (int i = 0; i < 1000; i++){
+        cache->set(long_key, long_key_len, hash_val, "value6", 6, 0);
+        cache->get(long_key, long_key_len, hash_val, out);
+        cache->get(long_key, long_key_len, out);
+        cache->get_into(long_key, long_key_len, buf, sizeof(buf), len);
+        cache->visit(long_key, long_key_len, [](const char *, uint32_t){
+        });
+        cache->check(long_key, long_key_len);
+        cache->del(long_key, long_key_len, hash_val);
+        cache->del(long_key, long_key_len);
+    }
+    std::cout << "allocations in hot path=" << (alloc_num - alloc_before) << std::endl;
+    if (alloc_num != alloc_before){
+        return 1;
+    }
+
+    //统计信息是一份快照，拿到后随便读
+    ringcache::stats_t stats = cache->get_stats();
+    std::cout << "hit=" << stats.get_hit_num << "\tmiss=" << stats.get_miss_num << "\thit_rate=" << stats.hit_rate() << "\titem_num=" << stats.item_num() << std::endl;
+    //导出给监控：to_prometheus是Prometheus的文本格式，to_json是JSON
+    std::cout << ringcache::to_json(stats) << std::endl;
+
+    //保存快照，重启后在新实例上恢复
+    expect(cache->save("/tmp/ringcache_test.snapshot") == RINGCACHE_ERRNO_OK, "save");
+    //已经有数据的实例不能加载
+    expect(cache->load("/tmp/ringcache_test.snapshot") == RINGCACHE_ERRNO_SNAPSHOT_MISMATCH, "load into a non-empty cache");
+    delete cache;
+    //大小不一样的实例不能加载，文件不存在时是IO错误
+    cache = new ringcache::ringcache(32);
+    expect(cache->load("/tmp/ringcache_test.snapshot") == RINGCACHE_ERRNO_SNAPSHOT_MISMATCH, "load into a cache of another size");
+    expect(cache->load("/tmp/ringcache_test.no_such_snapshot") == RINGCACHE_ERRNO_SNAPSHOT_IO, "load a missing file");
+    delete cache;
+    //读到内存里加载和mmap加载，数据都要和保存时一样，只有key1~key5，已经过期的key7不恢复
+    for (int use_mmap = 0; use_mmap <= 1; use_mmap++){
+        cache = new ringcache::ringcache(16);
+        uint32_t ret = cache->load("/tmp/ringcache_test.snapshot", use_mmap);
+        std::cout << "load errno=" << ret << std::endl;
+        expect(ret == RINGCACHE_ERRNO_OK, "load");
+        expect(cache->get_stats().index_item_num == 5, "items after load");
+        for (int i = 1; i <= 5; i++){
+            std::string key = "key" + std::to_string(i);
+            expect(cache->get(key, val) == RINGCACHE_ERRNO_OK && val == "value" + std::to_string(i), "after load " + key);
+        }
+        std::cout << "after load key5=" << val << std::endl;
+        expect(cache->get("key7", val) == RINGCACHE_ERRNO_NOT_FOUND, "expired key7 after load");
+        expect(cache->get(long_key, long_key_len, val) == RINGCACHE_ERRNO_NOT_FOUND, "deleted key after load");
+        //加载后照常写入
+        expect(cache->set("key8", "value8", 0) == RINGCACHE_ERRNO_OK && cache->get("key8", val) == RINGCACHE_ERRNO_OK && val == "value8", "set after load");
+        delete cache;
+    }
+    unlink("/tmp/ringcache_test.snapshot");
+
+    if (!resize_test()){
+        return 1;
+    }
+    if (!write_test()){
+        return 1;
+    }
+    if (!size_class_test()){
+        return 1;
+    }
+    if (!codec_test()){
+        return 1;
+    }
+    if (!trace_test()){
+        return 1;
+    }
+    if (!sharded_test()){
+        return 1;
+    }
+    if (!core_test()){
+        return 1;
+    }
+    if (!mc_test()){
+        return 1;
+    }
+    if (!shm_test()){
+        return 1;
+    }
+    if (!entry_layout_test()){
+        return 1;
+    }
+    return test_failed ? 1 : 0;
 }
 